@@ -0,0 +1,28 @@
+#----------------------------------------------------------------
+# Generated CMake target import file.
+#----------------------------------------------------------------
+
+# Commands may need to know the format version.
+set(CMAKE_IMPORT_FILE_VERSION 1)
+
+# Import target "Zep::Zep" for configuration ""
+set_property(TARGET Zep::Zep APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(Zep::Zep PROPERTIES
+  IMPORTED_LINK_INTERFACE_LANGUAGES_NOCONFIG "CXX"
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libZep.a"
+  )
+
+list(APPEND _cmake_import_check_targets Zep::Zep )
+list(APPEND _cmake_import_check_files_for_Zep::Zep "${_IMPORT_PREFIX}/lib/libZep.a" )
+
+# Import target "Zep::unittests" for configuration ""
+set_property(TARGET Zep::unittests APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(Zep::unittests PROPERTIES
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/bin/unittests"
+  )
+
+list(APPEND _cmake_import_check_targets Zep::unittests )
+list(APPEND _cmake_import_check_files_for_Zep::unittests "${_IMPORT_PREFIX}/bin/unittests" )
+
+# Commands beyond this point should not need to know the version.
+set(CMAKE_IMPORT_FILE_VERSION)
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/zep_bench.dir/main.cpp.o"
+  "CMakeFiles/zep_bench.dir/main.cpp.o.d"
+  "zep_bench"
+  "zep_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/zep_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1 @@
+#define ZEP_ROOT "/root/repo"
@@ -0,0 +1,54 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/buffer.cpp" "src/CMakeFiles/Zep.dir/buffer.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/buffer.cpp.o.d"
+  "/root/repo/src/buffer_io.cpp" "src/CMakeFiles/Zep.dir/buffer_io.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/buffer_io.cpp.o.d"
+  "/root/repo/src/buffer_search.cpp" "src/CMakeFiles/Zep.dir/buffer_search.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/buffer_search.cpp.o.d"
+  "/root/repo/src/commands.cpp" "src/CMakeFiles/Zep.dir/commands.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/commands.cpp.o.d"
+  "/root/repo/src/display.cpp" "src/CMakeFiles/Zep.dir/display.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/display.cpp.o.d"
+  "/root/repo/src/editor.cpp" "src/CMakeFiles/Zep.dir/editor.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/editor.cpp.o.d"
+  "/root/repo/src/filesystem.cpp" "src/CMakeFiles/Zep.dir/filesystem.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/filesystem.cpp.o.d"
+  "/root/repo/src/glyph_iterator.cpp" "src/CMakeFiles/Zep.dir/glyph_iterator.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/glyph_iterator.cpp.o.d"
+  "/root/repo/src/indexer.cpp" "src/CMakeFiles/Zep.dir/indexer.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/indexer.cpp.o.d"
+  "/root/repo/src/keymap.cpp" "src/CMakeFiles/Zep.dir/keymap.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/keymap.cpp.o.d"
+  "/root/repo/src/line_widgets.cpp" "src/CMakeFiles/Zep.dir/line_widgets.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/line_widgets.cpp.o.d"
+  "/root/repo/src/mcommon/animation/timer.cpp" "src/CMakeFiles/Zep.dir/mcommon/animation/timer.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mcommon/animation/timer.cpp.o.d"
+  "/root/repo/src/mcommon/file/compress.cpp" "src/CMakeFiles/Zep.dir/mcommon/file/compress.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mcommon/file/compress.cpp.o.d"
+  "/root/repo/src/mcommon/file/path.cpp" "src/CMakeFiles/Zep.dir/mcommon/file/path.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mcommon/file/path.cpp.o.d"
+  "/root/repo/src/mcommon/string/stringutils.cpp" "src/CMakeFiles/Zep.dir/mcommon/string/stringutils.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mcommon/string/stringutils.cpp.o.d"
+  "/root/repo/src/mode.cpp" "src/CMakeFiles/Zep.dir/mode.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode.cpp.o.d"
+  "/root/repo/src/mode_grep.cpp" "src/CMakeFiles/Zep.dir/mode_grep.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_grep.cpp.o.d"
+  "/root/repo/src/mode_repl.cpp" "src/CMakeFiles/Zep.dir/mode_repl.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_repl.cpp.o.d"
+  "/root/repo/src/mode_search.cpp" "src/CMakeFiles/Zep.dir/mode_search.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_search.cpp.o.d"
+  "/root/repo/src/mode_standard.cpp" "src/CMakeFiles/Zep.dir/mode_standard.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_standard.cpp.o.d"
+  "/root/repo/src/mode_tree.cpp" "src/CMakeFiles/Zep.dir/mode_tree.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_tree.cpp.o.d"
+  "/root/repo/src/mode_vim.cpp" "src/CMakeFiles/Zep.dir/mode_vim.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/mode_vim.cpp.o.d"
+  "/root/repo/src/range_markers.cpp" "src/CMakeFiles/Zep.dir/range_markers.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/range_markers.cpp.o.d"
+  "/root/repo/src/regex.cpp" "src/CMakeFiles/Zep.dir/regex.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/regex.cpp.o.d"
+  "/root/repo/src/regress.cpp" "src/CMakeFiles/Zep.dir/regress.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/regress.cpp.o.d"
+  "/root/repo/src/scroller.cpp" "src/CMakeFiles/Zep.dir/scroller.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/scroller.cpp.o.d"
+  "/root/repo/src/splits.cpp" "src/CMakeFiles/Zep.dir/splits.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/splits.cpp.o.d"
+  "/root/repo/src/syntax.cpp" "src/CMakeFiles/Zep.dir/syntax.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/syntax.cpp.o.d"
+  "/root/repo/src/syntax_markdown.cpp" "src/CMakeFiles/Zep.dir/syntax_markdown.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/syntax_markdown.cpp.o.d"
+  "/root/repo/src/syntax_providers.cpp" "src/CMakeFiles/Zep.dir/syntax_providers.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/syntax_providers.cpp.o.d"
+  "/root/repo/src/syntax_rainbow_brackets.cpp" "src/CMakeFiles/Zep.dir/syntax_rainbow_brackets.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/syntax_rainbow_brackets.cpp.o.d"
+  "/root/repo/src/syntax_tree.cpp" "src/CMakeFiles/Zep.dir/syntax_tree.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/syntax_tree.cpp.o.d"
+  "/root/repo/src/tab_window.cpp" "src/CMakeFiles/Zep.dir/tab_window.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/tab_window.cpp.o.d"
+  "/root/repo/src/theme.cpp" "src/CMakeFiles/Zep.dir/theme.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/theme.cpp.o.d"
+  "/root/repo/src/undo.cpp" "src/CMakeFiles/Zep.dir/undo.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/undo.cpp.o.d"
+  "/root/repo/src/window.cpp" "src/CMakeFiles/Zep.dir/window.cpp.o" "gcc" "src/CMakeFiles/Zep.dir/window.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,81 @@
+file(REMOVE_RECURSE
+  "../lib/libZep.a"
+  "../lib/libZep.pdb"
+  "CMakeFiles/Zep.dir/buffer.cpp.o"
+  "CMakeFiles/Zep.dir/buffer.cpp.o.d"
+  "CMakeFiles/Zep.dir/buffer_io.cpp.o"
+  "CMakeFiles/Zep.dir/buffer_io.cpp.o.d"
+  "CMakeFiles/Zep.dir/buffer_search.cpp.o"
+  "CMakeFiles/Zep.dir/buffer_search.cpp.o.d"
+  "CMakeFiles/Zep.dir/commands.cpp.o"
+  "CMakeFiles/Zep.dir/commands.cpp.o.d"
+  "CMakeFiles/Zep.dir/display.cpp.o"
+  "CMakeFiles/Zep.dir/display.cpp.o.d"
+  "CMakeFiles/Zep.dir/editor.cpp.o"
+  "CMakeFiles/Zep.dir/editor.cpp.o.d"
+  "CMakeFiles/Zep.dir/filesystem.cpp.o"
+  "CMakeFiles/Zep.dir/filesystem.cpp.o.d"
+  "CMakeFiles/Zep.dir/glyph_iterator.cpp.o"
+  "CMakeFiles/Zep.dir/glyph_iterator.cpp.o.d"
+  "CMakeFiles/Zep.dir/indexer.cpp.o"
+  "CMakeFiles/Zep.dir/indexer.cpp.o.d"
+  "CMakeFiles/Zep.dir/keymap.cpp.o"
+  "CMakeFiles/Zep.dir/keymap.cpp.o.d"
+  "CMakeFiles/Zep.dir/line_widgets.cpp.o"
+  "CMakeFiles/Zep.dir/line_widgets.cpp.o.d"
+  "CMakeFiles/Zep.dir/mcommon/animation/timer.cpp.o"
+  "CMakeFiles/Zep.dir/mcommon/animation/timer.cpp.o.d"
+  "CMakeFiles/Zep.dir/mcommon/file/compress.cpp.o"
+  "CMakeFiles/Zep.dir/mcommon/file/compress.cpp.o.d"
+  "CMakeFiles/Zep.dir/mcommon/file/path.cpp.o"
+  "CMakeFiles/Zep.dir/mcommon/file/path.cpp.o.d"
+  "CMakeFiles/Zep.dir/mcommon/string/stringutils.cpp.o"
+  "CMakeFiles/Zep.dir/mcommon/string/stringutils.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode.cpp.o"
+  "CMakeFiles/Zep.dir/mode.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_grep.cpp.o"
+  "CMakeFiles/Zep.dir/mode_grep.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_repl.cpp.o"
+  "CMakeFiles/Zep.dir/mode_repl.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_search.cpp.o"
+  "CMakeFiles/Zep.dir/mode_search.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_standard.cpp.o"
+  "CMakeFiles/Zep.dir/mode_standard.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_tree.cpp.o"
+  "CMakeFiles/Zep.dir/mode_tree.cpp.o.d"
+  "CMakeFiles/Zep.dir/mode_vim.cpp.o"
+  "CMakeFiles/Zep.dir/mode_vim.cpp.o.d"
+  "CMakeFiles/Zep.dir/range_markers.cpp.o"
+  "CMakeFiles/Zep.dir/range_markers.cpp.o.d"
+  "CMakeFiles/Zep.dir/regex.cpp.o"
+  "CMakeFiles/Zep.dir/regex.cpp.o.d"
+  "CMakeFiles/Zep.dir/regress.cpp.o"
+  "CMakeFiles/Zep.dir/regress.cpp.o.d"
+  "CMakeFiles/Zep.dir/scroller.cpp.o"
+  "CMakeFiles/Zep.dir/scroller.cpp.o.d"
+  "CMakeFiles/Zep.dir/splits.cpp.o"
+  "CMakeFiles/Zep.dir/splits.cpp.o.d"
+  "CMakeFiles/Zep.dir/syntax.cpp.o"
+  "CMakeFiles/Zep.dir/syntax.cpp.o.d"
+  "CMakeFiles/Zep.dir/syntax_markdown.cpp.o"
+  "CMakeFiles/Zep.dir/syntax_markdown.cpp.o.d"
+  "CMakeFiles/Zep.dir/syntax_providers.cpp.o"
+  "CMakeFiles/Zep.dir/syntax_providers.cpp.o.d"
+  "CMakeFiles/Zep.dir/syntax_rainbow_brackets.cpp.o"
+  "CMakeFiles/Zep.dir/syntax_rainbow_brackets.cpp.o.d"
+  "CMakeFiles/Zep.dir/syntax_tree.cpp.o"
+  "CMakeFiles/Zep.dir/syntax_tree.cpp.o.d"
+  "CMakeFiles/Zep.dir/tab_window.cpp.o"
+  "CMakeFiles/Zep.dir/tab_window.cpp.o.d"
+  "CMakeFiles/Zep.dir/theme.cpp.o"
+  "CMakeFiles/Zep.dir/theme.cpp.o.d"
+  "CMakeFiles/Zep.dir/undo.cpp.o"
+  "CMakeFiles/Zep.dir/undo.cpp.o.d"
+  "CMakeFiles/Zep.dir/window.cpp.o"
+  "CMakeFiles/Zep.dir/window.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/Zep.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,30 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/tests/buffer.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/buffer.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/buffer.test.cpp.o.d"
+  "/root/repo/src/tests/gap_buffer.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/gap_buffer.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/gap_buffer.test.cpp.o.d"
+  "/root/repo/src/tests/indexer.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/indexer.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/indexer.test.cpp.o.d"
+  "/root/repo/src/tests/mode_standard.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/mode_standard.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/mode_standard.test.cpp.o.d"
+  "/root/repo/src/tests/mode_vim.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/mode_vim.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/mode_vim.test.cpp.o.d"
+  "/root/repo/src/tests/regex.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/regex.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/regex.test.cpp.o.d"
+  "/root/repo/src/tests/syntax.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/syntax.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/syntax.test.cpp.o.d"
+  "/root/repo/src/tests/threadpool.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/threadpool.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/threadpool.test.cpp.o.d"
+  "/root/repo/src/tests/undo.test.cpp" "tests/CMakeFiles/unittests.dir/__/src/tests/undo.test.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/__/src/tests/undo.test.cpp.o.d"
+  "/root/repo/tests/googletest/googletest/src/gtest-all.cc" "tests/CMakeFiles/unittests.dir/googletest/googletest/src/gtest-all.cc.o" "gcc" "tests/CMakeFiles/unittests.dir/googletest/googletest/src/gtest-all.cc.o.d"
+  "/root/repo/tests/main.cpp" "tests/CMakeFiles/unittests.dir/main.cpp.o" "gcc" "tests/CMakeFiles/unittests.dir/main.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_warn_build/src/CMakeFiles/Zep.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
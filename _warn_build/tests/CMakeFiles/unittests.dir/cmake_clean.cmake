@@ -0,0 +1,31 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/unittests.dir/__/src/tests/buffer.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/buffer.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/gap_buffer.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/gap_buffer.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/indexer.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/indexer.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/mode_standard.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/mode_standard.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/mode_vim.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/mode_vim.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/regex.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/regex.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/syntax.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/syntax.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/threadpool.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/threadpool.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/__/src/tests/undo.test.cpp.o"
+  "CMakeFiles/unittests.dir/__/src/tests/undo.test.cpp.o.d"
+  "CMakeFiles/unittests.dir/googletest/googletest/src/gtest-all.cc.o"
+  "CMakeFiles/unittests.dir/googletest/googletest/src/gtest-all.cc.o.d"
+  "CMakeFiles/unittests.dir/main.cpp.o"
+  "CMakeFiles/unittests.dir/main.cpp.o.d"
+  "unittests"
+  "unittests.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/unittests.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,419 @@
+// Headless benchmarks of the editor's core operations, on made up C++ text from 1K up to 1G.
+// Each result is written as one line of JSON, so that runs can be kept and compared:
+// {"name":"insert_middle","bytes":1048576,"lines":20345,"iterations":4096,"seconds":0.0123,"ns_per_op":3002.9}
+//
+// zep_bench [--sizes 1K,64K,1M,16M] [--filter name] [--out results.jsonl] [--time seconds]
+#include "config_app.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "zep/buffer.h"
+#include "zep/buffer_search.h"
+#include "zep/commands.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/filesystem.h"
+#include "zep/mode_vim.h"
+#include "zep/range_markers.h"
+#include "zep/syntax.h"
+#include "zep/tab_window.h"
+#include "zep/undo.h"
+#include "zep/window.h"
+
+#include "zep/mcommon/animation/timer.h"
+
+using namespace Zep;
+
+namespace
+{
+
+struct BenchOptions
+{
+    std::vector<uint64_t> sizes = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+    std::string filter;
+    fs::path outPath;
+
+    // Repeated operations run for about this long
+    double seconds = 0.25;
+};
+
+const uint64_t MaxIterations = 1 << 20;
+
+// 1K, 64K, 1M, 1G or a number of bytes
+bool ParseSize(const std::string& text, uint64_t& size)
+{
+    char* pEnd = nullptr;
+    size = std::strtoull(text.c_str(), &pEnd, 10);
+    if (pEnd == text.c_str())
+    {
+        return false;
+    }
+
+    std::string unit = pEnd;
+    if (unit == "K" || unit == "k")
+    {
+        size *= 1024;
+    }
+    else if (unit == "M" || unit == "m")
+    {
+        size *= 1024 * 1024;
+    }
+    else if (unit == "G" || unit == "g")
+    {
+        size *= 1024 * 1024 * 1024;
+    }
+    else if (!unit.empty())
+    {
+        return false;
+    }
+    return size != 0;
+}
+
+bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    for (int arg = 1; arg < argc; arg++)
+    {
+        std::string name = argv[arg];
+        if (arg + 1 >= argc)
+        {
+            std::cerr << "Missing value for: " << name << std::endl;
+            return false;
+        }
+
+        std::string value = argv[++arg];
+        if (name == "--sizes")
+        {
+            options.sizes.clear();
+            std::istringstream str(value);
+            std::string sizeText;
+            while (std::getline(str, sizeText, ','))
+            {
+                uint64_t size;
+                if (!ParseSize(sizeText, size))
+                {
+                    std::cerr << "Bad size: " << sizeText << std::endl;
+                    return false;
+                }
+                options.sizes.push_back(size);
+            }
+        }
+        else if (name == "--filter")
+        {
+            options.filter = value;
+        }
+        else if (name == "--out")
+        {
+            options.outPath = value;
+        }
+        else if (name == "--time")
+        {
+            options.seconds = std::atof(value.c_str());
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lines that look enough like C++ to give the syntax something to do; the same every run
+std::string MakeCorpus(uint64_t size)
+{
+    static const char* Words[] = { "int", "auto", "return", "if", "else", "for", "const", "void", "value", "count", "buffer", "index", "std::string", "m_pWindow", "42", "0x1F", "3.14f", "nullptr" };
+    static const char* Punctuation[] = { " ", " = ", "(", ")", ", ", "; ", " + ", "->", ".", "[", "]", " { ", " }" };
+
+    std::string text;
+    text.reserve(size_t(size));
+
+    uint32_t seed = 12345;
+    auto next = [&seed](uint32_t range) {
+        seed = seed * 1664525 + 1013904223;
+        return (seed >> 8) % range;
+    };
+
+    while (text.size() < size)
+    {
+        auto indent = next(4) * 4;
+        text.append(indent, ' ');
+
+        auto kind = next(16);
+        if (kind == 0)
+        {
+            text += "// A comment about the next few lines";
+        }
+        else if (kind == 1)
+        {
+            text += "auto name = \"a string with some words in it\";";
+        }
+        else if (kind != 2)
+        {
+            auto words = 2 + next(12);
+            for (uint32_t word = 0; word < words; word++)
+            {
+                text += Words[next(sizeof(Words) / sizeof(Words[0]))];
+                text += Punctuation[next(sizeof(Punctuation) / sizeof(Punctuation[0]))];
+            }
+        }
+        text += '\n';
+    }
+
+    // End on a line, at the size asked for
+    text.resize(size_t(size));
+    text.back() = '\n';
+    return text;
+}
+
+class Bench
+{
+public:
+    Bench(const BenchOptions& options, std::ostream& out)
+        : m_options(options)
+        , m_out(out)
+    {
+    }
+
+    bool Enabled(const std::string& name) const
+    {
+        return m_options.filter.empty() || name.find(m_options.filter) != std::string::npos;
+    }
+
+    // Run the operation until the time is up, and report the average; returns the number of times it ran
+    uint64_t Measure(const std::string& name, const std::function<void(uint64_t)>& fnOp, uint64_t maxIterations = MaxIterations)
+    {
+        if (!Enabled(name))
+        {
+            return 0;
+        }
+
+        timer time;
+        timer_start(time);
+        uint64_t iterations = 0;
+        double seconds = 0.0;
+        do
+        {
+            fnOp(iterations++);
+            seconds = timer_get_elapsed_seconds(time);
+        } while (seconds < m_options.seconds && iterations < maxIterations);
+
+        Report(name, iterations, seconds);
+        return iterations;
+    }
+
+    // Run the operation an exact number of times; for undoing what another one did, so it runs even if filtered out
+    void MeasureCount(const std::string& name, uint64_t iterations, const std::function<void(uint64_t)>& fnOp)
+    {
+        timer time;
+        timer_start(time);
+        for (uint64_t index = 0; index < iterations; index++)
+        {
+            fnOp(index);
+        }
+
+        if (iterations != 0 && Enabled(name))
+        {
+            Report(name, iterations, timer_get_elapsed_seconds(time));
+        }
+    }
+
+    void SetCorpus(uint64_t bytes, long lines)
+    {
+        m_bytes = bytes;
+        m_lines = lines;
+    }
+
+private:
+    void Report(const std::string& name, uint64_t iterations, double seconds)
+    {
+        m_out << "{\"name\":\"" << name << "\",\"bytes\":" << m_bytes << ",\"lines\":" << m_lines
+              << ",\"iterations\":" << iterations << ",\"seconds\":" << seconds
+              << ",\"ns_per_op\":" << (seconds * 1e9) / double(iterations) << "}" << std::endl;
+    }
+
+private:
+    const BenchOptions& m_options;
+    std::ostream& m_out;
+    uint64_t m_bytes = 0;
+    long m_lines = 0;
+};
+
+void RunCorpus(Bench& bench, uint64_t size, const fs::path& tempDir)
+{
+    auto corpus = MakeCorpus(size);
+    auto corpusPath = tempDir / ("zep_bench_" + std::to_string(size) + ".cpp");
+    {
+        std::ofstream file(corpusPath, std::ios::binary);
+        file.write(corpus.data(), corpus.size());
+    }
+
+    // Without threads everything is done by the time each call returns, so the time is all of it
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads, new ZepFileSystemCPP(ZEP_ROOT));
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 1024.0f));
+    bench.SetCorpus(size, long(std::count(corpus.begin(), corpus.end(), '\n')));
+
+    // Loading makes a new buffer each time, so it only happens once
+    ZepBuffer* pBuffer = nullptr;
+    bench.Measure("load", [&](uint64_t) {
+        pBuffer = spEditor->InitWithFileOrDir(corpusPath.string());
+    }, 1);
+    if (!pBuffer)
+    {
+        pBuffer = spEditor->InitWithFileOrDir(corpusPath.string());
+    }
+
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    auto spMode = std::make_shared<ZepMode_Vim>(*spEditor);
+    spMode->Init();
+    spMode->Begin(pWindow);
+
+    bench.Measure("set_text", [&](uint64_t) {
+        pBuffer->SetText(corpus);
+    });
+
+    // The whole buffer again, as after a load
+    bench.Measure("syntax_update", [&](uint64_t) {
+        pBuffer->GetSyntax()->Notify(std::make_shared<BufferMessage>(pBuffer, BufferMessageType::TextChanged, pBuffer->Begin(), pBuffer->End()));
+    });
+
+    // A whole layout of the window; mostly UpdateLineSpans
+    bench.Measure("update_line_spans", [&](uint64_t) {
+        pWindow->DirtyLayout();
+        spEditor->Display();
+    });
+
+    // Each insert is taken out again by the same number of deletes, so the corpus is the same for the next one
+    const std::pair<const char*, float> positions[] = { { "begin", 0.0f }, { "middle", 0.5f }, { "end", 1.0f } };
+    for (auto& position : positions)
+    {
+        auto location = GlyphIterator(pBuffer, (unsigned long)(float(pBuffer->End().Index()) * position.second));
+        auto inserts = bench.Measure(std::string("insert_") + position.first, [&](uint64_t) {
+            ChangeRecord record;
+            pBuffer->Insert(location, "x", record);
+        });
+        bench.MeasureCount(std::string("delete_") + position.first, inserts, [&](uint64_t) {
+            ChangeRecord record;
+            pBuffer->Delete(location, location + 1, record);
+        });
+    }
+
+    // A word that isn't there, so it looks at everything
+    const std::string needle = "zep_bench_needle";
+    bench.Measure("find", [&](uint64_t) {
+        pBuffer->Find(pBuffer->Begin(), (const uint8_t*)needle.data(), (const uint8_t*)needle.data() + needle.size());
+    });
+
+    auto& search = pBuffer->GetSearch();
+    std::string error;
+    bench.Measure("search_regex", [&](uint64_t) {
+        search.Start("m_p\\w+", ByteRange(0, 0), error);
+    });
+
+    auto end = pBuffer->End().Index();
+    bench.Measure("search_next", [&](uint64_t iteration) {
+        ByteRange match;
+        search.FindNext(ByteIndex((iteration * 7919) % uint64_t(end)), Direction::Forward, match);
+    });
+    search.Clear();
+
+    // A mark every few lines, up to 10000
+    auto lines = pBuffer->GetLineCount();
+    auto markerSpacing = std::max(1l, lines / 10000);
+    for (long line = 0; line < lines; line += markerSpacing)
+    {
+        ByteRange range;
+        pBuffer->GetLineOffsets(line, range);
+        auto spMarker = std::make_shared<RangeMarker>(*pBuffer);
+        spMarker->SetRange(ByteRange(range.first, range.first + 1));
+        spMarker->markerType = RangeMarkerType::Mark;
+    }
+
+    bench.Measure("markers_on_line", [&](uint64_t iteration) {
+        pBuffer->GetRangeMarkersOnLine(RangeMarkerType::All, long((iteration * 7919) % uint64_t(lines)));
+    });
+
+    bench.Measure("markers_for_each", [&](uint64_t) {
+        uint64_t count = 0;
+        pBuffer->ForEachMarker(RangeMarkerType::All, Direction::Forward, pBuffer->Begin(), pBuffer->End(), [&count](const std::shared_ptr<RangeMarker>&) {
+            count++;
+            return true;
+        });
+    });
+    pBuffer->ClearRangeMarkers(RangeMarkerType::All);
+
+    // One change in each group, spread through the buffer
+    auto& undo = pBuffer->GetUndo();
+    auto changes = bench.Measure("undo_record", [&](uint64_t iteration) {
+        auto location = GlyphIterator(pBuffer, (unsigned long)((iteration * 7919) % uint64_t(end)));
+        auto spCommand = std::make_shared<ZepCommand_Insert>(*pBuffer, location, "abc");
+        undo.BeginGroup();
+        spCommand->Redo();
+        undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+    });
+
+    GlyphIterator cursor;
+    bench.MeasureCount("undo", changes, [&](uint64_t) {
+        undo.Undo(cursor);
+    });
+    bench.MeasureCount("redo", changes, [&](uint64_t) {
+        undo.Redo(cursor);
+    });
+
+    // Looking up the commands as they are typed, and then typing them
+    const std::vector<std::string> commands = { "j", "3j", "dd", "\"a2yy", "ciw", "gg", "G", "dw", "f(", ":", "zz", "5x" };
+    bench.Measure("keymap_find", [&](uint64_t iteration) {
+        auto& command = commands[iteration % commands.size()];
+        for (size_t length = 1; length <= command.size(); length++)
+        {
+            KeyMapResult result;
+            spMode->FindKeyMapping(command.substr(0, length), EditorMode::Normal, result);
+        }
+    });
+
+    pWindow->SetBufferCursor(pBuffer->Begin());
+    bench.Measure("keys_motion", [&](uint64_t iteration) {
+        spMode->AddCommandText((iteration & 1) ? "kkkkbbbb" : "jjjjwwww");
+    });
+
+    spMode.reset();
+    spEditor.reset();
+    fs::remove(corpusPath);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::cerr << "zep_bench [--sizes 1K,64K,1M,16M,1G] [--filter name] [--out results.jsonl] [--time seconds]" << std::endl;
+        return 1;
+    }
+
+    std::ofstream outFile;
+    if (!options.outPath.empty())
+    {
+        outFile.open(options.outPath, std::ios::app);
+        if (!outFile)
+        {
+            std::cerr << "Failed to open: " << options.outPath.string() << std::endl;
+            return 1;
+        }
+    }
+
+    Bench bench(options, outFile.is_open() ? (std::ostream&)outFile : std::cout);
+    auto tempDir = fs::temp_directory_path();
+    for (auto size : options.sizes)
+    {
+        RunCorpus(bench, size, tempDir);
+    }
+    return 0;
+}
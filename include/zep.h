@@ -4,6 +4,8 @@
 
 #ifdef ZEP_SINGLE_HEADER_BUILD
 #include "../src/buffer.cpp"
+#include "../src/buffer_io.cpp"
+#include "../src/buffer_search.cpp"
 #include "../src/commands.cpp"
 #include "../src/display.cpp"
 #include "../src/editor.cpp"
@@ -13,14 +15,17 @@
 #include "../src/keymap.cpp"
 #include "../src/line_widgets.cpp"
 #include "../src/mcommon/animation/timer.cpp"
+#include "../src/mcommon/file/compress.cpp"
 #include "../src/mcommon/file/path.cpp"
 #include "../src/mcommon/string/stringutils.cpp"
 #include "../src/mode.cpp"
+#include "../src/mode_grep.cpp"
 #include "../src/mode_search.cpp"
 #include "../src/mode_standard.cpp"
 #include "../src/mode_tree.cpp"
 #include "../src/mode_vim.cpp"
 #include "../src/range_markers.cpp"
+#include "../src/regex.cpp"
 #include "../src/scroller.cpp"
 #include "../src/splits.cpp"
 #include "../src/syntax.cpp"
@@ -30,6 +35,7 @@
 #include "../src/syntax_tree.cpp" 
 #include "../src/tab_window.cpp"
 #include "../src/theme.cpp"
+#include "../src/undo.cpp"
 #include "../src/window.cpp"
 #include "zep/imgui/display_imgui.h"
 #include "zep/imgui/editor_imgui.h"
@@ -18,6 +18,9 @@ namespace Zep
 {
 
 class ZepSyntax;
+class ZepBufferSearch;
+class ZepBufferIO;
+class ZepUndoJournal;
 class ZepTheme;
 class ZepMode;
 class ZepCommand;
@@ -109,6 +112,17 @@ struct ChangeRecord
     }
 };
 
+// Text split into lines, ready to put in a buffer; it doesn't touch the buffer, so big files can be prepared on another thread
+struct PreparedText
+{
+    std::vector<uint8_t> text;
+    std::vector<ByteIndex> lineEnds;
+    uint32_t fileFlags = 0;
+
+    // Of the text as it is in the buffer; the undo history saved with a file is only used if it matches
+    uint64_t hash = 0;
+};
+
 using fnKeyNotifier = std::function<bool(uint32_t key, uint32_t modifier)>;
 class ZepBuffer : public ZepComponent
 {
@@ -119,9 +133,20 @@ public:
 
     void Clear();
     void SetText(const std::string& strText, bool initFromFile = false);
+    void SetText(PreparedText& text, bool initFromFile = false);
+    static void PrepareText(const std::string& strText, PreparedText& text);
     void Load(const fs::path& path);
     bool Save(int64_t& size);
 
+    // Called when the file has been read or written, such as by a load or save on the thread pool
+    void SetLoadedText(PreparedText& text);
+    void MarkSaved(uint64_t updateCount, uint64_t textHash, uint64_t modifiedTime, uint64_t size);
+    bool Reload(bool force = false);
+
+    // Follow the end of a growing file, such as a log; optionally keeping only the last lines
+    void SetFollow(bool follow, long maxLines = 0);
+    bool IsFollowing() const;
+
     fs::path GetFilePath() const;
     std::string GetFileExtension() const;
     void SetFilePath(const fs::path& path);
@@ -216,6 +241,12 @@ public:
         return m_spSyntax.get();
     }
 
+    ZepBufferSearch& GetSearch();
+    ZepBufferIO& GetIO();
+
+    // Shows how far through a load or save the buffer is; empty if there isn't one
+    std::string GetProgressText() const;
+
     const std::string& GetName() const;
 
     std::string GetDisplayName() const;
@@ -282,12 +313,16 @@ public:
     Zep::signal<void(ZepBuffer& buffer, const GlyphIterator&, const std::string&)> sigPreInsert;
     Zep::signal<void(ZepBuffer& buffer, const GlyphIterator&, const GlyphIterator&)> sigPreDelete;
 
-    std::stack<std::shared_ptr<ZepCommand>>& GetUndoStack();
-    std::stack<std::shared_ptr<ZepCommand>>& GetRedoStack();
+    ZepUndoJournal& GetUndo();
 
 
 private:
     void MarkUpdate();
+    void UpdateFileInfo();
+    void FileChanged();
+    bool ReadAppended(uint64_t size, std::string& added, bool& strippedCR);
+    void UpdateFollow();
+    void DropFollowLines();
 
 private:
     // Buffer & record of the line end locations
@@ -304,6 +339,16 @@ private:
     uint64_t m_updateCount = 0;
     uint64_t m_lastUpdateTime = 0;
 
+    // The file's time and size when it was last read or written
+    uint64_t m_fileModifiedTime = 0;
+    uint64_t m_fileSize = 0;
+    bool m_fileWatched = false;
+    bool m_fileChangedWhileBusy = false;
+
+    // Following the end of the file
+    bool m_follow = false;
+    long m_followMaxLines = 0;
+
     // Syntax and theme
     std::shared_ptr<ZepSyntax> m_spSyntax;
     std::shared_ptr<ZepTheme> m_spOverrideTheme;
@@ -317,9 +362,12 @@ private:
     // Modes
     std::shared_ptr<ZepMode> m_spMode;
     fnKeyNotifier m_postKeyNotifier;
-    
-    std::stack<std::shared_ptr<ZepCommand>> m_undoStack;
-    std::stack<std::shared_ptr<ZepCommand>> m_redoStack;
+
+    std::shared_ptr<ZepUndoJournal> m_spUndo;
+
+    // Search and file IO; last so that they stop before the text goes away
+    std::shared_ptr<ZepBufferSearch> m_spSearch;
+    std::shared_ptr<ZepBufferIO> m_spIO;
 };
 
 // Notification payload
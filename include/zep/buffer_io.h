@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zep/editor.h"
+#include "zep/filesystem.h"
+#include "zep/gap_buffer.h"
+#include "zep/glyph_iterator.h"
+
+#include "zep/mcommon/string/stringutils.h"
+
+namespace Zep
+{
+
+class ZepBuffer;
+struct PreparedText;
+
+// Reads and writes a buffer's file on the thread pool, so that the editor keeps going while big files load and save.
+// A save doesn't copy the text up front; the thread takes a block at a time out of the gap buffer, and writes it
+// without holding anything, putting back the \r's for CRLF files as it goes.
+// If the buffer is about to change before it is done, only the part of what is left that the edit touches is copied
+// out first; the rest is still read from the buffer, wherever the edit moves it to.  Saves asked for while one is
+// running are put together into one more save when it is done (write behind), so typing never waits for the disk.
+// How far through it is shows in the airline.
+class ZepBufferIO : public ZepComponent
+{
+public:
+    ZepBufferIO(ZepBuffer& buffer);
+    virtual ~ZepBufferIO();
+
+    // Read the file, and put it in the buffer when it has all arrived
+    void StartLoad(const fs::path& path);
+
+    // Write the buffer to its file; the result is shown when it is done
+    bool StartSave();
+
+    // Write the buffer to its file now
+    bool Save(int64_t& size);
+
+    bool IsBusy() const;
+    bool IsLoading() const;
+
+    // Wait for the current load or save, and finish it
+    void Wait();
+
+    // "Saving 40%"; empty if nothing is happening
+    std::string GetProgressText() const;
+
+    virtual void Notify(std::shared_ptr<ZepMessage> payload) override;
+
+private:
+    struct LoadJob
+    {
+        fs::path path;
+        std::atomic<uint64_t> total = { 0 };
+        std::atomic<uint64_t> done = { 0 };
+        std::atomic<bool> stop = { false };
+        std::shared_ptr<PreparedText> spText;
+    };
+
+    struct SavePiece
+    {
+        // Where it is in the buffer; or in the text, once it has been copied out
+        ByteIndex offset = 0;
+        ByteIndex size = 0;
+        bool copied = false;
+        std::string text;
+    };
+
+    struct SaveJob
+    {
+        fs::path path;
+        uint64_t updateCount = 0;
+        bool expandCR = false;
+        bool result = false;
+        std::atomic<uint64_t> total = { 0 };
+        std::atomic<uint64_t> done = { 0 };
+
+        // Bytes in the file; more than the text if \r's are put back
+        uint64_t written = 0;
+
+        // Of the text, before the \r's are put back
+        uint64_t hash = FnvHashStart;
+
+        // The file's time and size once it is closed, so that the write isn't taken for someone else's change
+        uint64_t modifiedTime = 0;
+        uint64_t fileSize = 0;
+
+        // What is left to write, in order; pieces of the buffer, and the parts of it which an edit has copied out
+        std::mutex mutex;
+        std::deque<SavePiece> pieces;
+        const GapBuffer<uint8_t>* pText = nullptr;
+
+        // Between the buffer's messages before and after an edit, when its text can't be read
+        bool changing = false;
+        std::condition_variable changed;
+    };
+
+    static void ReadFile(IZepFileSystem& fileSystem, LoadJob& job);
+    static void WriteFile(IZepFileSystem& fileSystem, SaveJob& job);
+    static void ExpandCR(const FileBlock* pBlocks, size_t count, std::vector<uint8_t>& expanded);
+    static void SplitPieces(SaveJob& job, ByteIndex start, ByteIndex end);
+    static void MovePieces(SaveJob& job, ByteIndex from, ByteIndex distance);
+    std::shared_ptr<SaveJob> MakeSaveJob() const;
+    void FinishLoad();
+    void FinishSave();
+
+private:
+    ZepBuffer& m_buffer;
+
+    std::shared_ptr<LoadJob> m_spLoad;
+    std::future<void> m_loadResult;
+
+    std::shared_ptr<SaveJob> m_spSave;
+    std::future<void> m_saveResult;
+
+    // Asked to save while saving
+    bool m_savePending = false;
+};
+
+} // namespace Zep
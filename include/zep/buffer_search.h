@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "zep/editor.h"
+#include "zep/glyph_iterator.h"
+#include "zep/regex.h"
+
+namespace Zep
+{
+
+class ZepBuffer;
+enum class Direction;
+
+// A regular expression search of a buffer.
+// The buffer is split into fixed chunks which start on a line, and the matches for each chunk are found the first
+// time they are needed; either by the display asking for the visible lines, by n/N looking for the next match,
+// or by the thread pool filling in the rest of the buffer in the background, starting with the first range given.
+// A match which starts in a chunk belongs to it, even if it runs on into the next one.
+// Match sets are thrown away when the buffer update count changes, and found again on demand.
+// There is no limit on the number of matches, and looking up the next one is a binary search.
+class ZepBufferSearch : public ZepComponent
+{
+public:
+    ZepBufferSearch(ZepBuffer& buffer);
+    virtual ~ZepBufferSearch();
+
+    // Start a new search, cancelling the last one
+    bool Start(const std::string& pattern, const ByteRange& firstRange, std::string& error);
+    void Clear();
+    void Interrupt();
+
+    // Every chunk of the current text has been searched
+    bool IsComplete() const;
+
+    // Get the matches which overlap the range, in order
+    void GetMatches(const ByteRange& range, std::vector<ByteRange>& matches);
+
+    // Find the nearest match which starts after (or before) the location, wrapping around the buffer
+    bool FindNext(ByteIndex location, Direction dir, ByteRange& match);
+
+    // The match to show as the current one
+    void SetCurrentMatch(const ByteRange& match);
+    const ByteRange& GetCurrentMatch() const;
+
+    // Matches are shown until hidden, or the next search starts
+    bool IsVisible() const;
+    void Hide();
+
+    virtual void Notify(std::shared_ptr<ZepMessage> payload) override;
+
+private:
+    struct SearchRun
+    {
+        CancelToken cancel;
+        ZepRegex regex;
+    };
+
+    struct SearchChunk
+    {
+        ByteIndex begin = 0;
+        ByteIndex end = 0;
+        std::vector<ByteRange> matches;
+    };
+
+    void Restart();
+    void Resume();
+    void Wait();
+    void EnsureCurrent();
+    size_t ChunkFromLocation(ByteIndex location) const;
+    ByteIndex ChunkStart(size_t index, ByteIndex textEnd) const;
+    std::shared_ptr<const SearchChunk> GetChunk(size_t index);
+    std::vector<ByteRange>::const_iterator FirstMatch(size_t index, const SearchChunk& chunk);
+    std::shared_ptr<const SearchChunk> SearchChunkRange(const SearchRun& run, size_t index, ByteIndex textEnd) const;
+    void SearchChunks(std::shared_ptr<SearchRun> spRun, std::vector<size_t> order, ByteIndex textEnd);
+
+private:
+    ZepBuffer& m_buffer;
+    std::shared_ptr<SearchRun> m_spRun;
+    std::vector<std::future<void>> m_searchResults;
+
+    // Chunks are written by the threads, so guarded by the mutex
+    mutable std::mutex m_chunkMutex;
+    std::vector<std::shared_ptr<const SearchChunk>> m_chunks;
+    size_t m_chunksSearched = 0;
+    uint64_t m_chunkUpdateCount = 0;
+    ByteIndex m_chunkEnd = 0;
+
+    ByteRange m_firstRange;
+    ByteRange m_currentMatch = ByteRange(-1, -1);
+    bool m_hidden = false;
+};
+
+} // namespace Zep
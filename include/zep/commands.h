@@ -31,6 +31,12 @@ public:
         return m_cursorBefore;
     }
 
+    // What Redo did to the text, for the undo journal
+    const ChangeRecord& GetChangeRecord() const
+    {
+        return m_changeRecord;
+    }
+
 protected:
     ZepBuffer& m_buffer;
     GlyphIterator m_cursorBefore;
@@ -38,28 +44,6 @@ protected:
     ChangeRecord m_changeRecord;
 };
 
-class ZepCommand_GroupMarker : public ZepCommand
-{
-public:
-    ZepCommand_GroupMarker(ZepBuffer& currentMode)
-        : ZepCommand(currentMode)
-    {
-    }
-    virtual void Redo() override{};
-    virtual void Undo() override{};
-};
-
-class ZepCommand_EndGroup : public ZepCommand
-{
-public:
-    ZepCommand_EndGroup(ZepBuffer& currentMode)
-        : ZepCommand(currentMode)
-    {
-    }
-    virtual void Redo() override{};
-    virtual void Undo() override{};
-};
-
 class ZepCommand_DeleteRange : public ZepCommand
 {
 public:
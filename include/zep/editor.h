@@ -17,6 +17,7 @@
 #include "zep/mcommon/math/math.h"
 #include "zep/mcommon/threadpool.h"
 
+#include "zep/filesystem.h"
 #include "zep/keymap.h"
 
 #include "splits.h"
@@ -113,7 +114,8 @@ enum class Msg
     ComponentChanged,
     Tick,
     ConfigChanged,
-    ToolTip
+    ToolTip,
+    FileChanged
 };
 
 struct IZepComponent;
@@ -154,6 +156,18 @@ public:
     IZepComponent* pComponent = nullptr;
 };
 
+// Something changed on disk; from the file system's watcher, or the application
+struct FileChangeMessage : public ZepMessage
+{
+    FileChangeMessage(const FileChange& fileChange)
+        : ZepMessage(Msg::FileChanged, fileChange.path.string())
+        , change(fileChange)
+    {
+    }
+
+    FileChange change;
+};
+
 struct IZepComponent
 {
     virtual void Notify(std::shared_ptr<ZepMessage> message)
@@ -255,6 +269,13 @@ struct EditorConfig
     bool cursorLineSolid = false;
     bool showNormalModeKeyStrokes = false;
     bool searchGitRoot = true;
+    bool atomicSave = true;
+    bool writeBehind = true;
+    uint64_t undoBufferMemory = 64 * 1024 * 1024; // Undo history kept in memory, for each buffer and for all of them
+    uint64_t undoTotalMemory = 256 * 1024 * 1024;
+    bool persistentUndo = true; // Keep the undo history of files in git projects in .zep/undo
+    bool projectIndex = true; // Index the files and symbols of the git project that is opened, in .zep/indexdb
+    bool profileZones = false; // Keep the timed zones of each thread, for :ZTrace
     float backgroundFadeTime = 60.0f;
     float backgroundFadeWait = 60.0f;
 };
@@ -372,6 +393,7 @@ public:
 
     ZepWindow* AddTree();
     ZepWindow* AddSearch();
+    ZepWindow* AddGrep(const std::string& pattern);
 
     void ResetCursorTimer();
     bool GetCursorBlinkState() const;
@@ -382,6 +404,10 @@ public:
     void RequestRefresh();
     bool RefreshRequired();
 
+    // While held, windows only work out the cursor's column when a command needs it, not every time it moves
+    void HoldCursorColumns(bool hold);
+    bool CursorColumnsHeld() const;
+
     void SetCommandText(const std::string& strCommand);
 
     std::string GetCommandText() const;
@@ -430,8 +456,12 @@ public:
 
     ThreadPool& GetThreadPool() const;
 
+    // The project index; there once a file or folder in a git project has been opened, unless turned off in the config
+    Indexer* GetIndexer() const;
+
     // Used to inform when a file changes - called from outside zep by the platform specific code, if possible
     virtual void OnFileChanged(const fs::path& path);
+    void BroadcastFileChange(const FileChange& change);
 
     ZepBuffer* GetBufferFromHandle(uint64_t handle);
 
@@ -444,6 +474,7 @@ private:
     ZepBuffer* CreateNewBuffer(const fs::path& path);
 
     void InitBuffer(ZepBuffer& buffer);
+    void StartProjectIndex();
     void InitDataGrid(ZepBuffer& buffer, const NVec2i& dimensions);
 
     // Ensure there is a valid tab window and return it
@@ -485,6 +516,7 @@ private:
 
     mutable std::atomic_bool m_bPendingRefresh = { true };
     mutable bool m_lastCursorBlink = false;
+    bool m_holdCursorColumns = false;
 
     std::vector<std::string> m_commandLines; // Command information, shown under the buffer
 
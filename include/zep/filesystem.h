@@ -4,6 +4,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 #include <filesystem>
 
 #include "zep_config.h"
@@ -15,7 +16,42 @@ namespace fs = std::filesystem;
 
 enum ZepFileSystemFlags
 {
-    SearchGitRoot = (1 << 0)
+    SearchGitRoot = (1 << 0),
+    AtomicSave = (1 << 1) // Write to a temporary file, and rename it over the old one when it is all on the disk
+};
+
+// Something that happened in a watched folder
+struct FileChange
+{
+    enum class Type
+    {
+        Created,
+        Deleted,
+        Modified,
+        Overflow // Changes were lost; anything could have changed
+    };
+
+    Type type = Type::Modified;
+    fs::path path;
+    bool isDirectory = false;
+};
+
+// A piece of a file to write; a file can be written from several, such as the two halves of a gap buffer
+struct FileBlock
+{
+    const void* pData = nullptr;
+    size_t size = 0;
+};
+
+// A file being written a few blocks at a time, so that big buffers don't need copying into one string first
+class IZepFileWriter
+{
+public:
+    virtual ~IZepFileWriter(){};
+    virtual bool Write(const FileBlock* pBlocks, size_t count) = 0;
+
+    // Finish the file; false if any of it failed to write
+    virtual bool Close() = 0;
 };
 
 // Zep's view of the outside world in terms of files
@@ -26,8 +62,26 @@ class IZepFileSystem
 public:
     virtual ~IZepFileSystem(){};
     virtual std::string Read(const fs::path& filePath) = 0;
+
+    // Read part of a file, such as what has been added to the end of a log
+    virtual std::string ReadRange(const fs::path& filePath, uint64_t offset, uint64_t size)
+    {
+        auto str = Read(filePath);
+        return offset < str.size() ? str.substr(size_t(offset), size_t(size)) : std::string();
+    }
     virtual bool Write(const fs::path& filePath, const void* pData, size_t size) = 0;
 
+    // Add to the end of a file, such as the undo history.  The default reads it, and writes all of it again
+    virtual bool Append(const fs::path& filePath, const void* pData, size_t size)
+    {
+        auto str = Exists(filePath) ? Read(filePath) : std::string();
+        str.append((const char*)pData, size);
+        return Write(filePath, str.data(), str.size());
+    }
+
+    // Write a file in pieces.  The default collects them, and calls Write when it is closed
+    virtual std::unique_ptr<IZepFileWriter> OpenWriter(const fs::path& filePath);
+
     // This is the application config path, where the executable configuration files live
     // (and most likely the .exe too).
     virtual fs::path GetConfigPath() const = 0;
@@ -48,6 +102,34 @@ public:
     // A callback API for scaning
     virtual void ScanDirectory(const fs::path& path, std::function<bool(const fs::path& path, bool& dont_recurse)> fnScan) const = 0;
 
+    // The modification time (in any units, only compared with itself) and size, used to tell if a file has changed.
+    // Optional; without it the project index is rebuilt each time
+    virtual bool GetFileInfo(const fs::path& path, uint64_t& modifiedTime, uint64_t& size) const
+    {
+        (void)path;
+        (void)modifiedTime;
+        (void)size;
+        return false;
+    }
+
+    // Watch a folder (but not its sub folders) for files being created, deleted or changed.
+    // Optional; without it the project index is only brought up to date when the project is opened
+    virtual bool WatchDirectory(const fs::path& path)
+    {
+        (void)path;
+        return false;
+    }
+    virtual void UnwatchDirectory(const fs::path& path)
+    {
+        (void)path;
+    }
+
+    // Add the changes seen since the last call; doesn't wait for any
+    virtual void ReadChanges(std::vector<FileChange>& changes)
+    {
+        (void)changes;
+    }
+
     // Equivalent means 'the same file'
     virtual bool Equivalent(const fs::path& path1, const fs::path& path2) const = 0;
     virtual fs::path Canonical(const fs::path& path) const = 0;
@@ -66,7 +148,10 @@ public:
     ZepFileSystemCPP(const fs::path& configPath);
     ~ZepFileSystemCPP();
     virtual std::string Read(const fs::path& filePath) override;
+    virtual std::string ReadRange(const fs::path& filePath, uint64_t offset, uint64_t size) override;
     virtual bool Write(const fs::path& filePath, const void* pData, size_t size) override;
+    virtual bool Append(const fs::path& filePath, const void* pData, size_t size) override;
+    virtual std::unique_ptr<IZepFileWriter> OpenWriter(const fs::path& filePath) override;
     virtual void ScanDirectory(const fs::path& path, std::function<bool(const fs::path& path, bool& dont_recurse)> fnScan) const override;
     virtual void SetWorkingDirectory(const fs::path& path) override;
     virtual bool MakeDirectories(const fs::path& path) override;
@@ -76,6 +161,12 @@ public:
     virtual bool IsDirectory(const fs::path& path) const override;
     virtual bool IsReadOnly(const fs::path& path) const override;
     virtual bool Exists(const fs::path& path) const override;
+    virtual bool GetFileInfo(const fs::path& path, uint64_t& modifiedTime, uint64_t& size) const override;
+#ifdef __linux__
+    virtual bool WatchDirectory(const fs::path& path) override;
+    virtual void UnwatchDirectory(const fs::path& path) override;
+    virtual void ReadChanges(std::vector<FileChange>& changes) override;
+#endif
     virtual bool Equivalent(const fs::path& path1, const fs::path& path2) const override;
     virtual fs::path Canonical(const fs::path& path) const override;
     virtual void SetFlags(uint32_t flags) override;
@@ -83,7 +174,14 @@ public:
 private:
     fs::path m_workingDirectory;
     fs::path m_configPath;
-    uint32_t m_flags = ZepFileSystemFlags::SearchGitRoot;
+    uint32_t m_flags = ZepFileSystemFlags::SearchGitRoot | ZepFileSystemFlags::AtomicSave;
+
+#ifdef __linux__
+    // inotify handle, and the folder each watch is on
+    int m_watchHandle = -1;
+    std::map<int, fs::path> m_watches;
+    std::map<fs::path, int> m_watchPaths;
+#endif
 };
 #endif // CPP File system
 
@@ -32,6 +32,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.*/
 #include <cstring>
 #include <string>
 #include <limits>
+#include <type_traits>
 
 #ifdef _DEBUG
 #define DEBUG_FILL_GAP for (auto* pCh = m_pGapStart; pCh < m_pGapEnd; pCh++) { *pCh = '@'; }
@@ -624,6 +625,61 @@ public:
         return pEnd;
     }
 
+    // Find the substring [s_first, s_last) starting in the external range [first, last); the match must
+    // lie completely inside the range.  Returns the external offset of the match, or last if not found.
+    // Like find_first_of, this walks the 2 halves either side of the gap directly instead of using an iterator.
+    // Candidates are found with a fast scan for the first element (memchr for byte buffers), then checked
+    // against the last element before doing a full compare; a candidate may straddle the gap.
+    size_t find(size_t first, size_t last, const T* s_first, const T* s_last) const
+    {
+        assert(first <= last);
+        assert(last <= size());
+
+        const size_t len = s_last - s_first;
+        if (len == 0)
+        {
+            return first;
+        }
+
+        if (last - first < len)
+        {
+            return last;
+        }
+
+        const size_t gapOffset = m_pGapStart - m_pStart;
+        const size_t endOffset = last - len + 1;
+        const T firstVal = *s_first;
+        const T lastVal = *(s_last - 1);
+
+        size_t offset = first;
+        while (offset < endOffset)
+        {
+            // For each half, pBase + external offset is the pointer to the data
+            const T* pBase = m_pStart;
+            size_t halfEnd = std::min(gapOffset, endOffset);
+            if (offset >= gapOffset)
+            {
+                pBase = m_pGapEnd - gapOffset;
+                halfEnd = endOffset;
+            }
+
+            const T* pFound = find_value(pBase + offset, pBase + halfEnd, firstVal);
+            if (pFound == pBase + halfEnd)
+            {
+                offset = halfEnd;
+                continue;
+            }
+
+            offset = pFound - pBase;
+            if (*GetGaplessPtr(offset + len - 1) == lastVal && match_at(offset, s_first, len))
+            {
+                return offset;
+            }
+            offset++;
+        }
+        return last;
+    }
+
     // Wrappers around find_*
     template<class ForwardIt>
     const_iterator find_first_of(const_iterator first, const_iterator last,
@@ -739,6 +795,39 @@ private:
         return offset;
     }
 
+    // Find a value in a contiguous range, which must not contain the gap; returns pEnd if not found
+    inline const T* find_value(const T* pStart, const T* pEnd, const T& val) const
+    {
+        if constexpr (sizeof(T) == 1 && std::is_integral<T>::value)
+        {
+            auto pFound = static_cast<const T*>(std::memchr(pStart, static_cast<unsigned char>(val), pEnd - pStart));
+            return pFound ? pFound : pEnd;
+        }
+        else
+        {
+            return std::find(pStart, pEnd, val);
+        }
+    }
+
+    // Compare len values at the external offset; the compare is split if it crosses the gap
+    inline bool match_at(size_t offset, const T* pVal, size_t len) const
+    {
+        const size_t gapOffset = m_pGapStart - m_pStart;
+        if (offset < gapOffset)
+        {
+            size_t count = std::min(len, gapOffset - offset);
+            if (!std::equal(pVal, pVal + count, m_pStart + offset))
+            {
+                return false;
+            }
+            pVal += count;
+            offset += count;
+            len -= count;
+        }
+
+        return std::equal(pVal, pVal + len, m_pGapEnd + (offset - gapOffset));
+    }
+
     // The fixed_size of the buffer, including the gap
     inline size_t CurrentSizeWithGap() const
     {
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <array>
 #include <future>
 #include <memory>
 #include <regex>
 #include <thread>
 
 #include "zep/editor.h"
+#include "zep/filesystem.h"
 
 namespace Zep
 {
@@ -19,6 +21,13 @@ struct FileIndexResult
     std::vector<fs::path> paths;
     std::vector<std::string> lowerPaths;
     std::string errors;
+
+    // For each byte, a bit for every path whose lower case string contains it; empty if none do.
+    // A path can only fuzzy match if it has all of the characters being searched for,
+    // so the search ANDs these together, 64 paths at a time, before looking at any path string
+    std::vector<std::vector<uint64_t>> charPaths;
+
+    void BuildCharIndex();
 };
 
 struct SymbolDetails
@@ -27,31 +36,123 @@ struct SymbolDetails
     int column = 0;
 };
 
-using SymbolContainer = std::map<std::string, SymbolDetails>;
+// A symbol found in a file; paths are relative to the project root
+struct SymbolLocation
+{
+    std::string name;
+    fs::path path;
+    SymbolDetails details;
+};
+
+// Symbols are found by their simple (unqualified) name
+using SymbolContainer = std::multimap<std::string, SymbolLocation>;
+
+// The symbols found in a file, by qualified name
+using FileSymbols = std::vector<std::pair<std::string, SymbolDetails>>;
+
+// A folder in the project index; if its time changes, files have been added or removed
+struct IndexedDirectory
+{
+    fs::path path;
+    uint64_t modifiedTime = 0;
+};
+
+// A file in the project index, with what is needed to tell if it has changed, and its symbols
+struct IndexedFile
+{
+    fs::path path;
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    bool parsed = false;
+    FileSymbols symbols;
+};
+
+// Everything that is stored in .zep/indexdb.  Paths are relative to the root
+struct ProjectIndex
+{
+    fs::path root;
+    uint64_t patternHash = 0;
+    std::vector<IndexedDirectory> directories;
+    std::vector<IndexedFile> files;
+};
 
 class Indexer : public ZepComponent
 {
 public:
     Indexer(ZepEditor& editor);
+    virtual ~Indexer();
 
     virtual void Notify(std::shared_ptr<ZepMessage> message) override;
 
     bool StartIndexing();
+    bool StartIndexing(const fs::path& root);
     void StartSymbolSearch();
 
+    // Find where a symbol is defined; the name can be qualified (Class::Method) or not
+    bool FindSymbol(const std::string& name, std::vector<SymbolLocation>& locations) const;
+    const fs::path& GetSearchRoot() const;
+
+    // Find the functions, classes, structs and defines in C/C++ source
+    static void ScanSymbols(const std::string& text, FileSymbols& symbols);
+
     static void GetSearchPaths(ZepEditor& editor, const fs::path& path, std::vector<std::string>& ignore_patterns, std::vector<std::string>& include_patterns, std::string& errors);
     static std::future<std::shared_ptr<FileIndexResult>> IndexPaths(ZepEditor& editor, const fs::path& startPath);
 
+    // The on disk index.  The file is a header and fixed size records followed by the strings; it is read in one go,
+    // and every record is copied out into the ProjectIndex
+    static bool LoadIndex(IZepFileSystem& fileSystem, const fs::path& indexPath, ProjectIndex& index);
+    static bool SaveIndex(IZepFileSystem& fileSystem, const fs::path& indexPath, const ProjectIndex& index);
+
+    // Bring an index up to date with the files on disk.  Only folders whose time has changed are scanned,
+    // and only files whose time or size has changed are marked to be parsed again
+    static std::shared_ptr<ProjectIndex> UpdateIndex(ZepEditor& editor, const ProjectIndex& oldIndex);
+
+    std::shared_ptr<ProjectIndex> GetIndex() const;
+
+private:
+    void SaveIndex();
+    void AddSymbols(const fs::path& path, const FileSymbols& symbols);
+    void RemoveSymbols(const fs::path& path, const FileSymbols& symbols);
+    bool TakeWork(size_t worker, uint32_t& fileIndex);
+    void QueueFiles(const std::vector<uint32_t>& files);
+
+    void WatchDirectories();
+    void ApplyChanges();
+    bool UpdateFile(const fs::path& rel);
+    void RemoveFile(const fs::path& rel);
+    void AddDirectory(const fs::path& rel, std::set<fs::path>& parse);
+    void RemoveDirectory(const fs::path& rel);
+
 private:
     bool m_fileSearchActive = false;
-    std::future<std::shared_ptr<FileIndexResult>> m_indexResult;
-    std::shared_ptr<FileIndexResult> m_spFilePaths;
+    std::future<std::shared_ptr<ProjectIndex>> m_indexResult;
+    std::shared_ptr<ProjectIndex> m_spIndex;
+    fs::path m_indexPath;
+    std::vector<std::string> m_ignorePaths;
+    std::vector<std::string> m_includePaths;
+
+    // Changes wait here while the threads are parsing, since the files can't be moved around under them
+    std::vector<FileChange> m_pendingChanges;
 
-    std::mutex m_queueMutex;
-    std::deque<fs::path> m_searchQueue;
+    // Each thread has its own queue of files to parse, and steals from the back of the others when it runs out
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> files;
+    };
+    std::vector<std::unique_ptr<WorkQueue>> m_workQueues;
+    std::vector<std::future<void>> m_symbolResults;
 
+    // Guards the files in the index while they are parsed
     std::mutex m_symbolMutex;
-    SymbolContainer m_symbols;
+
+    // The symbol table is split by name, so that the threads rarely wait for each other
+    struct SymbolShard
+    {
+        mutable std::mutex mutex;
+        SymbolContainer symbols;
+    };
+    std::array<SymbolShard, 16> m_symbolShards;
     fs::path m_searchRoot;
 };
 
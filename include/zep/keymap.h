@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <regex>
 #include <set>
@@ -98,6 +99,10 @@ DECLARE_COMMANDID(QuickSearch)
 
 DECLARE_COMMANDID(Undo)
 DECLARE_COMMANDID(Redo)
+DECLARE_COMMANDID(UndoEarlier)
+DECLARE_COMMANDID(UndoLater)
+DECLARE_COMMANDID(MacroRecord)
+DECLARE_COMMANDID(MacroPlay)
 
 DECLARE_COMMANDID(MotionNextMarker)
 DECLARE_COMMANDID(MotionPreviousMarker)
@@ -181,10 +186,77 @@ struct CommandNode
     std::unordered_map<std::string, std::shared_ptr<CommandNode>> children;
 };
 
+// The trees of one or more keymaps, compiled into a table that is walked a key at a time.
+// Keys are integer codes: a byte for a character, or a number for a group such as <C-r>.  Each state is the set of
+// places in the trees that the keys so far could have got to (a <D> can take more digits, a <R> wants its register),
+// and has its moves sorted by key code; keys it doesn't list take its 'other' move.  A state which ends a command
+// holds the tree node that does it, and the captures are read back along that node's path when it is found.
+// Where more than one command ends, the earlier map wins, then the one with fewest wildcards.
+struct KeyMapAutomaton
+{
+    enum class NodeType : uint8_t
+    {
+        Key,
+        Digits,
+        Register,
+        AnyChar
+    };
+
+    struct Node
+    {
+        uint32_t parent = 0;
+        NodeType type = NodeType::Key;
+        uint32_t code = 0;
+        uint32_t firstChild = 0;
+        uint32_t childCount = 0;
+        StringId commandId;
+    };
+
+    struct Move
+    {
+        uint32_t code;
+        uint32_t state;
+    };
+
+    struct State
+    {
+        uint32_t firstMove = 0;
+        uint32_t moveCount = 0;
+        uint32_t otherState = 0;
+
+        // The node whose command this state finishes, or NoNode; and if more keys can follow
+        uint32_t found = 0;
+        bool live = false;
+    };
+
+    static const uint32_t NoNode = 0xFFFFFFFF;
+    static const uint32_t DeadState = 0;
+    static const uint32_t StartState = 1;
+
+    std::vector<Node> nodes;
+    std::vector<std::string> tokens;
+    std::vector<State> states;
+    std::vector<Move> moves;
+
+    // Different every time one is compiled
+    uint64_t serial = 0;
+};
+
+// Where a search stopped, so that the next search, for the same keys and one more, starts from there
+struct KeyMapMatch
+{
+    uint64_t serial = 0;
+    uint32_t state = KeyMapAutomaton::StartState;
+    std::string command;
+};
+
 struct KeyMap
 {
     bool ignoreFinalDigit = false;
     std::shared_ptr<CommandNode> spRoot = std::make_shared<CommandNode>();
+
+    // Built when first searched after a change
+    mutable std::shared_ptr<KeyMapAutomaton> spCompiled;
 };
 
 struct KeyMapResult
@@ -198,6 +270,17 @@ struct KeyMapResult
     StringId foundMapping;
     std::string searchPath;
 
+    void Clear()
+    {
+        captureNumbers.clear();
+        captureChars.clear();
+        captureRegisters.clear();
+        commandWithoutGroups.clear();
+        needMoreChars = false;
+        foundMapping = StringId();
+        searchPath.clear();
+    }
+
     int TotalCount() const
     {
         if (captureNumbers.empty())
@@ -227,6 +310,12 @@ enum class KeyMapAdd
 bool keymap_add(const std::vector<KeyMap*>& maps, const std::vector<std::string>& strCommand, const StringId& commandId, KeyMapAdd opt = KeyMapAdd::Replace);
 bool keymap_add(KeyMap& map, const std::string& strCommand, const StringId& commandId, KeyMapAdd opt = KeyMapAdd::Replace);
 void keymap_find(const KeyMap& map, const std::string& strCommand, KeyMapResult& result);
+void keymap_find(const KeyMapAutomaton& automaton, const std::string& strCommand, KeyMapResult& result, KeyMapMatch* pMatch = nullptr, bool describe = false);
+void keymap_compile(const std::vector<const KeyMap*>& maps, KeyMapAutomaton& automaton);
+
+// Changes whenever a map is added to, so that compiled maps can tell they are out of date
+uint64_t keymap_generation();
+void keymap_changed();
 void keymap_dump(const KeyMap& map, std::ostringstream& str);
 
 } // namespace Zep
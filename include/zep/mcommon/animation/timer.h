@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <ostream>
 #include <string>
 #include <unordered_map>
 
@@ -42,17 +43,61 @@ extern profile_data globalProfiler;
 
 void profile_add_value(profile_value& val, double av);
 
+// Zones for traces.  Each thread keeps the zones it has finished in a ring of its own, overwriting the oldest, so a
+// zone only takes its thread's lock.  The rings are written out together as a Chrome/Perfetto JSON trace, in which
+// zones nest by time, so it shows what each one was inside.  Names must be string literals.
+struct profile_zone_event
+{
+    const char* name = nullptr;
+    uint64_t start = 0; // Nanoseconds
+    uint64_t duration = 0;
+};
+
+uint64_t profile_time_now();
+void profile_enable(bool enable);
+bool profile_enabled();
+void profile_zone_end(const char* name, uint64_t start);
+void profile_set_thread_name(const std::string& name);
+size_t profile_zone_count();
+void profile_write_trace(std::ostream& str);
+
+class ProfileZone
+{
+public:
+    ProfileZone(const char* zoneName)
+        : name(zoneName)
+        , start(profile_enabled() ? profile_time_now() : 0)
+    {
+    }
+
+    ~ProfileZone()
+    {
+        if (start != 0)
+        {
+            profile_zone_end(name, start);
+        }
+    }
+
+    const char* name;
+    uint64_t start;
+};
+
 class ProfileBlock
 {
 public:
     const char* strTimer;
     timer blockTimer;
     uint64_t elapsed = 0;
+    ProfileZone zone;
 
     ProfileBlock(const char* timer);
     ~ProfileBlock();
 };
 
+// Timed for the averages, and a zone in the trace
 #define TIME_SCOPE(name) ProfileBlock name##_timer_block(#name);
 
+// Only a zone in the trace
+#define PROFILE_ZONE(name) ProfileZone name##_profile_zone(#name);
+
 } // namespace Zep
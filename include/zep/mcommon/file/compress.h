@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Zep
+{
+
+// A small, fast LZ77 compressor for text that is put away for a while, such as old undo history.
+// The output is runs of literal bytes, each followed by a copy of bytes seen earlier in the same block.
+void lz_compress(const uint8_t* pData, size_t size, std::vector<uint8_t>& out);
+
+// Unpack a block made by lz_compress; false if it is damaged, or isn't the expected size
+bool lz_decompress(const uint8_t* pData, size_t size, size_t expectedSize, std::vector<uint8_t>& out);
+
+} // namespace Zep
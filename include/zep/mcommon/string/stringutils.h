@@ -89,6 +89,11 @@ inline std::wstring makeWStr(const std::string& str)
 std::string string_from_wstring(const std::wstring& str);
 std::string string_tolower(const std::string& str);
 
+// FNV-1a; it can be carried on from one piece of text to the next by passing back the last hash, and gives the same
+// answer however the text is split up
+const uint64_t FnvHashStart = 0xcbf29ce484222325ULL;
+uint64_t fnv_hash_64(const void* pData, size_t size, uint64_t hash = FnvHashStart);
+
 struct StringId
 {
     uint32_t id = 0;
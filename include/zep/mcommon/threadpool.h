@@ -25,14 +25,20 @@ freely, subject to the following restrictions:
 CM: Note: Modified from the original to support query of the threads available on the machine,
 and fallback to using single threaded if not possible.
 Original here: https://github.com/progschj/ThreadPool
+
+Since changed to work stealing: each worker has its own queues, and takes from the others when it has nothing to do.
+Tasks are interactive (someone is waiting for them) or background (indexing); a worker only starts a background task
+if nothing interactive is waiting, and background tasks never take the last worker.  A task can be given a cancel
+token; if it is cancelled before the task starts, the task is skipped, and the task can look at it as it goes.
+Queued tasks are moved, not copied, and small ones are kept inside the queue entry.
 */
 
 #ifndef THREAD_POOL_HPP
 #define THREAD_POOL_HPP
 
 // containers
+#include <deque>
 #include <vector>
-#include <queue>
 // threading
 #include <thread>
 #include <mutex>
@@ -40,11 +46,116 @@ Original here: https://github.com/progschj/ThreadPool
 #include <atomic>
 #include <future>
 // utility wrappers
+#include <cstddef>
 #include <memory>
 #include <functional>
+#include <new>
+#include <type_traits>
 // exceptions
 #include <stdexcept>
 
+enum class TaskPriority
+{
+    Interactive,
+    Background
+};
+
+// Shared by a task and whoever started it
+class CancelToken {
+public:
+    CancelToken() : cancelled(std::make_shared<std::atomic_bool>(false)) {}
+    void cancel() const { *cancelled = true; }
+    bool is_cancelled() const { return *cancelled; }
+private:
+    std::shared_ptr<std::atomic_bool> cancelled;
+};
+
+// A move only task; held in place if it fits, which a packaged task does
+class PoolTask {
+public:
+    PoolTask() = default;
+
+    template<class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, PoolTask>::value>::type>
+    PoolTask(F&& f)
+    {
+        using task_t = typename std::decay<F>::type;
+        if constexpr (sizeof(task_t) <= inline_size && alignof(task_t) <= alignof(std::max_align_t))
+        {
+            new (storage) task_t(std::forward<F>(f));
+            ops = ops_for<task_t>();
+        }
+        else
+        {
+            new (storage) heap_task<task_t>{ std::unique_ptr<task_t>(new task_t(std::forward<F>(f))) };
+            ops = ops_for<heap_task<task_t>>();
+        }
+    }
+
+    PoolTask(PoolTask&& other) noexcept { take(other); }
+    PoolTask& operator=(PoolTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    PoolTask(const PoolTask&) = delete;
+    PoolTask& operator=(const PoolTask&) = delete;
+    ~PoolTask() { reset(); }
+
+    void operator()() { ops->run(storage); }
+
+private:
+    static const size_t inline_size = 64;
+
+    struct task_ops {
+        void (*run)(void*);
+        void (*move)(void*, void*);
+        void (*destroy)(void*);
+    };
+
+    template<class T>
+    struct heap_task {
+        std::unique_ptr<T> task;
+        void operator()() { (*task)(); }
+    };
+
+    template<class T>
+    static const task_ops* ops_for()
+    {
+        static const task_ops task_ops_t = {
+            [](void* p) { (*static_cast<T*>(p))(); },
+            [](void* dest, void* src) { new (dest) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); },
+            [](void* p) { static_cast<T*>(p)->~T(); }
+        };
+        return &task_ops_t;
+    }
+
+    void take(PoolTask& other)
+    {
+        ops = other.ops;
+        if (ops)
+        {
+            ops->move(storage, other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        if (ops)
+        {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[inline_size];
+    const task_ops* ops = nullptr;
+};
+
 // std::thread pool for resources recycling
 class ThreadPool {
 public:
@@ -54,29 +165,12 @@ public:
         // If not enough threads, the pool will just execute all tasks immediately
         if (threads_n > 1)
         {
+            for (size_t index = 0; index < threads_n; index++)
+                this->queues.emplace_back(new worker_queue());
+
             this->workers.reserve(threads_n);
-            for (; threads_n; --threads_n)
-                this->workers.emplace_back(
-                    [this]
-            {
-                while (true)
-                {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this] { return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-
-                    task();
-                }
-            }
-            );
+            for (size_t index = 0; index < threads_n; index++)
+                this->workers.emplace_back([this, index] { work(index); });
         }
     }
     // deleted copy&move ctors&assignments
@@ -84,54 +178,202 @@ public:
     ThreadPool& operator=(const ThreadPool&) = delete;
     ThreadPool(ThreadPool&&) = delete;
     ThreadPool& operator=(ThreadPool&&) = delete;
+
     // add new work item to the pool
     template<class F, class... Args>
-    #if ((defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L)
     std::future<typename std::invoke_result<F, Args...>::type> enqueue(F&& f, Args&&... args)
-    #else
-    std::future<typename std::result_of<F(Args...)>::type> enqueue(F&& f, Args&&... args)
-    #endif
     {
-        #if ((defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L)
-        using packaged_task_t = std::packaged_task<typename std::invoke_result<F, Args...>::type()>;
-        #else
-        using packaged_task_t = std::packaged_task<typename std::result_of<F(Args...)>::type ()>;
-        #endif
+        return enqueue_with(TaskPriority::Interactive, CancelToken(), std::forward<F>(f), std::forward<Args>(args)...);
+    }
 
-        std::shared_ptr<packaged_task_t> task(new packaged_task_t(
-                std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-            ));
+    // add a work item which is skipped if the token is cancelled before it starts; it then returns a default result
+    template<class F, class... Args>
+    std::future<typename std::invoke_result<F, Args...>::type> enqueue_with(TaskPriority priority, const CancelToken& token, F&& f, Args&&... args)
+    {
+        using result_t = typename std::invoke_result<F, Args...>::type;
+        auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        std::packaged_task<result_t()> task([token, bound]() mutable -> result_t {
+            if constexpr (std::is_void<result_t>::value)
+            {
+                if (!token.is_cancelled())
+                    bound();
+            }
+            else if constexpr (std::is_default_constructible<result_t>::value)
+            {
+                if (token.is_cancelled())
+                    return result_t();
+                return bound();
+            }
+            else
+            {
+                return bound();
+            }
+        });
+
+        auto res = task.get_future();
 
         // If there are no works, just run the task in the main thread and return
         if (workers.empty())
         {
-            (*task)();
-            return task->get_future();
+            task();
+            return res;
+        }
+
+        // A worker's own tasks go on its own queue; others are spread around
+        auto& self = current_worker();
+        auto index = self.pool == this ? self.index : (next_queue++ % queues.size());
+        {
+            std::unique_lock<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks[int(priority)].emplace_back(std::move(task));
         }
-        auto res = task->get_future();
         {
-            std::unique_lock<std::mutex> lock(this->queue_mutex);
-            this->tasks.emplace([task](){ (*task)(); });
+            // Counted once it is there to take, and under the lock so that no worker misses it
+            std::unique_lock<std::mutex> lock(this->sleep_mutex);
+            this->pending[int(priority)]++;
         }
         this->condition.notify_one();
         return res;
     }
+
+    // the number of workers; 0 if tasks run as they are added
+    size_t thread_count() const
+    {
+        return this->workers.size();
+    }
+
     // the destructor joins all threads
     virtual ~ThreadPool()
     {
-        this->stop = true;
+        {
+            std::unique_lock<std::mutex> lock(this->sleep_mutex);
+            this->stop = true;
+        }
         this->condition.notify_all();
         for(std::thread& worker : this->workers)
             worker.join();
     }
+
 private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<PoolTask> tasks[2];
+    };
+
+    struct worker_identity {
+        const ThreadPool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    static worker_identity& current_worker()
+    {
+        thread_local worker_identity identity;
+        return identity;
+    }
+
+    void work(size_t index)
+    {
+        current_worker() = worker_identity{ this, index };
+        while (true)
+        {
+            PoolTask task;
+            if (take(index, TaskPriority::Interactive, task))
+            {
+                task();
+                continue;
+            }
+
+            if (take(index, TaskPriority::Background, task))
+            {
+                task();
+
+                // Another background task may be able to start now
+                this->running_background--;
+                {
+                    std::unique_lock<std::mutex> lock(this->sleep_mutex);
+                }
+                this->condition.notify_one();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(this->sleep_mutex);
+            this->condition.wait(lock, [this] { return (this->stop && idle()) || can_take(); });
+            if (this->stop && idle())
+                return;
+        }
+    }
+
+    bool idle() const
+    {
+        return this->pending[0] == 0 && this->pending[1] == 0;
+    }
+
+    // Background tasks leave a worker for interactive ones
+    bool can_take() const
+    {
+        return this->pending[0] != 0 || (this->pending[1] != 0 && this->running_background + 1 < this->workers.size());
+    }
+
+    // From our own queue first, and then the others'.  One of the queued tasks is claimed before looking for it, so
+    // there is always one to find; it may be in a queue already passed, if more came in while we looked.
+    bool take(size_t index, TaskPriority priority, PoolTask& task)
+    {
+        if (priority == TaskPriority::Background)
+        {
+            auto running = this->running_background.load();
+            do
+            {
+                if (running + 1 >= this->workers.size())
+                    return false;
+            } while (!this->running_background.compare_exchange_weak(running, running + 1));
+        }
+
+        auto& count = this->pending[int(priority)];
+        auto queued = count.load();
+        do
+        {
+            if (queued == 0)
+            {
+                if (priority == TaskPriority::Background)
+                    this->running_background--;
+                return false;
+            }
+        } while (!count.compare_exchange_weak(queued, queued - 1));
+
+        for (size_t offset = 0;; offset++)
+        {
+            auto& queue = *queues[(index + offset) % queues.size()];
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            auto& tasks = queue.tasks[int(priority)];
+            if (tasks.empty())
+                continue;
+
+            // Our own from the front, in the order they came; others' from the back
+            if (offset % queues.size() == 0)
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            else
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            }
+            return true;
+        }
+    }
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
+    // a queue for each worker, interactive and background
+    std::vector< std::unique_ptr<worker_queue> > queues;
+    std::atomic<size_t> next_queue = { 0 };
+
+    // queued tasks of each priority, and background ones running
+    std::atomic<size_t> pending[2] = { { 0 }, { 0 } };
+    std::atomic<size_t> running_background = { 0 };
 
     // synchronization
-    std::mutex queue_mutex;
+    std::mutex sleep_mutex;
     std::condition_variable condition;
     // workers finalization flag
     std::atomic_bool stop;
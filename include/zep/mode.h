@@ -52,6 +52,9 @@ struct ExtKeys
     };
 };
 
+// "Escape" -> ExtKeys::ESCAPE
+ExtKeys::Key MapStringToExKey(const std::string& str);
+
 struct ModifierKey
 {
     enum Key
@@ -116,6 +119,9 @@ class CommandContext
 public:
     CommandContext(const std::string& commandIn, ZepMode& md, EditorMode editorMode);
 
+    // Ready for the next key in the same buffer; what was used last time is kept to be filled again
+    void Reset(const std::string& commandIn, EditorMode editorMode);
+
     void GetCommandRegisters();
     void UpdateRegisters();
 
@@ -134,7 +140,7 @@ public:
     GlyphIterator cursorAfterOverride;
 
     // Register state
-    std::stack<char> registers;
+    std::stack<char, std::vector<char>> registers;
     Register tempReg;
     const Register* pRegister = nullptr;
 
@@ -158,7 +164,10 @@ public:
     virtual void AddKeyPress(uint32_t key, uint32_t modifierKeys = ModifierKey::None);
     virtual const char* Name() const = 0;
     virtual void Begin(ZepWindow* pWindow);
-    virtual void Notify(std::shared_ptr<ZepMessage> message) override {}
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override
+    {
+        ZEP_UNUSED(message);
+    }
     virtual uint32_t ModifyWindowFlags(uint32_t windowFlags)
     {
         return windowFlags;
@@ -177,6 +186,15 @@ public:
     virtual void Undo();
     virtual void Redo();
 
+    // Through the undo tree in the order the changes were made; by a number of changes, or by seconds if not 0
+    virtual void UndoInTime(long changes, int64_t seconds);
+
+    // Keys typed from q<reg> until q go in the register; @<reg> plays them back, count times, as one undo step
+    virtual void StartMacro(char reg);
+    virtual void StopMacro();
+    virtual bool PlayMacro(char reg, int count);
+    char GetMacroRegister() const;
+
     virtual CursorType GetCursorType() const;
 
     virtual void SwitchMode(EditorMode currentMode);
@@ -185,6 +203,10 @@ public:
 
     const KeyMap& GetKeyMappings(EditorMode mode) const;
 
+    // Search the editor's global maps and then the mode's, carrying on from the last search if the command has only
+    // grown since
+    void FindKeyMapping(const std::string& command, EditorMode mode, KeyMapResult& result);
+
     // Keys handled by modes
     virtual void AddCommandText(std::string strText);
     virtual void AddCommand(std::shared_ptr<ZepCommand> spCmd);
@@ -217,7 +239,9 @@ protected:
 
     virtual void ClampCursorForMode();
     virtual bool HandleExCommand(std::string strCommand);
-    virtual std::string ConvertInputToMapString(uint32_t key, uint32_t modifierKeys);
+    virtual bool HandleSubstitute(const std::string& strCommand);
+    virtual void UpdateSearchCursor();
+    virtual void ConvertInputToMapString(uint32_t key, uint32_t modifierKeys, std::string& str);
 
     virtual bool HandleIgnoredInput(CommandContext&)
     {
@@ -239,6 +263,27 @@ protected:
     KeyMap m_visualMap;
     KeyMap m_insertMap;
 
+    // For each editor mode, the maps searched, compiled together
+    struct CompiledKeyMaps
+    {
+        uint64_t generation = 0;
+        KeyMapAutomaton automaton;
+    };
+    CompiledKeyMaps m_compiledKeyMaps[int(EditorMode::Ex) + 1];
+    KeyMapMatch m_keyMapMatch;
+
+    // The text of the key being handled, and a context for each key being handled at once (a macro's keys are
+    // handled inside the command that plays them); kept so that they aren't made again for every key
+    std::string m_keyInput;
+    std::vector<std::unique_ptr<CommandContext>> m_keyContexts;
+    size_t m_keyContextDepth = 0;
+
+    // The register being recorded to, and what has been typed so far
+    char m_macroRegister = 0;
+    std::string m_macroKeys;
+    char m_lastMacroRegister = 0;
+    bool m_playingMacro = false;
+
     Direction m_lastFindDirection = Direction::Forward;
     Direction m_lastSearchDirection = Direction::Forward;
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mode.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include <zep/indexer.h>
+#include <zep/regex.h>
+
+namespace Zep
+{
+
+class ZepWindow;
+
+// Search the contents of the project files for a pattern.
+// The files come from the same index as the file search, and are searched on the thread pool;
+// matching lines are streamed into the results buffer as they are found.
+// Return opens the file at the line of the match.
+class ZepMode_Grep : public ZepMode
+{
+public:
+    ZepMode_Grep(ZepEditor& editor, ZepWindow& previousWindow, ZepWindow& window, const fs::path& startPath, const std::string& pattern);
+    ~ZepMode_Grep();
+
+    virtual void AddKeyPress(uint32_t key, uint32_t modifiers = 0) override;
+    virtual void Begin(ZepWindow* pWindow) override;
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+    virtual EditorMode DefaultMode() const override
+    {
+        return EditorMode::Normal;
+    }
+
+    static const char* StaticName()
+    {
+        return "Grep";
+    }
+    virtual const char* Name() const override
+    {
+        return StaticName();
+    }
+
+    virtual CursorType GetCursorType() const override;
+
+private:
+    enum class OpenType
+    {
+        Replace,
+        VSplit,
+        HSplit,
+        Tab
+    };
+    void OpenSelection(OpenType type);
+    void StartGrep();
+    void GrepFiles();
+    void ShowResults();
+    void Stop();
+
+private:
+    struct GrepResult
+    {
+        uint32_t pathIndex = 0;
+        long line = 0;
+        long column = 0;
+        std::string text;
+    };
+
+    bool m_fileSearchActive = false;
+    std::future<std::shared_ptr<FileIndexResult>> m_indexResult;
+    std::shared_ptr<FileIndexResult> m_spFilePaths;
+
+    // The threads take the next file to search from the counter until they run out, or are stopped
+    CancelToken m_cancel;
+    std::atomic<uint32_t> m_nextFile = { 0 };
+    std::atomic<uint32_t> m_filesSearched = { 0 };
+    std::vector<std::future<void>> m_grepResults;
+
+    // Results found by the threads, waiting to be shown
+    std::mutex m_resultMutex;
+    std::vector<GrepResult> m_pendingResults;
+
+    // Results shown in the buffer; one per line
+    std::vector<GrepResult> m_results;
+
+    ZepRegex m_regex;
+    std::string m_pattern;
+
+    ZepWindow& m_launchWindow;
+    ZepWindow& m_window;
+    fs::path m_startPath;
+};
+
+} // namespace Zep
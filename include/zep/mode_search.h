@@ -52,25 +52,30 @@ private:
     void OpenSelection(OpenType type);
 
 private:
-    // List of lines in the file result, with last found char
-    struct SearchResult
+    // A scored path, for ranking the results
+    struct ScoredResult
     {
+        int32_t score = 0;
         uint32_t index = 0;
-        uint32_t location = 0;
     };
 
-    // A mapping from character distance to a list of lines
+    // The paths which match a search string, as a bit for each, and the best of them in order
     struct IndexSet
     {
-        std::multimap<uint32_t, SearchResult> indices;
+        std::vector<uint64_t> paths;
+        size_t count = 0;
+        std::vector<ScoredResult> top;
     };
 
+    static int32_t FuzzyScore(const std::string& path, const std::string& term);
+    static void MergeTop(std::vector<ScoredResult>& top, const std::vector<ScoredResult>& more);
+
     bool fileSearchActive = false;
     bool treeSearchActive = false;
 
     // Results of the file search and the indexing threads
     std::future<std::shared_ptr<FileIndexResult>> m_indexResult;
-    std::future<std::shared_ptr<IndexSet>> m_searchResult;
+    std::vector<std::future<std::shared_ptr<IndexSet>>> m_searchResults;
 
     // All files that can potentially match
     std::shared_ptr<FileIndexResult> m_spFilePaths;
@@ -80,6 +85,9 @@ private:
     // index a,b,c -> index b,c -> index c
     std::vector<std::shared_ptr<IndexSet>> m_indexTree;
 
+    // The paths in the results buffer
+    std::vector<uint32_t> m_shownResults;
+
     // What we are searching for
     std::string m_searchTerm;
     bool m_caseImportant = false;
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+struct RegexNode;
+
+// Instructions for the compiled regex program
+enum class RegexOp
+{
+    Char,
+    Class,
+    Split,
+    Jump,
+    LineBegin,
+    LineEnd,
+    WordBegin,
+    WordEnd,
+    Save,
+    Match
+};
+
+// A small regular expression engine for buffer searches.
+// Patterns use the vim 'magic' syntax:
+//   .  *  [abc]  [^a-z]  ^  $  \+  \?  \=  \|  \(\)  \<  \>  \d \D \w \W \s \S \a \l \u \x \t \n  \c \C
+// Everything else is a literal, so most plain text searches behave as before.
+// The first 9 \(\) groups can be read back for a match, for \1 to \9 in a substitute.
+// The pattern is compiled to a small program which is run as a Thompson/Pike NFA simulation;
+// this never backtracks, so the time taken is linear in the length of the searched text, whatever the pattern.
+// Matching is byte oriented; '.' and negated classes consume a whole UTF8 codepoint.
+class ZepRegex
+{
+public:
+    // Compile the pattern; returns false and fills in the error if the pattern is bad
+    bool Compile(const std::string& pattern, std::string& error);
+    bool IsValid() const;
+
+    // Find the first (leftmost, greedy) match at or after pStart in the text [pBegin, pEnd).
+    // pBegin/pEnd are treated as line boundaries for ^ and $, as well as any '\n' in the text.
+    bool Find(const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pStart, const uint8_t*& pMatchBegin, const uint8_t*& pMatchEnd) const;
+
+    // Find all of the non-overlapping matches in the text, calling back with each one.
+    // As in vim, an empty match is reported and the search moves on a character; but not one straight after the last match.
+    // Return false from the callback to stop the search
+    void FindAll(const uint8_t* pBegin, const uint8_t* pEnd, std::function<bool(const uint8_t*, const uint8_t*)> fnMatch) const;
+
+    // Get the text of the groups for a match that Find returned; group 0 is the whole match, and a group which
+    // didn't take part is empty.  This runs the match again, keeping where each group went.
+    using RegexGroups = std::vector<std::pair<const uint8_t*, const uint8_t*>>;
+    void GetGroups(const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pMatchBegin, const uint8_t* pMatchEnd, RegexGroups& groups) const;
+    uint32_t GetGroupCount() const;
+
+private:
+    struct RegexInst
+    {
+        RegexOp op;
+        uint8_t ch = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+    };
+
+    struct RegexThread
+    {
+        uint32_t pc;
+        const uint8_t* pStart;
+    };
+
+    struct RegexGroupThread
+    {
+        uint32_t pc;
+        RegexGroups groups;
+    };
+
+    struct RegexState
+    {
+        std::vector<RegexThread> current;
+        std::vector<RegexThread> next;
+        std::vector<uint32_t> visited;
+        uint32_t generation = 0;
+    };
+
+    uint32_t Emit(RegexOp op, uint8_t ch = 0, uint32_t x = 0, uint32_t y = 0);
+    void Generate(const RegexNode& node);
+    void AddThread(RegexState& state, std::vector<RegexThread>& list, uint32_t pc, const uint8_t* pStart, const uint8_t* pos, const uint8_t* pBegin, const uint8_t* pEnd) const;
+    bool Find(RegexState& state, const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pStart, const uint8_t*& pMatchBegin, const uint8_t*& pMatchEnd) const;
+    void AddGroupThread(std::vector<bool>& visited, std::vector<RegexGroupThread>& list, uint32_t pc, RegexGroups groups, const uint8_t* pos, const uint8_t* pBegin, const uint8_t* pEnd) const;
+    void FindFirstByte();
+
+private:
+    std::vector<RegexInst> m_program;
+    std::vector<std::bitset<256>> m_classes;
+    bool m_ignoreCase = false;
+    uint32_t m_groupCount = 0;
+
+    // If every match must start with a single known byte, we can skip to it quickly
+    int m_firstByte = -1;
+};
+
+} // namespace Zep
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zep/filesystem.h"
+#include "zep/glyph_iterator.h"
+
+namespace Zep
+{
+
+class ZepBuffer;
+struct ChangeRecord;
+
+// The undo history of a buffer.
+// Each change is a small fixed size record: where it happened, the text it removed and the text it added, and the cursor
+// before and after.  Short text is kept in the record itself; longer text goes in an arena of large blocks, which is only
+// ever added to at the end.  Typing, backspace and delete next to the last change in a group are added to its record.
+// Groups are the steps that undo/redo move by: the index of their first record, and the group they were made after.
+// So the groups make a tree; a change after an undo starts a new branch, and nothing is thrown away.  Redo follows the
+// branch that was last used.  Going to any other state (by the order the changes were made, or by time) undoes the
+// changes up to the point where the branches meet, and redoes them down the other branch; the states in between
+// aren't visited.
+// When the arena grows past the buffer's budget, or all the buffers together go past theirs, the blocks furthest from
+// where we are in the history are compressed into a temporary file, and read back if undo/redo gets to them.
+// Saving a file in a git project also saves the history in .zep/undo, keyed by the file's path.  Each save adds what is
+// new since the last one to the end of the file, on the thread pool; so a save ends the current group, and what has been
+// written is never changed.  The history is only read back when undo gets to the start of the history in memory (or the
+// file is first saved), and only used if the state it was saved at has the text that was loaded.
+class ZepUndoJournal
+{
+public:
+    ZepUndoJournal(ZepBuffer& buffer);
+    ~ZepUndoJournal();
+
+    // The next change starts a new group
+    void BeginGroup();
+
+    // Record a change which has been made to the buffer
+    void AddChange(const ChangeRecord& change, const GlyphIterator& cursorBefore, const GlyphIterator& cursorAfter);
+
+    // Undo/redo the last/next group; the cursor is where it should go, if valid
+    bool Undo(GlyphIterator& cursor);
+    bool Redo(GlyphIterator& cursor);
+
+    // Go back or forward through the states in the order they were made, whichever branch they are on; by a number
+    // of changes, or a number of seconds (:earlier 10m)
+    bool MoveByChanges(long changes, GlyphIterator& cursor);
+    bool MoveByTime(int64_t seconds, GlyphIterator& cursor);
+
+    bool CanUndo() const;
+    bool CanRedo() const;
+    void Clear();
+
+    // Text was taken from the start of the buffer without being recorded, such as the oldest lines of a log that is
+    // followed; the history moves back with the rest of the text, or is cleared if it changed what was taken
+    void RemovedFromStart(ByteIndex size);
+
+    // The buffer has loaded the file, and its text has this hash; the history saved with it is read if undo needs it
+    void SetSavedHistory(const fs::path& filePath, uint64_t textHash);
+
+    // The file has been saved, with the text the history ends at; false if the history can't be kept for it
+    bool SaveHistory(const fs::path& filePath, uint64_t textHash);
+
+    // Bytes held in memory by the history, and in the spill file
+    size_t GetMemoryUsed() const;
+    uint64_t GetSpilledSize() const;
+
+    // Move text out to the spill file until at most this much memory is used
+    void Spill(size_t memoryUsed);
+
+private:
+    static const uint32_t InlineTextSize = 8;
+
+    struct UndoText
+    {
+        uint64_t size = 0;
+        union
+        {
+            uint8_t bytes[InlineTextSize];
+            uint32_t arena[2]; // Block, offset
+        } data;
+    };
+
+    struct UndoRecord
+    {
+        ByteIndex location = 0;
+        ByteIndex cursorBefore = -1;
+        ByteIndex cursorAfter = -1;
+        UndoText deleted;
+        UndoText inserted;
+    };
+
+    struct ArenaBlock
+    {
+        // Empty while it is spilled
+        std::vector<uint8_t> text;
+        uint32_t size = 0;
+        bool spilled = false;
+
+        // The compressed copy in the spill file; it is only written once
+        uint64_t spillOffset = 0;
+        uint32_t spillSize = 0;
+    };
+
+    // The state before any of the groups; the text as it was loaded
+    static const uint32_t RootGroup = 0xFFFFFFFF;
+
+    struct UndoGroup
+    {
+        uint32_t firstRecord = 0;
+        uint32_t parent = RootGroup;
+
+        // The branch redo goes down
+        uint32_t lastChild = RootGroup;
+
+        // Seconds since the epoch
+        int64_t time = 0;
+    };
+
+    UndoText StoreText(const std::string& text);
+    UndoText UpdateText(const UndoText& oldText, const std::string& text);
+    void AppendText(UndoText& stored, const std::string& text);
+    bool MergeChange(const ChangeRecord& change, const GlyphIterator& cursorAfter);
+    std::string GetText(const UndoText& text);
+    uint32_t GroupEnd(size_t group) const;
+    uint32_t& LastChild(uint32_t group);
+    bool GoTo(uint32_t group, GlyphIterator& cursor);
+    void ApplyGroup(uint32_t group, bool undo, GlyphIterator& cursor);
+    bool LoadGroup(size_t group);
+    bool LoadBlock(ArenaBlock& block);
+    bool WriteSpillCopy(ArenaBlock& block);
+    bool AddSpillCopy(ArenaBlock& block, const uint8_t* pPacked, size_t size);
+    bool ReadSpillCopy(const ArenaBlock& block, std::vector<uint8_t>& packed);
+    bool SpillBlock(ArenaBlock& block);
+    bool OpenSpillFile();
+    void CloseSpillFile();
+    fs::path GetHistoryPath(const fs::path& filePath) const;
+    void LoadSavedHistory();
+
+    // What a save adds to the history file, and the queue of them that the thread pool writes in order
+    struct HistorySegment;
+    struct HistoryWriter;
+    static void WriteHistory(IZepFileSystem& fileSystem, HistoryWriter& writer);
+    void CheckBudget();
+    void Apply(const UndoRecord& record, bool undo);
+
+private:
+    ZepBuffer& m_buffer;
+    std::vector<UndoRecord> m_records;
+    std::vector<UndoGroup> m_groups;
+    std::vector<ArenaBlock> m_arena;
+
+    // Compressed blocks; only opened when the budget is first reached
+    FILE* m_pSpillFile = nullptr;
+    uint64_t m_spillSize = 0;
+
+    // The arena has grown, or had blocks read back in
+    bool m_arenaGrew = false;
+
+    // The file whose saved history comes before the history in memory, if it hasn't been read yet
+    fs::path m_savedHistoryFile;
+    uint64_t m_savedHistoryHash = 0;
+
+    // How much of the history is in the file; the next save adds what comes after it.  Until the file is known to have
+    // the history up to a point, the next save writes all of it again
+    fs::path m_historyPath;
+    bool m_historyInFile = false;
+    uint32_t m_savedGroups = 0;
+    uint32_t m_savedRecords = 0;
+    uint32_t m_savedBlocks = 0;
+    uint32_t m_savedBlockSize = 0;
+    std::vector<uint32_t> m_savedLastChild;
+    std::shared_ptr<HistoryWriter> m_spHistoryWriter;
+    std::future<void> m_historyWritten;
+
+    // The group whose change made the text as it is now
+    uint32_t m_current = RootGroup;
+    uint32_t m_rootLastChild = RootGroup;
+    bool m_groupOpen = false;
+};
+
+} // namespace Zep
@@ -148,6 +148,7 @@ public:
 
     virtual long GetMaxDisplayLines();
     virtual long GetNumDisplayedLines();
+    virtual ByteRange GetVisibleByteRange();
 
     virtual ZepBuffer& GetBuffer() const;
     virtual void SetBuffer(ZepBuffer* pBuffer);
@@ -167,6 +168,7 @@ private:
     void UpdateVisibleLineRange();
 
     NVec2i BufferToDisplay(const GlyphIterator& location);
+    long GetLastCursorColumn();
 
     void ScrollToCursor();
     bool IsInsideVisibleText(NVec2i pos) const;
@@ -241,6 +243,7 @@ private:
     // Cursor
     GlyphIterator m_bufferCursor; // Location in buffer coordinates.  Each window has a different buffer cursor
     long m_lastCursorColumn = 0; // The last cursor column (could be removed and recalculated)
+    bool m_cursorColumnStale = false; // The cursor moved while the editor held the columns
     NVec2f m_mousePos; // Current mouse location
     GlyphIterator m_mouseIterator; // Current iterator for the mouse cursor
 
@@ -265,6 +268,9 @@ private:
     std::map<NVec2f, std::shared_ptr<RangeMarker>> m_toolTips; // All tooltips for a given position, currently only 1 at a time
 
     NVec2f lastLinePx;
+
+    // Search matches in the visible range, updated each display
+    std::vector<ByteRange> m_searchMatches;
 };
 
 } // namespace Zep
@@ -5,8 +5,13 @@
 #include <regex>
 
 #include "zep/buffer.h"
+#include "zep/buffer_io.h"
+#include "zep/buffer_search.h"
+#include "zep/commands.h"
 #include "zep/editor.h"
 #include "zep/filesystem.h"
+#include "zep/undo.h"
+#include "zep/window.h"
 
 #include "zep/mcommon/string/stringutils.h"
 
@@ -18,6 +23,9 @@ namespace Zep
 namespace
 {
 
+// Files at least this big are read on the thread pool
+const uint64_t AsyncLoadSize = 8 * 1024 * 1024;
+
 // A VIM-like definition of a word.  Actually, in Vim this can be changed, but this editor
 // assumes a word is alphanumeric or underscore for consistency
 inline bool IsWordChar(const char c)
@@ -78,6 +86,62 @@ ZepBuffer::~ZepBuffer()
 
 void ZepBuffer::Notify(std::shared_ptr<ZepMessage> message)
 {
+    if (message->messageId == Msg::Tick)
+    {
+        if (m_fileChangedWhileBusy && !GetIO().IsBusy())
+        {
+            m_fileChangedWhileBusy = false;
+            FileChanged();
+        }
+        // Without a watcher, keep looking at the file
+        else if (m_follow && !m_fileWatched)
+        {
+            UpdateFollow();
+        }
+        return;
+    }
+
+    if (message->messageId == Msg::FileChanged)
+    {
+        auto& change = std::static_pointer_cast<FileChangeMessage>(message)->change;
+        if (change.isDirectory || m_filePath.empty() || (change.type != FileChange::Type::Overflow && change.path != m_filePath))
+        {
+            return;
+        }
+
+        // Our own save shows up too; it is looked at once the file is closed, against the time and size it was left with
+        if (m_spIO && m_spIO->IsBusy())
+        {
+            m_fileChangedWhileBusy = true;
+            return;
+        }
+
+        FileChanged();
+    }
+}
+
+// The file changed on disk; follow it, reload it, or say so if there are edits that would be lost
+void ZepBuffer::FileChanged()
+{
+    if (m_follow)
+    {
+        UpdateFollow();
+        return;
+    }
+
+    if (!HasFileFlags(FileFlags::Dirty))
+    {
+        Reload();
+        return;
+    }
+
+    // Don't throw away the edits; :e! will reload it
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    if (GetEditor().GetFileSystem().GetFileInfo(m_filePath, modifiedTime, size) && (modifiedTime != m_fileModifiedTime || size != m_fileSize))
+    {
+        GetEditor().SetCommandText("File changed on disk since it was edited: " + GetName());
+    }
 }
 
 // Vertical column
@@ -340,34 +404,20 @@ GlyphIterator ZepBuffer::Find(GlyphIterator start, const uint8_t* pBeginString,
         }
     }
 
-    auto itrBuffer = start;
-    auto itrEnd = End();
-    while (itrBuffer != itrEnd)
+    // Search the gap buffer directly; the match can't include the terminating 0
+    auto endIndex = ByteIndex(End().Index());
+    if (start.Index() >= endIndex)
     {
-        auto itrNext = itrBuffer;
-
-        // Loop the string and match it to the buffer
-        auto pCurrent = pBeginString;
-        while (pCurrent != pEndString && itrNext != itrEnd)
-        {
-            if (*pCurrent != itrNext.Char())
-            {
-                break;
-            }
-            pCurrent++;
-            itrNext++;
-        };
-
-        // We successfully got to the end
-        if (pCurrent == pEndString)
-        {
-            return itrBuffer;
-        }
+        return GlyphIterator();
+    }
 
-        itrBuffer++;
-    };
+    auto found = m_workingBuffer.find(start.Index(), endIndex, pBeginString, pEndString);
+    if (found == size_t(endIndex))
+    {
+        return GlyphIterator();
+    }
 
-    return GlyphIterator();
+    return GlyphIterator(this, ByteIndex(found));
 }
 
 GlyphIterator ZepBuffer::FindOnLineMotion(GlyphIterator start, const uint8_t* pCh, Direction dir) const
@@ -725,14 +775,27 @@ void ZepBuffer::Load(const fs::path& path)
     // TODO: I believe that some of this buffer config should move to Editor.cpp
     GetEditor().SetBufferSyntax(*this);
 
-    if (GetEditor().GetFileSystem().Exists(path))
+    auto& fileSystem = GetEditor().GetFileSystem();
+    if (fileSystem.Exists(path))
     {
-        m_filePath = GetEditor().GetFileSystem().Canonical(path);
-        auto read = GetEditor().GetFileSystem().Read(path);
+        m_filePath = fileSystem.Canonical(path);
+
+        // Big files arrive later; until then the buffer is empty, and can't be changed
+        uint64_t modifiedTime = 0;
+        uint64_t size = 0;
+        if (fileSystem.GetFileInfo(m_filePath, modifiedTime, size) && size >= AsyncLoadSize)
+        {
+            Clear();
+            m_fileFlags = ZSetFlags(m_fileFlags, FileFlags::Locked);
+            GetIO().StartLoad(m_filePath);
+            return;
+        }
 
         // Always set text, to ensure we prepare the buffer with 0 terminator,
         // even if string is empty
-        SetText(read, true);
+        PreparedText text;
+        PrepareText(fileSystem.Read(m_filePath), text);
+        SetLoadedText(text);
     }
     else
     {
@@ -740,7 +803,25 @@ void ZepBuffer::Load(const fs::path& path)
         // But we may have a path we haven't save to yet!
         Clear();
         m_filePath = path;
+        UpdateFileInfo();
+    }
+}
+
+void ZepBuffer::SetLoadedText(PreparedText& text)
+{
+    SetText(text, true);
+    m_fileFlags = ZClearFlags(m_fileFlags, FileFlags::Locked);
+
+    // The history from when it was last saved is read if it is needed
+    GetUndo().Clear();
+    if (GetEditor().GetConfig().persistentUndo)
+    {
+        GetUndo().SetSavedHistory(m_filePath, text.hash);
     }
+
+    // Reloaded when it changes
+    UpdateFileInfo();
+    m_fileWatched = GetEditor().GetFileSystem().WatchDirectory(m_filePath.parent_path());
 }
 
 bool ZepBuffer::Save(int64_t& size)
@@ -755,41 +836,518 @@ bool ZepBuffer::Save(int64_t& size)
         return false;
     }
 
-    auto str = GetWorkingBuffer().string();
+    return GetIO().Save(size);
+}
 
-    // Put back /r/n if necessary while writing the file
-    // At the moment, Zep removes /r/n and just uses /n while modifying text.
-    // It replaces the /r on files that had it afterwards
-    // Alternatively we could manage them 'in place', but that would make parsing more complex.
-    // And then what do you do if there are 2 different styles in the file.
-    if (m_fileFlags & FileFlags::StrippedCR)
+// The text as it was at the update count is now in the file, which had the time and size given once it was closed
+void ZepBuffer::MarkSaved(uint64_t updateCount, uint64_t textHash, uint64_t modifiedTime, uint64_t size)
+{
+    if (GetEditor().GetFileSystem().Exists(m_filePath))
     {
-        // TODO: faster way to replace newlines
-        string_replace_in_place(str, "\n", "\r\n");
+        // We wrote succesfully, so make sure our path is canonical
+        m_filePath = GetEditor().GetFileSystem().Canonical(m_filePath);
     }
 
-    // Remove the appended 0 if necessary
-    size = (int64_t)str.size();
-    if (m_fileFlags & FileFlags::TerminatedWithZero)
+    // Edits made while it was being written still need saving; and the history no longer ends at the saved text
+    if (updateCount == m_updateCount)
     {
-        size--;
+        m_fileFlags = ZClearFlags(m_fileFlags, FileFlags::Dirty);
+        if (GetEditor().GetConfig().persistentUndo)
+        {
+            GetUndo().SaveHistory(m_filePath, textHash);
+        }
     }
 
-    // Ensure size is at least 0
-    size = std::max(size, int64_t(0));
+    // Our own change; don't reload it.  Anything written since it was closed is still seen as a change
+    m_fileModifiedTime = modifiedTime;
+    m_fileSize = size;
+}
+
+namespace
+{
 
-    if (GetEditor().GetFileSystem().Write(m_filePath, &str[0], (size_t)size))
+// Diffs with more changes than this are applied as a single replacement
+const long MaxDiffEdits = 1000;
+
+// Bytes at the old end of a growing file which are checked against the buffer, to see that it was only added to
+const uint64_t AppendCheckSize = 4096;
+
+struct DiffLine
+{
+    size_t offset = 0;
+    size_t length = 0;
+    size_t hash = 0;
+};
+
+// A run of changed lines: [oldBegin, oldEnd) in the buffer is replaced by [newBegin, newEnd) from the file
+struct LineHunk
+{
+    long oldBegin = 0;
+    long oldEnd = 0;
+    long newBegin = 0;
+    long newEnd = 0;
+};
+
+std::vector<DiffLine> SplitDiffLines(const std::string& text)
+{
+    std::vector<DiffLine> lines;
+    size_t start = 0;
+    while (start < text.size())
     {
-        m_fileFlags = ZClearFlags(m_fileFlags, FileFlags::Dirty);
+        auto end = text.find('\n', start);
+        end = (end == std::string::npos) ? text.size() : end + 1;
+
+        DiffLine line;
+        line.offset = start;
+        line.length = end - start;
+        line.hash = std::hash<std::string>()(text.substr(start, end - start));
+        lines.push_back(line);
+        start = end;
+    }
+    return lines;
+}
 
-        if (GetEditor().GetFileSystem().Exists(m_filePath))
+std::string StripCR(const std::string& text, bool& stripped)
+{
+    std::string result;
+    result.reserve(text.size());
+    for (auto ch : text)
+    {
+        if (ch == '\r')
         {
-            // We wrote succesfully, so make sure our path is canonical
-            m_filePath = GetEditor().GetFileSystem().Canonical(m_filePath);
+            stripped = true;
+        }
+        else
+        {
+            result.push_back(ch);
         }
-        return true;
     }
-    return false;
+    return result;
+}
+
+// Myers' O(ND) difference of two line lists, after removing the lines they start and end with.
+// Returns the hunks from the last to the first, so that applying them in order doesn't move the ones still to do
+std::vector<LineHunk> DiffLines(const std::string& oldText, const std::vector<DiffLine>& oldLines, const std::string& newText, const std::vector<DiffLine>& newLines)
+{
+    auto equal = [&](long oldIndex, long newIndex) {
+        auto& oldLine = oldLines[oldIndex];
+        auto& newLine = newLines[newIndex];
+        return oldLine.hash == newLine.hash && oldLine.length == newLine.length && oldText.compare(oldLine.offset, oldLine.length, newText, newLine.offset, newLine.length) == 0;
+    };
+
+    long oldCount = long(oldLines.size());
+    long newCount = long(newLines.size());
+
+    long prefix = 0;
+    while (prefix < oldCount && prefix < newCount && equal(prefix, prefix))
+    {
+        prefix++;
+    }
+
+    long suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix && equal(oldCount - suffix - 1, newCount - suffix - 1))
+    {
+        suffix++;
+    }
+
+    long n = oldCount - prefix - suffix;
+    long m = newCount - prefix - suffix;
+    std::vector<LineHunk> hunks;
+    if (n == 0 && m == 0)
+    {
+        return hunks;
+    }
+
+    // Forward search, keeping the furthest x reached on each diagonal k for every d
+    std::vector<long> v(size_t(2 * (n + m) + 3), 0);
+    auto offset = n + m + 1;
+    std::vector<std::vector<long>> trace;
+    long found = -1;
+    for (long d = 0; d <= n + m && d <= MaxDiffEdits; d++)
+    {
+        trace.emplace_back(v.begin() + (offset - d - 1), v.begin() + (offset + d + 2));
+        for (long k = -d; k <= d; k += 2)
+        {
+            long x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            long y = x - k;
+            while (x < n && y < m && equal(prefix + x, prefix + y))
+            {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m)
+            {
+                found = d;
+                break;
+            }
+        }
+
+        if (found >= 0)
+        {
+            break;
+        }
+    }
+
+    if (found < 0)
+    {
+        hunks.push_back(LineHunk{ prefix, prefix + n, prefix, prefix + m });
+        return hunks;
+    }
+
+    // Walk back along the path; runs of edits between matching lines are the hunks
+    long x = n;
+    long y = m;
+    bool open = false;
+    LineHunk hunk;
+    for (long d = found; d >= 0; d--)
+    {
+        auto& vd = trace[d];
+        auto at = [&](long k) {
+            return vd[size_t(k + d + 1)];
+        };
+
+        long k = x - y;
+        long prevK = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+        long prevX = d == 0 ? 0 : at(prevK);
+        long prevY = prevX - prevK;
+
+        // The end of the edit, where the matching lines start
+        long midX = d == 0 ? 0 : (prevK == k + 1 ? prevX : prevX + 1);
+        long midY = d == 0 ? 0 : (prevK == k + 1 ? prevY + 1 : prevY);
+
+        if (x > midX && open)
+        {
+            hunks.push_back(hunk);
+            open = false;
+        }
+
+        if (d > 0)
+        {
+            if (!open)
+            {
+                hunk.oldEnd = prefix + midX;
+                hunk.newEnd = prefix + midY;
+                open = true;
+            }
+            hunk.oldBegin = prefix + prevX;
+            hunk.newBegin = prefix + prevY;
+        }
+
+        x = prevX;
+        y = prevY;
+    }
+
+    if (open)
+    {
+        hunks.push_back(hunk);
+    }
+    return hunks;
+}
+
+} // namespace
+
+// Record what the file looked like when it was read or written, so that a change to it can be spotted
+void ZepBuffer::UpdateFileInfo()
+{
+    m_fileModifiedTime = 0;
+    m_fileSize = 0;
+    if (!m_filePath.empty())
+    {
+        GetEditor().GetFileSystem().GetFileInfo(m_filePath, m_fileModifiedTime, m_fileSize);
+    }
+}
+
+// If the file has grown, and the end of what we have is still there, get what was added
+bool ZepBuffer::ReadAppended(uint64_t size, std::string& added, bool& strippedCR)
+{
+    if (m_fileSize == 0 || size <= m_fileSize)
+    {
+        return false;
+    }
+
+    auto checkSize = std::min(m_fileSize, AppendCheckSize);
+    auto tail = GetEditor().GetFileSystem().ReadRange(m_filePath, m_fileSize - checkSize, size - m_fileSize + checkSize);
+    if (tail.size() != size - m_fileSize + checkSize)
+    {
+        return false;
+    }
+
+    auto check = StripCR(tail.substr(0, size_t(checkSize)), strippedCR);
+    auto checkStart = End().Index() - ByteIndex(check.size());
+    if (checkStart < 0 || GetBufferText(GlyphIterator(this, checkStart), End()) != check)
+    {
+        return false;
+    }
+
+    added = StripCR(tail.substr(size_t(checkSize)), strippedCR);
+    return true;
+}
+
+// Bring the text up to date with the file, changing only the lines that differ.
+// Markers, syntax and the cursors are left alone outside of the changed lines, and the changes can be undone.
+// If the file has just been added to, only the new part is read.  Forcing it throws away any edits.
+bool ZepBuffer::Reload(bool force)
+{
+    auto& fileSystem = GetEditor().GetFileSystem();
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    if (m_filePath.empty() || !fileSystem.GetFileInfo(m_filePath, modifiedTime, size))
+    {
+        return false;
+    }
+
+    if (!force && modifiedTime == m_fileModifiedTime && size == m_fileSize)
+    {
+        return false;
+    }
+
+    bool strippedCR = false;
+    std::vector<LineHunk> hunks;
+    std::vector<DiffLine> oldLines;
+    std::string oldText;
+    std::string newText;
+
+    // A growing file, such as a log
+    if (!force && ReadAppended(size, newText, strippedCR))
+    {
+        hunks.push_back(LineHunk{ GetLineCount(), GetLineCount(), 0, long(newText.size()) });
+    }
+
+    if (hunks.empty())
+    {
+        newText = StripCR(fileSystem.Read(m_filePath), strippedCR);
+        oldText = GetBufferText(Begin(), End());
+        oldLines = SplitDiffLines(oldText);
+
+        auto newLines = SplitDiffLines(newText);
+        hunks = DiffLines(oldText, oldLines, newText, newLines);
+
+        // Convert to bytes in the new text
+        for (auto& hunk : hunks)
+        {
+            auto newBegin = hunk.newBegin < long(newLines.size()) ? newLines[hunk.newBegin].offset : newText.size();
+            auto newEnd = hunk.newEnd < long(newLines.size()) ? newLines[hunk.newEnd].offset : newText.size();
+            hunk.newBegin = long(newBegin);
+            hunk.newEnd = long(newEnd);
+        }
+    }
+
+    if (strippedCR)
+    {
+        m_fileFlags |= FileFlags::StrippedCR;
+    }
+
+    if (hunks.empty())
+    {
+        m_fileModifiedTime = modifiedTime;
+        m_fileSize = size;
+        return false;
+    }
+
+    // Keep the cursors on the same lines
+    struct WindowCursor
+    {
+        ZepWindow* pWindow;
+        long line;
+        long column;
+    };
+    std::vector<WindowCursor> cursors;
+    for (auto pWindow : GetEditor().FindBufferWindows(this))
+    {
+        auto cursor = pWindow->GetBufferCursor();
+        auto line = GetBufferLine(cursor);
+        ByteRange range;
+        GetLineOffsets(line, range);
+        cursors.push_back(WindowCursor{ pWindow, line, cursor.Index() - range.first });
+    }
+
+    auto byteOffset = [&](long line) {
+        if (line < long(oldLines.size()))
+        {
+            return ByteIndex(oldLines[line].offset);
+        }
+        return End().Index();
+    };
+
+    // Apply as one undo group; the hunks are last first, so the earlier offsets still hold
+    auto& undo = GetUndo();
+    auto addCommand = [&](std::shared_ptr<ZepCommand> spCommand) {
+        spCommand->Redo();
+        undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+    };
+    undo.BeginGroup();
+
+    for (auto& hunk : hunks)
+    {
+        auto start = GlyphIterator(this, byteOffset(hunk.oldBegin));
+        auto end = GlyphIterator(this, byteOffset(hunk.oldEnd));
+        auto text = newText.substr(size_t(hunk.newBegin), size_t(hunk.newEnd - hunk.newBegin));
+        if (start == end)
+        {
+            addCommand(std::make_shared<ZepCommand_Insert>(*this, start, text));
+        }
+        else if (text.empty())
+        {
+            addCommand(std::make_shared<ZepCommand_DeleteRange>(*this, start, end));
+        }
+        else
+        {
+            addCommand(std::make_shared<ZepCommand_ReplaceRange>(*this, ReplaceRangeMode::Replace, start, end, text));
+        }
+
+        // Lines after the hunk move by the number of lines it added
+        auto addedLines = long(std::count(text.begin(), text.end(), '\n')) - (hunk.oldEnd - hunk.oldBegin);
+        for (auto& cursor : cursors)
+        {
+            if (hunk.oldBegin == hunk.oldEnd)
+            {
+                // Inserted before the cursor line; but not when added to the end
+                if (cursor.line >= hunk.oldBegin && hunk.oldBegin < long(oldLines.size()))
+                {
+                    cursor.line += addedLines;
+                }
+            }
+            else if (cursor.line >= hunk.oldEnd)
+            {
+                cursor.line += addedLines;
+            }
+            else if (cursor.line >= hunk.oldBegin)
+            {
+                cursor.line = hunk.oldBegin;
+            }
+        }
+    }
+
+    for (auto& cursor : cursors)
+    {
+        ByteRange range;
+        if (GetLineOffsets(cursor.line, range))
+        {
+            cursor.pWindow->SetBufferCursor(GlyphIterator(this, std::min(range.first + cursor.column, std::max(range.first, range.second - 1))));
+        }
+    }
+
+    m_fileFlags = ZClearFlags(m_fileFlags, FileFlags::Dirty);
+    m_fileModifiedTime = modifiedTime;
+    m_fileSize = size;
+    return true;
+}
+
+// Follow the end of the file, like tail -f.  What is added to the file is added straight to the end of the buffer,
+// and windows whose cursor is on the last line move down with it.  With a line limit, the oldest lines are dropped.
+// Following isn't undoable; the undo history of edits made to the buffer is kept, unless the text it changed goes
+void ZepBuffer::SetFollow(bool follow, long maxLines)
+{
+    m_follow = follow;
+    m_followMaxLines = follow ? std::max(0l, maxLines) : 0;
+    if (m_follow)
+    {
+        UpdateFollow();
+        DropFollowLines();
+    }
+}
+
+bool ZepBuffer::IsFollowing() const
+{
+    return m_follow;
+}
+
+void ZepBuffer::UpdateFollow()
+{
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    if (m_filePath.empty() || !GetEditor().GetFileSystem().GetFileInfo(m_filePath, modifiedTime, size))
+    {
+        return;
+    }
+
+    if (modifiedTime == m_fileModifiedTime && size == m_fileSize)
+    {
+        return;
+    }
+
+    // Windows at the end keep up with it
+    std::vector<ZepWindow*> windowsAtEnd;
+    for (auto pWindow : GetEditor().FindBufferWindows(this))
+    {
+        if (GetBufferLine(pWindow->GetBufferCursor()) >= GetLineCount() - 2)
+        {
+            windowsAtEnd.push_back(pWindow);
+        }
+    }
+
+    bool strippedCR = false;
+    std::string added;
+    ChangeRecord changeRecord;
+    if (ReadAppended(size, added, strippedCR))
+    {
+        Insert(End(), added, changeRecord);
+    }
+    else if (size != m_fileSize || modifiedTime != m_fileModifiedTime)
+    {
+        // Truncated, or rotated; start again, and the history of the old text goes
+        auto text = StripCR(GetEditor().GetFileSystem().Read(m_filePath), strippedCR);
+        if (End().Index() > 0)
+        {
+            Delete(Begin(), End(), changeRecord);
+        }
+        Insert(Begin(), text, changeRecord);
+        GetUndo().Clear();
+
+        // Can't tell a log that was rotated from one that was cut short
+        GetEditor().SetCommandText("File truncated or replaced, read again: " + GetName());
+    }
+
+    if (strippedCR)
+    {
+        m_fileFlags |= FileFlags::StrippedCR;
+    }
+
+    DropFollowLines();
+
+    for (auto pWindow : windowsAtEnd)
+    {
+        pWindow->SetBufferCursor(GetLinePos(End(), LineLocation::LineBegin));
+    }
+
+    m_fileFlags = ZClearFlags(m_fileFlags, FileFlags::Dirty);
+    m_fileModifiedTime = modifiedTime;
+    m_fileSize = size;
+}
+
+// Keep to the line limit, by removing lines from the start.  That moves all of the text, so they go in batches; once
+// there are a tenth more than the limit, it goes back down to it
+void ZepBuffer::DropFollowLines()
+{
+    // The last line is the empty one after the final line end
+    auto lines = GetLineCount() - 1;
+    if (m_followMaxLines <= 0 || lines <= m_followMaxLines + m_followMaxLines / 10)
+    {
+        return;
+    }
+
+    ByteRange range;
+    if (!GetLineOffsets(lines - m_followMaxLines - 1, range))
+    {
+        return;
+    }
+
+    auto dropped = range.second;
+    std::vector<std::pair<ZepWindow*, ByteIndex>> cursors;
+    for (auto pWindow : GetEditor().FindBufferWindows(this))
+    {
+        cursors.push_back(std::make_pair(pWindow, pWindow->GetBufferCursor().Index()));
+    }
+
+    ChangeRecord changeRecord;
+    Delete(Begin(), GlyphIterator(this, dropped), changeRecord);
+    GetUndo().RemovedFromStart(dropped);
+
+    for (auto& cursor : cursors)
+    {
+        cursor.first->SetBufferCursor(GlyphIterator(this, std::max(0l, cursor.second - dropped)));
+    }
 }
 
 std::string ZepBuffer::GetDisplayName() const
@@ -879,54 +1437,67 @@ void ZepBuffer::Clear()
 // Replace the buffer with the text
 void ZepBuffer::SetText(const std::string& text, bool initFromFile)
 {
-    // First, clear it
-    Clear();
+    PreparedText prepared;
+    PrepareText(text, prepared);
+    SetText(prepared, initFromFile);
+}
 
+// Split the text into lines, and find the flags for it
+void ZepBuffer::PrepareText(const std::string& text, PreparedText& prepared)
+{
+    // Since incremental insertion of a big file into a gap buffer gives us worst case performance,
+    // We build the buffer in a separate array and assign it.  Much faster.
+    auto& input = prepared.text;
+    input.reserve(text.size());
+
+    // We remove \r, we only care about \n
     bool lastWasSpace = false;
-    if (!text.empty())
+    for (auto& ch : text)
     {
-        // Since incremental insertion of a big file into a gap buffer gives us worst case performance,
-        // We build the buffer in a separate array and assign it.  Much faster.
-        std::vector<uint8_t> input;
-
-        m_lineEnds.clear();
-
-        // Update the gap buffer with the text
-        // We remove \r, we only care about \n
-        for (auto& ch : text)
+        if (ch == '\r')
         {
-            if (ch == '\r')
+            prepared.fileFlags |= FileFlags::StrippedCR;
+        }
+        else
+        {
+            input.push_back(ch);
+            if (ch == '\n')
             {
-                m_fileFlags |= FileFlags::StrippedCR;
+                prepared.lineEnds.push_back(ByteIndex(input.size()));
+                lastWasSpace = false;
             }
-            else
+            else if (ch == '\t')
             {
-                input.push_back(ch);
-                if (ch == '\n')
-                {
-                    m_lineEnds.push_back(ByteIndex(input.size()));
-                    lastWasSpace = false;
-                }
-                else if (ch == '\t')
-                {
-                    m_fileFlags |= FileFlags::HasTabs;
-                    lastWasSpace = false;
-                }
-                else if (ch == ' ')
-                {
-                    if (lastWasSpace)
-                    {
-                        m_fileFlags |= FileFlags::HasSpaceTabs;
-                    }
-                    lastWasSpace = true;
-                }
-                else
+                prepared.fileFlags |= FileFlags::HasTabs;
+                lastWasSpace = false;
+            }
+            else if (ch == ' ')
+            {
+                if (lastWasSpace)
                 {
-                    lastWasSpace = false;
+                    prepared.fileFlags |= FileFlags::HasSpaceTabs;
                 }
+                lastWasSpace = true;
+            }
+            else
+            {
+                lastWasSpace = false;
             }
         }
-        m_workingBuffer.assign(input.begin(), input.end());
+    }
+    prepared.hash = fnv_hash_64(input.data(), input.size());
+}
+
+void ZepBuffer::SetText(PreparedText& text, bool initFromFile)
+{
+    // First, clear it
+    Clear();
+
+    m_fileFlags |= text.fileFlags;
+    if (!text.text.empty())
+    {
+        m_lineEnds = std::move(text.lineEnds);
+        m_workingBuffer.assign(text.text.begin(), text.text.end());
     }
 
     // If file is only tabs, then force tab mode
@@ -1103,6 +1674,7 @@ std::string ZepBuffer::GetBufferText(const GlyphIterator& start, const GlyphIter
 
 bool ZepBuffer::Insert(const GlyphIterator& startIndex, const std::string& str, ChangeRecord& changeRecord)
 {
+    PROFILE_ZONE(BufferInsert);
     if (!startIndex.Valid())
     {
         return false;
@@ -1112,10 +1684,8 @@ bool ZepBuffer::Insert(const GlyphIterator& startIndex, const std::string& str,
 
     sigPreInsert(*this, startIndex, str);
 
-    // We are about to modify this range
-    // TODO: Is this correct, and/or useful in any way??
-    // We aren't changing this range at all; we are shifting those characters forward and replacing the area
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startIndex, endIndex));
+    // We are about to modify the buffer; none of the text is changed, just what is after the insert point is moved on
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startIndex, startIndex));
 
     // abcdef\r\nabc<insert>dfdf\r\n
     auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startIndex.Index());
@@ -1175,6 +1745,7 @@ bool ZepBuffer::Insert(const GlyphIterator& startIndex, const std::string& str,
 
 bool ZepBuffer::Replace(const GlyphIterator& startIndex, const GlyphIterator& endIndex, std::string str, ReplaceRangeMode mode, ChangeRecord& changeRecord)
 {
+    PROFILE_ZONE(BufferReplace);
     if (!startIndex.Valid() || !endIndex.Valid())
     {
         return false;
@@ -1222,22 +1793,23 @@ bool ZepBuffer::Replace(const GlyphIterator& startIndex, const GlyphIterator& en
 // This makes a few things fall out more easily
 bool ZepBuffer::Delete(const GlyphIterator& startIndex, const GlyphIterator& endIndex, ChangeRecord& changeRecord)
 {
+    PROFILE_ZONE(BufferDelete);
     assert(startIndex.Valid());
     assert(endIndex.Valid());
 
-    // We are about to modify this range
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startIndex, endIndex));
-
-    changeRecord.strDeleted = GetBufferText(startIndex, endIndex);
-
-    sigPreDelete(*this, startIndex, endIndex);
-
     auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startIndex.Index());
     if (itrLine == m_lineEnds.end())
     {
         return false;
     }
 
+    // We are about to modify this range; every message before a change has one after it
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startIndex, endIndex));
+
+    changeRecord.strDeleted = GetBufferText(startIndex, endIndex);
+
+    sigPreDelete(*this, startIndex, endIndex);
+
     auto itrLastLine = std::upper_bound(itrLine, m_lineEnds.end(), endIndex.Index());
     auto offsetDiff = endIndex.Index() - startIndex.Index();
 
@@ -1547,6 +2119,29 @@ void ZepBuffer::SetMode(std::shared_ptr<ZepMode> spMode)
     m_spMode = spMode;
 }
 
+ZepBufferSearch& ZepBuffer::GetSearch()
+{
+    if (!m_spSearch)
+    {
+        m_spSearch = std::make_shared<ZepBufferSearch>(*this);
+    }
+    return *m_spSearch;
+}
+
+ZepBufferIO& ZepBuffer::GetIO()
+{
+    if (!m_spIO)
+    {
+        m_spIO = std::make_shared<ZepBufferIO>(*this);
+    }
+    return *m_spIO;
+}
+
+std::string ZepBuffer::GetProgressText() const
+{
+    return m_spIO ? m_spIO->GetProgressText() : std::string();
+}
+
 tRangeMarkers ZepBuffer::GetRangeMarkersOnLine(uint32_t markerTypes, long line) const
 {
     ByteRange range;
@@ -1767,14 +2362,13 @@ const std::string& ZepBuffer::GetName() const
     return m_strName;
 }
     
-std::stack<std::shared_ptr<ZepCommand>>& ZepBuffer::GetUndoStack()
+ZepUndoJournal& ZepBuffer::GetUndo()
 {
-    return m_undoStack;
-}
-
-std::stack<std::shared_ptr<ZepCommand>>& ZepBuffer::GetRedoStack()
-{
-    return m_redoStack;
+    if (!m_spUndo)
+    {
+        m_spUndo = std::make_shared<ZepUndoJournal>(*this);
+    }
+    return *m_spUndo;
 }
 
 GlyphIterator ZepBuffer::FindMatchingParen(GlyphIterator bufferCursor)
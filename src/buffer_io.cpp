@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "zep/buffer.h"
+#include "zep/buffer_io.h"
+
+#include "zep/mcommon/logger.h"
+#include "zep/mcommon/threadutils.h"
+
+namespace Zep
+{
+
+namespace
+{
+// Files are read and written this much at a time; the buffer can't change while a block is being taken out of it
+const uint64_t LoadChunkSize = 4 * 1024 * 1024;
+const size_t SaveChunkSize = 1024 * 1024;
+
+// Copy a range of the gap buffer, from either side of the gap
+void CopyText(const GapBuffer<uint8_t>& text, ByteIndex offset, ByteIndex size, std::string& out)
+{
+    auto firstSize = ByteIndex(text.m_pGapStart - text.m_pStart);
+    if (offset < firstSize)
+    {
+        auto take = std::min(size, firstSize - offset);
+        out.append((const char*)text.m_pStart + offset, size_t(take));
+        offset += take;
+        size -= take;
+    }
+
+    if (size > 0)
+    {
+        out.append((const char*)text.m_pGapEnd + (offset - firstSize), size_t(size));
+    }
+}
+} // namespace
+
+ZepBufferIO::ZepBufferIO(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor())
+    , m_buffer(buffer)
+{
+}
+
+ZepBufferIO::~ZepBufferIO()
+{
+    // A load can be dropped, but a save must get to the end of the file
+    if (m_spLoad)
+    {
+        m_spLoad->stop = true;
+        m_loadResult.wait();
+    }
+
+    if (m_spSave)
+    {
+        m_saveResult.wait();
+
+        // The buffer is going, so the save that was waiting has to happen now
+        if (m_savePending)
+        {
+            auto spJob = MakeSaveJob();
+            WriteFile(GetEditor().GetFileSystem(), *spJob);
+        }
+    }
+}
+
+void ZepBufferIO::StartLoad(const fs::path& path)
+{
+    Wait();
+
+    auto spJob = std::make_shared<LoadJob>();
+    spJob->path = path;
+    spJob->spText = std::make_shared<PreparedText>();
+
+    auto& fileSystem = GetEditor().GetFileSystem();
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    if (fileSystem.GetFileInfo(path, modifiedTime, size))
+    {
+        spJob->total = size;
+    }
+
+    m_spLoad = spJob;
+    m_loadResult = GetEditor().GetThreadPool().enqueue([spJob, &fileSystem]() {
+        ReadFile(fileSystem, *spJob);
+    });
+
+    // Without threads, it is already done
+    if (is_future_ready(m_loadResult))
+    {
+        FinishLoad();
+    }
+}
+
+bool ZepBufferIO::StartSave()
+{
+    if (m_buffer.HasFileFlags(FileFlags::Locked | FileFlags::ReadOnly) || m_buffer.GetFilePath().empty())
+    {
+        return false;
+    }
+
+    // With write behind, asking again while it is saving just saves once more when it is done
+    if (m_spSave && GetEditor().GetConfig().writeBehind)
+    {
+        m_savePending = true;
+        return true;
+    }
+
+    Wait();
+
+    auto spJob = MakeSaveJob();
+    auto& fileSystem = GetEditor().GetFileSystem();
+    m_spSave = spJob;
+    m_saveResult = GetEditor().GetThreadPool().enqueue([spJob, &fileSystem]() {
+        WriteFile(fileSystem, *spJob);
+    });
+
+    if (is_future_ready(m_saveResult))
+    {
+        FinishSave();
+    }
+    return true;
+}
+
+bool ZepBufferIO::Save(int64_t& size)
+{
+    Wait();
+
+    // Nothing can change the text while we are writing it here
+    auto spJob = MakeSaveJob();
+    WriteFile(GetEditor().GetFileSystem(), *spJob);
+    size = int64_t(spJob->written);
+    if (spJob->result)
+    {
+        m_buffer.MarkSaved(spJob->updateCount, spJob->hash, spJob->modifiedTime, spJob->fileSize);
+    }
+    return spJob->result;
+}
+
+// Point the job at the text in the gap buffer; nothing is copied
+std::shared_ptr<ZepBufferIO::SaveJob> ZepBufferIO::MakeSaveJob() const
+{
+    auto spJob = std::make_shared<SaveJob>();
+    spJob->path = m_buffer.GetFilePath();
+    spJob->updateCount = m_buffer.GetUpdateCount();
+
+    // Remove the appended 0 if necessary
+    const auto& textBuffer = m_buffer.GetWorkingBuffer();
+    auto size = textBuffer.size();
+    if (size > 0 && m_buffer.HasFileFlags(FileFlags::TerminatedWithZero))
+    {
+        size--;
+    }
+
+    spJob->pText = &textBuffer;
+    if (size > 0)
+    {
+        spJob->pieces.push_back(SavePiece{ 0, ByteIndex(size), false, {} });
+    }
+    spJob->total = size;
+
+    // Zep removes \r\n and just uses \n while modifying text; the \r's are put back as it is written
+    spJob->expandCR = m_buffer.HasFileFlags(FileFlags::StrippedCR);
+    return spJob;
+}
+
+void ZepBufferIO::ReadFile(IZepFileSystem& fileSystem, LoadJob& job)
+{
+    std::string text;
+    if (job.total == 0)
+    {
+        // Don't know how big it is, so can't show the progress
+        text = fileSystem.Read(job.path);
+    }
+    else
+    {
+        // Carry on to the end, in case it has grown since we looked
+        text.reserve(size_t(job.total));
+        while (!job.stop)
+        {
+            auto chunk = fileSystem.ReadRange(job.path, text.size(), LoadChunkSize);
+            if (chunk.empty())
+            {
+                break;
+            }
+            text.append(chunk);
+            job.done = text.size();
+        }
+    }
+
+    if (!job.stop)
+    {
+        ZepBuffer::PrepareText(text, *job.spText);
+    }
+}
+
+// Put back the \r before each \n, into a block at most twice the size
+void ZepBufferIO::ExpandCR(const FileBlock* pBlocks, size_t count, std::vector<uint8_t>& expanded)
+{
+    expanded.clear();
+    for (size_t index = 0; index < count; index++)
+    {
+        auto pText = (const uint8_t*)pBlocks[index].pData;
+        auto pEnd = pText + pBlocks[index].size;
+        while (pText < pEnd)
+        {
+            auto pNewLine = (const uint8_t*)memchr(pText, '\n', pEnd - pText);
+            auto pLineEnd = pNewLine ? pNewLine : pEnd;
+            expanded.insert(expanded.end(), pText, pLineEnd);
+            if (!pNewLine)
+            {
+                break;
+            }
+            expanded.push_back('\r');
+            expanded.push_back('\n');
+            pText = pNewLine + 1;
+        }
+    }
+}
+
+void ZepBufferIO::WriteFile(IZepFileSystem& fileSystem, SaveJob& job)
+{
+    auto spWriter = fileSystem.OpenWriter(job.path);
+    if (!spWriter)
+    {
+        ZLOG(ERROR, "Failed to open for writing: " << job.path.string());
+        return;
+    }
+
+    // The same space is used for every block; the \r's are only put back for CRLF files
+    std::string chunk;
+    chunk.reserve(SaveChunkSize);
+    std::vector<uint8_t> expanded;
+    if (job.expandCR)
+    {
+        expanded.reserve(SaveChunkSize * 2);
+    }
+
+    bool ok = true;
+    for (;;)
+    {
+        // Take the next block while the buffer is left alone; it can change again while the block is written
+        chunk.clear();
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.changed.wait(lock, [&job]() { return !job.changing; });
+            while (!job.pieces.empty() && chunk.size() < SaveChunkSize)
+            {
+                auto& piece = job.pieces.front();
+                auto take = std::min(piece.size, ByteIndex(SaveChunkSize - chunk.size()));
+                if (piece.copied)
+                {
+                    chunk.append(piece.text, size_t(piece.offset), size_t(take));
+                }
+                else
+                {
+                    CopyText(*job.pText, piece.offset, take, chunk);
+                }
+
+                piece.offset += take;
+                piece.size -= take;
+                if (piece.size == 0)
+                {
+                    job.pieces.pop_front();
+                }
+            }
+        }
+
+        if (chunk.empty())
+        {
+            break;
+        }
+
+        job.hash = fnv_hash_64(chunk.data(), chunk.size(), job.hash);
+
+        FileBlock block{ chunk.data(), chunk.size() };
+        if (job.expandCR)
+        {
+            ExpandCR(&block, 1, expanded);
+            block = FileBlock{ expanded.data(), expanded.size() };
+        }
+
+        ok = spWriter->Write(&block, 1);
+        if (!ok)
+        {
+            break;
+        }
+
+        job.written += block.size;
+        job.done += chunk.size();
+    }
+
+    job.result = spWriter->Close() && ok;
+    if (job.result)
+    {
+        fileSystem.GetFileInfo(job.path, job.modifiedTime, job.fileSize);
+    }
+}
+
+// Split the pieces still in the buffer at the edges of an edit, and copy out the ones inside it
+void ZepBufferIO::SplitPieces(SaveJob& job, ByteIndex start, ByteIndex end)
+{
+    for (size_t index = 0; index < job.pieces.size(); index++)
+    {
+        auto offset = job.pieces[index].offset;
+        auto pieceEnd = offset + job.pieces[index].size;
+
+        // An insert only splits the piece it lands inside
+        bool overlaps = start < pieceEnd && end > offset;
+        bool inside = start > offset && start < pieceEnd;
+        if (job.pieces[index].copied || !(overlaps || inside))
+        {
+            continue;
+        }
+
+        auto copyStart = std::max(start, offset);
+        auto copyEnd = std::min(end, pieceEnd);
+
+        std::vector<SavePiece> split;
+        if (copyStart > offset)
+        {
+            split.push_back(SavePiece{ offset, copyStart - offset, false, {} });
+        }
+        if (copyEnd > copyStart)
+        {
+            SavePiece copy{ 0, copyEnd - copyStart, true, {} };
+            CopyText(*job.pText, copyStart, copyEnd - copyStart, copy.text);
+            split.push_back(std::move(copy));
+        }
+        if (pieceEnd > copyEnd)
+        {
+            split.push_back(SavePiece{ copyEnd, pieceEnd - copyEnd, false, {} });
+        }
+
+        job.pieces.erase(job.pieces.begin() + index);
+        job.pieces.insert(job.pieces.begin() + index, std::make_move_iterator(split.begin()), std::make_move_iterator(split.end()));
+        index += split.size() - 1;
+    }
+}
+
+// Text was added or removed at a point; the pieces in the buffer after it have moved
+void ZepBufferIO::MovePieces(SaveJob& job, ByteIndex from, ByteIndex distance)
+{
+    for (auto& piece : job.pieces)
+    {
+        if (!piece.copied && piece.offset >= from)
+        {
+            piece.offset += distance;
+        }
+    }
+}
+
+void ZepBufferIO::FinishLoad()
+{
+    auto spJob = m_spLoad;
+    m_loadResult.wait();
+    m_spLoad.reset();
+
+    m_buffer.SetLoadedText(*spJob->spText);
+    GetEditor().RequestRefresh();
+}
+
+void ZepBufferIO::FinishSave()
+{
+    auto spJob = m_spSave;
+    m_saveResult.wait();
+    m_spSave.reset();
+
+    std::ostringstream strText;
+    if (spJob->result)
+    {
+        m_buffer.MarkSaved(spJob->updateCount, spJob->hash, spJob->modifiedTime, spJob->fileSize);
+        strText << "Wrote " << spJob->path.string() << ", " << spJob->written << " bytes";
+    }
+    else
+    {
+        strText << "Failed to save: " << m_buffer.GetDisplayName() << " at: " << spJob->path.string();
+    }
+    GetEditor().SetCommandText(strText.str());
+    GetEditor().RequestRefresh();
+
+    // Everything asked for since it started goes in one more save
+    if (m_savePending)
+    {
+        m_savePending = false;
+        StartSave();
+    }
+}
+
+bool ZepBufferIO::IsBusy() const
+{
+    return m_spLoad || m_spSave;
+}
+
+bool ZepBufferIO::IsLoading() const
+{
+    return bool(m_spLoad);
+}
+
+void ZepBufferIO::Wait()
+{
+    // Finishing a save can start the next one
+    while (IsBusy())
+    {
+        if (m_spLoad)
+        {
+            FinishLoad();
+        }
+
+        if (m_spSave)
+        {
+            FinishSave();
+        }
+    }
+}
+
+std::string ZepBufferIO::GetProgressText() const
+{
+    auto progress = [](const char* pName, uint64_t done, uint64_t total) {
+        auto percent = total == 0 ? 100 : (done * 100) / total;
+        return std::string(pName) + " " + std::to_string(std::min(percent, uint64_t(100))) + "%";
+    };
+
+    if (m_spLoad)
+    {
+        return progress("Loading", m_spLoad->done, m_spLoad->total);
+    }
+    else if (m_spSave)
+    {
+        return progress("Saving", m_spSave->done, m_spSave->total);
+    }
+    return std::string();
+}
+
+void ZepBufferIO::Notify(std::shared_ptr<ZepMessage> payload)
+{
+    if (payload->messageId == Msg::Tick)
+    {
+        if (m_spLoad && is_future_ready(m_loadResult))
+        {
+            FinishLoad();
+        }
+
+        if (m_spSave && is_future_ready(m_saveResult))
+        {
+            FinishSave();
+        }
+
+        // Keep the progress moving
+        if (IsBusy())
+        {
+            GetEditor().RequestRefresh();
+        }
+    }
+    else if (payload->messageId == Msg::Buffer)
+    {
+        auto spBufferMsg = std::static_pointer_cast<BufferMessage>(payload);
+        if (spBufferMsg->pBuffer != &m_buffer || spBufferMsg->type == BufferMessageType::MarkersChanged || !m_spSave)
+        {
+            return;
+        }
+
+        auto& job = *m_spSave;
+        auto start = spBufferMsg->startLocation.Index();
+        auto end = spBufferMsg->endLocation.Index();
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            switch (spBufferMsg->type)
+            {
+            // The text is about to move; copy out what the edit touches, and the thread waits until it is done
+            case BufferMessageType::PreBufferChange:
+                SplitPieces(job, start, end);
+                job.changing = true;
+                return;
+            case BufferMessageType::TextAdded:
+                MovePieces(job, start, end - start);
+                break;
+            case BufferMessageType::TextDeleted:
+                MovePieces(job, end, start - end);
+                break;
+            default:
+                break;
+            }
+            job.changing = false;
+        }
+        job.changed.notify_all();
+    }
+}
+
+} // namespace Zep
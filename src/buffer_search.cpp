@@ -0,0 +1,460 @@
+#include "zep/buffer_search.h"
+#include "zep/buffer.h"
+
+#include "zep/mcommon/logger.h"
+#include "zep/mcommon/threadutils.h"
+
+namespace Zep
+{
+
+namespace
+{
+// Size of the blocks of text that are searched in one go
+const ByteIndex SearchChunkSize = 64 * 1024;
+} // namespace
+
+ZepBufferSearch::ZepBufferSearch(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor())
+    , m_buffer(buffer)
+{
+}
+
+ZepBufferSearch::~ZepBufferSearch()
+{
+    Interrupt();
+    Wait();
+}
+
+bool ZepBufferSearch::Start(const std::string& pattern, const ByteRange& firstRange, std::string& error)
+{
+    Clear();
+
+    auto spRun = std::make_shared<SearchRun>();
+    if (!spRun->regex.Compile(pattern, error))
+    {
+        return false;
+    }
+
+    m_spRun = spRun;
+    m_firstRange = firstRange;
+    Restart();
+    return true;
+}
+
+// Throw away the old chunks, and have the pool search them all again
+void ZepBufferSearch::Restart()
+{
+    m_chunkEnd = m_buffer.End().Index();
+    auto count = size_t((m_chunkEnd + SearchChunkSize - 1) / SearchChunkSize);
+    {
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        m_chunks.assign(count, nullptr);
+        m_chunksSearched = 0;
+        m_chunkUpdateCount = m_buffer.GetUpdateCount();
+    }
+    Resume();
+}
+
+// Have the pool search the chunks which are not done yet; the first range is searched first
+void ZepBufferSearch::Resume()
+{
+    std::vector<size_t> order;
+    {
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        if (m_chunks.empty())
+        {
+            return;
+        }
+
+        auto count = m_chunks.size();
+        auto first = std::min(size_t(std::max(m_firstRange.first, 0l) / SearchChunkSize), count - 1);
+        for (size_t offset = 0; offset < count; offset++)
+        {
+            auto index = (first + offset) % count;
+            if (!m_chunks[index])
+            {
+                order.push_back(index);
+            }
+        }
+    }
+
+    if (order.empty())
+    {
+        return;
+    }
+
+    // If the pool has no threads, this will end up serial
+    auto spRun = m_spRun;
+    auto textEnd = m_chunkEnd;
+    m_searchResults.push_back(GetEditor().GetThreadPool().enqueue_with(TaskPriority::Interactive, spRun->cancel, [=]() {
+        SearchChunks(spRun, order, textEnd);
+    }));
+}
+
+// If the text has changed since the chunks were searched, start again with the same pattern.
+// If the run was only stopped for a change which didn't happen, the chunks are still good; just finish them
+void ZepBufferSearch::EnsureCurrent()
+{
+    if (!m_spRun)
+    {
+        return;
+    }
+
+    auto changed = m_chunkUpdateCount != m_buffer.GetUpdateCount();
+    if (!changed && !m_spRun->cancel.is_cancelled())
+    {
+        return;
+    }
+
+    Interrupt();
+    auto spRun = std::make_shared<SearchRun>();
+    spRun->regex = m_spRun->regex;
+    m_spRun = spRun;
+    if (changed)
+    {
+        Restart();
+    }
+    else
+    {
+        Resume();
+    }
+}
+
+// Chunks begin at the start of the line containing their nominal start.
+// The start of each chunk only depends on the text, so threads will always agree on where they are.
+ByteIndex ZepBufferSearch::ChunkStart(size_t index, ByteIndex textEnd) const
+{
+    auto nominal = ByteIndex(index) * SearchChunkSize;
+    if (nominal == 0 || nominal >= textEnd)
+    {
+        return std::min(nominal, textEnd);
+    }
+
+    const uint8_t newLine = '\n';
+    auto found = m_buffer.GetWorkingBuffer().find(size_t(nominal - 1), size_t(textEnd), &newLine, &newLine + 1);
+    return std::min(ByteIndex(found) + 1, textEnd);
+}
+
+size_t ZepBufferSearch::ChunkFromLocation(ByteIndex location) const
+{
+    if (m_chunks.empty())
+    {
+        return 0;
+    }
+
+    location = std::max(0l, std::min(location, m_chunkEnd));
+    auto index = std::min(size_t(location / SearchChunkSize), m_chunks.size() - 1);
+
+    // Long lines can push a chunk start past the location
+    while (index > 0 && ChunkStart(index, m_chunkEnd) > location)
+    {
+        index--;
+    }
+    return index;
+}
+
+// A pattern with a '\n' in it can match across the end of the chunk, so the search carries on through the next one.
+// Only the matches which start in this chunk are kept; a match which is longer than a whole chunk is cut short
+std::shared_ptr<const ZepBufferSearch::SearchChunk> ZepBufferSearch::SearchChunkRange(const SearchRun& run, size_t index, ByteIndex textEnd) const
+{
+    auto spChunk = std::make_shared<SearchChunk>();
+    spChunk->begin = ChunkStart(index, textEnd);
+    spChunk->end = ChunkStart(index + 1, textEnd);
+    if (spChunk->end <= spChunk->begin)
+    {
+        return spChunk;
+    }
+    auto searchEnd = ChunkStart(index + 2, textEnd);
+
+    // Search in place unless the range crosses the gap
+    const auto& textBuffer = m_buffer.GetWorkingBuffer();
+    auto gapOffset = ByteIndex(textBuffer.m_pGapStart - textBuffer.m_pStart);
+    std::vector<uint8_t> scratch;
+    const uint8_t* pData;
+    if (searchEnd <= gapOffset)
+    {
+        pData = textBuffer.m_pStart + spChunk->begin;
+    }
+    else if (spChunk->begin >= gapOffset)
+    {
+        pData = textBuffer.m_pGapEnd + (spChunk->begin - gapOffset);
+    }
+    else
+    {
+        scratch.assign(textBuffer.begin() + spChunk->begin, textBuffer.begin() + searchEnd);
+        pData = scratch.data();
+    }
+
+    auto begin = spChunk->begin;
+    auto end = spChunk->end;
+    auto& matches = spChunk->matches;
+    run.regex.FindAll(pData, pData + (searchEnd - begin), [&](const uint8_t* pMatchBegin, const uint8_t* pMatchEnd) {
+        auto match = ByteRange(begin + ByteIndex(pMatchBegin - pData), begin + ByteIndex(pMatchEnd - pData));
+        if (match.first >= end)
+        {
+            return false;
+        }
+        matches.push_back(match);
+        return true;
+    });
+    return spChunk;
+}
+
+void ZepBufferSearch::SearchChunks(std::shared_ptr<SearchRun> spRun, std::vector<size_t> order, ByteIndex textEnd)
+{
+    for (auto index : order)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_chunkMutex);
+            if (spRun->cancel.is_cancelled())
+            {
+                return;
+            }
+
+            // Already found on demand
+            if (m_chunks[index])
+            {
+                continue;
+            }
+        }
+
+        auto spChunk = SearchChunkRange(*spRun, index, textEnd);
+
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        if (spRun->cancel.is_cancelled())
+        {
+            return;
+        }
+
+        if (!m_chunks[index])
+        {
+            m_chunks[index] = spChunk;
+            m_chunksSearched++;
+        }
+    }
+}
+
+std::shared_ptr<const ZepBufferSearch::SearchChunk> ZepBufferSearch::GetChunk(size_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        if (m_chunks[index])
+        {
+            return m_chunks[index];
+        }
+    }
+
+    // Not searched yet; do it now instead of waiting for the thread
+    auto spChunk = SearchChunkRange(*m_spRun, index, m_chunkEnd);
+
+    std::lock_guard<std::mutex> lock(m_chunkMutex);
+    if (!m_chunks[index])
+    {
+        m_chunks[index] = spChunk;
+        m_chunksSearched++;
+    }
+    return m_chunks[index];
+}
+
+// The next chunk searches from its own start, so it can find matches inside the last one which ran into it; skip those
+std::vector<ByteRange>::const_iterator ZepBufferSearch::FirstMatch(size_t index, const SearchChunk& chunk)
+{
+    if (index == 0 || chunk.matches.empty())
+    {
+        return chunk.matches.begin();
+    }
+
+    auto spPrevious = GetChunk(index - 1);
+    if (spPrevious->matches.empty() || spPrevious->matches.back().second <= chunk.begin)
+    {
+        return chunk.matches.begin();
+    }
+
+    return std::lower_bound(chunk.matches.begin(), chunk.matches.end(), spPrevious->matches.back().second, [](const ByteRange& match, ByteIndex location) {
+        return match.first < location;
+    });
+}
+
+void ZepBufferSearch::GetMatches(const ByteRange& range, std::vector<ByteRange>& matches)
+{
+    EnsureCurrent();
+    if (!m_spRun || m_chunks.empty() || range.second <= range.first)
+    {
+        return;
+    }
+
+    // A match from the chunk before can run into the range
+    auto start = ChunkFromLocation(range.first);
+    for (auto index = start > 0 ? start - 1 : start; index < m_chunks.size(); index++)
+    {
+        auto spChunk = GetChunk(index);
+        if (spChunk->begin >= range.second)
+        {
+            break;
+        }
+
+        // Matches don't overlap, so they are sorted by both ends; an empty match counts as the character after it
+        auto itr = std::upper_bound(FirstMatch(index, *spChunk), spChunk->matches.end(), range.first, [](ByteIndex location, const ByteRange& match) {
+            return location < std::max(match.second, match.first + 1);
+        });
+
+        for (; itr != spChunk->matches.end() && itr->first < range.second; itr++)
+        {
+            matches.push_back(*itr);
+        }
+    }
+}
+
+bool ZepBufferSearch::FindNext(ByteIndex location, Direction dir, ByteRange& match)
+{
+    EnsureCurrent();
+    if (!m_spRun || m_chunks.empty())
+    {
+        return false;
+    }
+
+    auto byStart = [](const ByteRange& match, ByteIndex location) {
+        return match.first < location;
+    };
+
+    auto start = ChunkFromLocation(location);
+    if (dir == Direction::Forward)
+    {
+        for (auto index = start; index < m_chunks.size(); index++)
+        {
+            auto spChunk = GetChunk(index);
+            auto itr = std::lower_bound(FirstMatch(index, *spChunk), spChunk->matches.end(), location + 1, byStart);
+            if (itr != spChunk->matches.end())
+            {
+                match = *itr;
+                return true;
+            }
+        }
+
+        // Wrap around
+        for (size_t index = 0; index <= start; index++)
+        {
+            auto spChunk = GetChunk(index);
+            auto itr = FirstMatch(index, *spChunk);
+            if (itr != spChunk->matches.end())
+            {
+                match = *itr;
+                return true;
+            }
+        }
+    }
+    else
+    {
+        for (auto index = start + 1; index-- > 0;)
+        {
+            auto spChunk = GetChunk(index);
+            auto itrFirst = FirstMatch(index, *spChunk);
+            auto itr = std::lower_bound(itrFirst, spChunk->matches.end(), location, byStart);
+            if (itr != itrFirst)
+            {
+                match = *(itr - 1);
+                return true;
+            }
+        }
+
+        for (auto index = m_chunks.size(); index-- > start;)
+        {
+            auto spChunk = GetChunk(index);
+            if (FirstMatch(index, *spChunk) != spChunk->matches.end())
+            {
+                match = spChunk->matches.back();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool ZepBufferSearch::IsComplete() const
+{
+    std::lock_guard<std::mutex> lock(m_chunkMutex);
+    return m_spRun && m_chunkUpdateCount == m_buffer.GetUpdateCount() && m_chunksSearched == m_chunks.size();
+}
+
+void ZepBufferSearch::SetCurrentMatch(const ByteRange& match)
+{
+    m_currentMatch = match;
+}
+
+const ByteRange& ZepBufferSearch::GetCurrentMatch() const
+{
+    return m_currentMatch;
+}
+
+bool ZepBufferSearch::IsVisible() const
+{
+    return m_spRun && !m_hidden;
+}
+
+void ZepBufferSearch::Hide()
+{
+    m_hidden = true;
+    m_currentMatch = ByteRange(-1, -1);
+}
+
+void ZepBufferSearch::Interrupt()
+{
+    // Threads will notice and stop at the end of the current chunk
+    if (m_spRun)
+    {
+        m_spRun->cancel.cancel();
+    }
+}
+
+void ZepBufferSearch::Wait()
+{
+    for (auto& result : m_searchResults)
+    {
+        result.wait();
+    }
+    m_searchResults.clear();
+}
+
+void ZepBufferSearch::Clear()
+{
+    Interrupt();
+    m_spRun.reset();
+    {
+        std::lock_guard<std::mutex> lock(m_chunkMutex);
+        m_chunks.clear();
+        m_chunksSearched = 0;
+    }
+    m_currentMatch = ByteRange(-1, -1);
+    m_hidden = false;
+}
+
+void ZepBufferSearch::Notify(std::shared_ptr<ZepMessage> payload)
+{
+    if (payload->messageId == Msg::Tick)
+    {
+        // Forget about finished searches
+        m_searchResults.erase(std::remove_if(m_searchResults.begin(), m_searchResults.end(), [](std::future<void>& result) {
+            return is_future_ready(result);
+        }),
+            m_searchResults.end());
+
+        // A change was on the way, but didn't happen; finish the search which was stopped for it
+        if (m_spRun && m_spRun->cancel.is_cancelled() && m_chunkUpdateCount == m_buffer.GetUpdateCount())
+        {
+            EnsureCurrent();
+        }
+    }
+    else if (payload->messageId == Msg::Buffer)
+    {
+        auto spBufferMsg = std::static_pointer_cast<BufferMessage>(payload);
+        if (spBufferMsg->pBuffer == &m_buffer && spBufferMsg->type == BufferMessageType::PreBufferChange)
+        {
+            // The threads are reading the text, so they must finish before it changes.
+            // The matches are found again when next asked for, or the search carries on at the next tick if nothing changed
+            Interrupt();
+            Wait();
+        }
+    }
+}
+
+} // namespace Zep
@@ -28,6 +28,7 @@ void ZepCommand_DeleteRange::Redo()
     if (m_startIndex != m_endIndex)
     {
         m_changeRecord.Clear();
+        m_changeRecord.itrStart = m_startIndex;
         m_buffer.Delete(m_startIndex, m_endIndex, m_changeRecord);
     }
 }
@@ -53,6 +54,7 @@ ZepCommand_Insert::ZepCommand_Insert(ZepBuffer& buffer, const GlyphIterator& sta
 void ZepCommand_Insert::Redo()
 {
     m_changeRecord.Clear();
+    m_changeRecord.itrStart = m_startIndex;
     bool ret = m_buffer.Insert(m_startIndex, m_strInsert, m_changeRecord);
     assert(ret);
     if (ret == true)
@@ -90,7 +92,11 @@ void ZepCommand_ReplaceRange::Redo()
     if (m_startIndex != m_endIndex)
     {
         m_changeRecord.Clear();
+        m_changeRecord.itrStart = m_startIndex;
         m_buffer.Replace(m_startIndex, m_endIndex, m_strReplace, m_mode, m_changeRecord);
+
+        // A fill writes over each character in place
+        m_changeRecord.strInserted = m_mode == ReplaceRangeMode::Fill ? std::string(m_changeRecord.strDeleted.size(), m_strReplace[0]) : m_strReplace;
     }
 }
 
@@ -1,6 +1,8 @@
 #include "zep/editor.h"
+#include "zep/buffer_io.h"
 #include "zep/filesystem.h"
 #include "zep/indexer.h"
+#include "zep/mode_grep.h"
 #include "zep/mode_search.h"
 #include "zep/mode_standard.h"
 #include "zep/mode_tree.h"
@@ -85,6 +87,9 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const fs::path& configRoot, uint32_t
     }
 #endif
 
+    // The thread the editor runs on, in traces
+    profile_set_thread_name("Main");
+
     if (m_flags & ZepEditorFlags::DisableThreads)
     {
         m_threadPool = std::make_unique<ThreadPool>(1);
@@ -123,11 +128,6 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const fs::path& configRoot, uint32_t
     m_editorRegion->children.push_back(m_tabContentRegion);
     m_editorRegion->children.push_back(m_commandRegion);
 
-#ifdef IMPLEMENTED_INDEXER
-    m_indexer = std::make_shared<Indexer>(*this);
-    m_indexer->StartIndexing();
-#endif
-
     Reset();
 }
 
@@ -144,14 +144,30 @@ ThreadPool& ZepEditor::GetThreadPool() const
     return *m_threadPool;
 }
 
+Indexer* ZepEditor::GetIndexer() const
+{
+    return m_indexer.get();
+}
+
 void ZepEditor::OnFileChanged(const fs::path& path)
 {
-    if (path.filename() == "zep.cfg")
+    FileChange change;
+    change.path = path;
+    change.isDirectory = GetFileSystem().IsDirectory(path);
+    BroadcastFileChange(change);
+}
+
+// Tell the buffers and the index; and reload the config if it changed
+void ZepEditor::BroadcastFileChange(const FileChange& change)
+{
+    if (change.path.filename() == "zep.cfg" && change.type != FileChange::Type::Deleted)
     {
         ZLOG(INFO, "Reloading config");
-        LoadConfig(path);
+        LoadConfig(change.path);
         Broadcast(std::make_shared<ZepMessage>(Msg::ConfigChanged));
     }
+
+    Broadcast(std::make_shared<FileChangeMessage>(change));
 }
 
 // If you pass a valid path to a 'zep.cfg' file, then editor settings will serialize from that
@@ -205,6 +221,13 @@ void ZepEditor::LoadConfig(std::shared_ptr<cpptoml::table> spConfig)
         m_config.shortTabNames = spConfig->get_qualified_as<bool>("editor.short_tab_names").value_or(false);
         m_config.tabToneColors = spConfig->get_qualified_as<bool>("editor.tab_tone_colors").value_or(false);
         m_config.searchGitRoot = spConfig->get_qualified_as<bool>("search.search_git_root").value_or(true);
+        m_config.atomicSave = spConfig->get_qualified_as<bool>("editor.atomic_save").value_or(true);
+        m_config.writeBehind = spConfig->get_qualified_as<bool>("editor.write_behind").value_or(true);
+        m_config.undoBufferMemory = uint64_t(spConfig->get_qualified_as<int64_t>("editor.undo_buffer_memory_mb").value_or(64)) * 1024 * 1024;
+        m_config.undoTotalMemory = uint64_t(spConfig->get_qualified_as<int64_t>("editor.undo_memory_mb").value_or(256)) * 1024 * 1024;
+        m_config.persistentUndo = spConfig->get_qualified_as<bool>("editor.persistent_undo").value_or(true);
+        m_config.projectIndex = spConfig->get_qualified_as<bool>("editor.project_index").value_or(true);
+        m_config.profileZones = spConfig->get_qualified_as<bool>("editor.profile_zones").value_or(false);
         auto styleStr = string_tolower(spConfig->get_qualified_as<std::string>("editor.style").value_or("normal"));
         if (styleStr == "normal")
         {
@@ -216,7 +239,12 @@ void ZepEditor::LoadConfig(std::shared_ptr<cpptoml::table> spConfig)
         }
 
         // Forward settings to file system
-        GetFileSystem().SetFlags(m_config.searchGitRoot ? ZepFileSystemFlags::SearchGitRoot : 0);
+        GetFileSystem().SetFlags((m_config.searchGitRoot ? ZepFileSystemFlags::SearchGitRoot : 0) | (m_config.atomicSave ? ZepFileSystemFlags::AtomicSave : 0));
+
+        if (m_config.profileZones)
+        {
+            profile_enable(true);
+        }
     }
     catch (...)
     {
@@ -232,14 +260,20 @@ void ZepEditor::SaveConfig(std::shared_ptr<cpptoml::table> spConfig)
         spConfig->insert("editor", table);
     }
 
+    table->insert("atomic_save", m_config.atomicSave);
     table->insert("autohide_command_region", m_config.autoHideCommandRegion);
     table->insert("background_fade_time", (double)m_config.backgroundFadeTime);
     table->insert("background_fade_wait", (double)m_config.backgroundFadeWait);
     table->insert("cursor_line_solid", m_config.cursorLineSolid);
     table->insert("line_margin_bottom", m_config.lineMargins.y);
     table->insert("line_margin_top", m_config.lineMargins.x);
+    table->insert("persistent_undo", m_config.persistentUndo);
+    table->insert("profile_zones", m_config.profileZones);
+    table->insert("project_index", m_config.projectIndex);
     table->insert("short_tab_names", m_config.shortTabNames);
     table->insert("tab_tone_colors", m_config.tabToneColors);
+    table->insert("undo_buffer_memory_mb", int64_t(m_config.undoBufferMemory / (1024 * 1024)));
+    table->insert("undo_memory_mb", int64_t(m_config.undoTotalMemory / (1024 * 1024)));
     table->insert("search_git_root", m_config.searchGitRoot);
     table->insert("show_indicator_region", m_config.showIndicatorRegion);
     table->insert("show_line_numbers", m_config.showLineNumbers);
@@ -247,6 +281,7 @@ void ZepEditor::SaveConfig(std::shared_ptr<cpptoml::table> spConfig)
     table->insert("show_scrollbar", m_config.showScrollBar);
     table->insert("widget_margin_bottom", m_config.widgetMargins.y);
     table->insert("widget_margin_top", m_config.widgetMargins.x);
+    table->insert("write_behind", m_config.writeBehind);
 
     table->insert("style", m_config.style == EditorStyle::Minimal ? "minimal" : "normal");
 
@@ -283,17 +318,14 @@ void ZepEditor::SaveBuffer(ZepBuffer& buffer)
     {
         strText << "Error: No file name";
     }
+    else if (buffer.GetIO().StartSave())
+    {
+        // Written on the thread pool; the result is shown when it is done
+        return;
+    }
     else
     {
-        int64_t size;
-        if (!buffer.Save(size))
-        {
-            strText << "Failed to save: " << buffer.GetDisplayName() << " at: " << buffer.GetFilePath().string();
-        }
-        else
-        {
-            strText << "Wrote " << buffer.GetFilePath().string() << ", " << size << " bytes";
-        }
+        strText << "Failed to save: " << buffer.GetDisplayName() << " at: " << buffer.GetFilePath().string();
     }
     SetCommandText(strText.str());
 }
@@ -432,6 +464,29 @@ ZepWindow* ZepEditor::AddSearch()
     return pSearchWindow;
 }
 
+ZepWindow* ZepEditor::AddGrep(const std::string& pattern)
+{
+    if (!GetActiveTabWindow())
+    {
+        return nullptr;
+    }
+
+    auto pGrepBuffer = GetEmptyBuffer("Grep", FileFlags::Locked | FileFlags::ReadOnly);
+    pGrepBuffer->SetBufferType(BufferType::Search);
+
+    auto pActiveWindow = GetActiveTabWindow()->GetActiveWindow();
+    bool hasGit = false;
+    auto searchPath = GetFileSystem().GetSearchRoot(pActiveWindow->GetBuffer().GetFilePath(), hasGit);
+
+    auto pGrepWindow = GetActiveTabWindow()->AddWindow(pGrepBuffer, nullptr, RegionLayoutType::VBox);
+    pGrepWindow->SetWindowFlags(pGrepWindow->GetWindowFlags() | WindowFlags::Modal);
+
+    auto pMode = std::make_shared<ZepMode_Grep>(*this, *pActiveWindow, *pGrepWindow, searchPath, pattern);
+    pGrepBuffer->SetMode(pMode);
+    pMode->Begin(pGrepWindow);
+    return pGrepWindow;
+}
+
 ZepTabWindow* ZepEditor::EnsureTab()
 {
     if (m_tabWindows.empty())
@@ -466,6 +521,7 @@ ZepBuffer* ZepEditor::InitWithFileOrDir(const std::string& str)
         {
             // Remember the working directory
             fs.SetWorkingDirectory(startPath);
+            StartProjectIndex();
             return &GetActiveTabWindow()->GetActiveWindow()->GetBuffer();
         }
         else
@@ -479,9 +535,32 @@ ZepBuffer* ZepEditor::InitWithFileOrDir(const std::string& str)
         }
     }
 
+    StartProjectIndex();
     return InitWithFile(str);
 }
 
+// Index the git project the working directory is in; text and files outside of a project don't get one
+void ZepEditor::StartProjectIndex()
+{
+    if (!m_config.projectIndex)
+    {
+        return;
+    }
+
+    bool foundGit = false;
+    auto root = GetFileSystem().GetSearchRoot(GetFileSystem().GetWorkingDirectory(), foundGit);
+    if (!foundGit || (m_indexer && m_indexer->GetSearchRoot() == root))
+    {
+        return;
+    }
+
+    m_indexer = std::make_shared<Indexer>(*this);
+    if (!m_indexer->StartIndexing(root))
+    {
+        m_indexer.reset();
+    }
+}
+
 ZepBuffer* ZepEditor::InitWithFile(const std::string& str)
 {
     fs::path startPath(str);
@@ -740,6 +819,9 @@ void ZepEditor::RegisterGlobalMode(std::shared_ptr<ZepMode> spMode)
 void ZepEditor::RegisterExCommand(std::shared_ptr<ZepExCommand> spCommand)
 {
     m_mapExCommands[spCommand->ExCommandName()] = spCommand;
+
+    // Its keys are searched with every mode's
+    keymap_changed();
 }
 
 ZepExCommand* ZepEditor::FindExCommand(const std::string& strName)
@@ -895,6 +977,7 @@ void ZepEditor::RegisterSyntaxFactory(const std::vector<std::string>& mappings,
 // Inform clients of an event in the buffer
 bool ZepEditor::Broadcast(std::shared_ptr<ZepMessage> message)
 {
+    PROFILE_ZONE(Broadcast);
     Notify(message);
     if (message->handled)
         return true;
@@ -1077,10 +1160,19 @@ std::string ZepEditor::GetCommandText() const
 
 void ZepEditor::SetCommandText(const std::string& strCommand)
 {
-    m_commandLines = string_split(strCommand, "\n\r");
-    if (m_commandLines.empty())
+    // Cleared for every key typed, so the line is kept rather than split out again
+    if (strCommand.empty())
+    {
+        m_commandLines.resize(1);
+        m_commandLines[0].clear();
+    }
+    else
     {
-        m_commandLines.push_back("");
+        m_commandLines = string_split(strCommand, "\n\r");
+        if (m_commandLines.empty())
+        {
+            m_commandLines.push_back("");
+        }
     }
     m_bRegionsChanged = true;
 }
@@ -1090,8 +1182,26 @@ void ZepEditor::RequestRefresh()
     m_bPendingRefresh = true;
 }
 
+void ZepEditor::HoldCursorColumns(bool hold)
+{
+    m_holdCursorColumns = hold;
+}
+
+bool ZepEditor::CursorColumnsHeld() const
+{
+    return m_holdCursorColumns;
+}
+
 bool ZepEditor::RefreshRequired()
 {
+    // Pick up changes to watched files
+    std::vector<FileChange> changes;
+    GetFileSystem().ReadChanges(changes);
+    for (auto& change : changes)
+    {
+        BroadcastFileChange(change);
+    }
+
     // Allow any components to update themselves
     Broadcast(std::make_shared<ZepMessage>(Msg::Tick));
 
@@ -1160,6 +1270,7 @@ void ZepEditor::UpdateSize()
 
 void ZepEditor::Display()
 {
+    PROFILE_ZONE(EditorDisplay);
     UpdateWindowState();
 
     if (m_bRegionsChanged)
@@ -8,10 +8,66 @@
 
 #undef ERROR
 
+namespace Zep
+{
+
+namespace
+{
+// For file systems that can only write a whole file at once
+class ZepFileWriterBuffered : public IZepFileWriter
+{
+public:
+    ZepFileWriterBuffered(IZepFileSystem& fileSystem, const fs::path& path)
+        : m_fileSystem(fileSystem)
+        , m_path(path)
+    {
+    }
+
+    virtual bool Write(const FileBlock* pBlocks, size_t count) override
+    {
+        for (size_t index = 0; index < count; index++)
+        {
+            m_data.append((const char*)pBlocks[index].pData, pBlocks[index].size);
+        }
+        return true;
+    }
+
+    virtual bool Close() override
+    {
+        return m_fileSystem.Write(m_path, m_data.data(), m_data.size());
+    }
+
+private:
+    IZepFileSystem& m_fileSystem;
+    fs::path m_path;
+    std::string m_data;
+};
+} // namespace
+
+std::unique_ptr<IZepFileWriter> IZepFileSystem::OpenWriter(const fs::path& filePath)
+{
+    return std::make_unique<ZepFileWriterBuffered>(*this, filePath);
+}
+
+} // namespace Zep
+
 #if defined(ZEP_FEATURE_CPP_FILE_SYSTEM)
 
 #include <filesystem>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 #ifdef __APPLE__
 namespace cpp_fs = std::__fs::filesystem;
 #else
@@ -39,6 +95,12 @@ ZepFileSystemCPP::ZepFileSystemCPP(const fs::path& configPath)
 
 ZepFileSystemCPP::~ZepFileSystemCPP()
 {
+#ifdef __linux__
+    if (m_watchHandle != -1)
+    {
+        close(m_watchHandle);
+    }
+#endif
 }
 
 void ZepFileSystemCPP::SetWorkingDirectory(const fs::path& path)
@@ -106,21 +168,340 @@ std::string ZepFileSystemCPP::Read(const fs::path& fileName)
     return std::string();
 }
 
+std::string ZepFileSystemCPP::ReadRange(const fs::path& fileName, uint64_t offset, uint64_t size)
+{
+    std::ifstream in(fileName, std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        ZLOG(ERROR, "File Not Found: " << fileName.string());
+        return std::string();
+    }
+
+    in.seekg(0, std::ios::end);
+    auto fileSize = uint64_t(in.tellg());
+    if (offset >= fileSize)
+    {
+        return std::string();
+    }
+
+    std::string contents;
+    contents.resize(size_t(std::min(size, fileSize - offset)));
+    in.seekg(std::streamoff(offset), std::ios::beg);
+    in.read(&contents[0], contents.size());
+    return contents;
+}
+
 bool ZepFileSystemCPP::Write(const fs::path& fileName, const void* pData, size_t size)
 {
-    FILE* pFile;
-    pFile = fopen(fileName.string().c_str(), "wb");
-    if (!pFile)
+    auto spWriter = OpenWriter(fileName);
+    if (!spWriter)
     {
         return false;
     }
+
     // Valid to open/close with size == 0, which will truncate
-    if (size != 0)
+    FileBlock block{ pData, size };
+    bool written = spWriter->Write(&block, 1);
+    return spWriter->Close() && written;
+}
+
+bool ZepFileSystemCPP::Append(const fs::path& fileName, const void* pData, size_t size)
+{
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::app);
+    if (!out)
     {
-        fwrite(pData, sizeof(uint8_t), size, pFile);
+        ZLOG(ERROR, "Failed to open for appending: " << fileName.string());
+        return false;
     }
-    fclose(pFile);
-    return true;
+
+    out.write((const char*)pData, std::streamsize(size));
+    out.close();
+    return bool(out);
+}
+
+namespace
+{
+// A file that is written next to the target, and renamed over it when it is complete.
+// If we die half way through, the target is untouched, and only the temporary is left behind
+struct AtomicFile
+{
+    fs::path targetPath;
+    fs::path tempPath;
+
+    fs::path TempPath(const fs::path& path)
+    {
+        return path.parent_path() / ("." + path.filename().string() + ".zep~");
+    }
+
+    // Put the finished file in place of the target
+    bool Replace()
+    {
+        std::error_code ec;
+        cpp_fs::rename(tempPath.string(), targetPath.string(), ec);
+        if (ec)
+        {
+            ZLOG(ERROR, "Failed to replace " << targetPath.string() << ": " << ec.message());
+            Remove();
+            return false;
+        }
+        tempPath.clear();
+        return true;
+    }
+
+    void Remove()
+    {
+        if (!tempPath.empty())
+        {
+            std::error_code ec;
+            cpp_fs::remove(tempPath.string(), ec);
+            tempPath.clear();
+        }
+    }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// Writes each set of blocks with a single writev
+class ZepFileWriterPosix : public IZepFileWriter
+{
+public:
+    ZepFileWriterPosix(int file, const AtomicFile& atomic)
+        : m_file(file)
+        , m_atomic(atomic)
+    {
+    }
+
+    ~ZepFileWriterPosix()
+    {
+        // Not closed, so not finished; leave the target alone
+        if (m_file != -1)
+        {
+            close(m_file);
+            m_atomic.Remove();
+        }
+    }
+
+    virtual bool Write(const FileBlock* pBlocks, size_t count) override
+    {
+        std::vector<iovec> vecs;
+        for (size_t index = 0; index < count; index++)
+        {
+            if (pBlocks[index].size != 0)
+            {
+                vecs.push_back(iovec{ (void*)pBlocks[index].pData, pBlocks[index].size });
+            }
+        }
+
+        // The kernel can write less than asked for; carry on from where it stopped
+        size_t first = 0;
+        while (first < vecs.size())
+        {
+            auto written = writev(m_file, &vecs[first], int(std::min(vecs.size() - first, size_t(IOV_MAX))));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                m_failed = true;
+                return false;
+            }
+
+            auto left = size_t(written);
+            while (first < vecs.size() && left >= vecs[first].iov_len)
+            {
+                left -= vecs[first].iov_len;
+                first++;
+            }
+            if (left != 0)
+            {
+                vecs[first].iov_base = (uint8_t*)vecs[first].iov_base + left;
+                vecs[first].iov_len -= left;
+            }
+        }
+        return true;
+    }
+
+    virtual bool Close() override
+    {
+        if (m_file == -1)
+        {
+            return !m_failed;
+        }
+
+        if (m_atomic.tempPath.empty())
+        {
+            m_failed |= close(m_file) != 0;
+            m_file = -1;
+            return !m_failed;
+        }
+
+        // The data must be on the disk before the rename is, or a crash could leave an empty file
+        m_failed |= fsync(m_file) != 0;
+        m_failed |= close(m_file) != 0;
+        m_file = -1;
+        if (m_failed)
+        {
+            m_atomic.Remove();
+            return false;
+        }
+
+        if (!m_atomic.Replace())
+        {
+            m_failed = true;
+            return false;
+        }
+
+        // And the rename itself
+        auto dir = open(m_atomic.targetPath.parent_path().string().c_str(), O_RDONLY | O_CLOEXEC);
+        if (dir != -1)
+        {
+            fsync(dir);
+            close(dir);
+        }
+        return true;
+    }
+
+private:
+    int m_file = -1;
+    AtomicFile m_atomic;
+    bool m_failed = false;
+};
+#else
+class ZepFileWriterStdio : public IZepFileWriter
+{
+public:
+    ZepFileWriterStdio(FILE* pFile, const AtomicFile& atomic)
+        : m_pFile(pFile)
+        , m_atomic(atomic)
+    {
+    }
+
+    ~ZepFileWriterStdio()
+    {
+        if (m_pFile)
+        {
+            fclose(m_pFile);
+            m_atomic.Remove();
+        }
+    }
+
+    virtual bool Write(const FileBlock* pBlocks, size_t count) override
+    {
+        for (size_t index = 0; index < count; index++)
+        {
+            if (fwrite(pBlocks[index].pData, sizeof(uint8_t), pBlocks[index].size, m_pFile) != pBlocks[index].size)
+            {
+                m_failed = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual bool Close() override
+    {
+        if (!m_pFile)
+        {
+            return !m_failed;
+        }
+
+        m_failed |= fflush(m_pFile) != 0;
+        m_failed |= fclose(m_pFile) != 0;
+        m_pFile = nullptr;
+        if (m_atomic.tempPath.empty())
+        {
+            return !m_failed;
+        }
+
+        if (m_failed)
+        {
+            m_atomic.Remove();
+            return false;
+        }
+        m_failed = !m_atomic.Replace();
+        return !m_failed;
+    }
+
+private:
+    FILE* m_pFile = nullptr;
+    AtomicFile m_atomic;
+    bool m_failed = false;
+};
+#endif
+} // namespace
+
+std::unique_ptr<IZepFileWriter> ZepFileSystemCPP::OpenWriter(const fs::path& fileName)
+{
+    // A new file has nothing to lose, so is written in place
+    AtomicFile atomic;
+    atomic.targetPath = fileName;
+    if ((m_flags & ZepFileSystemFlags::AtomicSave) && Exists(fileName))
+    {
+        // Replace what a link points to, not the link
+        std::error_code ec;
+        if (cpp_fs::is_symlink(fileName.string(), ec))
+        {
+            auto target = cpp_fs::canonical(fileName.string(), ec);
+            if (!ec)
+            {
+                atomic.targetPath = fs::path(target.string());
+            }
+        }
+        atomic.tempPath = atomic.TempPath(atomic.targetPath);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    int file = -1;
+    if (!atomic.tempPath.empty())
+    {
+        // Keep the permissions of the file we are replacing
+        struct stat fileStat;
+        auto mode = stat(atomic.targetPath.string().c_str(), &fileStat) == 0 ? (fileStat.st_mode & 07777) : 0644;
+        file = open(atomic.tempPath.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        if (file != -1)
+        {
+            fchmod(file, mode);
+        }
+        else
+        {
+            // Probably can't make files in the folder; all we can do is write over it
+            ZLOG(DBG, "Can't write " << atomic.tempPath.string() << ", saving in place");
+            atomic.tempPath.clear();
+        }
+    }
+
+    if (file == -1)
+    {
+        file = open(fileName.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+
+    if (file == -1)
+    {
+        return nullptr;
+    }
+    return std::make_unique<ZepFileWriterPosix>(file, atomic);
+#else
+    FILE* pFile = nullptr;
+    if (!atomic.tempPath.empty())
+    {
+        pFile = fopen(atomic.tempPath.string().c_str(), "wb");
+        if (!pFile)
+        {
+            atomic.tempPath.clear();
+        }
+    }
+
+    if (!pFile)
+    {
+        pFile = fopen(fileName.string().c_str(), "wb");
+    }
+
+    if (!pFile)
+    {
+        return nullptr;
+    }
+    return std::make_unique<ZepFileWriterStdio>(pFile, atomic);
+#endif
 }
 
 void ZepFileSystemCPP::ScanDirectory(const fs::path& path, std::function<bool(const fs::path& path, bool& dont_recurse)> fnScan) const
@@ -156,6 +537,143 @@ bool ZepFileSystemCPP::Exists(const fs::path& path) const
     }
 }
 
+bool ZepFileSystemCPP::GetFileInfo(const fs::path& path, uint64_t& modifiedTime, uint64_t& size) const
+{
+    std::error_code ec;
+    auto status = cpp_fs::status(path.string(), ec);
+    if (ec || !cpp_fs::exists(status))
+    {
+        return false;
+    }
+
+    auto time = cpp_fs::last_write_time(path.string(), ec);
+    if (ec)
+    {
+        return false;
+    }
+    modifiedTime = uint64_t(time.time_since_epoch().count());
+
+    size = 0;
+    if (cpp_fs::is_regular_file(status))
+    {
+        size = uint64_t(cpp_fs::file_size(path.string(), ec));
+    }
+    return !ec;
+}
+
+#ifdef __linux__
+bool ZepFileSystemCPP::WatchDirectory(const fs::path& path)
+{
+    if (m_watchHandle == -1)
+    {
+        // Non blocking, so that changes can be picked up on the editor tick
+        m_watchHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_watchHandle == -1)
+        {
+            ZLOG(ERROR, "Can't watch for file changes");
+            return false;
+        }
+    }
+
+    if (m_watchPaths.find(path) != m_watchPaths.end())
+    {
+        return true;
+    }
+
+    auto watch = inotify_add_watch(m_watchHandle, path.c_str(), IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (watch == -1)
+    {
+        ZLOG(DBG, "Can't watch: " << path.string());
+        return false;
+    }
+
+    m_watches[watch] = path;
+    m_watchPaths[path] = watch;
+    return true;
+}
+
+void ZepFileSystemCPP::UnwatchDirectory(const fs::path& path)
+{
+    auto itr = m_watchPaths.find(path);
+    if (itr == m_watchPaths.end())
+    {
+        return;
+    }
+
+    inotify_rm_watch(m_watchHandle, itr->second);
+    m_watches.erase(itr->second);
+    m_watchPaths.erase(itr);
+}
+
+void ZepFileSystemCPP::ReadChanges(std::vector<FileChange>& changes)
+{
+    if (m_watchHandle == -1)
+    {
+        return;
+    }
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    for (;;)
+    {
+        auto bytes = read(m_watchHandle, buffer, sizeof(buffer));
+        if (bytes <= 0)
+        {
+            return;
+        }
+
+        for (ssize_t offset = 0; offset < bytes;)
+        {
+            auto pEvent = (const inotify_event*)(buffer + offset);
+            offset += sizeof(inotify_event) + pEvent->len;
+
+            if (pEvent->mask & IN_Q_OVERFLOW)
+            {
+                FileChange change;
+                change.type = FileChange::Type::Overflow;
+                changes.push_back(change);
+                continue;
+            }
+
+            auto itr = m_watches.find(pEvent->wd);
+            if (itr == m_watches.end())
+            {
+                continue;
+            }
+
+            // The folder has gone, and the watch with it
+            if (pEvent->mask & IN_IGNORED)
+            {
+                m_watchPaths.erase(itr->second);
+                m_watches.erase(itr);
+                continue;
+            }
+
+            if (pEvent->len == 0)
+            {
+                continue;
+            }
+
+            FileChange change;
+            change.path = itr->second / pEvent->name;
+            change.isDirectory = (pEvent->mask & IN_ISDIR) != 0;
+            if (pEvent->mask & (IN_CREATE | IN_MOVED_TO))
+            {
+                change.type = FileChange::Type::Created;
+            }
+            else if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                change.type = FileChange::Type::Deleted;
+            }
+            else
+            {
+                change.type = FileChange::Type::Modified;
+            }
+            changes.push_back(change);
+        }
+    }
+}
+#endif
+
 bool ZepFileSystemCPP::Equivalent(const fs::path& path1, const fs::path& path2) const
 {
     try
@@ -222,7 +740,7 @@ fs::path ZepFileSystemCPP::GetSearchRoot(const fs::path& start, bool& foundGit)
                     recurse = false;
 
                     // Found the .git repo
-                    if (p.extension() == ".git" && IsDirectory(p))
+                    if (p.filename() == ".git" && IsDirectory(p))
                     {
                         foundGit = true;
 
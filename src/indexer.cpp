@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <set>
+#include <thread>
+
 #include "zep/mcommon/file/fnmatch.h"
 #include "zep/mcommon/file/path.h"
 #include "zep/mcommon/logger.h"
@@ -13,6 +19,9 @@ namespace Zep
 enum TypeName
 {
     t_class,
+    t_struct,
+    t_union,
+    t_enum,
     t_void,
     t_byte,
     t_char,
@@ -30,6 +39,9 @@ enum TypeName
 
 std::map<std::string, TypeName> MapToType = {
     { "class", t_class },
+    { "struct", t_struct },
+    { "union", t_union },
+    { "enum", t_enum },
     { "void", t_void },
     { "byte", t_byte },
     { "char", t_char },
@@ -45,11 +57,180 @@ std::map<std::string, TypeName> MapToType = {
     { "int8_t", t_int8_t }
 };
 
+void FileIndexResult::BuildCharIndex()
+{
+    charPaths.clear();
+    charPaths.resize(256);
+
+    auto words = (lowerPaths.size() + 63) / 64;
+    for (uint32_t index = 0; index < uint32_t(lowerPaths.size()); index++)
+    {
+        for (auto ch : lowerPaths[index])
+        {
+            auto& paths = charPaths[uint8_t(ch)];
+            if (paths.empty())
+            {
+                paths.resize(words, 0);
+            }
+            paths[index >> 6] |= (uint64_t(1) << (index & 63));
+        }
+    }
+}
+
+namespace
+{
+
+const uint32_t IndexMagic = 0x5844495a; // 'ZIDX'
+const uint32_t IndexVersion = 1;
+
+// The layout of .zep/indexdb; the records are all 8 byte aligned
+struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t directoryCount;
+    uint32_t fileCount;
+    uint32_t symbolCount;
+    uint32_t stringBytes;
+    uint32_t rootOffset;
+    uint32_t rootLength;
+    uint64_t patternHash;
+};
+
+struct IndexDirectoryRecord
+{
+    uint64_t modifiedTime;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+struct IndexFileRecord
+{
+    uint64_t modifiedTime;
+    uint64_t size;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t firstSymbol;
+    uint32_t symbolCount;
+};
+
+struct IndexSymbolRecord
+{
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int32_t line;
+    int32_t column;
+};
+
+// Check a path relative to the root against the project patterns.
+// Returns true for a directory that should be looked in, or a file that should be indexed
+bool FilterPath(const std::string& rel, bool isDir, const std::vector<std::string>& ignorePaths, const std::vector<std::string>& includePaths, bool& recurse)
+{
+    // Nothing to find in the repository; and watching it would see every git command
+    if (isDir && fs::path(rel).filename() == ".git")
+    {
+        recurse = false;
+        return false;
+    }
+
+    recurse = true;
+    for (auto& proj : ignorePaths)
+    {
+        if (fnmatch(proj.c_str(), rel.c_str(), 0) == 0)
+        {
+            recurse = false;
+            return false;
+        }
+    }
+
+    if (isDir)
+    {
+        return true;
+    }
+
+    for (auto& proj : includePaths)
+    {
+        if (fnmatch(proj.c_str(), rel.c_str(), 0) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t HashPatterns(const std::vector<std::string>& ignorePaths, const std::vector<std::string>& includePaths)
+{
+    std::ostringstream str;
+    for (auto& pattern : ignorePaths)
+    {
+        str << pattern << '\n';
+    }
+    str << '\n';
+    for (auto& pattern : includePaths)
+    {
+        str << pattern << '\n';
+    }
+    // Saved in the index, so it must be the same in every build
+    auto patterns = str.str();
+    return fnv_hash_64(patterns.data(), patterns.size());
+}
+
+// Class::Method -> Method
+std::string SimpleName(const std::string& name)
+{
+    auto pos = name.rfind("::");
+    return pos == std::string::npos ? name : name.substr(pos + 2);
+}
+
+bool IsInDirectory(const fs::path& path, const fs::path& dir)
+{
+    auto itrPath = path.begin();
+    for (auto& part : dir)
+    {
+        if (itrPath == path.end() || *itrPath != part)
+        {
+            return false;
+        }
+        itrPath++;
+    }
+    return true;
+}
+
+std::vector<IndexedFile>::iterator FindFile(std::vector<IndexedFile>& files, const fs::path& path)
+{
+    auto itr = std::lower_bound(files.begin(), files.end(), path, [](const IndexedFile& file, const fs::path& path) {
+        return file.path < path;
+    });
+    return (itr != files.end() && itr->path == path) ? itr : files.end();
+}
+
+} // namespace
+
 Indexer::Indexer(ZepEditor& editor)
     : ZepComponent(editor)
 {
 }
 
+Indexer::~Indexer()
+{
+    if (m_indexResult.valid())
+    {
+        m_indexResult.wait();
+    }
+
+    // Stop the threads taking any more files
+    for (auto& spQueue : m_workQueues)
+    {
+        std::lock_guard<std::mutex> lock(spQueue->mutex);
+        spQueue->files.clear();
+    }
+
+    for (auto& result : m_symbolResults)
+    {
+        result.wait();
+    }
+}
+
 void Indexer::GetSearchPaths(ZepEditor& editor, const fs::path& path, std::vector<std::string>& ignore_patterns, std::vector<std::string>& include_patterns, std::string& errors)
 {
     fs::path config = path / ".zep" / "project.cfg";
@@ -122,81 +303,335 @@ std::future<std::shared_ptr<FileIndexResult>> Indexer::IndexPaths(ZepEditor& edi
         return make_ready_future(spResult);
     }
 
+    // Scanning a whole project is long; it leaves a worker for what the user is waiting on
     auto pFileSystem = &editor.GetFileSystem();
-    return editor.GetThreadPool().enqueue([=](fs::path root) {
+    return editor.GetThreadPool().enqueue_with(TaskPriority::Background, CancelToken(), [=](fs::path root) {
         spResult->root = root;
 
         try
         {
             // Index the whole subtree, ignoring any patterns supplied to us
             pFileSystem->ScanDirectory(root, [&](const fs::path& p, bool& recurse) -> bool {
-                recurse = true;
-
                 auto bDir = pFileSystem->IsDirectory(p);
 
                 // Add this one to our list
                 auto targetZep = pFileSystem->Canonical(p);
                 auto rel = path_get_relative(root, targetZep);
 
-                bool matched = true;
-                for (auto& proj : ignorePaths)
+                // Not adding directories to the search list
+                if (!FilterPath(rel.string(), bDir, ignorePaths, includePaths, recurse) || bDir)
                 {
-                    auto res = fnmatch(proj.c_str(), rel.string().c_str(), 0);
-                    if (res == 0)
-                    {
-                        matched = false;
-                        break;
-                    }
+                    return true;
                 }
 
-                if (!matched)
+                spResult->paths.push_back(rel);
+                spResult->lowerPaths.push_back(string_tolower(rel.string()));
+
+                return true;
+            });
+        }
+        catch (std::exception&)
+        {
+        }
+
+        spResult->BuildCharIndex();
+        return spResult;
+    },
+        startPath);
+}
+
+bool Indexer::LoadIndex(IZepFileSystem& fileSystem, const fs::path& indexPath, ProjectIndex& index)
+{
+    if (!fileSystem.Exists(indexPath))
+    {
+        return false;
+    }
+
+    auto data = fileSystem.Read(indexPath);
+
+    IndexHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != IndexMagic || header.version != IndexVersion)
+    {
+        return false;
+    }
+
+    auto directoryStart = sizeof(IndexHeader);
+    auto fileStart = directoryStart + header.directoryCount * sizeof(IndexDirectoryRecord);
+    auto symbolStart = fileStart + header.fileCount * sizeof(IndexFileRecord);
+    auto stringStart = symbolStart + header.symbolCount * sizeof(IndexSymbolRecord);
+    if (stringStart + header.stringBytes != data.size())
+    {
+        ZLOG(INFO, "Index is the wrong size, ignoring: " << indexPath.string());
+        return false;
+    }
+
+    bool valid = true;
+    auto getString = [&](uint32_t offset, uint32_t length) {
+        if (uint64_t(offset) + length > header.stringBytes)
+        {
+            valid = false;
+            return std::string();
+        }
+        return data.substr(stringStart + offset, length);
+    };
+
+    index = ProjectIndex();
+    index.root = getString(header.rootOffset, header.rootLength);
+    index.patternHash = header.patternHash;
+
+    index.directories.resize(header.directoryCount);
+    for (uint32_t dir = 0; dir < header.directoryCount; dir++)
+    {
+        IndexDirectoryRecord record;
+        memcpy(&record, data.data() + directoryStart + dir * sizeof(record), sizeof(record));
+        index.directories[dir].path = getString(record.pathOffset, record.pathLength);
+        index.directories[dir].modifiedTime = record.modifiedTime;
+    }
+
+    index.files.resize(header.fileCount);
+    for (uint32_t file = 0; file < header.fileCount; file++)
+    {
+        IndexFileRecord record;
+        memcpy(&record, data.data() + fileStart + file * sizeof(record), sizeof(record));
+
+        auto& indexedFile = index.files[file];
+        indexedFile.path = getString(record.pathOffset, record.pathLength);
+        indexedFile.modifiedTime = record.modifiedTime;
+        indexedFile.size = record.size;
+        indexedFile.parsed = record.modifiedTime != 0;
+
+        if (uint64_t(record.firstSymbol) + record.symbolCount > header.symbolCount)
+        {
+            return false;
+        }
+
+        for (uint32_t symbol = record.firstSymbol; symbol < record.firstSymbol + record.symbolCount; symbol++)
+        {
+            IndexSymbolRecord symbolRecord;
+            memcpy(&symbolRecord, data.data() + symbolStart + symbol * sizeof(symbolRecord), sizeof(symbolRecord));
+
+            SymbolDetails details;
+            details.line = symbolRecord.line;
+            details.column = symbolRecord.column;
+            indexedFile.symbols.push_back(std::make_pair(getString(symbolRecord.nameOffset, symbolRecord.nameLength), details));
+        }
+    }
+
+    return valid;
+}
+
+bool Indexer::SaveIndex(IZepFileSystem& fileSystem, const fs::path& indexPath, const ProjectIndex& index)
+{
+    std::string strings;
+    auto addString = [&](const std::string& str, uint32_t& offset, uint32_t& length) {
+        offset = uint32_t(strings.size());
+        length = uint32_t(str.size());
+        strings += str;
+    };
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IndexMagic;
+    header.version = IndexVersion;
+    header.directoryCount = uint32_t(index.directories.size());
+    header.fileCount = uint32_t(index.files.size());
+    header.patternHash = index.patternHash;
+    addString(index.root.string(), header.rootOffset, header.rootLength);
+
+    std::vector<IndexDirectoryRecord> directoryRecords(index.directories.size());
+    for (size_t dir = 0; dir < index.directories.size(); dir++)
+    {
+        directoryRecords[dir].modifiedTime = index.directories[dir].modifiedTime;
+        addString(index.directories[dir].path.string(), directoryRecords[dir].pathOffset, directoryRecords[dir].pathLength);
+    }
+
+    std::vector<IndexFileRecord> fileRecords(index.files.size());
+    std::vector<IndexSymbolRecord> symbolRecords;
+    for (size_t file = 0; file < index.files.size(); file++)
+    {
+        auto& indexedFile = index.files[file];
+        auto& record = fileRecords[file];
+
+        // Files that haven't been parsed yet are stored with no time, so that they are parsed next time
+        record.modifiedTime = indexedFile.parsed ? indexedFile.modifiedTime : 0;
+        record.size = indexedFile.size;
+        record.firstSymbol = uint32_t(symbolRecords.size());
+        record.symbolCount = uint32_t(indexedFile.symbols.size());
+        addString(indexedFile.path.string(), record.pathOffset, record.pathLength);
+
+        for (auto& symbol : indexedFile.symbols)
+        {
+            IndexSymbolRecord symbolRecord;
+            symbolRecord.line = symbol.second.line;
+            symbolRecord.column = symbol.second.column;
+            addString(symbol.first, symbolRecord.nameOffset, symbolRecord.nameLength);
+            symbolRecords.push_back(symbolRecord);
+        }
+    }
+    header.symbolCount = uint32_t(symbolRecords.size());
+    header.stringBytes = uint32_t(strings.size());
+
+    std::string data;
+    data.reserve(sizeof(header) + directoryRecords.size() * sizeof(IndexDirectoryRecord) + fileRecords.size() * sizeof(IndexFileRecord) + symbolRecords.size() * sizeof(IndexSymbolRecord) + strings.size());
+    data.append((const char*)&header, sizeof(header));
+    data.append((const char*)directoryRecords.data(), directoryRecords.size() * sizeof(IndexDirectoryRecord));
+    data.append((const char*)fileRecords.data(), fileRecords.size() * sizeof(IndexFileRecord));
+    data.append((const char*)symbolRecords.data(), symbolRecords.size() * sizeof(IndexSymbolRecord));
+    data.append(strings);
+
+    return fileSystem.Write(indexPath, data.data(), data.size());
+}
+
+std::shared_ptr<ProjectIndex> Indexer::UpdateIndex(ZepEditor& editor, const ProjectIndex& oldIndex)
+{
+    auto& fileSystem = editor.GetFileSystem();
+    auto spIndex = std::make_shared<ProjectIndex>();
+    spIndex->root = oldIndex.root;
+
+    std::vector<std::string> ignorePaths;
+    std::vector<std::string> includePaths;
+    std::string errors;
+    GetSearchPaths(editor, oldIndex.root, ignorePaths, includePaths, errors);
+    if (!errors.empty())
+    {
+        ZLOG(ERROR, errors);
+    }
+
+    // If the patterns changed, the old list of files is no use
+    spIndex->patternHash = HashPatterns(ignorePaths, includePaths);
+    bool useOld = spIndex->patternHash == oldIndex.patternHash;
+
+    const auto& root = spIndex->root;
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+
+    // Folders which are still there; the ones that have changed need looking in again
+    std::set<fs::path> knownDirectories;
+    std::vector<fs::path> scanDirectories;
+    for (auto& dir : oldIndex.directories)
+    {
+        if (!useOld || !fileSystem.GetFileInfo(root / dir.path, modifiedTime, size))
+        {
+            continue;
+        }
+
+        knownDirectories.insert(dir.path);
+        spIndex->directories.push_back(IndexedDirectory{ dir.path, modifiedTime });
+        if (modifiedTime != dir.modifiedTime)
+        {
+            scanDirectories.push_back(dir.path);
+        }
+    }
+
+    if (knownDirectories.find(fs::path()) == knownDirectories.end())
+    {
+        fileSystem.GetFileInfo(root, modifiedTime, size);
+        knownDirectories.insert(fs::path());
+        spIndex->directories.push_back(IndexedDirectory{ fs::path(), modifiedTime });
+        scanDirectories.push_back(fs::path());
+    }
+
+    // Files which are still there; the ones that have changed need parsing again
+    std::set<fs::path> knownFiles;
+    for (auto& file : oldIndex.files)
+    {
+        if (!useOld || !fileSystem.GetFileInfo(root / file.path, modifiedTime, size))
+        {
+            continue;
+        }
+
+        knownFiles.insert(file.path);
+        if (file.parsed && modifiedTime == file.modifiedTime && size == file.size)
+        {
+            spIndex->files.push_back(file);
+        }
+        else
+        {
+            spIndex->files.push_back(IndexedFile{ file.path, modifiedTime, size, false, {} });
+        }
+    }
+
+    // Look for new things in the changed folders; new folders are searched all the way down
+    for (auto& dir : scanDirectories)
+    {
+        try
+        {
+            fileSystem.ScanDirectory(root / dir, [&](const fs::path& p, bool& recurse) -> bool {
+                auto bDir = fileSystem.IsDirectory(p);
+                auto rel = path_get_relative(root, fileSystem.Canonical(p));
+                if (!FilterPath(rel.string(), bDir, ignorePaths, includePaths, recurse))
                 {
-                    if (bDir)
-                    {
-                        recurse = false;
-                    }
                     return true;
                 }
 
-                matched = false;
-                for (auto& proj : includePaths)
+                if (bDir)
                 {
-                    auto res = fnmatch(proj.c_str(), rel.string().c_str(), 0);
-                    if (res == 0)
+                    // Known folders are checked on their own
+                    if (!knownDirectories.insert(rel).second)
                     {
-                        matched = true;
-                        break;
+                        recurse = false;
+                        return true;
                     }
-                }
 
-                if (!matched)
-                {
+                    fileSystem.GetFileInfo(p, modifiedTime, size);
+                    spIndex->directories.push_back(IndexedDirectory{ rel, modifiedTime });
                     return true;
                 }
 
-                // Not adding directories to the search list
-                if (bDir)
+                if (knownFiles.insert(rel).second)
                 {
-                    return true;
+                    fileSystem.GetFileInfo(p, modifiedTime, size);
+                    spIndex->files.push_back(IndexedFile{ rel, modifiedTime, size, false, {} });
                 }
-
-                spResult->paths.push_back(rel);
-                spResult->lowerPaths.push_back(string_tolower(rel.string()));
-
                 return true;
             });
         }
         catch (std::exception&)
         {
         }
-        return spResult;
-    },
-        startPath);
+    }
+
+    std::sort(spIndex->files.begin(), spIndex->files.end(), [](const IndexedFile& lhs, const IndexedFile& rhs) {
+        return lhs.path < rhs.path;
+    });
+    return spIndex;
+}
+
+std::shared_ptr<ProjectIndex> Indexer::GetIndex() const
+{
+    return m_spIndex;
+}
+
+void Indexer::SaveIndex()
+{
+    if (!m_spIndex || m_indexPath.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_symbolMutex);
+    if (!SaveIndex(GetEditor().GetFileSystem(), m_indexPath, *m_spIndex))
+    {
+        ZLOG(ERROR, "Failed to write the index: " << m_indexPath.string());
+    }
 }
 
 void Indexer::Notify(std::shared_ptr<ZepMessage> message)
 {
-    if (message->messageId == Msg::Tick)
+    if (message->messageId == Msg::FileChanged)
+    {
+        // Applied on the tick, once there is an index
+        if (m_spIndex || m_fileSearchActive)
+        {
+            m_pendingChanges.push_back(std::static_pointer_cast<FileChangeMessage>(message)->change);
+        }
+    }
+    else if (message->messageId == Msg::Tick)
     {
         if (m_fileSearchActive)
         {
@@ -206,74 +641,930 @@ void Indexer::Notify(std::shared_ptr<ZepMessage> message)
             }
 
             m_fileSearchActive = false;
+            m_spIndex = m_indexResult.get();
 
-            m_spFilePaths = m_indexResult.get();
-            if (!m_spFilePaths->errors.empty())
+            for (auto& shard : m_symbolShards)
             {
-                GetEditor().SetCommandText(m_spFilePaths->errors);
-                return;
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.symbols.clear();
             }
 
-            // Queue the files to be searched
+            // The files that haven't changed already have their symbols; the rest are parsed
+            std::vector<uint32_t> unparsed;
+            for (uint32_t index = 0; index < uint32_t(m_spIndex->files.size()); index++)
             {
-                std::lock_guard<std::mutex> guard(m_queueMutex);
-                for (auto& p : m_spFilePaths->paths)
+                auto& file = m_spIndex->files[index];
+                if (file.parsed)
                 {
-                    m_searchQueue.push_back(p);
+                    AddSymbols(file.path, file.symbols);
+                }
+                else
+                {
+                    unparsed.push_back(index);
                 }
             }
 
-            // Kick off the thread
+            // From now on, the index is kept up to date by watching the folders
+            WatchDirectories();
+
+            QueueFiles(unparsed);
             StartSymbolSearch();
+            return;
         }
-    }
-}
 
-void Indexer::StartSymbolSearch()
-{
-    GetEditor().GetThreadPool().enqueue([=]() {
-        for (;;)
+        if (!m_spIndex)
+        {
+            return;
+        }
+
+        if (!m_symbolResults.empty())
         {
-            fs::path path;
+            for (auto& result : m_symbolResults)
             {
-                std::lock_guard<std::mutex> lock(m_queueMutex);
-                if (m_searchQueue.empty())
+                if (!is_future_ready(result))
                 {
-                    return true;
+                    return;
                 }
-
-                path = m_searchQueue.front();
-                m_searchQueue.pop_front();
             }
 
-            auto& fs = GetEditor().GetFileSystem();
-
-            std::string strLast;
-
-            auto fullPath = m_searchRoot / path;
-            if (fs.Exists(fullPath))
-            {
-                ZLOG(DBG, "Parsing: " << fullPath.string());
-                auto strFile = GetEditor().GetFileSystem().Read(fullPath);
+            m_symbolResults.clear();
+            SaveIndex();
+        }
 
-                std::vector<std::string> tokens;
-                string_split(strFile, ";()[] \t\n\r&!\"\'*:,<>", tokens);
-            }
+        if (!m_pendingChanges.empty())
+        {
+            ApplyChanges();
         }
-    });
+    }
 }
 
-bool Indexer::StartIndexing()
+void Indexer::WatchDirectories()
 {
-    bool foundGit = false;
-    m_searchRoot = GetEditor().GetFileSystem().GetSearchRoot(GetEditor().GetFileSystem().GetWorkingDirectory(), foundGit);
-    if (!foundGit)
+    auto& fileSystem = GetEditor().GetFileSystem();
+    for (auto& dir : m_spIndex->directories)
     {
-        ZLOG(INFO, "Not a git project");
-        return false;
+        fileSystem.WatchDirectory(m_spIndex->root / dir.path);
     }
+}
 
-    auto& fs = GetEditor().GetFileSystem();
+void Indexer::ApplyChanges()
+{
+    std::vector<FileChange> changes;
+    changes.swap(m_pendingChanges);
+
+    auto& fileSystem = GetEditor().GetFileSystem();
+    const auto& root = m_spIndex->root;
+
+    std::set<fs::path> parse;
+    bool changed = false;
+    for (auto& change : changes)
+    {
+        if (change.type == FileChange::Type::Overflow)
+        {
+            // Lost track; check everything against the disk, as when the project is opened
+            ZLOG(INFO, "Missed file changes, updating the index");
+            auto pEditor = &GetEditor();
+            auto oldIndex = *m_spIndex;
+            m_fileSearchActive = true;
+            m_indexResult = GetEditor().GetThreadPool().enqueue_with(TaskPriority::Background, CancelToken(), [=]() {
+                return Indexer::UpdateIndex(*pEditor, oldIndex);
+            });
+            return;
+        }
+
+        if (!IsInDirectory(change.path, root))
+        {
+            continue;
+        }
+
+        auto rel = path_get_relative(root, change.path);
+        bool recurse = true;
+        if (rel.empty() || !FilterPath(rel.string(), change.isDirectory, m_ignorePaths, m_includePaths, recurse))
+        {
+            continue;
+        }
+
+        // Whatever the event was, the file system says what is there now
+        changed = true;
+        if (change.isDirectory)
+        {
+            if (fileSystem.IsDirectory(change.path))
+            {
+                AddDirectory(rel, parse);
+            }
+            else
+            {
+                RemoveDirectory(rel);
+            }
+        }
+        else if (fileSystem.Exists(change.path))
+        {
+            if (UpdateFile(rel))
+            {
+                parse.insert(rel);
+            }
+        }
+        else
+        {
+            RemoveFile(rel);
+            parse.erase(rel);
+        }
+
+        // Keep the folder time current, so it isn't scanned again next time the index is loaded
+        uint64_t size = 0;
+        auto parent = rel.parent_path();
+        auto itrDir = std::find_if(m_spIndex->directories.begin(), m_spIndex->directories.end(), [&](const IndexedDirectory& dir) {
+            return dir.path == parent;
+        });
+        if (itrDir != m_spIndex->directories.end())
+        {
+            fileSystem.GetFileInfo(root / parent, itrDir->modifiedTime, size);
+        }
+    }
+
+    if (!parse.empty())
+    {
+        // Files may have moved around in the list, so look them up now that it has settled
+        std::vector<uint32_t> files;
+        for (auto& path : parse)
+        {
+            auto itr = FindFile(m_spIndex->files, path);
+            if (itr != m_spIndex->files.end())
+            {
+                files.push_back(uint32_t(itr - m_spIndex->files.begin()));
+            }
+        }
+        QueueFiles(files);
+        StartSymbolSearch();
+    }
+    else if (changed)
+    {
+        SaveIndex();
+    }
+}
+
+// Add a new file to the index, or mark an existing one to be parsed again.  Returns false if it hasn't changed
+bool Indexer::UpdateFile(const fs::path& rel)
+{
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+    GetEditor().GetFileSystem().GetFileInfo(m_spIndex->root / rel, modifiedTime, size);
+
+    auto& files = m_spIndex->files;
+    auto itr = std::lower_bound(files.begin(), files.end(), rel, [](const IndexedFile& file, const fs::path& path) {
+        return file.path < path;
+    });
+    if (itr == files.end() || itr->path != rel)
+    {
+        files.insert(itr, IndexedFile{ rel, modifiedTime, size, false, {} });
+        return true;
+    }
+
+    if (itr->parsed && itr->modifiedTime == modifiedTime && itr->size == size)
+    {
+        return false;
+    }
+
+    RemoveSymbols(itr->path, itr->symbols);
+    itr->symbols.clear();
+    itr->parsed = false;
+    itr->modifiedTime = modifiedTime;
+    itr->size = size;
+    return true;
+}
+
+void Indexer::RemoveFile(const fs::path& rel)
+{
+    auto itr = FindFile(m_spIndex->files, rel);
+    if (itr != m_spIndex->files.end())
+    {
+        RemoveSymbols(itr->path, itr->symbols);
+        m_spIndex->files.erase(itr);
+    }
+}
+
+// A new folder; it could have come with files and folders already in it
+void Indexer::AddDirectory(const fs::path& rel, std::set<fs::path>& parse)
+{
+    auto& fileSystem = GetEditor().GetFileSystem();
+    const auto& root = m_spIndex->root;
+
+    auto addDirectory = [&](const fs::path& dirPath) {
+        uint64_t modifiedTime = 0;
+        uint64_t size = 0;
+        fileSystem.GetFileInfo(root / dirPath, modifiedTime, size);
+        auto itr = std::find_if(m_spIndex->directories.begin(), m_spIndex->directories.end(), [&](const IndexedDirectory& dir) {
+            return dir.path == dirPath;
+        });
+        if (itr == m_spIndex->directories.end())
+        {
+            m_spIndex->directories.push_back(IndexedDirectory{ dirPath, modifiedTime });
+        }
+
+        // Watch before looking inside, so that nothing added in between is missed
+        fileSystem.WatchDirectory(root / dirPath);
+    };
+
+    addDirectory(rel);
+    try
+    {
+        fileSystem.ScanDirectory(root / rel, [&](const fs::path& p, bool& recurse) -> bool {
+            auto bDir = fileSystem.IsDirectory(p);
+            auto pathRel = path_get_relative(root, fileSystem.Canonical(p));
+            if (!FilterPath(pathRel.string(), bDir, m_ignorePaths, m_includePaths, recurse))
+            {
+                return true;
+            }
+
+            if (bDir)
+            {
+                addDirectory(pathRel);
+            }
+            else if (UpdateFile(pathRel))
+            {
+                parse.insert(pathRel);
+            }
+            return true;
+        });
+    }
+    catch (std::exception&)
+    {
+    }
+}
+
+void Indexer::RemoveDirectory(const fs::path& rel)
+{
+    auto& files = m_spIndex->files;
+    auto itrFile = std::remove_if(files.begin(), files.end(), [&](const IndexedFile& file) {
+        if (!IsInDirectory(file.path, rel))
+        {
+            return false;
+        }
+        RemoveSymbols(file.path, file.symbols);
+        return true;
+    });
+    files.erase(itrFile, files.end());
+
+    auto& directories = m_spIndex->directories;
+    auto itrDir = std::remove_if(directories.begin(), directories.end(), [&](const IndexedDirectory& dir) {
+        if (!IsInDirectory(dir.path, rel))
+        {
+            return false;
+        }
+        GetEditor().GetFileSystem().UnwatchDirectory(m_spIndex->root / dir.path);
+        return true;
+    });
+    directories.erase(itrDir, directories.end());
+}
+
+void Indexer::QueueFiles(const std::vector<uint32_t>& files)
+{
+    // Shared out between the threads
+    auto threads = std::max(1u, std::thread::hardware_concurrency());
+    m_workQueues.clear();
+    for (uint32_t thread = 0; thread < threads; thread++)
+    {
+        m_workQueues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    uint32_t nextQueue = 0;
+    for (auto index : files)
+    {
+        m_workQueues[nextQueue++ % threads]->files.push_back(index);
+    }
+}
+
+void Indexer::AddSymbols(const fs::path& path, const FileSymbols& symbols)
+{
+    for (auto& symbol : symbols)
+    {
+        auto simpleName = SimpleName(symbol.first);
+        auto& shard = m_symbolShards[std::hash<std::string>()(simpleName) % m_symbolShards.size()];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.symbols.insert(std::make_pair(simpleName, SymbolLocation{ symbol.first, path, symbol.second }));
+    }
+}
+
+void Indexer::RemoveSymbols(const fs::path& path, const FileSymbols& symbols)
+{
+    for (auto& symbol : symbols)
+    {
+        auto simpleName = SimpleName(symbol.first);
+        auto& shard = m_symbolShards[std::hash<std::string>()(simpleName) % m_symbolShards.size()];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto range = shard.symbols.equal_range(simpleName);
+        for (auto itr = range.first; itr != range.second;)
+        {
+            itr = itr->second.path == path ? shard.symbols.erase(itr) : std::next(itr);
+        }
+    }
+}
+
+// Take the next file from the front of this thread's queue, or from the back of another
+bool Indexer::TakeWork(size_t worker, uint32_t& fileIndex)
+{
+    for (size_t offset = 0; offset < m_workQueues.size(); offset++)
+    {
+        auto& queue = *m_workQueues[(worker + offset) % m_workQueues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.files.empty())
+        {
+            continue;
+        }
+
+        if (offset == 0)
+        {
+            fileIndex = queue.files.front();
+            queue.files.pop_front();
+        }
+        else
+        {
+            fileIndex = queue.files.back();
+            queue.files.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void Indexer::StartSymbolSearch()
+{
+    auto spIndex = m_spIndex;
+    for (size_t worker = 0; worker < m_workQueues.size(); worker++)
+    {
+        m_symbolResults.push_back(GetEditor().GetThreadPool().enqueue_with(TaskPriority::Background, CancelToken(), [=]() {
+            auto& fs = GetEditor().GetFileSystem();
+            uint32_t fileIndex;
+            while (TakeWork(worker, fileIndex))
+            {
+                auto& file = spIndex->files[fileIndex];
+                auto fullPath = spIndex->root / file.path;
+
+                FileSymbols symbols;
+                if (fs.Exists(fullPath))
+                {
+                    ScanSymbols(fs.Read(fullPath), symbols);
+                }
+
+                AddSymbols(file.path, symbols);
+
+                std::lock_guard<std::mutex> lock(m_symbolMutex);
+                file.symbols = std::move(symbols);
+                file.parsed = true;
+            }
+        }));
+    }
+}
+
+bool Indexer::FindSymbol(const std::string& name, std::vector<SymbolLocation>& locations) const
+{
+    locations.clear();
+
+    auto simpleName = SimpleName(name);
+
+    // A qualified name must match the end of the symbol's name
+    auto& shard = m_symbolShards[std::hash<std::string>()(simpleName) % m_symbolShards.size()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.symbols.equal_range(simpleName);
+    for (auto itr = range.first; itr != range.second; itr++)
+    {
+        auto& symbolName = itr->second.name;
+        if (symbolName == name || (symbolName.size() > name.size() + 1 && symbolName.compare(symbolName.size() - name.size(), name.size(), name) == 0 && symbolName.compare(symbolName.size() - name.size() - 2, 2, "::") == 0))
+        {
+            locations.push_back(itr->second);
+        }
+    }
+
+    std::sort(locations.begin(), locations.end(), [](const SymbolLocation& lhs, const SymbolLocation& rhs) {
+        return lhs.path < rhs.path || (lhs.path == rhs.path && lhs.details.line < rhs.details.line);
+    });
+    return !locations.empty();
+}
+
+const fs::path& Indexer::GetSearchRoot() const
+{
+    return m_searchRoot;
+}
+
+namespace
+{
+
+// Words which look like a function call followed by a block, but are not functions
+const std::set<std::string> NotFunctions = {
+    "if",
+    "for",
+    "while",
+    "switch",
+    "catch",
+    "return",
+    "sizeof",
+    "alignof",
+    "decltype",
+    "new",
+    "delete",
+    "throw",
+    "operator",
+    "static_assert",
+    "else",
+    "do",
+    "case",
+    "goto"
+};
+
+// Words allowed between a function's arguments and its body
+const std::set<std::string> FunctionQualifiers = {
+    "const",
+    "volatile",
+    "override",
+    "final",
+    "noexcept",
+    "&",
+    "&&"
+};
+
+struct SymbolToken
+{
+    std::string text;
+    bool identifier = false;
+    int line = 0;
+    int column = 0;
+};
+
+enum class SymbolScope
+{
+    Namespace,
+    Class,
+    Body
+};
+
+bool IsIdentifierStart(char ch)
+{
+    return std::isalpha(uint8_t(ch)) || ch == '_';
+}
+
+bool IsIdentifierChar(char ch)
+{
+    return std::isalnum(uint8_t(ch)) || ch == '_';
+}
+
+bool IsClassKey(const SymbolToken& token)
+{
+    if (!token.identifier)
+    {
+        return false;
+    }
+    auto itr = MapToType.find(token.text);
+    return itr != MapToType.end() && (itr->second == t_class || itr->second == t_struct || itr->second == t_union || itr->second == t_enum);
+}
+
+// If the statement declares a class/struct/union/enum, return the token with its name
+int FindClassName(const std::vector<SymbolToken>& tokens)
+{
+    // struct Point p = { 0, 0 };
+    for (auto& token : tokens)
+    {
+        if (token.text == "=")
+        {
+            return -1;
+        }
+    }
+
+    int angleDepth = 0;
+    for (int index = 0; index < int(tokens.size()); index++)
+    {
+        auto& token = tokens[index];
+        if (token.text == "<")
+        {
+            angleDepth++;
+        }
+        else if (token.text == ">")
+        {
+            angleDepth--;
+        }
+        else if (token.text == "(")
+        {
+            return -1;
+        }
+        else if (angleDepth == 0 && IsClassKey(token))
+        {
+            // enum class Name
+            if (index + 1 < int(tokens.size()) && IsClassKey(tokens[index + 1]))
+            {
+                continue;
+            }
+
+            // The name is the last identifier before the base list or the body; this skips things like export macros
+            int name = -1;
+            for (auto next = index + 1; next < int(tokens.size()) && tokens[next].text != ":"; next++)
+            {
+                if (!tokens[next].identifier || tokens[next].text == "final")
+                {
+                    break;
+                }
+                name = next;
+            }
+            return name;
+        }
+    }
+    return -1;
+}
+
+// If the statement is a function definition, return the first and last tokens of its (possibly qualified) name
+bool FindFunctionName(const std::vector<SymbolToken>& tokens, bool inClass, int& first, int& last)
+{
+    // The arguments start at the first bracket outside of template arguments
+    int angleDepth = 0;
+    int open = -1;
+    for (int index = 0; index < int(tokens.size()); index++)
+    {
+        auto& text = tokens[index].text;
+        if (text == "<")
+        {
+            angleDepth++;
+        }
+        else if (text == ">")
+        {
+            angleDepth--;
+        }
+        else if (text == "=")
+        {
+            return false;
+        }
+        else if (text == "(" && angleDepth <= 0)
+        {
+            open = index;
+            break;
+        }
+    }
+
+    if (open < 1 || !tokens[open - 1].identifier || NotFunctions.count(tokens[open - 1].text))
+    {
+        return false;
+    }
+
+    // Name, walking back over Class::~Class
+    last = open - 1;
+    first = last;
+    bool qualified = false;
+    if (first > 0 && tokens[first - 1].text == "~")
+    {
+        first--;
+    }
+    while (first > 1 && tokens[first - 1].text == "::" && tokens[first - 2].identifier)
+    {
+        first -= 2;
+        qualified = true;
+    }
+
+    // Something must come before the name, unless it is a member or a qualified name; this rules out calls and macros
+    if (!inClass && !qualified)
+    {
+        if (first == 0)
+        {
+            return false;
+        }
+
+        auto& previous = tokens[first - 1];
+        if (previous.identifier ? NotFunctions.count(previous.text) != 0 : (previous.text != "*" && previous.text != "&" && previous.text != "&&" && previous.text != ">"))
+        {
+            return false;
+        }
+    }
+
+    // Match the closing bracket
+    int depth = 0;
+    int close = -1;
+    for (int index = open; index < int(tokens.size()); index++)
+    {
+        if (tokens[index].text == "(")
+        {
+            depth++;
+        }
+        else if (tokens[index].text == ")" && --depth == 0)
+        {
+            close = index;
+            break;
+        }
+    }
+    if (close < 0)
+    {
+        return false;
+    }
+
+    // Only qualifiers, a trailing return type or a constructor's initializers can follow
+    for (int index = close + 1; index < int(tokens.size()); index++)
+    {
+        auto& text = tokens[index].text;
+        if (text == ":" || text == "->")
+        {
+            break;
+        }
+        else if (text == "(" && index > 0 && tokens[index - 1].text == "noexcept")
+        {
+            for (depth = 0; index < int(tokens.size()); index++)
+            {
+                if (tokens[index].text == "(")
+                {
+                    depth++;
+                }
+                else if (tokens[index].text == ")" && --depth == 0)
+                {
+                    break;
+                }
+            }
+        }
+        else if (!FunctionQualifiers.count(text))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// A single pass over C/C++ source, finding definitions of functions, classes, structs and defines.
+// This isn't a parser; it skips comments, strings and function bodies, and looks at the statement in front of each
+// opening brace to decide what it belongs to.  Lines and columns are 0 based.
+void Indexer::ScanSymbols(const std::string& text, FileSymbols& symbols)
+{
+    std::vector<SymbolToken> statement;
+    std::vector<std::pair<SymbolScope, std::string>> scopes;
+
+    auto inBody = [&]() {
+        return !scopes.empty() && scopes.back().first == SymbolScope::Body;
+    };
+
+    auto qualify = [&](const std::string& name) {
+        std::string qualified;
+        for (auto& scope : scopes)
+        {
+            if (scope.first == SymbolScope::Class)
+            {
+                qualified += scope.second + "::";
+            }
+        }
+        return qualified + name;
+    };
+
+    int line = 0;
+    size_t lineStart = 0;
+    bool startOfLine = true;
+
+    const size_t end = text.size();
+    size_t pos = 0;
+    while (pos < end)
+    {
+        auto ch = text[pos];
+        if (ch == '\n')
+        {
+            line++;
+            lineStart = ++pos;
+            startOfLine = true;
+            continue;
+        }
+        else if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\f' || ch == '\v')
+        {
+            pos++;
+            continue;
+        }
+
+        auto column = int(pos - lineStart);
+        bool wasStartOfLine = startOfLine;
+        startOfLine = false;
+
+        // Comments
+        if (ch == '/' && pos + 1 < end && text[pos + 1] == '/')
+        {
+            while (pos < end && text[pos] != '\n')
+            {
+                pos++;
+            }
+            continue;
+        }
+        else if (ch == '/' && pos + 1 < end && text[pos + 1] == '*')
+        {
+            for (pos += 2; pos < end && !(text[pos] == '*' && pos + 1 < end && text[pos + 1] == '/'); pos++)
+            {
+                if (text[pos] == '\n')
+                {
+                    line++;
+                    lineStart = pos + 1;
+                }
+            }
+            pos = std::min(pos + 2, end);
+            continue;
+        }
+
+        // Preprocessor; look at defines, skip the rest, including continued lines
+        if (ch == '#' && wasStartOfLine)
+        {
+            pos++;
+            while (pos < end && (text[pos] == ' ' || text[pos] == '\t'))
+            {
+                pos++;
+            }
+
+            if (text.compare(pos, 6, "define") == 0)
+            {
+                pos += 6;
+                while (pos < end && (text[pos] == ' ' || text[pos] == '\t'))
+                {
+                    pos++;
+                }
+
+                auto nameStart = pos;
+                while (pos < end && IsIdentifierChar(text[pos]))
+                {
+                    pos++;
+                }
+
+                if (pos != nameStart && IsIdentifierStart(text[nameStart]))
+                {
+                    symbols.push_back(std::make_pair(text.substr(nameStart, pos - nameStart), SymbolDetails{ line, int(nameStart - lineStart) }));
+                }
+            }
+
+            for (; pos < end && text[pos] != '\n'; pos++)
+            {
+                if (text[pos] == '\\' && pos + 1 < end && (text[pos + 1] == '\n' || text[pos + 1] == '\r'))
+                {
+                    pos = text.find('\n', pos);
+                    if (pos == std::string::npos)
+                    {
+                        pos = end;
+                        break;
+                    }
+                    line++;
+                    lineStart = pos + 1;
+                }
+            }
+            continue;
+        }
+
+        // Strings and characters; a raw string's prefix has already been read as an identifier
+        if (ch == '"' || ch == '\'')
+        {
+            bool raw = ch == '"' && !statement.empty() && pos > 0 && text[pos - 1] == 'R' && !statement.back().text.empty() && statement.back().text.back() == 'R';
+            if (raw)
+            {
+                auto open = text.find('(', pos);
+                auto delimiter = ")" + text.substr(pos + 1, open == std::string::npos ? 0 : open - pos - 1) + "\"";
+                auto close = open == std::string::npos ? std::string::npos : text.find(delimiter, open);
+                auto stringEnd = close == std::string::npos ? end : close + delimiter.size();
+                for (; pos < stringEnd; pos++)
+                {
+                    if (text[pos] == '\n')
+                    {
+                        line++;
+                        lineStart = pos + 1;
+                    }
+                }
+                statement.pop_back();
+                continue;
+            }
+
+            for (pos++; pos < end && text[pos] != ch && text[pos] != '\n'; pos++)
+            {
+                if (text[pos] == '\\')
+                {
+                    pos++;
+                }
+            }
+            pos = std::min(pos + 1, end);
+            if (!inBody())
+            {
+                statement.push_back(SymbolToken{ std::string(1, ch), false, line, column });
+            }
+            continue;
+        }
+
+        // Numbers, including 1'000 and 1.0e-5f
+        if (std::isdigit(uint8_t(ch)))
+        {
+            for (pos++; pos < end && (IsIdentifierChar(text[pos]) || text[pos] == '.' || text[pos] == '\''); pos++)
+            {
+            }
+            if (!inBody())
+            {
+                statement.push_back(SymbolToken{ "0", false, line, column });
+            }
+            continue;
+        }
+
+        if (IsIdentifierStart(ch))
+        {
+            auto wordStart = pos;
+            while (pos < end && IsIdentifierChar(text[pos]))
+            {
+                pos++;
+            }
+
+            // Only the raw string check cares about identifiers in a function body
+            if (!inBody() || (pos < end && text[pos] == '"'))
+            {
+                statement.push_back(SymbolToken{ text.substr(wordStart, pos - wordStart), true, line, column });
+            }
+            continue;
+        }
+
+        pos++;
+        if (ch == '{')
+        {
+            auto scope = std::make_pair(SymbolScope::Body, std::string());
+            if (!inBody())
+            {
+                bool inClass = !scopes.empty() && scopes.back().first == SymbolScope::Class;
+                int first = 0;
+                int last = 0;
+                auto className = FindClassName(statement);
+                if (className >= 0)
+                {
+                    auto& token = statement[className];
+                    symbols.push_back(std::make_pair(qualify(token.text), SymbolDetails{ token.line, token.column }));
+                    scope = std::make_pair(SymbolScope::Class, token.text);
+                }
+                else if (FindFunctionName(statement, inClass, first, last))
+                {
+                    std::string name;
+                    for (auto index = first; index <= last; index++)
+                    {
+                        name += statement[index].text;
+                    }
+
+                    auto& token = statement[last];
+                    symbols.push_back(std::make_pair(qualify(name), SymbolDetails{ token.line, token.column }));
+                }
+                else if (statement.empty() || statement[0].text == "namespace" || statement[0].text == "extern" || (statement.size() > 1 && statement[1].text == "namespace"))
+                {
+                    // Blocks at namespace level (extern "C", inline namespace, or a stray brace) can contain definitions
+                    scope.first = statement.empty() && !scopes.empty() ? scopes.back().first : SymbolScope::Namespace;
+                    if (scope.first == SymbolScope::Class)
+                    {
+                        scope.first = SymbolScope::Body;
+                    }
+                }
+            }
+            scopes.push_back(scope);
+            statement.clear();
+        }
+        else if (ch == '}')
+        {
+            if (!scopes.empty())
+            {
+                scopes.pop_back();
+            }
+            statement.clear();
+        }
+        else if (ch == ';')
+        {
+            statement.clear();
+        }
+        else if (!inBody())
+        {
+            // public: etc. start a new statement
+            if (ch == ':' && pos < end && text[pos] == ':')
+            {
+                pos++;
+                statement.push_back(SymbolToken{ "::", false, line, column });
+            }
+            else if (ch == ':' && statement.size() == 1 && (statement[0].text == "public" || statement[0].text == "private" || statement[0].text == "protected"))
+            {
+                statement.clear();
+            }
+            else if ((ch == '-' && pos < end && text[pos] == '>') || (ch == '&' && pos < end && text[pos] == '&'))
+            {
+                statement.push_back(SymbolToken{ text.substr(pos - 1, 2), false, line, column });
+                pos++;
+            }
+            else
+            {
+                statement.push_back(SymbolToken{ std::string(1, ch), false, line, column });
+            }
+        }
+    }
+}
+
+bool Indexer::StartIndexing()
+{
+    bool foundGit = false;
+    auto root = GetEditor().GetFileSystem().GetSearchRoot(GetEditor().GetFileSystem().GetWorkingDirectory(), foundGit);
+    if (!foundGit)
+    {
+        ZLOG(INFO, "Not a git project");
+        return false;
+    }
+
+    return StartIndexing(root);
+}
+
+bool Indexer::StartIndexing(const fs::path& root)
+{
+    m_searchRoot = root;
+
+    std::string errors;
+    GetSearchPaths(GetEditor(), m_searchRoot, m_ignorePaths, m_includePaths, errors);
+    auto& fs = GetEditor().GetFileSystem();
 
     auto indexDBRoot = m_searchRoot / ".zep";
     if (!fs.IsDirectory(indexDBRoot))
@@ -285,11 +1576,25 @@ bool Indexer::StartIndexing()
         }
     }
 
-    int v = 0;
-    fs.Write(indexDBRoot / "indexdb", &v, 1);
+    // The last index can be used straight away, while it is checked against the disk
+    m_indexPath = indexDBRoot / "indexdb";
+    ProjectIndex oldIndex;
+    if (LoadIndex(fs, m_indexPath, oldIndex) && oldIndex.root == m_searchRoot)
+    {
+        m_spIndex = std::make_shared<ProjectIndex>(oldIndex);
+    }
+    else
+    {
+        oldIndex = ProjectIndex();
+        oldIndex.root = m_searchRoot;
+    }
 
     m_fileSearchActive = true;
-    m_indexResult = Indexer::IndexPaths(GetEditor(), m_searchRoot);
+    auto pEditor = &GetEditor();
+    // Keeping the project index up to date can wait for anything the user is waiting for
+    m_indexResult = GetEditor().GetThreadPool().enqueue_with(TaskPriority::Background, CancelToken(), [=]() {
+        return Indexer::UpdateIndex(*pEditor, oldIndex);
+    });
 
     return true;
 }
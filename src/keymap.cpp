@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <limits>
 #include <regex>
+#include <string_view>
 
 #include "zep/keymap.h"
 #include "zep/mode.h"
@@ -140,6 +144,9 @@ bool keymap_add(KeyMap& map, const std::string& strCommand, const StringId& comm
         }
     }
 
+    map.spCompiled.reset();
+    keymap_changed();
+
     if (spCurrent->commandId != 0 && option == KeyMapAdd::New)
     {
         assert(!"Adding twice?");
@@ -181,210 +188,505 @@ bool isDigit(const char ch)
     return false;
 }
 
-// Walk the tree of tokens, figuring out which command this is
-// Input to this function:
-// <C-x>fgh
-// i.e. Keyboard mappings are fed in as <> strings.
-void keymap_find(const KeyMap& map, const std::string& strCommand, KeyMapResult& findResult)
+namespace
+{
+// Key codes below this are bytes; groups such as <C-r> are numbered from here
+const uint32_t KeyGroupBase = 256;
+
+// A group which no map has; only a wildcard takes it
+const uint32_t KeyUnknownGroup = 0xFFFFFFFE;
+
+// Stands for every key a state doesn't have a move for
+const uint32_t KeyOther = 0xFFFFFFFF;
+
+// Places in the tree are a node, and how far through it we are
+const uint32_t KeyPlaceAtNode = 0;
+const uint32_t KeyPlaceInDigits = 1;
+const uint32_t KeyPlaceAfterQuote = 2;
+
+uint64_t KeyMapGeneration = 1;
+uint64_t KeyMapSerial = 0;
+
+uint32_t GroupCode(const std::string_view& group, bool add)
+{
+    // Shared by all maps, so that the same group has the same code in each
+    static std::map<std::string, uint32_t, std::less<>> groups;
+    auto itr = groups.find(group);
+    if (itr != groups.end())
+    {
+        return itr->second;
+    }
+
+    if (!add)
+    {
+        return KeyUnknownGroup;
+    }
+
+    auto code = KeyGroupBase + uint32_t(groups.size());
+    groups.emplace(std::string(group), code);
+    return code;
+}
+
+// The length of the token at the start of the text; a <> group, or one char
+size_t TokenLength(const char* pText, size_t size)
+{
+    if (pText[0] == '<')
+    {
+        auto pEnd = (const char*)memchr(pText, '>', size);
+        if (pEnd)
+        {
+            return pEnd - pText + 1;
+        }
+    }
+    return 1;
+}
+
+uint32_t TokenCode(const char* pText, size_t length)
+{
+    if (length == 1)
+    {
+        return uint8_t(pText[0]);
+    }
+    return GroupCode(std::string_view(pText, length), false);
+}
+
+bool IsDigitCode(uint32_t code)
 {
-    auto consumeDigits = [](std::shared_ptr<CommandNode>& spNode, std::string::const_iterator& itrChar, std::string::const_iterator itrEnd, std::vector<int>& result, std::ostringstream& str) {
-        if (spNode->token == "<D>")
+    return code >= '0' && code <= '9';
+}
+
+// The places the key moves the given places to; places which can't go any further are dropped
+void StepPlaces(const KeyMapAutomaton& automaton, const std::vector<uint32_t>& places, uint32_t code, std::vector<uint32_t>& next)
+{
+    next.clear();
+    for (auto place : places)
+    {
+        auto nodeIndex = place >> 2;
+        auto where = place & 3;
+        if (where == KeyPlaceAfterQuote)
         {
-            // Walk along grabbing digits
-            auto itrStart = itrChar;
-            while (itrChar != itrEnd && isDigit(*itrChar))
-            {
-                itrChar++;
-            }
+            // Any key is the register
+            next.push_back(nodeIndex << 2);
+            continue;
+        }
 
-            if (itrStart != itrChar)
+        // Digits are taken for as long as they come
+        if (where == KeyPlaceInDigits && IsDigitCode(code))
+        {
+            next.push_back(place);
+            continue;
+        }
+
+        auto& node = automaton.nodes[nodeIndex];
+        for (auto childIndex = node.firstChild; childIndex < node.firstChild + node.childCount; childIndex++)
+        {
+            auto& child = automaton.nodes[childIndex];
+            switch (child.type)
             {
-                auto token = std::string(itrStart, itrChar);
-                try
+            case KeyMapAutomaton::NodeType::Key:
+                if (child.code == code)
                 {
-                    // Grab the data, but continue to search for the next token
-                    result.push_back(std::stoi(token));
-                    str << "(D:" << token << ")";
+                    next.push_back(childIndex << 2);
                 }
-                catch (std::exception& ex)
+                break;
+            case KeyMapAutomaton::NodeType::Digits:
+                if (IsDigitCode(code))
                 {
-                    ZEP_UNUSED(ex);
-                    ZLOG(DBG, ex.what());
+                    next.push_back((childIndex << 2) | KeyPlaceInDigits);
                 }
-                return true;
+                break;
+            case KeyMapAutomaton::NodeType::Register:
+                if (code == '"')
+                {
+                    next.push_back((childIndex << 2) | KeyPlaceAfterQuote);
+                }
+                break;
+            case KeyMapAutomaton::NodeType::AnyChar:
+                next.push_back(childIndex << 2);
+                break;
             }
         }
-        return false;
-    };
+    }
+
+    next.erase(std::remove_if(next.begin(), next.end(), [&](uint32_t place) {
+        auto& node = automaton.nodes[place >> 2];
+        return node.commandId.id == 0 && node.childCount == 0;
+    }),
+        next.end());
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+}
+
+uint32_t StepState(const KeyMapAutomaton& automaton, uint32_t state, uint32_t code)
+{
+    auto& current = automaton.states[state];
+    auto pBegin = automaton.moves.data() + current.firstMove;
+    auto pEnd = pBegin + current.moveCount;
+    auto pMove = std::lower_bound(pBegin, pEnd, code, [](const KeyMapAutomaton::Move& move, uint32_t value) {
+        return move.code < value;
+    });
+    if (pMove != pEnd && pMove->code == code)
+    {
+        return pMove->state;
+    }
+    return current.otherState;
+}
+
+// Walk the keys along the path to the found node, picking up the captures; returns where the node's keys end
+size_t ReadCaptures(const KeyMapAutomaton& automaton, uint32_t nodeIndex, const std::string& strCommand, KeyMapResult& result, bool describe)
+{
+    auto& node = automaton.nodes[nodeIndex];
+    if (node.parent == nodeIndex)
+    {
+        return 0;
+    }
 
-    auto consumeChar = [](std::shared_ptr<CommandNode>& spNode, std::string::const_iterator& itrChar, std::string::const_iterator itrEnd, std::vector<char>& chars, std::ostringstream& str) {
-        if (spNode->token == "<.>")
+    auto pos = ReadCaptures(automaton, node.parent, strCommand, result, describe);
+    auto size = strCommand.size();
+    auto start = pos;
+    switch (node.type)
+    {
+    case KeyMapAutomaton::NodeType::Key:
+        pos += TokenLength(&strCommand[pos], size - pos);
+        break;
+    case KeyMapAutomaton::NodeType::Digits:
+    {
+        // Too big to count is ignored, but still taken
+        int value = 0;
+        bool fits = true;
+        while (pos < size && isDigit(strCommand[pos]))
         {
-            // Special match groups
-            if (itrChar != itrEnd)
-            {
-                chars.push_back(*itrChar);
-                str << "(." << *itrChar << ")";
-                itrChar++;
-                return true;
-            }
+            auto digit = strCommand[pos++] - '0';
+            fits = fits && value <= (std::numeric_limits<int>::max() - digit) / 10;
+            value = fits ? value * 10 + digit : value;
         }
-        return false;
-    };
 
-    auto consumeRegister = [](std::shared_ptr<CommandNode>& spNode, std::string::const_iterator& itrChar, std::string::const_iterator itrEnd, std::vector<char>& registers, std::ostringstream& str) {
-        if (spNode->token == "<R>")
+        if (fits)
         {
-            // Grab register
-            if (itrChar != itrEnd && *itrChar == '"')
+            result.captureNumbers.push_back(value);
+        }
+
+        if (describe)
+        {
+            result.searchPath += "(D:" + strCommand.substr(start, pos - start) + ")";
+        }
+    }
+    break;
+    case KeyMapAutomaton::NodeType::Register:
+        pos++;
+        if (pos < size)
+        {
+            result.captureRegisters.push_back(strCommand[pos]);
+            if (describe)
             {
-                itrChar++;
-                if (itrChar != itrEnd)
-                {
-                    registers.push_back(*itrChar);
-                    str << "(\"" << *itrChar << ")";
-                    itrChar++;
-                }
-                return true;
+                result.searchPath += "(\"" + std::string(1, strCommand[pos]) + ")";
             }
+            pos += TokenLength(&strCommand[pos], size - pos);
         }
-        return false;
-    };
+        break;
+    case KeyMapAutomaton::NodeType::AnyChar:
+        result.captureChars.push_back(strCommand[pos]);
+        if (describe)
+        {
+            result.searchPath += "(." + std::string(1, strCommand[pos]) + ")";
+        }
+        pos += TokenLength(&strCommand[pos], size - pos);
+        break;
+    }
 
-    struct Captures
+    if (describe)
     {
-        std::vector<int> captureNumbers;
-        std::vector<char> captureChars;
-        std::vector<char> captureRegisters;
-    };
+        result.searchPath += "(" + automaton.tokens[nodeIndex] + ")";
+    }
+    return pos;
+}
 
-    std::function<bool(std::shared_ptr<CommandNode>, std::string::const_iterator, std::string::const_iterator, const Captures& captures, KeyMapResult&)> fnSearch;
-    fnSearch = [&](std::shared_ptr<CommandNode> spNode, std::string::const_iterator itrChar, std::string::const_iterator itrEnd, const Captures& captures, KeyMapResult& result) {
-        for (auto& child : spNode->children)
-        {
-            auto spChildNode = child.second;
-            std::string::const_iterator itr = itrChar;
+} // namespace
 
-            Captures nodeCaptures;
-            std::ostringstream strCaptures;
+uint64_t keymap_generation()
+{
+    return KeyMapGeneration;
+}
 
-            std::string token;
+void keymap_changed()
+{
+    KeyMapGeneration++;
+}
 
-            // Consume wildcards
-            if (consumeDigits(spChildNode, itr, itrEnd, nodeCaptures.captureNumbers, strCaptures))
+// Build the automaton for the maps: the trees go into one array, then the states are found from the start state,
+// one set of places at a time
+void keymap_compile(const std::vector<const KeyMap*>& maps, KeyMapAutomaton& automaton)
+{
+    automaton = KeyMapAutomaton();
+    automaton.serial = ++KeyMapSerial;
+
+    // Which map the node is in, then the wildcards on the way to it; less wins
+    std::vector<uint32_t> priority;
+    std::vector<const CommandNode*> source;
+    std::vector<uint32_t> start;
+    for (uint32_t mapIndex = 0; mapIndex < uint32_t(maps.size()); mapIndex++)
+    {
+        auto rootIndex = uint32_t(automaton.nodes.size());
+        KeyMapAutomaton::Node root;
+        root.parent = rootIndex;
+        automaton.nodes.push_back(root);
+        automaton.tokens.push_back("");
+        source.push_back(maps[mapIndex]->spRoot.get());
+        priority.push_back(mapIndex << 16);
+        start.push_back(rootIndex << 2);
+    }
+
+    // A node's children are next to each other, in order of their tokens
+    for (uint32_t nodeIndex = 0; nodeIndex < uint32_t(automaton.nodes.size()); nodeIndex++)
+    {
+        std::vector<const CommandNode*> children;
+        for (auto& [token, spChild] : source[nodeIndex]->children)
+        {
+            children.push_back(spChild.get());
+        }
+        std::sort(children.begin(), children.end(), [](const CommandNode* pLeft, const CommandNode* pRight) {
+            return pLeft->token < pRight->token;
+        });
+
+        automaton.nodes[nodeIndex].firstChild = uint32_t(automaton.nodes.size());
+        automaton.nodes[nodeIndex].childCount = uint32_t(children.size());
+        for (auto pChild : children)
+        {
+            KeyMapAutomaton::Node node;
+            node.parent = nodeIndex;
+            node.commandId = pChild->commandId;
+
+            auto nodePriority = priority[nodeIndex] + 1;
+            if (pChild->token == "<D>")
             {
-                token = spChildNode->token;
+                node.type = KeyMapAutomaton::NodeType::Digits;
             }
-            else if (consumeRegister(spChildNode, itr, itrEnd, nodeCaptures.captureRegisters, strCaptures))
+            else if (pChild->token == "<R>")
             {
-                token = spChildNode->token;
+                node.type = KeyMapAutomaton::NodeType::Register;
             }
-            else if (consumeChar(spChildNode, itr, itrEnd, nodeCaptures.captureChars, strCaptures))
+            else if (pChild->token == "<.>")
             {
-                token = spChildNode->token;
+                node.type = KeyMapAutomaton::NodeType::AnyChar;
             }
             else
             {
-                // Grab full <C-> tokens
-                token = string_slurp_if(itr, itrEnd, '<', '>');
-                if (token.empty() && itr != itrEnd)
+                node.code = pChild->token.size() == 1 ? uint8_t(pChild->token[0]) : GroupCode(pChild->token, true);
+                nodePriority--;
+            }
+
+            automaton.nodes.push_back(node);
+            automaton.tokens.push_back(pChild->token);
+            priority.push_back(nodePriority);
+            source.push_back(pChild);
+        }
+    }
+
+    std::map<std::vector<uint32_t>, uint32_t> stateIds;
+    std::vector<std::vector<uint32_t>> stateSets;
+    auto findState = [&](const std::vector<uint32_t>& places) {
+        auto itr = stateIds.find(places);
+        if (itr != stateIds.end())
+        {
+            return itr->second;
+        }
+        auto id = uint32_t(stateSets.size());
+        stateIds[places] = id;
+        stateSets.push_back(places);
+        return id;
+    };
+
+    findState(std::vector<uint32_t>());
+    stateSets.push_back(start);
+    if (!start.empty())
+    {
+        stateIds[start] = KeyMapAutomaton::StartState;
+    }
+
+    std::vector<uint32_t> codes;
+    std::vector<uint32_t> next;
+    for (uint32_t stateIndex = 0; stateIndex < uint32_t(stateSets.size()); stateIndex++)
+    {
+        auto places = stateSets[stateIndex];
+
+        KeyMapAutomaton::State state;
+        state.found = KeyMapAutomaton::NoNode;
+        codes.clear();
+        for (auto place : places)
+        {
+            auto nodeIndex = place >> 2;
+            auto& node = automaton.nodes[nodeIndex];
+            if (node.commandId.id != 0)
+            {
+                auto best = state.found;
+                if (best == KeyMapAutomaton::NoNode || priority[nodeIndex] < priority[best] || (priority[nodeIndex] == priority[best] && nodeIndex < best))
                 {
-                    // ... or next char
-                    token = std::string(itr, itr + 1);
-                    string_eat_char(itr, itrEnd);
+                    state.found = nodeIndex;
                 }
             }
+            state.live = state.live || node.childCount != 0;
 
-            if (token.empty() && child.second->commandId == StringId() && !spChildNode->children.empty())
+            // The keys which go somewhere different to the rest
+            if ((place & 3) == KeyPlaceAfterQuote)
             {
-                result.searchPath += "(...)";
-                result.needMoreChars = true;
                 continue;
             }
 
-            // We found a matching token or wildcard token at this level
-            if (child.first == token)
+            if ((place & 3) == KeyPlaceInDigits)
             {
-                // Remember what we found
-                result.searchPath += strCaptures.str() + "(" + token + ")";
-
-                // Remember if this is a valid match for something
-                result.foundMapping = spChildNode->commandId;
-
-                // Append our capture groups to the current hierarchy level
-                nodeCaptures.captureChars.insert(nodeCaptures.captureChars.end(), captures.captureChars.begin(), captures.captureChars.end());
-                nodeCaptures.captureNumbers.insert(nodeCaptures.captureNumbers.end(), captures.captureNumbers.begin(), captures.captureNumbers.end());
-                nodeCaptures.captureRegisters.insert(nodeCaptures.captureRegisters.end(), captures.captureRegisters.begin(), captures.captureRegisters.end());
+                for (uint32_t digit = '0'; digit <= '9'; digit++)
+                {
+                    codes.push_back(digit);
+                }
+            }
 
-                // This node doesn't have a mapping, so look harder
-                if (result.foundMapping == StringId())
+            for (auto childIndex = node.firstChild; childIndex < node.firstChild + node.childCount; childIndex++)
+            {
+                auto& child = automaton.nodes[childIndex];
+                if (child.type == KeyMapAutomaton::NodeType::Key)
                 {
-                    // There are more children, and we haven't got any more characters, keep asking for more
-                    if (!spChildNode->children.empty() && itr == itrEnd)
-                    {
-                        result.needMoreChars = true;
-                    }
-                    else
+                    codes.push_back(child.code);
+                }
+                else if (child.type == KeyMapAutomaton::NodeType::Digits)
+                {
+                    for (uint32_t digit = '0'; digit <= '9'; digit++)
                     {
-                        // Walk down to the next level
-                        if (fnSearch(spChildNode, itr, itrEnd, nodeCaptures, result))
-                            return true;
+                        codes.push_back(digit);
                     }
                 }
-                else
+                else if (child.type == KeyMapAutomaton::NodeType::Register)
                 {
-                    // This is the find result, note it and record the capture groups for the find
-                    result.searchPath += " : " + spChildNode->commandId.ToString();
-                    result.captureChars = nodeCaptures.captureChars;
-                    result.captureNumbers = nodeCaptures.captureNumbers;
-                    result.captureRegisters = nodeCaptures.captureRegisters;
-                    result.needMoreChars = false;
-                    return true;
+                    codes.push_back('"');
                 }
             }
-        };
+        }
 
-        // Searched and found nothing in this level
-        return false;
-    }; // fnSearch
+        // The search stops at a command, so it doesn't need any moves
+        if (state.found == KeyMapAutomaton::NoNode)
+        {
+            std::sort(codes.begin(), codes.end());
+            codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+            StepPlaces(automaton, places, KeyOther, next);
+            state.otherState = findState(next);
+            state.firstMove = uint32_t(automaton.moves.size());
+            for (auto code : codes)
+            {
+                StepPlaces(automaton, places, code, next);
+                auto target = findState(next);
+                if (target != state.otherState)
+                {
+                    automaton.moves.push_back(KeyMapAutomaton::Move{ code, target });
+                }
+            }
+            state.moveCount = uint32_t(automaton.moves.size()) - state.firstMove;
+        }
+        automaton.states.push_back(state);
+    }
+}
 
+// Input to this function:
+// <C-x>fgh
+// i.e. Keyboard mappings are fed in as <> strings.
+// Each token is a move in the automaton; if the match is given, and was for the start of this command, the search
+// carries on from where it got to.
+void keymap_find(const KeyMapAutomaton& automaton, const std::string& strCommand, KeyMapResult& findResult, KeyMapMatch* pMatch, bool describe)
+{
     findResult.needMoreChars = false;
 
-    Captures captures;
-    bool found = fnSearch(map.spRoot, strCommand.begin(), strCommand.end(), captures, findResult);
-    if (!found)
+    size_t pos = 0;
+    uint32_t state = automaton.states.size() > KeyMapAutomaton::StartState ? KeyMapAutomaton::StartState : KeyMapAutomaton::DeadState;
+    if (pMatch && pMatch->serial == automaton.serial && pMatch->command.size() <= strCommand.size() && strCommand.compare(0, pMatch->command.size(), pMatch->command) == 0)
+    {
+        state = pMatch->state;
+        pos = pMatch->command.size();
+    }
+
+    bool canResume = pMatch != nullptr;
+    while (pos < strCommand.size() && state != KeyMapAutomaton::DeadState && automaton.states[state].found == KeyMapAutomaton::NoNode)
     {
-        if (findResult.needMoreChars)
+        auto length = TokenLength(&strCommand[pos], strCommand.size() - pos);
+
+        // A '<' on its own may be the start of a group when more keys come, so we can't carry on from after it
+        if (length == 1 && strCommand[pos] == '<')
+        {
+            canResume = false;
+        }
+
+        state = StepState(automaton, state, TokenCode(&strCommand[pos], length));
+        pos += length;
+
+        if (canResume)
+        {
+            pMatch->serial = automaton.serial;
+            pMatch->state = state;
+            pMatch->command.assign(strCommand, 0, pos);
+        }
+    }
+
+    auto& current = automaton.states[state];
+    if (current.found != KeyMapAutomaton::NoNode)
+    {
+        // This is the find result; the captures are read from the outside in, but were always given inside first
+        auto& node = automaton.nodes[current.found];
+        findResult.foundMapping = node.commandId;
+        ReadCaptures(automaton, current.found, strCommand, findResult, describe);
+        std::reverse(findResult.captureNumbers.begin(), findResult.captureNumbers.end());
+        std::reverse(findResult.captureChars.begin(), findResult.captureChars.end());
+        std::reverse(findResult.captureRegisters.begin(), findResult.captureRegisters.end());
+        if (describe)
+        {
+            findResult.searchPath += " : " + node.commandId.ToString();
+        }
+    }
+    else if (state != KeyMapAutomaton::DeadState && current.live)
+    {
+        findResult.needMoreChars = true;
+        if (describe)
         {
             findResult.searchPath += "(...)";
         }
-        else
+    }
+    else
+    {
+        // Special case where the user typed a j followed by _not_ a k.
+        // Return it as an insert command
+        if (strCommand.size() == 2 && strCommand[0] == 'j')
         {
-            // Special case where the user typed a j followed by _not_ a k.
-            // Return it as an insert command
-            if (strCommand.size() == 2 && strCommand[0] == 'j')
+            findResult.commandWithoutGroups = strCommand;
+            if (describe)
             {
-                findResult.needMoreChars = false;
-                findResult.commandWithoutGroups = strCommand;
                 findResult.searchPath += "(j.)";
             }
-            else
+        }
+        else
+        {
+            if (describe)
             {
                 findResult.searchPath += "(Unknown)";
+            }
 
-                // Didn't find anything, return sanitized text for possible input
-                auto itr = strCommand.begin();
-                auto token = string_slurp_if(itr, strCommand.end(), '<', '>');
-                if (token.empty())
-                {
-                    token = strCommand;
-                }
-                findResult.commandWithoutGroups = token;
+            // Didn't find anything, return sanitized text for possible input
+            auto itr = strCommand.begin();
+            auto token = string_slurp_if(itr, strCommand.end(), '<', '>');
+            if (token.empty())
+            {
+                token = strCommand;
             }
+            findResult.commandWithoutGroups = token;
         }
     }
+}
 
-    // ZLOG(DBG, strCommand << " - " << findResult.searchPath);
+// Walk the tree of tokens, figuring out which command this is
+void keymap_find(const KeyMap& map, const std::string& strCommand, KeyMapResult& findResult)
+{
+    if (!map.spCompiled)
+    {
+        map.spCompiled = std::make_shared<KeyMapAutomaton>();
+        keymap_compile({ &map }, *map.spCompiled);
+    }
+    keymap_find(*map.spCompiled, strCommand, findResult, nullptr, true);
 }
 
 } // namespace Zep
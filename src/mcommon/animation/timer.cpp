@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono> // Timing
 #include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "zep/mcommon/logger.h"
 
@@ -55,6 +61,7 @@ double timer_to_ms(uint64_t value)
 
 ProfileBlock::ProfileBlock(const char* timer)
     : strTimer(timer)
+    , zone(timer)
 {
     timer_start(blockTimer);
     if (globalProfiler.timerData.find(timer) == globalProfiler.timerData.end())
@@ -76,4 +83,180 @@ void profile_add_value(profile_value& val, double av)
     val.current = av;
 }
 
+namespace
+{
+// Enough for a few seconds of a busy frame loop on each thread
+const size_t ProfileRingSize = 64 * 1024;
+
+struct ProfileRing
+{
+    std::mutex mutex;
+    std::vector<profile_zone_event> events;
+    uint64_t written = 0;
+    uint32_t id = 0;
+    std::string name;
+};
+
+struct ProfileRings
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ProfileRing>> rings;
+};
+
+// Off unless asked for, so the rings aren't made
+std::atomic<bool> ProfileEnabled = { false };
+
+ProfileRings& GetProfileRings()
+{
+    static ProfileRings rings;
+    return rings;
+}
+
+// The calling thread's ring; kept after the thread has gone.  The events are only made when it finishes a zone
+ProfileRing& GetThreadRing()
+{
+    thread_local std::shared_ptr<ProfileRing> spRing;
+    if (!spRing)
+    {
+        spRing = std::make_shared<ProfileRing>();
+
+        auto& rings = GetProfileRings();
+        std::lock_guard<std::mutex> lock(rings.mutex);
+        spRing->id = uint32_t(rings.rings.size() + 1);
+        spRing->name = "Thread " + std::to_string(spRing->id);
+        rings.rings.push_back(spRing);
+    }
+    return *spRing;
+}
+
+void WriteJsonString(std::ostream& str, const char* pText)
+{
+    str << '"';
+    for (; *pText; pText++)
+    {
+        if (*pText == '"' || *pText == '\\')
+        {
+            str << '\\';
+        }
+        str << *pText;
+    }
+    str << '"';
+}
+} // namespace
+
+uint64_t profile_time_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void profile_enable(bool enable)
+{
+    ProfileEnabled = enable;
+}
+
+bool profile_enabled()
+{
+    return ProfileEnabled.load(std::memory_order_relaxed);
+}
+
+void profile_zone_end(const char* name, uint64_t start)
+{
+    auto end = profile_time_now();
+    auto& ring = GetThreadRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    if (ring.events.empty())
+    {
+        ring.events.resize(ProfileRingSize);
+    }
+    auto& event = ring.events[ring.written++ % ProfileRingSize];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+}
+
+void profile_set_thread_name(const std::string& name)
+{
+    auto& ring = GetThreadRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.name = name;
+}
+
+size_t profile_zone_count()
+{
+    auto& rings = GetProfileRings();
+    std::lock_guard<std::mutex> lock(rings.mutex);
+    size_t count = 0;
+    for (auto& spRing : rings.rings)
+    {
+        std::lock_guard<std::mutex> ringLock(spRing->mutex);
+        count += size_t(std::min(spRing->written, uint64_t(ProfileRingSize)));
+    }
+    return count;
+}
+
+// Times are in microseconds from the first zone still held
+void profile_write_trace(std::ostream& str)
+{
+    struct ThreadZones
+    {
+        uint32_t id;
+        std::string name;
+        std::vector<profile_zone_event> events;
+    };
+
+    // Copy out, so the threads aren't held up while it is written
+    std::vector<ThreadZones> threads;
+    {
+        auto& rings = GetProfileRings();
+        std::lock_guard<std::mutex> lock(rings.mutex);
+        for (auto& spRing : rings.rings)
+        {
+            std::lock_guard<std::mutex> ringLock(spRing->mutex);
+            ThreadZones zones{ spRing->id, spRing->name, {} };
+            auto count = std::min(spRing->written, uint64_t(ProfileRingSize));
+            zones.events.reserve(size_t(count));
+            for (auto index = spRing->written - count; index < spRing->written; index++)
+            {
+                zones.events.push_back(spRing->events[index % ProfileRingSize]);
+            }
+            threads.push_back(std::move(zones));
+        }
+    }
+
+    uint64_t first = std::numeric_limits<uint64_t>::max();
+    for (auto& thread : threads)
+    {
+        for (auto& event : thread.events)
+        {
+            first = std::min(first, event.start);
+        }
+    }
+
+    str << "{\"traceEvents\":[";
+    bool comma = false;
+    auto separate = [&]() {
+        str << (comma ? ",\n" : "\n");
+        comma = true;
+    };
+
+    str << std::fixed << std::setprecision(3);
+    for (auto& thread : threads)
+    {
+        separate();
+        str << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.id << ",\"args\":{\"name\":";
+        WriteJsonString(str, thread.name.c_str());
+        str << "}}";
+
+        for (auto& event : thread.events)
+        {
+            separate();
+            str << "{\"name\":";
+            WriteJsonString(str, event.name);
+            str << ",\"cat\":\"zep\",\"ph\":\"X\",\"ts\":" << double(event.start - first) / 1000.0
+                << ",\"dur\":" << double(event.duration) / 1000.0 << ",\"pid\":1,\"tid\":" << thread.id << "}";
+        }
+    }
+    str << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
 } // namespace Zep
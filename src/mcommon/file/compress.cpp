@@ -0,0 +1,139 @@
+#include <cstring>
+
+#include "zep/mcommon/file/compress.h"
+
+namespace Zep
+{
+
+namespace
+{
+const size_t LzMinMatch = 4;
+const uint32_t LzHashBits = 14;
+
+uint32_t lz_read32(const uint8_t* pData)
+{
+    uint32_t value;
+    memcpy(&value, pData, sizeof(value));
+    return value;
+}
+
+uint32_t lz_hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - LzHashBits);
+}
+
+void lz_write_count(std::vector<uint8_t>& out, size_t count)
+{
+    while (count >= 0x80)
+    {
+        out.push_back(uint8_t(count | 0x80));
+        count >>= 7;
+    }
+    out.push_back(uint8_t(count));
+}
+
+bool lz_read_count(const uint8_t*& pData, const uint8_t* pEnd, size_t& count)
+{
+    count = 0;
+    for (uint32_t shift = 0; pData < pEnd && shift < 64; shift += 7)
+    {
+        auto byte = *pData++;
+        count |= size_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+void lz_compress(const uint8_t* pData, size_t size, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(size / 2 + 16);
+
+    // Where each 4 bytes were last seen, plus one; 0 is nowhere
+    std::vector<uint32_t> table(size_t(1) << LzHashBits, 0);
+
+    size_t pos = 0;
+    size_t anchor = 0;
+    while (pos + LzMinMatch <= size)
+    {
+        auto value = lz_read32(pData + pos);
+        auto& entry = table[lz_hash(value)];
+        auto candidate = size_t(entry);
+        entry = uint32_t(pos + 1);
+
+        if (candidate == 0 || lz_read32(pData + candidate - 1) != value)
+        {
+            pos++;
+            continue;
+        }
+
+        auto match = candidate - 1;
+        auto length = LzMinMatch;
+        while (pos + length < size && pData[match + length] == pData[pos + length])
+        {
+            length++;
+        }
+
+        lz_write_count(out, pos - anchor);
+        out.insert(out.end(), pData + anchor, pData + pos);
+        lz_write_count(out, length - LzMinMatch);
+        lz_write_count(out, pos - match);
+
+        pos += length;
+        anchor = pos;
+    }
+
+    // The rest has no copy after it
+    lz_write_count(out, size - anchor);
+    out.insert(out.end(), pData + anchor, pData + size);
+}
+
+bool lz_decompress(const uint8_t* pData, size_t size, size_t expectedSize, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(expectedSize);
+
+    auto pEnd = pData + size;
+    while (pData < pEnd)
+    {
+        size_t literals = 0;
+        if (!lz_read_count(pData, pEnd, literals) || literals > size_t(pEnd - pData) || out.size() + literals > expectedSize)
+        {
+            return false;
+        }
+        out.insert(out.end(), pData, pData + literals);
+        pData += literals;
+
+        if (pData == pEnd)
+        {
+            break;
+        }
+
+        size_t length = 0;
+        size_t offset = 0;
+        if (!lz_read_count(pData, pEnd, length) || !lz_read_count(pData, pEnd, offset))
+        {
+            return false;
+        }
+
+        length += LzMinMatch;
+        if (offset == 0 || offset > out.size() || out.size() + length > expectedSize)
+        {
+            return false;
+        }
+
+        // The copy can overlap what it is making, so it goes a byte at a time
+        auto from = out.size() - offset;
+        for (size_t index = 0; index < length; index++)
+        {
+            out.push_back(out[from + index]);
+        }
+    }
+    return out.size() == expectedSize;
+}
+
+} // namespace Zep
@@ -26,6 +26,17 @@ std::string string_tolower(const std::string& str)
     return copy;
 }
 
+uint64_t fnv_hash_64(const void* pData, size_t size, uint64_t hash)
+{
+    auto pBytes = (const uint8_t*)pData;
+    for (size_t index = 0; index < size; index++)
+    {
+        hash ^= pBytes[index];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 std::string string_replace(std::string subject, const std::string& search, const std::string& replace)
 {
     size_t pos = 0;
@@ -1,45 +1,58 @@
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
 #include "zep/mode.h"
 #include "zep/buffer.h"
+#include "zep/buffer_search.h"
 #include "zep/editor.h"
 #include "zep/filesystem.h"
+#include "zep/indexer.h"
 #include "zep/mcommon/logger.h"
 #include "zep/mode_search.h"
 #include "zep/regress.h"
 #include "zep/syntax.h"
 #include "zep/tab_window.h"
+#include "zep/undo.h"
 
 namespace Zep
 {
 CommandContext::CommandContext(const std::string& commandIn, ZepMode& md, EditorMode editorMode)
     : owner(md)
-    , fullCommand(commandIn)
     , buffer(md.GetCurrentWindow()->GetBuffer())
-    , bufferCursor(md.GetCurrentWindow()->GetBufferCursor())
-    , tempReg("", false)
-    , currentMode(editorMode)
 {
-    registers.push('"');
-    pRegister = &tempReg;
+    Reset(commandIn, editorMode);
+}
 
-    bool needMore = false;
-    auto extraMaps = md.GetEditor().GetGlobalKeyMaps(md);
-    for (auto& extra : extraMaps)
-    {
-        keymap_find(*extra, fullCommand, keymap);
-        if (keymap.foundMapping.id != 0)
-        {
-            break;
-        }
-    }
+void CommandContext::Reset(const std::string& commandIn, EditorMode editorMode)
+{
+    // Assigned and cleared, rather than made again, so the strings and arrays keep their space
+    fullCommand = commandIn;
+    keymap.Clear();
+
+    replaceRangeMode = ReplaceRangeMode::Fill;
+    beginRange = GlyphIterator();
+    endRange = GlyphIterator();
+    bufferCursor = owner.GetCurrentWindow()->GetBufferCursor();
+    cursorAfterOverride = GlyphIterator();
 
-    if (keymap.foundMapping.id == 0)
+    while (!registers.empty())
     {
-        keymap_find(owner.GetKeyMappings(currentMode), fullCommand, keymap);
-        if (keymap.foundMapping.id == 0 && needMore)
-        {
-            keymap.needMoreChars = true;
-        }
+        registers.pop();
     }
+    tempReg.text.clear();
+    tempReg.lineWise = false;
+
+    currentMode = editorMode;
+    commandResult = CommandResult();
+    op = CommandOperation::None;
+    foundCommand = false;
+
+    registers.push('"');
+    pRegister = &tempReg;
+
+    owner.FindKeyMapping(fullCommand, currentMode, keymap);
 
     GetCommandRegisters();
 }
@@ -120,8 +133,10 @@ void CommandContext::GetCommandRegisters()
     {
         if (keymap.RegisterName() == '_')
         {
-            std::stack<char> temp;
-            registers.swap(temp);
+            while (!registers.empty())
+            {
+                registers.pop();
+            }
         }
         else
         {
@@ -237,7 +252,7 @@ void ZepMode::SwitchMode(EditorMode currentMode)
     // When leaving Ex mode, reset search markers
     if (m_currentMode == EditorMode::Ex)
     {
-        buffer.HideMarkers(RangeMarkerType::Search);
+        buffer.GetSearch().Hide();
     }
     else if (m_currentMode == EditorMode::Insert)
     {
@@ -286,11 +301,11 @@ void ZepMode::SwitchMode(EditorMode currentMode)
     }
 }
 
-std::string ZepMode::ConvertInputToMapString(uint32_t key, uint32_t modifierKeys)
+// Written into the given string, which is cleared first; it is kept between keys so nothing is allocated
+void ZepMode::ConvertInputToMapString(uint32_t key, uint32_t modifierKeys, std::string& str)
 {
-    bool brackets = false;
-    std::string str;
-    bool closeBracket = false;
+    str.clear();
+    str += '<';
     if (modifierKeys & ModifierKey::Ctrl)
     {
         str += "C-";
@@ -308,13 +323,13 @@ std::string ZepMode::ConvertInputToMapString(uint32_t key, uint32_t modifierKeys
             str += "S-";
         }
     }
-    brackets = !str.empty();
+    bool brackets = str.size() > 1;
 
-    std::string mapped;
+    const char* pMapped = nullptr;
 
 #define COMPARE_STR(a, b) \
     if (key == b)         \
-        mapped = #a;
+        pMapped = #a;
 
     COMPARE_STR(Return, ExtKeys::RETURN)
     COMPARE_STR(Escape, ExtKeys::ESCAPE)
@@ -342,17 +357,24 @@ std::string ZepMode::ConvertInputToMapString(uint32_t key, uint32_t modifierKeys
     COMPARE_STR(F11, ExtKeys::F11)
     COMPARE_STR(F12, ExtKeys::F12)
 
-    if (!mapped.empty())
+    if (pMapped)
     {
         brackets = true;
-        str += mapped;
+        str += pMapped;
     }
     else
     {
-        str += std::string((const char*)&key);
+        str += (const char*)&key;
     }
 
-    return brackets ? "<" + str + ">" : str;
+    if (brackets)
+    {
+        str += '>';
+    }
+    else
+    {
+        str.erase(0, 1);
+    }
 }
 
 // Handle a key press, convert it to an input command and context, and return it.
@@ -379,7 +401,22 @@ void ZepMode::AddKeyPress(uint32_t key, uint32_t modifierKeys)
 
     // Get the new command by parsing out the keys
     // We convert CTRL + f to a string: "<C-f>"
-    HandleMappedInput(ConvertInputToMapString(key, modifierKeys));
+    auto& input = m_keyInput;
+    ConvertInputToMapString(key, modifierKeys, input);
+    if (m_macroRegister != 0)
+    {
+        // A q on its own ends the recording, and isn't part of it
+        if (m_currentMode == EditorMode::Normal && m_currentCommand.empty() && input == "q")
+        {
+            StopMacro();
+            timer_restart(m_lastKeyPressTimer);
+            return;
+        }
+        // A '<' on its own would start a key name when played, so it is written as vim does
+        m_macroKeys += input == "<" ? "<lt>" : input;
+    }
+
+    HandleMappedInput(input);
 
     if (m_pCurrentWindow)
     {
@@ -428,33 +465,51 @@ void ZepMode::HandleMappedInput(const std::string& input)
     // Reset the cursor to keep it visible during typing, and not flashing
     GetEditor().ResetCursorTimer();
 
-    // Reset command text - it may get updated later.
-    GetEditor().SetCommandText("");
+    // Reset command text - it may get updated later.  Not while a macro plays; it is only seen when it is done
+    if (!m_playingMacro)
+    {
+        GetEditor().SetCommandText("");
+    }
 
     // Figure out the command we have typed. foundCommand means that the command was interpreted and understood.
     // If spCommand is returned, then there is an atomic command operation that needs to be done.
-    auto spContext = std::make_shared<CommandContext>(m_currentCommand, *this, m_currentMode);
+    // The context is the one used for the last key at this depth, unless that was for another buffer
+    if (m_keyContexts.size() <= m_keyContextDepth)
+    {
+        m_keyContexts.emplace_back();
+    }
+    auto& spSlot = m_keyContexts[m_keyContextDepth];
+    if (!spSlot || &spSlot->buffer != &m_pCurrentWindow->GetBuffer())
+    {
+        spSlot = std::make_unique<CommandContext>(m_currentCommand, *this, m_currentMode);
+    }
+    else
+    {
+        spSlot->Reset(m_currentCommand, m_currentMode);
+    }
+    auto pContext = spSlot.get();
+    m_keyContextDepth++;
 
     // Before handling the command, change the command text, since the command might override it
-    if (GetEditor().GetConfig().showNormalModeKeyStrokes && (m_currentMode == EditorMode::Normal || m_currentMode == EditorMode::Visual))
+    if (!m_playingMacro && GetEditor().GetConfig().showNormalModeKeyStrokes && (m_currentMode == EditorMode::Normal || m_currentMode == EditorMode::Visual))
     {
-        GetEditor().SetCommandText(spContext->keymap.searchPath);
+        GetEditor().SetCommandText(pContext->keymap.searchPath);
     }
 
-    spContext->foundCommand = GetCommand(*spContext);
+    pContext->foundCommand = GetCommand(*pContext);
 
     // Stay in insert mode unless commanded otherwise
-    if (spContext->commandResult.modeSwitch == EditorMode::None && spContext->foundCommand)
+    if (pContext->commandResult.modeSwitch == EditorMode::None && pContext->foundCommand)
     {
         if (m_modeFlags & ModeFlags::StayInInsertMode)
         {
-            spContext->commandResult.modeSwitch = EditorMode::Insert;
+            pContext->commandResult.modeSwitch = EditorMode::Insert;
         }
     }
 
     // A lambda to check for a pending mode switch after the command
-    auto enteringMode = [=](auto mode) {
-        if (m_currentMode != spContext->commandResult.modeSwitch && spContext->commandResult.modeSwitch == mode)
+    auto enteringMode = [&](auto mode) {
+        if (m_currentMode != pContext->commandResult.modeSwitch && pContext->commandResult.modeSwitch == mode)
         {
             return true;
         }
@@ -469,18 +524,22 @@ void ZepMode::HandleMappedInput(const std::string& input)
     }
 
     // Did we find something to do?
-    if (spContext->foundCommand)
+    if (pContext->foundCommand)
     {
         // It's an undoable command  - add it
         // Note: a command here is something that modifies the text.  It can be something like a delete
         // or a simple insert
-        if (spContext->commandResult.spCommand)
+        if (pContext->commandResult.spCommand)
         {
             // If not in insert mode, begin the group, because we have started a new operation
             // i.e. one group before adding characters and typing stuff.
-            if (m_currentMode != EditorMode::Insert || ZTestFlags(spContext->commandResult.flags, CommandResultFlags::BeginUndoGroup))
+            // A macro being played is all one group.
+            if (m_currentMode != EditorMode::Insert || ZTestFlags(pContext->commandResult.flags, CommandResultFlags::BeginUndoGroup))
             {
-                AddCommand(std::make_shared<ZepCommand_GroupMarker>(spContext->buffer));
+                if (!m_playingMacro)
+                {
+                    pContext->buffer.GetUndo().BeginGroup();
+                }
 
                 // Record for the dot command
                 m_dotCommand = m_currentCommand;
@@ -493,7 +552,7 @@ void ZepMode::HandleMappedInput(const std::string& input)
             }
 
             // Do the command
-            AddCommand(spContext->commandResult.spCommand);
+            AddCommand(pContext->commandResult.spCommand);
         }
         else
         {
@@ -501,21 +560,24 @@ void ZepMode::HandleMappedInput(const std::string& input)
             // remember the dot command that did it
             if (enteringMode(EditorMode::Insert))
             {
-                AddCommand(std::make_shared<ZepCommand_GroupMarker>(spContext->buffer));
+                if (!m_playingMacro)
+                {
+                    pContext->buffer.GetUndo().BeginGroup();
+                }
                 m_dotCommand = m_currentCommand;
             }
         }
 
         // If the command can't manage the count, we do it
         // Maybe all commands should handle the count?  What are the implications of that?  This bit is a bit messy
-        if (!(spContext->commandResult.flags & CommandResultFlags::HandledCount))
+        if (!(pContext->commandResult.flags & CommandResultFlags::HandledCount))
         {
             // Ignore count == 1, we already did it
-            for (int i = 1; i < spContext->keymap.TotalCount(); i++)
+            for (int i = 1; i < pContext->keymap.TotalCount(); i++)
             {
                 // May immediate execute and not return a command...
-                // Create a new 'inner' spContext-> for the next command, because we need to re-initialize the command
-                // spContext-> for 'after' what just happened!
+                // Create a new 'inner' context for the next command, because we need to re-initialize the command
+                // context for 'after' what just happened!
                 CommandContext contextInner(m_currentCommand, *this, m_currentMode);
                 if (GetCommand(contextInner) && contextInner.commandResult.spCommand)
                 {
@@ -526,7 +588,7 @@ void ZepMode::HandleMappedInput(const std::string& input)
         }
 
         // A mode to switch to after the command is done
-        SwitchMode(spContext->commandResult.modeSwitch);
+        SwitchMode(pContext->commandResult.modeSwitch);
 
         // If not in ex mode, wait for a new command
         // Can this be cleaner?
@@ -543,12 +605,17 @@ void ZepMode::HandleMappedInput(const std::string& input)
         // If not found, and there was no request for more characters, and we aren't in Ex mode
         if (m_currentMode != EditorMode::Ex)
         {
-            if (HandleIgnoredInput(*spContext) || !spContext->keymap.needMoreChars)
+            if (HandleIgnoredInput(*pContext) || !pContext->keymap.needMoreChars)
             {
                 ResetCommand();
             }
         }
     }
+
+    // The context waits for the next key, but the command it made is done with
+    pContext->commandResult.spCommand.reset();
+    m_keyContextDepth--;
+
     ClampCursorForMode();
 }
 
@@ -566,15 +633,8 @@ void ZepMode::AddCommand(std::shared_ptr<ZepCommand> spCmd)
         return;
     }
 
-    auto& undoStack = m_pCurrentWindow->GetBuffer().GetUndoStack();
-    auto& redoStack = m_pCurrentWindow->GetBuffer().GetRedoStack();
-
     spCmd->Redo();
-    undoStack.push(spCmd);
-
-    // Can't redo anything beyond this point
-    std::stack<std::shared_ptr<ZepCommand>> empty;
-    redoStack.swap(empty);
+    m_pCurrentWindow->GetBuffer().GetUndo().AddChange(spCmd->GetChangeRecord(), spCmd->GetCursorBefore(), spCmd->GetCursorAfter());
 
     if (spCmd->GetCursorAfter().Valid())
     {
@@ -589,74 +649,188 @@ void ZepMode::Redo()
         return;
     }
 
-    auto& undoStack = m_pCurrentWindow->GetBuffer().GetUndoStack();
-    auto& redoStack = m_pCurrentWindow->GetBuffer().GetRedoStack();
+    GlyphIterator cursor;
+    if (m_pCurrentWindow->GetBuffer().GetUndo().Redo(cursor) && cursor.Valid())
+    {
+        GetCurrentWindow()->SetBufferCursor(cursor);
+    }
+}
 
-    if (redoStack.empty())
+void ZepMode::Undo()
+{
+    if (m_pCurrentWindow == nullptr)
+    {
         return;
+    }
 
-    if (std::dynamic_pointer_cast<ZepCommand_GroupMarker>(redoStack.top()) != nullptr)
+    GlyphIterator cursor;
+    if (m_pCurrentWindow->GetBuffer().GetUndo().Undo(cursor) && cursor.Valid())
     {
-        undoStack.push(redoStack.top());
-        redoStack.pop();
+        GetCurrentWindow()->SetBufferCursor(cursor);
     }
+}
 
-    while (!redoStack.empty())
+void ZepMode::UndoInTime(long changes, int64_t seconds)
+{
+    if (m_pCurrentWindow == nullptr)
     {
-        auto& spCommand = redoStack.top();
-        spCommand->Redo();
+        return;
+    }
 
-        if (spCommand->GetCursorAfter().Valid())
-        {
-            GetCurrentWindow()->SetBufferCursor(spCommand->GetCursorAfter());
-        }
+    GlyphIterator cursor;
+    auto& undo = m_pCurrentWindow->GetBuffer().GetUndo();
+    if ((seconds != 0 ? undo.MoveByTime(seconds, cursor) : undo.MoveByChanges(changes, cursor)) && cursor.Valid())
+    {
+        GetCurrentWindow()->SetBufferCursor(cursor);
+    }
+}
 
-        undoStack.push(spCommand);
-        redoStack.pop();
+void ZepMode::StartMacro(char reg)
+{
+    // Capitals add to the register, as they do for yanks
+    if (!std::isalnum((unsigned char)reg) && reg != '"')
+    {
+        GetEditor().SetCommandText("Not a register: " + std::string(1, reg));
+        return;
+    }
 
-        if (std::dynamic_pointer_cast<ZepCommand_GroupMarker>(spCommand) != nullptr)
-        {
-            break;
-        }
-    };
+    m_macroRegister = reg;
+    m_macroKeys.clear();
+    GetEditor().RequestRefresh();
 }
 
-void ZepMode::Undo()
+void ZepMode::StopMacro()
 {
-    if (m_pCurrentWindow == nullptr)
+    if (m_macroRegister == 0)
     {
         return;
     }
 
-    auto& undoStack = m_pCurrentWindow->GetBuffer().GetUndoStack();
-    auto& redoStack = m_pCurrentWindow->GetBuffer().GetRedoStack();
-    if (undoStack.empty())
-        return;
+    auto& editor = GetEditor();
+    if (m_macroRegister >= 'A' && m_macroRegister <= 'Z')
+    {
+        auto lower = (char)std::tolower(m_macroRegister);
+        editor.SetRegister(lower, Register(editor.GetRegister(lower).text + m_macroKeys, false));
+    }
+    else
+    {
+        editor.SetRegister(m_macroRegister, Register(m_macroKeys, false));
+    }
+
+    m_lastMacroRegister = m_macroRegister;
+    m_macroRegister = 0;
+    m_macroKeys.clear();
+    editor.RequestRefresh();
+}
+
+char ZepMode::GetMacroRegister() const
+{
+    return m_macroRegister;
+}
+
+// The keys go straight to the command handling, split up once for all the times around.
+// It is one undo group, the command line isn't touched until the end, and the window only works out the cursor's
+// column if a command needs it.
+bool ZepMode::PlayMacro(char reg, int count)
+{
+    if (m_pCurrentWindow == nullptr)
+    {
+        return false;
+    }
+
+    // A macro can't play another, so it can't play itself forever
+    if (m_playingMacro)
+    {
+        return false;
+    }
+
+    if (reg == '@')
+    {
+        reg = m_lastMacroRegister;
+    }
 
-    if (std::dynamic_pointer_cast<ZepCommand_GroupMarker>(undoStack.top()) != nullptr)
+    std::string keys = reg != 0 ? GetEditor().GetRegister((char)std::tolower(reg)).text : std::string();
+    if (keys.empty())
     {
-        redoStack.push(undoStack.top());
-        undoStack.pop();
+        GetEditor().SetCommandText("No macro in register: " + std::string(1, reg));
+        return false;
     }
+    m_lastMacroRegister = reg;
 
-    while (!undoStack.empty())
+    // The key each one was, for the keys that are looked at as well as the map string
+    struct MacroKey
+    {
+        std::string input;
+        uint32_t key;
+    };
+    std::vector<MacroKey> macroKeys;
+    for (auto itr = keys.cbegin(); itr != keys.cend();)
     {
-        auto& spCommand = undoStack.top();
-        spCommand->Undo();
+        auto group = string_slurp_if(itr, keys.cend(), '<', '>');
+        if (group.empty())
+        {
+            auto ch = *itr++;
+            macroKeys.push_back(MacroKey{ std::string(1, ch), uint32_t((unsigned char)ch) });
+            continue;
+        }
 
-        if (spCommand->GetCursorBefore().Valid())
+        auto name = group.substr(1, group.size() - 2);
+        if (name == "lt")
         {
-            GetCurrentWindow()->SetBufferCursor(spCommand->GetCursorBefore());
+            macroKeys.push_back(MacroKey{ "<", uint32_t('<') });
+            continue;
         }
 
-        redoStack.push(spCommand);
-        undoStack.pop();
+        while (name.size() > 2 && name[1] == '-')
+        {
+            name = name.substr(2);
+        }
 
-        if (std::dynamic_pointer_cast<ZepCommand_GroupMarker>(spCommand) != nullptr)
+        uint32_t key = MapStringToExKey(name);
+        if (key == ExtKeys::NONE && name.size() == 1)
         {
-            break;
+            key = (unsigned char)name[0];
         }
-    };
+        macroKeys.push_back(MacroKey{ group, key });
+    }
+
+    auto pWindow = m_pCurrentWindow;
+    auto lastKey = m_lastKey;
+
+    // This command's keys aren't part of what is played
+    m_currentCommand.clear();
+    pWindow->GetBuffer().GetUndo().BeginGroup();
+    GetEditor().HoldCursorColumns(true);
+    m_playingMacro = true;
+
+    timer playTimer;
+    timer_start(playTimer);
+    uint64_t played = 0;
+    for (int i = 0; i < count && m_pCurrentWindow == pWindow; i++)
+    {
+        for (auto& macroKey : macroKeys)
+        {
+            m_lastKey = macroKey.key;
+            HandleMappedInput(macroKey.input);
+            timer_restart(m_lastKeyPressTimer);
+            played++;
+        }
+    }
+    auto seconds = timer_get_elapsed_seconds(playTimer);
+
+    m_playingMacro = false;
+    GetEditor().HoldCursorColumns(false);
+    m_lastKey = lastKey;
+
+    std::ostringstream str;
+    str << "@" << reg << ": " << played << " keys in " << std::fixed << std::setprecision(3) << seconds << "s";
+    if (seconds > 0.0)
+    {
+        str << ", " << uint64_t(double(played) / seconds) << " keys/s";
+    }
+    GetEditor().SetCommandText(str.str());
+    GetEditor().RequestRefresh();
+    return true;
 }
 
 GlyphRange ZepMode::GetInclusiveVisualRange() const
@@ -786,19 +960,19 @@ bool ZepMode::GetCommand(CommandContext& context)
     }
     else if (mappedCommand == id_MotionNextSearch)
     {
-        auto pFound = buffer.FindNextMarker(GetCurrentWindow()->GetBufferCursor(), m_lastSearchDirection, RangeMarkerType::Search);
-        if (pFound)
+        ByteRange match;
+        if (buffer.GetSearch().FindNext(GetCurrentWindow()->GetBufferCursor().Index(), m_lastSearchDirection, match))
         {
-            GetCurrentWindow()->SetBufferCursor(GlyphIterator(&context.buffer, pFound->GetRange().first));
+            GetCurrentWindow()->SetBufferCursor(GlyphIterator(&context.buffer, match.first));
         }
         return true;
     }
     else if (mappedCommand == id_MotionPreviousSearch)
     {
-        auto pFound = buffer.FindNextMarker(GetCurrentWindow()->GetBufferCursor(), m_lastSearchDirection == Direction::Forward ? Direction::Backward : Direction::Forward, RangeMarkerType::Search);
-        if (pFound)
+        ByteRange match;
+        if (buffer.GetSearch().FindNext(GetCurrentWindow()->GetBufferCursor().Index(), m_lastSearchDirection == Direction::Forward ? Direction::Backward : Direction::Forward, match))
         {
-            GetCurrentWindow()->SetBufferCursor(GlyphIterator(&context.buffer, pFound->GetRange().first));
+            GetCurrentWindow()->SetBufferCursor(GlyphIterator(&context.buffer, match.first));
         }
         return true;
     }
@@ -927,6 +1101,24 @@ bool ZepMode::GetCommand(CommandContext& context)
         Undo();
         return true;
     }
+    else if (mappedCommand == id_UndoEarlier || mappedCommand == id_UndoLater)
+    {
+        auto count = long(context.keymap.TotalCount());
+        UndoInTime(mappedCommand == id_UndoEarlier ? -count : count, 0);
+        context.commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
+    else if (mappedCommand == id_MacroRecord)
+    {
+        StartMacro(context.keymap.captureChars[0]);
+        return true;
+    }
+    else if (mappedCommand == id_MacroPlay)
+    {
+        PlayMacro(context.keymap.captureChars[0], context.keymap.TotalCount());
+        context.commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
     else if (mappedCommand == id_MotionLineEnd)
     {
         GetCurrentWindow()->SetBufferCursor(context.buffer.GetLinePos(bufferCursor, LineLocation::LineLastNonCR));
@@ -2093,6 +2285,283 @@ void ZepMode::UpdateVisualSelection()
     }
 }
 
+// :[range]s/pattern/replacement/[flags]
+// The range is empty for the current line, %, or two line addresses (number, '.', '$').
+// All of the matches are found first, and the new text for the span that they cover is built in one pass;
+// this is applied as a single replace, so it is one undo step however many matches there are.
+bool ZepMode::HandleSubstitute(const std::string& strCommand)
+{
+    auto pWindow = GetCurrentWindow();
+    auto& buffer = pWindow->GetBuffer();
+    size_t pos = 1;
+
+    auto parseAddress = [&](long& line) {
+        if (pos < strCommand.size() && strCommand[pos] == '.')
+        {
+            line = buffer.GetBufferLine(pWindow->GetBufferCursor());
+            pos++;
+            return true;
+        }
+        if (pos < strCommand.size() && strCommand[pos] == '$')
+        {
+            line = buffer.GetLineCount() - 1;
+            pos++;
+            return true;
+        }
+        if (pos < strCommand.size() && std::isdigit((uint8_t)strCommand[pos]))
+        {
+            line = 0;
+            while (pos < strCommand.size() && std::isdigit((uint8_t)strCommand[pos]))
+            {
+                line = line * 10 + (strCommand[pos++] - '0');
+            }
+            line = std::max(0l, line - 1);
+            return true;
+        }
+        return false;
+    };
+
+    // Line range
+    long firstLine = buffer.GetBufferLine(pWindow->GetBufferCursor());
+    long lastLine = firstLine;
+    if (pos < strCommand.size() && strCommand[pos] == '%')
+    {
+        firstLine = 0;
+        lastLine = buffer.GetLineCount() - 1;
+        pos++;
+    }
+    else if (parseAddress(firstLine))
+    {
+        lastLine = firstLine;
+        if (pos < strCommand.size() && strCommand[pos] == ',')
+        {
+            pos++;
+            if (!parseAddress(lastLine))
+            {
+                return false;
+            }
+        }
+    }
+
+    // 's' and a delimiter; this keeps :set, :split, etc. out
+    if (pos + 1 >= strCommand.size() || strCommand[pos] != 's')
+    {
+        return false;
+    }
+    pos++;
+    auto delim = strCommand[pos++];
+    if (std::isalnum((uint8_t)delim) || std::isspace((uint8_t)delim) || delim == '\\' || delim == '"')
+    {
+        return false;
+    }
+
+    // Read up to the next delimiter, removing the escape from an escaped delimiter
+    auto readPart = [&]() {
+        std::string part;
+        while (pos < strCommand.size() && strCommand[pos] != delim)
+        {
+            if (strCommand[pos] == '\\' && pos + 1 < strCommand.size())
+            {
+                if (strCommand[pos + 1] != delim)
+                {
+                    part += '\\';
+                }
+                part += strCommand[pos + 1];
+                pos += 2;
+                continue;
+            }
+            part += strCommand[pos++];
+        }
+        pos++;
+        return part;
+    };
+
+    auto pattern = readPart();
+    auto replacement = readPart();
+
+    // g: every match on a line, i/I: ignore or match case, n: only count the matches, e: no message if there are none
+    bool global = false;
+    bool countOnly = false;
+    bool quiet = false;
+    std::string caseFlag;
+    for (; pos < strCommand.size(); pos++)
+    {
+        auto flag = strCommand[pos];
+        switch (flag)
+        {
+        case 'g':
+            global = true;
+            break;
+        case 'i':
+            caseFlag = "\\c";
+            break;
+        case 'I':
+            caseFlag = "\\C";
+            break;
+        case 'n':
+            countOnly = true;
+            break;
+        case 'e':
+            quiet = true;
+            break;
+        case ' ':
+            break;
+        default:
+            GetEditor().SetCommandText("Unsupported substitute flag: " + std::string(1, flag));
+            return true;
+        }
+    }
+
+    // & and \0 are the whole match, \1 to \9 the groups, \r a new line.  Changing the case isn't done
+    for (size_t index = 0; index + 1 < replacement.size(); index++)
+    {
+        if (replacement[index] == '\\')
+        {
+            auto ch = replacement[++index];
+            if (ch == 'u' || ch == 'U' || ch == 'l' || ch == 'L' || ch == 'e' || ch == 'E')
+            {
+                GetEditor().SetCommandText("Unsupported in the replacement: \\" + std::string(1, ch));
+                return true;
+            }
+        }
+    }
+
+    std::string error;
+    ZepRegex regex;
+    if (pattern.empty() || !regex.Compile(caseFlag + pattern, error))
+    {
+        GetEditor().SetCommandText("Bad pattern: " + (error.empty() ? pattern : error));
+        return true;
+    }
+
+    if (firstLine > lastLine)
+    {
+        std::swap(firstLine, lastLine);
+    }
+    lastLine = std::min(lastLine, buffer.GetLineCount() - 1);
+
+    ByteRange firstRange;
+    ByteRange lastRange;
+    buffer.GetLineOffsets(firstLine, firstRange);
+    buffer.GetLineOffsets(lastLine, lastRange);
+    auto rangeEnd = std::min(lastRange.second, buffer.End().Index());
+    if (rangeEnd <= firstRange.first)
+    {
+        return true;
+    }
+
+    // Find all of the matches before changing anything
+    auto text = buffer.GetBufferText(GlyphIterator(&buffer, firstRange.first), GlyphIterator(&buffer, rangeEnd));
+    auto pBegin = (const uint8_t*)text.data();
+    auto pEnd = pBegin + text.size();
+    std::vector<ByteRange> matches;
+    long lines = 0;
+    const uint8_t* pLineEnd = nullptr;
+    regex.FindAll(pBegin, pEnd, [&](const uint8_t* pMatchBegin, const uint8_t* pMatchEnd) {
+        // An empty match after the last new line is on the line after the range
+        if (pMatchBegin == pEnd && pMatchEnd == pEnd && pEnd[-1] == '\n')
+        {
+            return false;
+        }
+
+        if (!pLineEnd || pMatchBegin >= pLineEnd)
+        {
+            lines++;
+        }
+        else if (!global)
+        {
+            // Only the first match on each line
+            return true;
+        }
+
+        pLineEnd = (const uint8_t*)memchr(pMatchBegin, '\n', pEnd - pMatchBegin);
+        pLineEnd = pLineEnd ? pLineEnd + 1 : pEnd;
+        matches.push_back(ByteRange(ByteIndex(pMatchBegin - pBegin), ByteIndex(pMatchEnd - pBegin)));
+        return true;
+    });
+
+    if (matches.empty())
+    {
+        if (!quiet)
+        {
+            GetEditor().SetCommandText("Pattern not found: " + pattern);
+        }
+        return true;
+    }
+
+    if (countOnly)
+    {
+        GetEditor().SetCommandText(std::to_string(matches.size()) + (matches.size() == 1 ? " match" : " matches") + " on " + std::to_string(lines) + (lines == 1 ? " line" : " lines"));
+        return true;
+    }
+
+    // Build the new text for the span covered by the matches
+    std::string newText;
+    newText.reserve(size_t(matches.back().second - matches.front().first));
+    auto last = matches.front().first;
+    ByteIndex lastReplaced = 0;
+    ZepRegex::RegexGroups groups;
+    for (auto& match : matches)
+    {
+        newText.append(text, last, match.first - last);
+        lastReplaced = ByteIndex(newText.size());
+        regex.GetGroups(pBegin, pEnd, pBegin + match.first, pBegin + match.second, groups);
+        for (size_t index = 0; index < replacement.size(); index++)
+        {
+            auto ch = replacement[index];
+            if (ch == '&')
+            {
+                newText.append(text, match.first, match.second - match.first);
+            }
+            else if (ch == '\\' && index + 1 < replacement.size())
+            {
+                ch = replacement[++index];
+                if (ch >= '0' && ch <= '9')
+                {
+                    auto group = size_t(ch - '0');
+                    if (group < groups.size())
+                    {
+                        newText.append((const char*)groups[group].first, groups[group].second - groups[group].first);
+                    }
+                }
+                else
+                {
+                    newText += (ch == 'r' || ch == 'n') ? '\n' : (ch == 't') ? '\t' : ch;
+                }
+            }
+            else
+            {
+                newText += ch;
+            }
+        }
+        last = match.second;
+    }
+    newText.append(text, last, matches.back().second - last);
+
+    auto spanStart = firstRange.first + matches.front().first;
+    auto spanEnd = firstRange.first + matches.back().second;
+    if (spanStart == spanEnd && newText.empty())
+    {
+        return true;
+    }
+
+    buffer.GetUndo().BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_ReplaceRange>(
+        buffer,
+        ReplaceRangeMode::Replace,
+        GlyphIterator(&buffer, spanStart),
+        GlyphIterator(&buffer, spanEnd),
+        newText,
+        pWindow->GetBufferCursor(),
+        GlyphIterator(&buffer, spanStart + lastReplaced)));
+
+    if (matches.size() > 1)
+    {
+        GetEditor().SetCommandText(std::to_string(matches.size()) + " substitutions");
+    }
+    return true;
+}
+
 bool ZepMode::HandleExCommand(std::string strCommand)
 {
     if (strCommand.empty())
@@ -2161,6 +2630,10 @@ bool ZepMode::HandleExCommand(std::string strCommand)
             auto strTok = string_split(strCommand, " ");
             pCommand->Run(strTok);
         }
+        else if (HandleSubstitute(strCommand))
+        {
+            // Handled :s
+        }
         else if (strCommand == ":reg")
         {
             std::ostringstream str;
@@ -2215,6 +2688,126 @@ bool ZepMode::HandleExCommand(std::string strCommand)
             }
             GetEditor().SetCurrentTabWindow(pTab);
         }
+        else if (strCommand.find(":ZGrep ") == 0)
+        {
+            // Search the contents of the project files
+            auto pattern = strCommand.substr(7);
+            GetEditor().AddGrep(Trim(pattern));
+        }
+        else if (strCommand.find(":ZTail") == 0)
+        {
+            // Follow the end of the file; a number keeps only that many lines
+            auto& buffer = GetCurrentWindow()->GetBuffer();
+            auto strTok = string_split(strCommand, " ");
+            if (strTok.size() > 1)
+            {
+                buffer.SetFollow(true, std::strtol(strTok[1].c_str(), nullptr, 10));
+            }
+            else
+            {
+                buffer.SetFollow(!buffer.IsFollowing());
+            }
+            GetEditor().SetCommandText(buffer.IsFollowing() ? "Following: " + buffer.GetName() : "Not following: " + buffer.GetName());
+        }
+        else if (strCommand.find(":ZTrace") == 0)
+        {
+            // Write the zones the threads have held on to, for chrome://tracing or Perfetto.
+            // The first time, unless editor.profile_zones is set, it only starts keeping them.  The path is the rest of the line
+            if (!profile_enabled())
+            {
+                profile_enable(true);
+                GetEditor().SetCommandText("Keeping trace zones; :ZTrace again to write them");
+            }
+            else
+            {
+                auto name = strCommand.substr(7);
+                Trim(name);
+                auto path = !name.empty() ? fs::path(name) : GetEditor().GetFileSystem().GetWorkingDirectory() / "zep_trace.json";
+                std::ostringstream str;
+                profile_write_trace(str);
+                auto trace = str.str();
+                if (GetEditor().GetFileSystem().Write(path, trace.c_str(), trace.size()))
+                {
+                    GetEditor().SetCommandText("Wrote " + std::to_string(profile_zone_count()) + " zones to " + path.string());
+                }
+                else
+                {
+                    GetEditor().SetCommandText("Failed to write: " + path.string());
+                }
+            }
+        }
+        else if (strCommand.find(":earlier") == 0 || strCommand.find(":later") == 0)
+        {
+            // :earlier 3, :later 10m; a number of changes, or a time in s, m, h or d
+            auto strTok = string_split(strCommand, " ");
+            long count = 1;
+            int64_t seconds = 0;
+            if (strTok.size() > 1)
+            {
+                char* pEnd = nullptr;
+                count = std::strtol(strTok[1].c_str(), &pEnd, 10);
+                switch (*pEnd)
+                {
+                case 's':
+                    seconds = count;
+                    break;
+                case 'm':
+                    seconds = count * 60;
+                    break;
+                case 'h':
+                    seconds = count * 60 * 60;
+                    break;
+                case 'd':
+                    seconds = count * 60 * 60 * 24;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (strCommand.find(":earlier") == 0)
+            {
+                count = -count;
+                seconds = -seconds;
+            }
+            UndoInTime(count, seconds);
+        }
+        else if (strCommand.find(":tag ") == 0)
+        {
+            // Go to the definition of a symbol in the project index
+            auto name = strCommand.substr(5);
+            Trim(name);
+
+            std::vector<SymbolLocation> locations;
+            auto pIndexer = GetEditor().GetIndexer();
+            if (!pIndexer)
+            {
+                GetEditor().SetCommandText("No project index");
+            }
+            else if (!pIndexer->FindSymbol(name, locations))
+            {
+                GetEditor().SetCommandText("Symbol not found: " + name);
+            }
+            else
+            {
+                auto& location = locations[0];
+                auto pBuffer = GetEditor().GetFileBuffer(pIndexer->GetSearchRoot() / location.path, 0, true);
+                if (pBuffer)
+                {
+                    GetCurrentWindow()->SetBuffer(pBuffer);
+
+                    ByteRange range;
+                    if (pBuffer->GetLineOffsets(location.details.line, range))
+                    {
+                        GetCurrentWindow()->SetBufferCursor(GlyphIterator(pBuffer, std::min(range.first + location.details.column, std::max(range.first, range.second - 1))));
+                    }
+
+                    std::ostringstream str;
+                    str << location.name << " (1 of " << locations.size() << ")";
+                    GetEditor().SetCommandText(str.str());
+                }
+            }
+        }
         else if (strCommand.find(":tree") == 0)
         {
             // Note this is a work in progress; not done yet.
@@ -2264,6 +2857,11 @@ bool ZepMode::HandleExCommand(std::string strCommand)
                 pTab->AddWindow(&GetCurrentWindow()->GetBuffer(), GetCurrentWindow(), RegionLayoutType::VBox);
             }
         }
+        else if (strCommand == ":e!")
+        {
+            // Go back to the file on disk
+            GetCurrentWindow()->GetBuffer().Reload(true);
+        }
         else if (strCommand.find(":e") == 0)
         {
             auto strTok = string_split(strCommand, " ");
@@ -2541,66 +3139,55 @@ bool ZepMode::HandleExCommand(std::string strCommand)
     }
     else if (!m_currentCommand.empty() && (m_currentCommand[0] == '/' || m_currentCommand[0] == '?'))
     {
-        // TODO: Busy editing the search string; do the search
+        // Busy editing the search string; do the search
         if (m_currentCommand.length() > 0)
         {
             auto pWindow = GetCurrentWindow();
             auto& buffer = pWindow->GetBuffer();
             auto searchString = m_currentCommand.substr(1);
 
-            buffer.ClearRangeMarkers(RangeMarkerType::Search);
-
-            uint32_t numMarkers = 0;
-            GlyphIterator start = buffer.Begin();
-
-            if (!searchString.empty())
+            // Starting a new search cancels the old one; matches on screen are found first
+            std::string error;
+            auto& search = buffer.GetSearch();
+            if (searchString.empty() || !search.Start(searchString, pWindow->GetVisibleByteRange(), error))
             {
-                static const uint32_t MaxMarkers = 1000;
-                while (numMarkers < MaxMarkers)
-                {
-                    auto found = buffer.Find(start, (uint8_t*)&searchString[0], (uint8_t*)&searchString[searchString.length()]);
-                    if (!found.Valid())
-                    {
-                        break;
-                    }
-
-                    start = found + 1;
-
-                    auto spMarker = std::make_shared<RangeMarker>(buffer);
-                    spMarker->SetColors(ThemeColor::VisualSelectBackground, ThemeColor::Text);
-                    spMarker->SetRange(ByteRange(found.Index(), found.PeekByteOffset(long(searchString.size())).Index()));
-                    spMarker->displayType = RangeMarkerDisplayType::Background;
-                    spMarker->markerType = RangeMarkerType::Search;
-
-                    numMarkers++;
-                }
+                search.Clear();
             }
 
-            Direction dir = (m_currentCommand[0] == '/') ? Direction::Forward : Direction::Backward;
-            m_lastSearchDirection = dir;
-
-            // Find the one on or in front of the cursor, in either direction.
-            auto startLocation = m_exCommandStartLocation;
-            if (dir == Direction::Forward)
-                startLocation--;
-            else
-                startLocation++;
-
-            auto pMark = buffer.FindNextMarker(startLocation, dir, RangeMarkerType::Search);
-            if (pMark)
-            {
-                pWindow->SetBufferCursor(GlyphIterator(&buffer, pMark->GetRange().first));
-                pMark->SetBackgroundColor(ThemeColor::Info);
-            }
-            else
-            {
-                pWindow->SetBufferCursor(m_exCommandStartLocation);
-            }
+            m_lastSearchDirection = (m_currentCommand[0] == '/') ? Direction::Forward : Direction::Backward;
+            UpdateSearchCursor();
         }
     }
     return false;
 }
 
+// Move to the nearest search match in the search direction, from where the search started
+void ZepMode::UpdateSearchCursor()
+{
+    auto pWindow = GetCurrentWindow();
+    auto& buffer = pWindow->GetBuffer();
+    auto& search = buffer.GetSearch();
+
+    // Find the one on or in front of the cursor, in either direction.
+    auto startLocation = m_exCommandStartLocation;
+    if (m_lastSearchDirection == Direction::Forward)
+        startLocation--;
+    else
+        startLocation++;
+
+    ByteRange match;
+    if (search.FindNext(startLocation.Index(), m_lastSearchDirection, match))
+    {
+        search.SetCurrentMatch(match);
+        pWindow->SetBufferCursor(GlyphIterator(&buffer, match.first));
+    }
+    else
+    {
+        search.SetCurrentMatch(ByteRange(-1, -1));
+        pWindow->SetBufferCursor(m_exCommandStartLocation);
+    }
+}
+
 const KeyMap& ZepMode::GetKeyMappings(EditorMode mode) const
 {
     if (mode == EditorMode::Visual)
@@ -2614,6 +3201,22 @@ const KeyMap& ZepMode::GetKeyMappings(EditorMode mode) const
     return m_insertMap;
 }
 
+void ZepMode::FindKeyMapping(const std::string& command, EditorMode mode, KeyMapResult& result)
+{
+    // Compiled again if any map has changed since
+    auto& compiled = m_compiledKeyMaps[int(mode)];
+    if (compiled.generation != keymap_generation())
+    {
+        auto maps = GetEditor().GetGlobalKeyMaps(*this);
+        maps.push_back(&GetKeyMappings(mode));
+        keymap_compile(maps, compiled.automaton);
+        compiled.generation = keymap_generation();
+    }
+
+    bool describe = GetEditor().GetConfig().showNormalModeKeyStrokes;
+    keymap_find(compiled.automaton, command, result, &m_keyMapMatch, describe);
+}
+
 void ZepMode::AddKeyMapWithCountRegisters(const std::vector<KeyMap*>& maps, const std::vector<std::string>& commands, const StringId& id)
 {
     for (auto& m : maps)
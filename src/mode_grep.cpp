@@ -0,0 +1,338 @@
+#include <cstring>
+
+#include "zep/mode_grep.h"
+#include "zep/filesystem.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+
+#include "zep/mcommon/logger.h"
+#include "zep/mcommon/threadutils.h"
+
+namespace Zep
+{
+
+namespace
+{
+// Long lines are cut short in the results
+const size_t MaxResultText = 256;
+
+// A file with a 0 in this much of its start is taken to be binary, as git does, and isn't searched
+const size_t GrepBinaryCheckSize = 8000;
+} // namespace
+
+ZepMode_Grep::ZepMode_Grep(ZepEditor& editor, ZepWindow& launchWindow, ZepWindow& window, const fs::path& path, const std::string& pattern)
+    : ZepMode(editor)
+    , m_pattern(pattern)
+    , m_launchWindow(launchWindow)
+    , m_window(window)
+    , m_startPath(path)
+{
+}
+
+ZepMode_Grep::~ZepMode_Grep()
+{
+    // Ensure threads have finished
+    Stop();
+    if (m_indexResult.valid())
+    {
+        m_indexResult.wait();
+    }
+}
+
+void ZepMode_Grep::Stop()
+{
+    m_cancel.cancel();
+    for (auto& result : m_grepResults)
+    {
+        result.wait();
+    }
+    m_grepResults.clear();
+}
+
+void ZepMode_Grep::AddKeyPress(uint32_t key, uint32_t modifiers)
+{
+    if (key == ExtKeys::ESCAPE)
+    {
+        // As for the file search; put back the window we came from and remove the results
+        Stop();
+        auto& buffer = m_window.GetBuffer();
+        GetEditor().GetActiveTabWindow()->RemoveWindow(&m_window);
+        GetEditor().GetActiveTabWindow()->SetActiveWindow(&m_launchWindow);
+        GetEditor().RemoveBuffer(&buffer);
+        return;
+    }
+    else if (key == ExtKeys::RETURN)
+    {
+        OpenSelection(OpenType::Replace);
+        return;
+    }
+    else if (modifiers & ModifierKey::Ctrl)
+    {
+        if (key == 'v')
+        {
+            OpenSelection(OpenType::VSplit);
+            return;
+        }
+        else if (key == 'x')
+        {
+            OpenSelection(OpenType::HSplit);
+            return;
+        }
+        else if (key == 't')
+        {
+            OpenSelection(OpenType::Tab);
+            return;
+        }
+    }
+    else if (key == 'j' || key == ExtKeys::DOWN)
+    {
+        m_window.MoveCursorY(1);
+    }
+    else if (key == 'k' || key == ExtKeys::UP)
+    {
+        m_window.MoveCursorY(-1);
+    }
+}
+
+void ZepMode_Grep::Begin(ZepWindow* pWindow)
+{
+    ZepMode::Begin(pWindow);
+
+    std::string error;
+    if (m_pattern.empty() || !m_regex.Compile(m_pattern, error))
+    {
+        GetEditor().SetCommandText("Bad pattern: " + (error.empty() ? m_pattern : error));
+        return;
+    }
+
+    GetEditor().SetCommandText(std::string("Indexing: ") + m_startPath.string());
+    m_indexResult = Indexer::IndexPaths(GetEditor(), m_startPath);
+    m_fileSearchActive = true;
+}
+
+void ZepMode_Grep::Notify(std::shared_ptr<ZepMessage> message)
+{
+    ZepMode::Notify(message);
+    if (message->messageId == Msg::Tick)
+    {
+        if (m_fileSearchActive)
+        {
+            if (!is_future_ready(m_indexResult))
+            {
+                return;
+            }
+
+            m_fileSearchActive = false;
+
+            m_spFilePaths = m_indexResult.get();
+            if (!m_spFilePaths->errors.empty())
+            {
+                GetEditor().SetCommandText(m_spFilePaths->errors);
+                return;
+            }
+
+            StartGrep();
+        }
+
+        if (m_spFilePaths)
+        {
+            ShowResults();
+        }
+    }
+}
+
+void ZepMode_Grep::StartGrep()
+{
+    // Each thread takes files until there are none left; if the pool has no threads this all happens here.
+    // It is background work, so it never has the last worker; searches in the buffers and loads still get a thread,
+    // and a change to a searched buffer doesn't wait for the grep to finish
+    auto& pool = GetEditor().GetThreadPool();
+    auto workers = pool.thread_count();
+    auto threads = workers > 1 ? workers - 1 : size_t(1);
+    for (size_t thread = 0; thread < threads; thread++)
+    {
+        m_grepResults.push_back(pool.enqueue_with(TaskPriority::Background, m_cancel, [=]() {
+            GrepFiles();
+        }));
+    }
+}
+
+void ZepMode_Grep::GrepFiles()
+{
+    auto& fileSystem = GetEditor().GetFileSystem();
+    std::vector<GrepResult> fileResults;
+    for (;;)
+    {
+        if (m_cancel.is_cancelled())
+        {
+            return;
+        }
+
+        auto pathIndex = m_nextFile++;
+        if (pathIndex >= m_spFilePaths->paths.size())
+        {
+            return;
+        }
+
+        auto strFile = fileSystem.Read(m_spFilePaths->root / m_spFilePaths->paths[pathIndex]);
+        auto pBegin = (const uint8_t*)strFile.data();
+        auto pEnd = pBegin + strFile.size();
+        if (memchr(pBegin, 0, std::min(strFile.size(), GrepBinaryCheckSize)))
+        {
+            m_filesSearched++;
+            continue;
+        }
+
+        // Count the lines as we go, and keep the first match on each one
+        long line = 0;
+        const uint8_t* pLineBegin = pBegin;
+        const uint8_t* pLineEnd = nullptr;
+        m_regex.FindAll(pBegin, pEnd, [&](const uint8_t* pMatchBegin, const uint8_t*) {
+            // An empty match at the end is after the last line
+            if (pMatchBegin == pEnd && (pEnd == pBegin || pEnd[-1] == '\n'))
+            {
+                return false;
+            }
+
+            if (pLineEnd && pMatchBegin < pLineEnd)
+            {
+                return true;
+            }
+
+            for (;;)
+            {
+                auto pNewLine = (const uint8_t*)memchr(pLineBegin, '\n', pMatchBegin - pLineBegin);
+                if (!pNewLine)
+                {
+                    break;
+                }
+                pLineBegin = pNewLine + 1;
+                line++;
+            }
+
+            pLineEnd = (const uint8_t*)memchr(pMatchBegin, '\n', pEnd - pMatchBegin);
+            pLineEnd = pLineEnd ? pLineEnd : pEnd;
+
+            GrepResult result;
+            result.pathIndex = pathIndex;
+            result.line = line;
+            result.column = long(pMatchBegin - pLineBegin);
+            result.text.assign((const char*)pLineBegin, std::min(size_t(pLineEnd - pLineBegin), MaxResultText));
+            while (!result.text.empty() && result.text.back() == '\r')
+            {
+                result.text.pop_back();
+            }
+            fileResults.push_back(result);
+            return !m_cancel.is_cancelled();
+        });
+
+        m_filesSearched++;
+        if (!fileResults.empty())
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            m_pendingResults.insert(m_pendingResults.end(), fileResults.begin(), fileResults.end());
+            fileResults.clear();
+        }
+    }
+}
+
+// Add the results found since the last time to the end of the buffer
+void ZepMode_Grep::ShowResults()
+{
+    std::vector<GrepResult> results;
+    {
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        results.swap(m_pendingResults);
+    }
+
+    if (!results.empty())
+    {
+        std::ostringstream str;
+        for (auto& result : results)
+        {
+            if (!m_results.empty())
+            {
+                str << '\n';
+            }
+            str << m_spFilePaths->paths[result.pathIndex].string() << ":" << (result.line + 1) << ": " << result.text;
+            m_results.push_back(result);
+        }
+
+        auto& buffer = m_window.GetBuffer();
+        ChangeRecord changeRecord;
+        buffer.Insert(buffer.End(), str.str(), changeRecord);
+        GetEditor().RequestRefresh();
+    }
+
+    std::ostringstream str;
+    str << "ZGrep: " << m_pattern << " (" << m_results.size() << " in " << m_filesSearched << " / " << m_spFilePaths->paths.size() << " files)";
+    GetEditor().SetCommandText(str.str());
+}
+
+void ZepMode_Grep::OpenSelection(OpenType type)
+{
+    auto line = m_window.GetBuffer().GetBufferLine(m_window.GetBufferCursor());
+    if (line < 0 || line >= long(m_results.size()))
+    {
+        return;
+    }
+
+    auto result = m_results[line];
+    auto fullPath = m_spFilePaths->root / m_spFilePaths->paths[result.pathIndex];
+    auto& buffer = m_window.GetBuffer();
+
+    Stop();
+    GetEditor().GetActiveTabWindow()->SetActiveWindow(&m_launchWindow);
+
+    auto pBuffer = GetEditor().GetFileBuffer(fullPath, 0, true);
+    if (pBuffer != nullptr)
+    {
+        ZepWindow* pTarget = nullptr;
+        switch (type)
+        {
+        case OpenType::Replace:
+        {
+            auto win = GetEditor().FindBufferWindows(pBuffer);
+            // If they just hit enter, then jump to existing if possible.
+            if (!win.empty())
+            {
+                GetEditor().SetCurrentTabWindow(&win[0]->GetTabWindow());
+                win[0]->GetTabWindow().SetActiveWindow(win[0]);
+                pTarget = win[0];
+            }
+            else
+            {
+                m_launchWindow.SetBuffer(pBuffer);
+                pTarget = &m_launchWindow;
+            }
+        }
+        break;
+        case OpenType::VSplit:
+            pTarget = GetEditor().GetActiveTabWindow()->AddWindow(pBuffer, &m_launchWindow, RegionLayoutType::HBox);
+            break;
+        case OpenType::HSplit:
+            pTarget = GetEditor().GetActiveTabWindow()->AddWindow(pBuffer, &m_launchWindow, RegionLayoutType::VBox);
+            break;
+        case OpenType::Tab:
+            pTarget = GetEditor().AddTabWindow()->AddWindow(pBuffer, nullptr, RegionLayoutType::HBox);
+            break;
+        }
+
+        // Go to the match
+        ByteRange range;
+        if (pTarget && pBuffer->GetLineOffsets(result.line, range))
+        {
+            pTarget->SetBufferCursor(GlyphIterator(pBuffer, std::min(range.first + result.column, std::max(range.first, range.second - 1))));
+        }
+    }
+
+    // Removing the buffer will also kill this mode and its window; this is the last thing we can do here
+    GetEditor().RemoveBuffer(&buffer);
+}
+
+CursorType ZepMode_Grep::GetCursorType() const
+{
+    return CursorType::LineMarker;
+}
+
+} // namespace Zep
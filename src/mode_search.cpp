@@ -1,3 +1,6 @@
+#include <iterator>
+#include <limits>
+
 #include "zep/mode_search.h"
 #include "zep/filesystem.h"
 #include "zep/tab_window.h"
@@ -8,9 +11,48 @@
 
 #include "zep/mcommon/file/fnmatch.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace Zep
 {
 
+namespace
+{
+// The results buffer only shows the best matches
+const size_t MaxShownResults = 200;
+
+// The candidates are found and scored in chunks of this many paths on the thread pool; a multiple of 64
+const size_t SearchChunkSize = 8192;
+
+// Scoring for fuzzy matches
+const int32_t ScoreMatch = 16;
+const int32_t ScoreConsecutive = 16;
+const int32_t ScoreBoundary = 12;
+const int32_t ScoreFileName = 4;
+const int32_t ScoreGap = 2;
+const int32_t ScoreMaxGap = 24;
+
+bool IsPathBoundary(char ch)
+{
+    return ch == '/' || ch == '\\' || ch == '_' || ch == '-' || ch == '.' || ch == ' ';
+}
+
+// The position of the lowest set bit
+uint32_t LowestBit(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, bits);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctzll(bits));
+#endif
+}
+
+} // namespace
+
 ZepMode_Search::ZepMode_Search(ZepEditor& editor, ZepWindow& launchWindow, ZepWindow& window, const fs::path& path)
     : ZepMode(editor)
     , m_launchWindow(launchWindow)
@@ -27,9 +69,9 @@ ZepMode_Search::~ZepMode_Search()
         m_indexResult.wait();
     }
 
-    if (m_searchResult.valid())
+    for (auto& result : m_searchResults)
     {
-        m_searchResult.wait();
+        result.wait();
     }
 }
 
@@ -114,7 +156,7 @@ void ZepMode_Search::AddKeyPress(uint32_t key, uint32_t modifiers)
 
     if (!m_indexTree.empty())
     {
-        str << " (" << m_indexTree[m_indexTree.size() - 1]->indices.size() << " / " << m_indexTree[0]->indices.size() << ")";
+        str << " (" << m_indexTree[m_indexTree.size() - 1]->count << " / " << m_indexTree[0]->count << ")";
     }
 
     GetEditor().SetCommandText(str.str());
@@ -172,24 +214,141 @@ void ZepMode_Search::InitSearchTree()
 {
     m_indexTree.clear();
     auto pInitSet = std::make_shared<IndexSet>();
-    for (uint32_t i = 0; i < (uint32_t)m_spFilePaths->paths.size(); i++)
+    auto count = m_spFilePaths->paths.size();
+    pInitSet->paths.resize((count + 63) / 64, ~uint64_t(0));
+    if (count & 63)
+    {
+        pInitSet->paths.back() = (uint64_t(1) << (count & 63)) - 1;
+    }
+    pInitSet->count = count;
+    for (uint32_t i = 0; i < (uint32_t)std::min(count, MaxShownResults); i++)
     {
-        pInitSet->indices.insert(std::make_pair(0, SearchResult{ i, 0 }));
+        pInitSet->top.push_back(ScoredResult{ 0, i });
     }
     m_indexTree.push_back(pInitSet);
 }
 
+// Score a path which contains the term as a subsequence; higher is better.
+// The match is found left to right, then tightened from the end back, since the latest start for the
+// same end gives the most compact match.  Consecutive characters, characters at the start of a word or
+// path component, and characters in the file name score more; gaps cost a little.
+int32_t ZepMode_Search::FuzzyScore(const std::string& path, const std::string& term)
+{
+    if (term.empty())
+    {
+        return 0;
+    }
+
+    size_t end = 0;
+    size_t termIndex = 0;
+    for (; end < path.size() && termIndex < term.size(); end++)
+    {
+        if (path[end] == term[termIndex])
+        {
+            termIndex++;
+        }
+    }
+
+    if (termIndex != term.size())
+    {
+        return std::numeric_limits<int32_t>::min();
+    }
+
+    auto start = end;
+    for (auto backIndex = term.size(); backIndex > 0;)
+    {
+        start--;
+        if (path[start] == term[backIndex - 1])
+        {
+            backIndex--;
+        }
+    }
+
+    auto fileNameStart = path.find_last_of("/\\");
+    fileNameStart = (fileNameStart == std::string::npos) ? 0 : fileNameStart + 1;
+
+    int32_t score = 0;
+    size_t last = std::string::npos;
+    termIndex = 0;
+    for (auto pos = start; pos < end && termIndex < term.size(); pos++)
+    {
+        if (path[pos] != term[termIndex])
+        {
+            continue;
+        }
+
+        score += ScoreMatch;
+        if (last != std::string::npos)
+        {
+            if (pos == last + 1)
+            {
+                score += ScoreConsecutive;
+            }
+            else
+            {
+                score -= std::min(ScoreMaxGap, int32_t(pos - last - 1) * ScoreGap);
+            }
+        }
+
+        if (pos == 0 || IsPathBoundary(path[pos - 1]))
+        {
+            score += ScoreBoundary;
+        }
+
+        if (pos >= fileNameStart)
+        {
+            score += ScoreFileName;
+        }
+
+        last = pos;
+        termIndex++;
+    }
+
+    // Prefer shorter paths when all else is equal
+    return score * 8 - int32_t(std::min(path.size(), size_t(255)) / 32);
+}
+
+// Keep the best results from both lists, in order; the index breaks ties so that the order is stable
+void ZepMode_Search::MergeTop(std::vector<ScoredResult>& top, const std::vector<ScoredResult>& more)
+{
+    auto better = [](const ScoredResult& lhs, const ScoredResult& rhs) {
+        return lhs.score != rhs.score ? lhs.score > rhs.score : lhs.index < rhs.index;
+    };
+
+    std::vector<ScoredResult> merged;
+    merged.reserve(std::min(top.size() + more.size(), MaxShownResults));
+    std::merge(top.begin(), top.end(), more.begin(), more.end(), std::back_inserter(merged), better);
+    if (merged.size() > MaxShownResults)
+    {
+        merged.resize(MaxShownResults);
+    }
+    top.swap(merged);
+}
+
+// Only fill the buffer if the best results have changed; the buffer only has the best ones in it
 void ZepMode_Search::ShowTreeResult()
 {
+    std::vector<uint32_t> shownResults;
+    for (auto& result : m_indexTree.back()->top)
+    {
+        shownResults.push_back(result.index);
+    }
+
+    if (!m_shownResults.empty() && shownResults == m_shownResults)
+    {
+        return;
+    }
+    m_shownResults = shownResults;
+
     std::ostringstream str;
     bool start = true;
-    for (auto& index : m_indexTree.back()->indices)
+    for (auto& index : m_shownResults)
     {
         if (!start)
         {
             str << std::endl;
         }
-        str << m_spFilePaths->paths[index.second.index].string();
+        str << m_spFilePaths->paths[index].string();
         start = false;
     }
     m_window.GetBuffer().SetText(str.str());
@@ -203,18 +362,17 @@ void ZepMode_Search::OpenSelection(OpenType type)
 
     auto cursor = m_window.GetBufferCursor();
     auto line = m_window.GetBuffer().GetBufferLine(cursor);
-    auto paths = m_indexTree[m_indexTree.size() - 1];
 
     auto& buffer = m_window.GetBuffer();
 
     GetEditor().GetActiveTabWindow()->SetActiveWindow(&m_launchWindow);
 
     long count = 0;
-    for (auto& index : m_indexTree.back()->indices)
+    for (auto& index : m_shownResults)
     {
         if (count == line)
         {
-            auto path = m_spFilePaths->paths[index.second.index];
+            auto path = m_spFilePaths->paths[index];
             auto full_path = m_spFilePaths->root / path;
 
             auto pBuffer = GetEditor().GetFileBuffer(full_path, 0, true);
@@ -265,12 +423,26 @@ void ZepMode_Search::UpdateTree()
 
     if (treeSearchActive)
     {
-        if (!is_future_ready(m_searchResult))
+        for (auto& result : m_searchResults)
         {
-            return;
+            if (!is_future_ready(result))
+            {
+                return;
+            }
+        }
+
+        // Put the chunks together; they are in path order, so the results are too
+        auto spResult = std::make_shared<IndexSet>();
+        for (auto& result : m_searchResults)
+        {
+            auto spChunk = result.get();
+            spResult->paths.insert(spResult->paths.end(), spChunk->paths.begin(), spChunk->paths.end());
+            spResult->count += spChunk->count;
+            MergeTop(spResult->top, spChunk->top);
         }
+        m_searchResults.clear();
 
-        m_indexTree.push_back(m_searchResult.get());
+        m_indexTree.push_back(spResult);
         treeSearchActive = false;
     }
 
@@ -290,55 +462,73 @@ void ZepMode_Search::UpdateTree()
     }
     else if (m_searchTerm.size() > treeDepth)
     {
-        std::shared_ptr<IndexSet> spStartSet;
-        spStartSet = m_indexTree[m_indexTree.size() - 1];
-        char startChar = m_searchTerm[m_indexTree.size() - 1];
-
-        // Search for a match at the next level of the search tree
-        m_searchResult = GetEditor().GetThreadPool().enqueue([&](std::shared_ptr<IndexSet> spStartSet, const char startChar) {
-            auto spResult = std::make_shared<IndexSet>();
-            for (auto& searchPair : spStartSet->indices)
-            {
-                auto index = searchPair.second.index;
-                auto loc = searchPair.second.location;
-                auto dist = searchPair.first;
+        // Search for a match at the next level of the search tree, in chunks on the thread pool, as background work so that a
+        // big project doesn't hold up the other workers.
+        // The candidates are the paths of the last level which also have the new character, found 64 at a time by
+        // ANDing the bits of the two; only they are scored, which checks that they have the whole term in order
+        auto spStartSet = m_indexTree[m_indexTree.size() - 1];
+        auto spFilePaths = m_spFilePaths;
+        auto term = m_searchTerm.substr(0, treeDepth + 1);
+        auto caseImportant = m_caseImportant;
+        if (!caseImportant)
+        {
+            term = string_tolower(term);
+        }
 
-                size_t pos = 0;
-                if (m_caseImportant)
-                {
-                    auto str = m_spFilePaths->paths[index].string();
-                    pos = str.find_first_of(startChar, loc);
-                }
-                else
+        auto lowerChar = uint8_t(std::tolower(uint8_t(term.back())));
+        auto words = spStartSet->paths.size();
+        auto chunkWords = SearchChunkSize / 64;
+        for (size_t chunkStart = 0; chunkStart < words || chunkStart == 0; chunkStart += chunkWords)
+        {
+            auto chunkEnd = std::min(chunkStart + chunkWords, words);
+            m_searchResults.push_back(GetEditor().GetThreadPool().enqueue_with(TaskPriority::Background, CancelToken(), [=]() {
+                auto spResult = std::make_shared<IndexSet>();
+                spResult->paths.resize(chunkEnd - chunkStart, 0);
+
+                // No path has the character
+                auto& charPaths = spFilePaths->charPaths[lowerChar];
+                if (charPaths.empty())
                 {
-                    auto str = m_spFilePaths->lowerPaths[index];
-                    pos = str.find_first_of(startChar, loc);
+                    return spResult;
                 }
 
-                if (pos != std::string::npos)
+                std::string casePath;
+                for (auto word = chunkStart; word < chunkEnd; word++)
                 {
-                    // this approach 'clumps things together'
-                    // It rewards more for strings of subsequent characters
-                    uint32_t newDist = ((uint32_t)pos - loc);
-                    if (dist == 0)
-                    {
-                        newDist = 1;
-                    }
-                    else if (newDist == 1)
-                    {
-                        newDist = dist;
-                    }
-                    else
+                    for (auto candidates = spStartSet->paths[word] & charPaths[word]; candidates != 0; candidates &= candidates - 1)
                     {
-                        newDist = dist + 1;
+                        auto bit = LowestBit(candidates);
+                        auto index = uint32_t(word * 64 + bit);
+                        auto pPath = &spFilePaths->lowerPaths[index];
+                        if (caseImportant)
+                        {
+                            casePath = spFilePaths->paths[index].string();
+                            pPath = &casePath;
+                        }
+
+                        auto score = FuzzyScore(*pPath, term);
+                        if (score != std::numeric_limits<int32_t>::min())
+                        {
+                            spResult->paths[word - chunkStart] |= uint64_t(1) << bit;
+                            spResult->count++;
+                            spResult->top.push_back(ScoredResult{ score, index });
+                        }
                     }
+                }
 
-                    spResult->indices.insert(std::make_pair(newDist, SearchResult{ index, (uint32_t)pos }));
+                // Keep the best of the chunk
+                auto better = [](const ScoredResult& lhs, const ScoredResult& rhs) {
+                    return lhs.score != rhs.score ? lhs.score > rhs.score : lhs.index < rhs.index;
+                };
+                if (spResult->top.size() > MaxShownResults)
+                {
+                    std::nth_element(spResult->top.begin(), spResult->top.begin() + MaxShownResults, spResult->top.end(), better);
+                    spResult->top.resize(MaxShownResults);
                 }
-            }
-            return spResult;
-        },
-            spStartSet, startChar);
+                std::sort(spResult->top.begin(), spResult->top.end(), better);
+                return spResult;
+            }));
+        }
 
         treeSearchActive = true;
     }
@@ -257,6 +257,10 @@ void ZepMode_Vim::SetupKeyMaps()
 
     AddKeyMapWithCountRegisters({ &m_normalMap, &m_visualMap }, { "<C-r>" }, id_Redo);
     AddKeyMapWithCountRegisters({ &m_normalMap, &m_visualMap }, { "<C-z>", "u" }, id_Undo);
+    AddKeyMapWithCountRegisters({ &m_normalMap }, { "g-" }, id_UndoEarlier);
+    AddKeyMapWithCountRegisters({ &m_normalMap }, { "g+" }, id_UndoLater);
+    keymap_add({ &m_normalMap }, { "q<.>" }, id_MacroRecord);
+    AddKeyMapWithCountRegisters({ &m_normalMap }, { "@<.>" }, id_MacroPlay);
 
     keymap_add({ &m_normalMap }, { "<Backspace>" }, id_MotionStandardLeft);
 
@@ -0,0 +1,909 @@
+#include "zep/regex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+namespace Zep
+{
+
+enum class RegexNodeType
+{
+    Char,
+    Class,
+    Concat,
+    Alternate,
+    Star,
+    Plus,
+    Quest,
+    Assert,
+    Group
+};
+
+// The parsed pattern; turned into a program by ZepRegex::Generate
+struct RegexNode
+{
+    RegexNodeType type = RegexNodeType::Concat;
+    uint8_t ch = 0;
+    uint32_t classIndex = 0;
+    bool consumeCodepoint = false; // Class matches a UTF8 lead byte; follow it with any continuation bytes
+    RegexOp assertOp = RegexOp::Match;
+    uint32_t group = 0;
+    std::vector<RegexNode> children;
+};
+
+namespace
+{
+
+// Class 0 is always the UTF8 continuation bytes
+const uint32_t ContinuationClass = 0;
+
+// Groups after this are only for grouping
+const uint32_t MaxRegexGroups = 9;
+
+bool IsRegexWord(uint8_t ch)
+{
+    return std::isalnum(ch) || ch == '_';
+}
+
+bool RegexAssert(RegexOp op, const uint8_t* pos, const uint8_t* pBegin, const uint8_t* pEnd)
+{
+    switch (op)
+    {
+    case RegexOp::LineBegin:
+        return pos == pBegin || pos[-1] == '\n';
+    case RegexOp::LineEnd:
+        return pos == pEnd || *pos == '\n';
+    case RegexOp::WordBegin:
+        return pos < pEnd && IsRegexWord(*pos) && (pos == pBegin || !IsRegexWord(pos[-1]));
+    case RegexOp::WordEnd:
+        return pos > pBegin && IsRegexWord(pos[-1]) && (pos == pEnd || !IsRegexWord(*pos));
+    default:
+        return true;
+    }
+}
+
+struct RegexParser
+{
+    RegexParser(const std::string& pat, bool ignoreCase, std::vector<std::bitset<256>>& cls)
+        : pattern(pat)
+        , ignore(ignoreCase)
+        , classes(cls)
+    {
+    }
+
+    const std::string& pattern;
+    bool ignore;
+    std::vector<std::bitset<256>>& classes;
+    size_t pos = 0;
+    uint32_t groupCount = 0;
+    std::string error;
+
+    bool AtEnd() const
+    {
+        return pos >= pattern.size();
+    }
+
+    bool Peek(const char* pszToken) const
+    {
+        return pattern.compare(pos, strlen(pszToken), pszToken) == 0;
+    }
+
+    RegexNode MakeClass(std::bitset<256> bits, bool negate)
+    {
+        if (ignore)
+        {
+            for (int ch = 'a'; ch <= 'z'; ch++)
+            {
+                if (bits[ch] || bits[std::toupper(ch)])
+                {
+                    bits[ch] = true;
+                    bits[std::toupper(ch)] = true;
+                }
+            }
+        }
+
+        RegexNode node;
+        node.type = RegexNodeType::Class;
+        if (negate)
+        {
+            bits.flip();
+            bits[(uint8_t)'\n'] = false;
+            bits &= ~classes[ContinuationClass];
+            node.consumeCodepoint = true;
+        }
+        node.classIndex = uint32_t(classes.size());
+        classes.push_back(bits);
+        return node;
+    }
+
+    RegexNode MakeChar(uint8_t ch)
+    {
+        if (ignore && std::isalpha(ch))
+        {
+            std::bitset<256> bits;
+            bits[ch] = true;
+            return MakeClass(bits, false);
+        }
+
+        RegexNode node;
+        node.type = RegexNodeType::Char;
+        node.ch = ch;
+        return node;
+    }
+
+    RegexNode MakeAssert(RegexOp op)
+    {
+        RegexNode node;
+        node.type = RegexNodeType::Assert;
+        node.assertOp = op;
+        return node;
+    }
+
+    // Character class escapes: \d \w etc.; returns false if this isn't one
+    bool GetEscapeClass(uint8_t ch, std::bitset<256>& bits, bool& negate) const
+    {
+        negate = std::isupper(ch) && ch != 'L' && ch != 'U';
+        switch (std::tolower(ch))
+        {
+        case 'd':
+            for (int c = '0'; c <= '9'; c++)
+                bits[c] = true;
+            return true;
+        case 'w':
+            for (int c = 0; c < 128; c++)
+                bits[c] = IsRegexWord(uint8_t(c));
+            return true;
+        case 's':
+            bits[(uint8_t)' '] = true;
+            bits[(uint8_t)'\t'] = true;
+            return true;
+        case 'a':
+            for (int c = 0; c < 128; c++)
+                bits[c] = std::isalpha(c) != 0;
+            return true;
+        case 'x':
+            for (int c = 0; c < 128; c++)
+                bits[c] = std::isxdigit(c) != 0;
+            return true;
+        case 'l':
+            if (ch == 'L')
+                return false;
+            for (int c = 'a'; c <= 'z'; c++)
+                bits[c] = true;
+            return true;
+        case 'u':
+            if (ch == 'U')
+                return false;
+            for (int c = 'A'; c <= 'Z'; c++)
+                bits[c] = true;
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    uint8_t EscapedChar(uint8_t ch) const
+    {
+        switch (ch)
+        {
+        case 't':
+            return '\t';
+        case 'n':
+            return '\n';
+        case 'e':
+            return 27;
+        case 'r':
+            return '\r';
+        default:
+            return ch;
+        }
+    }
+
+    // [abc] [^a-z] ; returns false if there is no closing bracket, in which case '[' is a literal
+    bool ParseBracket(RegexNode& node)
+    {
+        auto scan = pos + 1;
+        bool negate = false;
+        if (scan < pattern.size() && pattern[scan] == '^')
+        {
+            negate = true;
+            scan++;
+        }
+
+        std::bitset<256> bits;
+        bool first = true;
+        while (scan < pattern.size())
+        {
+            uint8_t ch = pattern[scan];
+            if (ch == ']' && !first)
+            {
+                pos = scan + 1;
+                node = MakeClass(bits, negate);
+                return true;
+            }
+            first = false;
+
+            if (ch == '\\' && scan + 1 < pattern.size())
+            {
+                bool classNegate;
+                std::bitset<256> escBits;
+                if (GetEscapeClass(pattern[scan + 1], escBits, classNegate) && !classNegate)
+                {
+                    bits |= escBits;
+                    scan += 2;
+                    continue;
+                }
+                ch = EscapedChar(pattern[scan + 1]);
+                scan++;
+            }
+
+            // Range
+            if (scan + 2 < pattern.size() && pattern[scan + 1] == '-' && pattern[scan + 2] != ']')
+            {
+                uint8_t chEnd = pattern[scan + 2];
+                if (chEnd < ch)
+                {
+                    error = "Reverse range in character class";
+                    return true;
+                }
+                for (int c = ch; c <= chEnd; c++)
+                {
+                    bits[c] = true;
+                }
+                scan += 3;
+                continue;
+            }
+
+            bits[ch] = true;
+            scan++;
+        }
+        return false;
+    }
+
+    bool ParseAtom(RegexNode& node)
+    {
+        uint8_t ch = pattern[pos];
+        if (ch == '.')
+        {
+            pos++;
+            node = MakeClass(std::bitset<256>(), true);
+            return true;
+        }
+        else if (ch == '[')
+        {
+            if (ParseBracket(node))
+            {
+                return error.empty();
+            }
+            pos++;
+            node = MakeChar(ch);
+            return true;
+        }
+        else if (ch == '\\')
+        {
+            if (pos + 1 >= pattern.size())
+            {
+                pos++;
+                node = MakeChar(ch);
+                return true;
+            }
+
+            uint8_t esc = pattern[pos + 1];
+            pos += 2;
+            if (esc == '(')
+            {
+                auto group = ++groupCount;
+                node = ParseAlternate();
+                if (!error.empty())
+                {
+                    return false;
+                }
+                if (!Peek("\\)"))
+                {
+                    error = "Unmatched \\(";
+                    return false;
+                }
+                pos += 2;
+                if (group <= MaxRegexGroups)
+                {
+                    RegexNode groupNode;
+                    groupNode.type = RegexNodeType::Group;
+                    groupNode.group = group;
+                    groupNode.children.push_back(std::move(node));
+                    node = std::move(groupNode);
+                }
+                return true;
+            }
+            else if (esc == '<')
+            {
+                node = MakeAssert(RegexOp::WordBegin);
+                return true;
+            }
+            else if (esc == '>')
+            {
+                node = MakeAssert(RegexOp::WordEnd);
+                return true;
+            }
+            else if (esc == '{')
+            {
+                error = "\\{ is not supported";
+                return false;
+            }
+
+            bool negate;
+            std::bitset<256> bits;
+            if (GetEscapeClass(esc, bits, negate))
+            {
+                node = MakeClass(bits, negate);
+                return true;
+            }
+
+            node = MakeChar(EscapedChar(esc));
+            return true;
+        }
+
+        pos++;
+        node = MakeChar(ch);
+        return true;
+    }
+
+    RegexNode ParseConcat()
+    {
+        RegexNode concat;
+        concat.type = RegexNodeType::Concat;
+
+        bool first = true;
+        while (!AtEnd() && !Peek("\\|") && !Peek("\\)"))
+        {
+            // Case flags apply to the whole pattern, and have already been read
+            if (Peek("\\c") || Peek("\\C"))
+            {
+                pos += 2;
+                continue;
+            }
+
+            if (first && pattern[pos] == '^')
+            {
+                pos++;
+                first = false;
+                concat.children.push_back(MakeAssert(RegexOp::LineBegin));
+                continue;
+            }
+            first = false;
+
+            if (pattern[pos] == '$' && (pos + 1 == pattern.size() || pattern.compare(pos + 1, 2, "\\|") == 0 || pattern.compare(pos + 1, 2, "\\)") == 0))
+            {
+                pos++;
+                concat.children.push_back(MakeAssert(RegexOp::LineEnd));
+                continue;
+            }
+
+            // A leading '*' is just a star
+            RegexNode atom;
+            if (pattern[pos] == '*' && concat.children.empty())
+            {
+                pos++;
+                atom = MakeChar('*');
+            }
+            else if (!ParseAtom(atom))
+            {
+                return concat;
+            }
+
+            // Quantifiers
+            for (;;)
+            {
+                RegexNodeType type;
+                if (Peek("*"))
+                {
+                    type = RegexNodeType::Star;
+                    pos++;
+                }
+                else if (Peek("\\+"))
+                {
+                    type = RegexNodeType::Plus;
+                    pos += 2;
+                }
+                else if (Peek("\\?") || Peek("\\="))
+                {
+                    type = RegexNodeType::Quest;
+                    pos += 2;
+                }
+                else
+                {
+                    break;
+                }
+
+                RegexNode quant;
+                quant.type = type;
+                quant.children.push_back(std::move(atom));
+                atom = std::move(quant);
+            }
+            concat.children.push_back(std::move(atom));
+        }
+        return concat;
+    }
+
+    RegexNode ParseAlternate()
+    {
+        auto node = ParseConcat();
+        while (error.empty() && Peek("\\|"))
+        {
+            pos += 2;
+            RegexNode alt;
+            alt.type = RegexNodeType::Alternate;
+            alt.children.push_back(std::move(node));
+            alt.children.push_back(ParseConcat());
+            node = std::move(alt);
+        }
+        return node;
+    }
+};
+
+} // namespace
+
+uint32_t ZepRegex::Emit(RegexOp op, uint8_t ch, uint32_t x, uint32_t y)
+{
+    RegexInst inst;
+    inst.op = op;
+    inst.ch = ch;
+    inst.x = x;
+    inst.y = y;
+    m_program.push_back(inst);
+    return uint32_t(m_program.size() - 1);
+}
+
+void ZepRegex::Generate(const RegexNode& node)
+{
+    switch (node.type)
+    {
+    case RegexNodeType::Char:
+        Emit(RegexOp::Char, node.ch);
+        break;
+    case RegexNodeType::Class:
+        Emit(RegexOp::Class, 0, node.classIndex);
+        if (node.consumeCodepoint)
+        {
+            auto split = Emit(RegexOp::Split);
+            Emit(RegexOp::Class, 0, ContinuationClass);
+            Emit(RegexOp::Jump, 0, split);
+            m_program[split].x = split + 1;
+            m_program[split].y = uint32_t(m_program.size());
+        }
+        break;
+    case RegexNodeType::Concat:
+        for (auto& child : node.children)
+        {
+            Generate(child);
+        }
+        break;
+    case RegexNodeType::Alternate:
+    {
+        auto split = Emit(RegexOp::Split);
+        m_program[split].x = uint32_t(m_program.size());
+        Generate(node.children[0]);
+        auto jump = Emit(RegexOp::Jump);
+        m_program[split].y = uint32_t(m_program.size());
+        Generate(node.children[1]);
+        m_program[jump].x = uint32_t(m_program.size());
+    }
+    break;
+    case RegexNodeType::Star:
+    {
+        auto split = Emit(RegexOp::Split);
+        Generate(node.children[0]);
+        Emit(RegexOp::Jump, 0, split);
+        m_program[split].x = split + 1;
+        m_program[split].y = uint32_t(m_program.size());
+    }
+    break;
+    case RegexNodeType::Plus:
+    {
+        auto start = uint32_t(m_program.size());
+        Generate(node.children[0]);
+        auto split = Emit(RegexOp::Split, 0, start);
+        m_program[split].y = split + 1;
+    }
+    break;
+    case RegexNodeType::Quest:
+    {
+        auto split = Emit(RegexOp::Split);
+        Generate(node.children[0]);
+        m_program[split].x = split + 1;
+        m_program[split].y = uint32_t(m_program.size());
+    }
+    break;
+    case RegexNodeType::Assert:
+        Emit(node.assertOp);
+        break;
+    case RegexNodeType::Group:
+        Emit(RegexOp::Save, 0, node.group * 2);
+        Generate(node.children[0]);
+        Emit(RegexOp::Save, 0, node.group * 2 + 1);
+        break;
+    }
+}
+
+bool ZepRegex::Compile(const std::string& pattern, std::string& error)
+{
+    m_program.clear();
+    m_classes.clear();
+    m_firstByte = -1;
+    m_groupCount = 0;
+
+    // \c or \C anywhere sets the case for the whole pattern (the last one wins)
+    m_ignoreCase = false;
+    for (size_t i = 0; i + 1 < pattern.size(); i++)
+    {
+        if (pattern[i] == '\\')
+        {
+            if (pattern[i + 1] == 'c')
+                m_ignoreCase = true;
+            else if (pattern[i + 1] == 'C')
+                m_ignoreCase = false;
+            i++;
+        }
+    }
+
+    std::bitset<256> continuation;
+    for (int ch = 0x80; ch < 0xC0; ch++)
+    {
+        continuation[ch] = true;
+    }
+    m_classes.push_back(continuation);
+
+    RegexParser parser(pattern, m_ignoreCase, m_classes);
+    auto root = parser.ParseAlternate();
+    if (parser.error.empty() && !parser.AtEnd())
+    {
+        parser.error = "Unmatched \\)";
+    }
+
+    if (!parser.error.empty())
+    {
+        error = parser.error;
+        m_program.clear();
+        return false;
+    }
+
+    m_groupCount = std::min(parser.groupCount, MaxRegexGroups);
+    Generate(root);
+    Emit(RegexOp::Match);
+
+    FindFirstByte();
+    return true;
+}
+
+bool ZepRegex::IsValid() const
+{
+    return !m_program.empty();
+}
+
+uint32_t ZepRegex::GetGroupCount() const
+{
+    return m_groupCount;
+}
+
+void ZepRegex::FindFirstByte()
+{
+    // Walk the instructions reachable before the first character is consumed.
+    // Assertions are assumed to pass, which can only make the answer more conservative
+    std::vector<bool> visited(m_program.size(), false);
+    std::vector<uint32_t> stack{ 0 };
+    int firstByte = -1;
+    while (!stack.empty())
+    {
+        auto pc = stack.back();
+        stack.pop_back();
+        if (visited[pc])
+        {
+            continue;
+        }
+        visited[pc] = true;
+
+        auto& inst = m_program[pc];
+        switch (inst.op)
+        {
+        case RegexOp::Jump:
+            stack.push_back(inst.x);
+            break;
+        case RegexOp::Split:
+            stack.push_back(inst.x);
+            stack.push_back(inst.y);
+            break;
+        case RegexOp::LineBegin:
+        case RegexOp::LineEnd:
+        case RegexOp::WordBegin:
+        case RegexOp::WordEnd:
+        case RegexOp::Save:
+            stack.push_back(pc + 1);
+            break;
+        case RegexOp::Char:
+            if (firstByte != -1 && firstByte != inst.ch)
+            {
+                return;
+            }
+            firstByte = inst.ch;
+            break;
+        case RegexOp::Class:
+        case RegexOp::Match:
+            return;
+        }
+    }
+    m_firstByte = firstByte;
+}
+
+void ZepRegex::AddThread(RegexState& state, std::vector<RegexThread>& list, uint32_t pc, const uint8_t* pStart, const uint8_t* pos, const uint8_t* pBegin, const uint8_t* pEnd) const
+{
+    if (state.visited[pc] == state.generation)
+    {
+        return;
+    }
+    state.visited[pc] = state.generation;
+
+    auto& inst = m_program[pc];
+    switch (inst.op)
+    {
+    case RegexOp::Jump:
+        AddThread(state, list, inst.x, pStart, pos, pBegin, pEnd);
+        break;
+    case RegexOp::Split:
+        AddThread(state, list, inst.x, pStart, pos, pBegin, pEnd);
+        AddThread(state, list, inst.y, pStart, pos, pBegin, pEnd);
+        break;
+    case RegexOp::LineBegin:
+    case RegexOp::LineEnd:
+    case RegexOp::WordBegin:
+    case RegexOp::WordEnd:
+        if (RegexAssert(inst.op, pos, pBegin, pEnd))
+        {
+            AddThread(state, list, pc + 1, pStart, pos, pBegin, pEnd);
+        }
+        break;
+    case RegexOp::Save:
+        AddThread(state, list, pc + 1, pStart, pos, pBegin, pEnd);
+        break;
+    default:
+        list.push_back(RegexThread{ pc, pStart });
+        break;
+    }
+}
+
+bool ZepRegex::Find(RegexState& state, const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pStart, const uint8_t*& pMatchBegin, const uint8_t*& pMatchEnd) const
+{
+    if (m_program.empty())
+    {
+        return false;
+    }
+
+    auto nextGeneration = [&]() {
+        if (++state.generation == 0)
+        {
+            std::fill(state.visited.begin(), state.visited.end(), 0);
+            state.generation = 1;
+        }
+    };
+
+    bool matched = false;
+    state.current.clear();
+
+    for (auto p = pStart;; p++)
+    {
+        if (!matched)
+        {
+            if (state.current.empty())
+            {
+                // Skip straight to the next possible start
+                if (m_firstByte >= 0)
+                {
+                    p = (const uint8_t*)memchr(p, m_firstByte, pEnd - p);
+                    if (p == nullptr)
+                    {
+                        return false;
+                    }
+                }
+                nextGeneration();
+            }
+
+            // A new attempt starting here, at the lowest priority
+            AddThread(state, state.current, 0, p, p, pBegin, pEnd);
+        }
+
+        if (state.current.empty())
+        {
+            if (matched || p == pEnd)
+            {
+                break;
+            }
+            continue;
+        }
+
+        nextGeneration();
+        state.next.clear();
+        for (auto& thread : state.current)
+        {
+            auto& inst = m_program[thread.pc];
+            if (inst.op == RegexOp::Match)
+            {
+                // Threads after this one have a lower priority, so they are cut
+                matched = true;
+                pMatchBegin = thread.pStart;
+                pMatchEnd = p;
+                break;
+            }
+
+            if (p == pEnd)
+            {
+                continue;
+            }
+
+            if ((inst.op == RegexOp::Char && *p == inst.ch) || (inst.op == RegexOp::Class && m_classes[inst.x][*p]))
+            {
+                AddThread(state, state.next, thread.pc + 1, thread.pStart, p + 1, pBegin, pEnd);
+            }
+        }
+        std::swap(state.current, state.next);
+
+        if (p == pEnd)
+        {
+            break;
+        }
+    }
+    return matched;
+}
+
+bool ZepRegex::Find(const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pStart, const uint8_t*& pMatchBegin, const uint8_t*& pMatchEnd) const
+{
+    RegexState state;
+    state.visited.resize(m_program.size(), 0);
+    return Find(state, pBegin, pEnd, pStart, pMatchBegin, pMatchEnd);
+}
+
+void ZepRegex::FindAll(const uint8_t* pBegin, const uint8_t* pEnd, std::function<bool(const uint8_t*, const uint8_t*)> fnMatch) const
+{
+    RegexState state;
+    state.visited.resize(m_program.size(), 0);
+
+    const uint8_t* pMatchBegin;
+    const uint8_t* pMatchEnd;
+    const uint8_t* pLastEnd = nullptr;
+    auto p = pBegin;
+    while (p <= pEnd && Find(state, pBegin, pEnd, p, pMatchBegin, pMatchEnd))
+    {
+        if (pMatchBegin == pMatchEnd)
+        {
+            // 'x*' matches before each character, but not where the last match ended
+            if (pMatchBegin != pLastEnd && !fnMatch(pMatchBegin, pMatchEnd))
+            {
+                return;
+            }
+
+            if (pMatchBegin == pEnd)
+            {
+                return;
+            }
+
+            // On to the next codepoint
+            p = pMatchBegin + 1;
+            while (p < pEnd && (*p & 0xC0) == 0x80)
+            {
+                p++;
+            }
+            continue;
+        }
+
+        if (!fnMatch(pMatchBegin, pMatchEnd))
+        {
+            return;
+        }
+        p = pMatchEnd;
+        pLastEnd = pMatchEnd;
+    }
+}
+
+void ZepRegex::AddGroupThread(std::vector<bool>& visited, std::vector<RegexGroupThread>& list, uint32_t pc, RegexGroups groups, const uint8_t* pos, const uint8_t* pBegin, const uint8_t* pEnd) const
+{
+    if (visited[pc])
+    {
+        return;
+    }
+    visited[pc] = true;
+
+    auto& inst = m_program[pc];
+    switch (inst.op)
+    {
+    case RegexOp::Jump:
+        AddGroupThread(visited, list, inst.x, std::move(groups), pos, pBegin, pEnd);
+        break;
+    case RegexOp::Split:
+        AddGroupThread(visited, list, inst.x, groups, pos, pBegin, pEnd);
+        AddGroupThread(visited, list, inst.y, std::move(groups), pos, pBegin, pEnd);
+        break;
+    case RegexOp::LineBegin:
+    case RegexOp::LineEnd:
+    case RegexOp::WordBegin:
+    case RegexOp::WordEnd:
+        if (RegexAssert(inst.op, pos, pBegin, pEnd))
+        {
+            AddGroupThread(visited, list, pc + 1, std::move(groups), pos, pBegin, pEnd);
+        }
+        break;
+    case RegexOp::Save:
+        if (inst.x & 1)
+        {
+            groups[inst.x / 2].second = pos;
+        }
+        else
+        {
+            groups[inst.x / 2].first = pos;
+        }
+        AddGroupThread(visited, list, pc + 1, std::move(groups), pos, pBegin, pEnd);
+        break;
+    default:
+        list.push_back(RegexGroupThread{ pc, std::move(groups) });
+        break;
+    }
+}
+
+// Only the text of the match is stepped through, and the first thread (in priority order) to match at its end wins
+void ZepRegex::GetGroups(const uint8_t* pBegin, const uint8_t* pEnd, const uint8_t* pMatchBegin, const uint8_t* pMatchEnd, RegexGroups& groups) const
+{
+    groups.assign(m_groupCount + 1, std::make_pair(pMatchBegin, pMatchBegin));
+    groups[0] = std::make_pair(pMatchBegin, pMatchEnd);
+    if (m_groupCount == 0 || m_program.empty())
+    {
+        return;
+    }
+
+    std::vector<bool> visited(m_program.size(), false);
+    std::vector<RegexGroupThread> current;
+    std::vector<RegexGroupThread> next;
+    RegexGroups empty(m_groupCount + 1, std::make_pair(nullptr, nullptr));
+    AddGroupThread(visited, current, 0, empty, pMatchBegin, pBegin, pEnd);
+
+    for (auto p = pMatchBegin; !current.empty(); p++)
+    {
+        std::fill(visited.begin(), visited.end(), false);
+        next.clear();
+        for (auto& thread : current)
+        {
+            auto& inst = m_program[thread.pc];
+            if (inst.op == RegexOp::Match)
+            {
+                if (p == pMatchEnd)
+                {
+                    for (uint32_t index = 1; index <= m_groupCount; index++)
+                    {
+                        if (thread.groups[index].first && thread.groups[index].second)
+                        {
+                            groups[index] = thread.groups[index];
+                        }
+                    }
+                    return;
+                }
+                continue;
+            }
+
+            if (p == pMatchEnd)
+            {
+                continue;
+            }
+
+            if ((inst.op == RegexOp::Char && *p == inst.ch) || (inst.op == RegexOp::Class && m_classes[inst.x][*p]))
+            {
+                AddGroupThread(visited, next, thread.pc + 1, thread.groups, p + 1, pBegin, pEnd);
+            }
+        }
+
+        if (p == pMatchEnd)
+        {
+            return;
+        }
+        std::swap(current, next);
+    }
+}
+
+} // namespace Zep
@@ -144,6 +144,7 @@ void ZepSyntax::Notify(std::shared_ptr<ZepMessage> spMsg)
 // TODO: Multiline comments
 void ZepSyntax::UpdateSyntax()
 {
+    PROFILE_ZONE(UpdateSyntax);
     auto& buffer = m_buffer.GetWorkingBuffer();
     auto itrCurrent = buffer.begin() + m_processedChar;
     auto itrEnd = buffer.begin() + m_targetChar;
@@ -2,9 +2,18 @@
 #include "zep/mcommon/logger.h"
 
 #include "zep/buffer.h"
+#include "zep/buffer_io.h"
+#include "zep/buffer_search.h"
+#include "zep/commands.h"
 #include "zep/display.h"
 #include "zep/editor.h"
+#include "zep/mcommon/animation/timer.h"
+#include "zep/mode.h"
+#include "zep/undo.h"
+#include "zep/window.h"
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iostream>
 
 using namespace Zep;
 class BufferTest : public testing::Test
@@ -59,4 +68,580 @@ TEST_F(BufferTest, FindFirstOf)
     ASSERT_TRUE(char_index == 0 && loc.Index() == 0);
 }
 
+TEST_F(BufferTest, Find)
+{
+    pBuffer->SetText("one two three\nfour two");
+
+    std::string search("two");
+    auto loc = pBuffer->Find(pBuffer->Begin(), (const uint8_t*)search.c_str(), nullptr);
+    ASSERT_EQ(loc.Index(), 4);
+
+    loc = pBuffer->Find(loc + 1, (const uint8_t*)search.c_str(), nullptr);
+    ASSERT_EQ(loc.Index(), 19);
+
+    loc = pBuffer->Find(loc + 1, (const uint8_t*)search.c_str(), nullptr);
+    ASSERT_FALSE(loc.Valid());
+
+    // Edit inside the word, so that the gap is in the middle of it
+    ChangeRecord record;
+    pBuffer->Delete(pBuffer->Begin() + 9, pBuffer->Begin() + 10, record);
+    pBuffer->Insert(pBuffer->Begin() + 9, "h", record);
+    search = "three";
+    loc = pBuffer->Find(pBuffer->Begin(), (const uint8_t*)search.c_str(), nullptr);
+    ASSERT_EQ(loc.Index(), 8);
+
+    // Can't match the terminating 0
+    search = "two";
+    loc = pBuffer->Find(pBuffer->Begin(), (const uint8_t*)search.c_str(), (const uint8_t*)search.c_str() + 4);
+    ASSERT_FALSE(loc.Valid());
+}
+
+TEST_F(BufferTest, SearchMatches)
+{
+    pBuffer->SetText("one two three\nfour two");
+
+    std::string error;
+    auto& search = pBuffer->GetSearch();
+    ASSERT_TRUE(search.Start("t\\w\\+", ByteRange(14, 22), error));
+    ASSERT_TRUE(search.IsComplete());
+    ASSERT_TRUE(pBuffer->GetRangeMarkers(RangeMarkerType::Search).empty());
+
+    std::vector<ByteRange> matches;
+    search.GetMatches(ByteRange(5, 20), matches);
+    ASSERT_EQ(matches.size(), 3);
+    ASSERT_EQ(matches[0].first, 4);
+    ASSERT_EQ(matches[2].first, 19);
+
+    // Next and previous wrap around the buffer
+    ByteRange match;
+    ASSERT_TRUE(search.FindNext(19, Direction::Forward, match));
+    ASSERT_EQ(match.first, 4);
+    ASSERT_TRUE(search.FindNext(4, Direction::Backward, match));
+    ASSERT_EQ(match.first, 19);
+
+    // Matches are found again after an edit
+    ChangeRecord record;
+    pBuffer->Insert(pBuffer->Begin(), "ten ", record);
+    ASSERT_TRUE(search.FindNext(0, Direction::Forward, match));
+    ASSERT_EQ(match.first, 8);
+
+    // A bad pattern leaves no results
+    ASSERT_FALSE(search.Start("t\\(", ByteRange(0, 0), error));
+    ASSERT_FALSE(error.empty());
+    ASSERT_FALSE(search.FindNext(0, Direction::Forward, match));
+}
+
+TEST_F(BufferTest, SearchEmptyMatches)
+{
+    pBuffer->SetText("one\ntwo\nthree");
+
+    // Each line start is a match of its own, with nothing in it
+    std::string error;
+    auto& search = pBuffer->GetSearch();
+    ASSERT_TRUE(search.Start("^", ByteRange(0, 0), error));
+
+    std::vector<ByteRange> matches;
+    search.GetMatches(ByteRange(0, pBuffer->End().Index()), matches);
+    ASSERT_EQ(matches.size(), 3);
+    ASSERT_EQ(matches[1].first, 4);
+    ASSERT_EQ(matches[1].second, 4);
+
+    matches.clear();
+    search.GetMatches(ByteRange(4, 5), matches);
+    ASSERT_EQ(matches.size(), 1);
+    ASSERT_EQ(matches[0].first, 4);
+
+    ByteRange match;
+    ASSERT_TRUE(search.FindNext(0, Direction::Forward, match));
+    ASSERT_EQ(match.first, 4);
+    ASSERT_TRUE(search.FindNext(8, Direction::Forward, match));
+    ASSERT_EQ(match.first, 0);
+    ASSERT_TRUE(search.FindNext(4, Direction::Backward, match));
+    ASSERT_EQ(match.first, 0);
+
+    // And so is each line end
+    ASSERT_TRUE(search.Start("$", ByteRange(0, 0), error));
+    ASSERT_TRUE(search.FindNext(3, Direction::Forward, match));
+    ASSERT_EQ(match.first, 7);
+    ASSERT_EQ(match.second, 7);
+}
+
+TEST_F(BufferTest, SearchManyMatches)
+{
+    const long Lines = 100000;
+    std::string text;
+    for (long line = 0; line < Lines; line++)
+    {
+        text += "two\n";
+    }
+    pBuffer->SetText(text);
+
+    // Far more matches than there used to be markers, spread over many chunks
+    std::string error;
+    auto& search = pBuffer->GetSearch();
+    ASSERT_TRUE(search.Start("two", ByteRange(0, 40), error));
+
+    std::vector<ByteRange> matches;
+    search.GetMatches(ByteRange(0, pBuffer->End().Index()), matches);
+    ASSERT_EQ(matches.size(), Lines);
+
+    ByteRange match;
+    ASSERT_TRUE(search.FindNext(0, Direction::Backward, match));
+    ASSERT_EQ(match.first, (Lines - 1) * 4);
+    ASSERT_TRUE(search.FindNext(match.first, Direction::Forward, match));
+    ASSERT_EQ(match.first, 0);
+    ASSERT_TRUE(search.FindNext(200000, Direction::Forward, match));
+    ASSERT_EQ(match.first, 200004);
+}
+
+TEST_F(BufferTest, SearchAcrossChunks)
+{
+    // 'foo' ends the line which crosses the first 64K, so 'bar' starts the next chunk
+    std::string text;
+    for (int line = 0; line < 655; line++)
+    {
+        text += std::string(99, 'a') + "\n";
+    }
+    text += std::string(40, 'b') + "foo\nbar\n";
+    for (int line = 0; line < 100; line++)
+    {
+        text += std::string(99, 'a') + "\n";
+    }
+    pBuffer->SetText(text);
+
+    // The match from the first chunk runs into the second, which must not find 'bar' inside it again
+    std::string error;
+    auto& search = pBuffer->GetSearch();
+    ASSERT_TRUE(search.Start("foo\\nbar\\|bar", ByteRange(0, 0), error));
+    ASSERT_TRUE(search.IsComplete());
+
+    std::vector<ByteRange> matches;
+    search.GetMatches(ByteRange(0, pBuffer->End().Index()), matches);
+    ASSERT_EQ(matches.size(), 1);
+    ASSERT_EQ(matches[0].first, 65540);
+    ASSERT_EQ(matches[0].second, 65547);
+
+    matches.clear();
+    search.GetMatches(ByteRange(65545, 65546), matches);
+    ASSERT_EQ(matches.size(), 1);
+    ASSERT_EQ(matches[0].first, 65540);
+
+    ByteRange match;
+    ASSERT_TRUE(search.FindNext(65541, Direction::Forward, match));
+    ASSERT_EQ(match.first, 65540);
+    ASSERT_TRUE(search.FindNext(65545, Direction::Backward, match));
+    ASSERT_EQ(match.first, 65540);
+}
+
+TEST_F(BufferTest, SearchFinishesAfterNoChange)
+{
+    auto spThreadedEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+    auto pThreadedBuffer = spThreadedEditor->InitWithText("search", "");
+    std::string text;
+    for (int line = 0; line < 400000; line++)
+    {
+        text += "line " + std::to_string(line) + "\n";
+    }
+    pThreadedBuffer->SetText(text);
+
+    // Stop the threads for a change which never comes; the search still gets to the end
+    std::string error;
+    auto& search = pThreadedBuffer->GetSearch();
+    ASSERT_TRUE(search.Start("line 1\\d*9", ByteRange(0, 0), error));
+    spThreadedEditor->Broadcast(std::make_shared<BufferMessage>(pThreadedBuffer, BufferMessageType::PreBufferChange, pThreadedBuffer->Begin(), pThreadedBuffer->Begin()));
+
+    auto start = timer_get_time_now();
+    while (!search.IsComplete() && timer_to_seconds(timer_get_time_now() - start) < 10.0)
+    {
+        spThreadedEditor->RefreshRequired();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_TRUE(search.IsComplete());
+
+    std::vector<ByteRange> matches;
+    search.GetMatches(ByteRange(0, pThreadedBuffer->End().Index()), matches);
+    ASSERT_EQ(matches.size(), 44681);
+
+    spThreadedEditor.reset();
+}
+
+namespace
+{
+void WriteTestFile(const fs::path& path, const std::string& text)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << text;
+}
+
+std::string ReadTestFile(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+} // namespace
+
+TEST_F(BufferTest, ReloadChangedLines)
+{
+    auto path = fs::temp_directory_path() / "zep_reload_test.txt";
+    WriteTestFile(path, "one\ntwo\nthree\nfour\nfive\n");
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+    auto pWindow = spEditor->FindBufferWindows(pFileBuffer)[0];
+
+    // A marker and the cursor after the change
+    auto spMarker = std::make_shared<RangeMarker>(*pFileBuffer);
+    spMarker->SetRange(ByteRange(14, 18));
+    pFileBuffer->AddRangeMarker(spMarker);
+    pWindow->SetBufferCursor(GlyphIterator(pFileBuffer, 19));
+
+    // Change a line and add one, with CRLF
+    WriteTestFile(path, "one\r\n2\r\nthree\r\nfour\r\nfour and a half\r\nfive\r\n");
+    ASSERT_TRUE(pFileBuffer->Reload());
+    ASSERT_STREQ(pFileBuffer->GetWorkingBuffer().string().c_str(), "one\n2\nthree\nfour\nfour and a half\nfive\n");
+    ASSERT_TRUE(pFileBuffer->HasFileFlags(FileFlags::StrippedCR));
+    ASSERT_FALSE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+
+    // 'four' moved up by 2, and the cursor stayed on 'five'
+    ASSERT_EQ(spMarker->GetRange().first, 12);
+    ASSERT_EQ(spMarker->GetRange().second, 16);
+    ASSERT_EQ(pFileBuffer->GetBufferLine(pWindow->GetBufferCursor()), 5);
+
+    // Nothing changed, nothing to do
+    ASSERT_FALSE(pFileBuffer->Reload());
+
+    // The reload is one undo
+    spEditor->GetGlobalMode()->Undo();
+    ASSERT_STREQ(pFileBuffer->GetWorkingBuffer().string().c_str(), "one\ntwo\nthree\nfour\nfive\n");
+
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, ReloadAppended)
+{
+    auto path = fs::temp_directory_path() / "zep_reload_append.txt";
+    WriteTestFile(path, "line 1\n");
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+
+    std::string text = "line 1\n";
+    for (int line = 2; line < 100; line++)
+    {
+        auto add = "line " + std::to_string(line) + "\n";
+        text += add;
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file << add;
+        file.close();
+
+        ASSERT_TRUE(pFileBuffer->Reload());
+    }
+    ASSERT_EQ(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()), text);
+
+    // Rewritten from the start, so not just added to
+    WriteTestFile(path, "new\n" + text);
+    ASSERT_TRUE(pFileBuffer->Reload());
+    ASSERT_EQ(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()), "new\n" + text);
+
+    fs::remove(path);
+}
+
+#ifdef __linux__
+TEST_F(BufferTest, ReloadWhenWatchedFileChanges)
+{
+    auto path = fs::temp_directory_path() / "zep_reload_watch.txt";
+    WriteTestFile(path, "before\n");
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+
+    WriteTestFile(path, "after\n");
+    spEditor->RefreshRequired();
+    ASSERT_STREQ(pFileBuffer->GetWorkingBuffer().string().c_str(), "after\n");
+
+    // Edits are kept until :e!
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(pFileBuffer->Begin(), "edited ", changeRecord);
+    WriteTestFile(path, "again\n");
+    spEditor->RefreshRequired();
+    ASSERT_STREQ(pFileBuffer->GetWorkingBuffer().string().c_str(), "edited after\n");
+    ASSERT_TRUE(pFileBuffer->Reload(true));
+    ASSERT_STREQ(pFileBuffer->GetWorkingBuffer().string().c_str(), "again\n");
+
+    fs::remove(path);
+}
+#endif
+
+TEST_F(BufferTest, FollowFile)
+{
+    auto path = fs::temp_directory_path() / "zep_follow_test.log";
+    WriteTestFile(path, "1\n2\n");
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+    auto pWindow = spEditor->FindBufferWindows(pFileBuffer)[0];
+    pWindow->SetBufferCursor(GlyphIterator(pFileBuffer, 2));
+
+    // Only the last 3 lines are kept, and the cursor moves with the end
+    pFileBuffer->SetFollow(true, 3);
+    for (int line = 3; line <= 5; line++)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file << line << "\n";
+        file.close();
+        spEditor->RefreshRequired();
+    }
+    ASSERT_EQ(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()), "3\n4\n5\n");
+    ASSERT_EQ(pFileBuffer->GetBufferLine(pWindow->GetBufferCursor()), 3);
+    ASSERT_FALSE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+    ASSERT_FALSE(pFileBuffer->GetUndo().CanUndo());
+
+    // Truncated, so start again
+    WriteTestFile(path, "new\n");
+    spEditor->RefreshRequired();
+    ASSERT_EQ(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()), "new\n");
+
+    pFileBuffer->SetFollow(false);
+    ASSERT_FALSE(pFileBuffer->IsFollowing());
+
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, FollowDropsLinesInBatches)
+{
+    auto path = fs::temp_directory_path() / "zep_follow_batch.log";
+    auto logLine = [](int line) {
+        return "line " + std::to_string(line) + " " + std::string(30, '-') + "\n";
+    };
+    std::string text;
+    for (int line = 0; line < 200; line++)
+    {
+        text += logLine(line);
+    }
+    WriteTestFile(path, text);
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+    pFileBuffer->SetFollow(true, 200);
+
+    // An edit to the buffer, away from the end that is checked as the file grows, stays in the history
+    auto& undo = pFileBuffer->GetUndo();
+    auto spCommand = std::make_shared<ZepCommand_Insert>(*pFileBuffer, GlyphIterator(pFileBuffer, long(text.find(logLine(50)))), "edit ");
+    spCommand->Redo();
+    undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+
+    auto append = [&](int line) {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file << logLine(line);
+        file.close();
+        spEditor->RefreshRequired();
+    };
+
+    // Up to a tenth over the limit before any go
+    for (int line = 200; line < 220; line++)
+    {
+        append(line);
+    }
+    ASSERT_EQ(pFileBuffer->GetLineCount() - 1, 220);
+    ASSERT_TRUE(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()).find(logLine(0)) == 0);
+    ASSERT_TRUE(undo.CanUndo());
+
+    append(220);
+    ASSERT_EQ(pFileBuffer->GetLineCount() - 1, 200);
+    ASSERT_TRUE(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()).find(logLine(21)) == 0);
+
+    // The edit was after what went, so it can still be undone
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    auto after = pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End());
+    ASSERT_EQ(after.find("edit "), std::string::npos);
+    ASSERT_NE(after.find(logLine(49) + logLine(50) + logLine(51)), std::string::npos);
+
+    pFileBuffer->SetFollow(false);
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, SaveAcrossGap)
+{
+    auto path = fs::temp_directory_path() / "zep_save_test.txt";
+    WriteTestFile(path, "one\r\ntwo\r\nthree\r\n");
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+
+    // The gap is left in the middle, so the file comes from both halves
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(GlyphIterator(pFileBuffer, 4), "one and a half\n", changeRecord);
+    ASSERT_TRUE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+
+    spEditor->SaveBuffer(*pFileBuffer);
+    ASSERT_EQ(ReadTestFile(path), "one\r\none and a half\r\ntwo\r\nthree\r\n");
+    ASSERT_FALSE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+    ASSERT_EQ(spEditor->GetCommandText().find("Wrote"), 0);
+
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, SaveCRLFInBlocks)
+{
+    auto path = fs::temp_directory_path() / "zep_save_crlf.txt";
+    std::string text;
+    for (int line = 0; line < 300000; line++)
+    {
+        text += "line " + std::to_string(line) + "\r\n";
+    }
+    WriteTestFile(path, text);
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+
+    // Several blocks, with a line end on the gap
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(GlyphIterator(pFileBuffer, 12), "\n", changeRecord);
+    text.insert(13, "\r\n");
+
+    int64_t size = 0;
+    ASSERT_TRUE(pFileBuffer->Save(size));
+    ASSERT_EQ(size, int64_t(text.size()));
+    ASSERT_TRUE(ReadTestFile(path) == text);
+
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, LoadAndSaveOnThreads)
+{
+    auto path = fs::temp_directory_path() / "zep_save_threads.txt";
+    std::string text;
+    for (int line = 0; line < 400000; line++)
+    {
+        text += "line " + std::to_string(line) + "\n";
+    }
+    WriteTestFile(path, text);
+
+    auto spThreadedEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+    auto pFileBuffer = spThreadedEditor->InitWithText("", "");
+    pFileBuffer->SetFilePath(path);
+    pFileBuffer->GetIO().StartLoad(path);
+    pFileBuffer->GetIO().Wait();
+    ASSERT_TRUE(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()) == text);
+    ASSERT_FALSE(pFileBuffer->HasFileFlags(FileFlags::Locked));
+
+    // Changes made while it is saving don't get into the file, however far it has got
+    WriteTestFile(path, "");
+    ASSERT_TRUE(pFileBuffer->GetIO().StartSave());
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(pFileBuffer->Begin(), "edited\n", changeRecord);
+    pFileBuffer->Delete(GlyphIterator(pFileBuffer, 2000000), GlyphIterator(pFileBuffer, 3000000), changeRecord);
+    pFileBuffer->Insert(GlyphIterator(pFileBuffer, 1000000), "inserted\n", changeRecord);
+    pFileBuffer->Replace(GlyphIterator(pFileBuffer, 4000000), GlyphIterator(pFileBuffer, 4000010), "x", ReplaceRangeMode::Fill, changeRecord);
+    pFileBuffer->GetIO().Wait();
+    ASSERT_FALSE(pFileBuffer->GetIO().IsBusy());
+    ASSERT_TRUE(ReadTestFile(path) == text);
+    ASSERT_TRUE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+
+    spThreadedEditor.reset();
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, OwnSaveIsNotAChange)
+{
+    auto path = fs::temp_directory_path() / "zep_save_change.txt";
+    std::string text;
+    for (int line = 0; line < 400000; line++)
+    {
+        text += "line " + std::to_string(line) + "\n";
+    }
+    WriteTestFile(path, text);
+
+    auto spThreadedEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+    auto pFileBuffer = spThreadedEditor->InitWithFile(path.string());
+    pFileBuffer->GetIO().Wait();
+
+    // The watcher sees the file being written; that doesn't wait for the save, or reload it afterwards
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(pFileBuffer->Begin(), "edited\n", changeRecord);
+    ASSERT_TRUE(pFileBuffer->GetIO().StartSave());
+    pFileBuffer->Insert(pFileBuffer->Begin(), "again\n", changeRecord);
+
+    FileChange change;
+    change.path = pFileBuffer->GetFilePath();
+    bool busy = pFileBuffer->GetIO().IsBusy();
+    spThreadedEditor->Broadcast(std::make_shared<FileChangeMessage>(change));
+    ASSERT_EQ(pFileBuffer->GetIO().IsBusy(), busy);
+
+    pFileBuffer->GetIO().Wait();
+    spThreadedEditor->RefreshRequired();
+    ASSERT_TRUE(pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End()) == "again\nedited\n" + text);
+    ASSERT_EQ(spThreadedEditor->GetCommandText().find("Wrote"), 0);
+
+    spThreadedEditor.reset();
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, AtomicSave)
+{
+    auto path = fs::temp_directory_path() / "zep_atomic_save.txt";
+    WriteTestFile(path, "old\n");
+    fs::permissions(path, fs::perms::owner_read | fs::perms::owner_write);
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+
+    ChangeRecord changeRecord;
+    pFileBuffer->Insert(pFileBuffer->Begin(), "new\n", changeRecord);
+    spEditor->SaveBuffer(*pFileBuffer);
+    ASSERT_EQ(ReadTestFile(path), "new\nold\n");
+
+    // Replaced by a new file, which is just like the old one
+    ASSERT_FALSE(fs::exists(path.parent_path() / ("." + path.filename().string() + ".zep~")));
+#ifndef _WIN32
+    ASSERT_EQ(fs::status(path).permissions() & fs::perms::all, fs::perms::owner_read | fs::perms::owner_write);
+#endif
+
+    fs::remove(path);
+}
+
+TEST_F(BufferTest, SaveWriteBehind)
+{
+    auto path = fs::temp_directory_path() / "zep_save_behind.txt";
+    std::string text;
+    for (int line = 0; line < 400000; line++)
+    {
+        text += "line " + std::to_string(line) + "\n";
+    }
+    WriteTestFile(path, text);
+
+    auto spThreadedEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+    auto pFileBuffer = spThreadedEditor->InitWithFile(path.string());
+
+    // Saves asked for while one is running don't wait; the last text is what ends up in the file
+    ChangeRecord changeRecord;
+    for (int edit = 0; edit < 3; edit++)
+    {
+        pFileBuffer->Insert(pFileBuffer->Begin(), "edit\n", changeRecord);
+        text = "edit\n" + text;
+        spThreadedEditor->SaveBuffer(*pFileBuffer);
+    }
+    pFileBuffer->GetIO().Wait();
+    ASSERT_TRUE(ReadTestFile(path) == text);
+    ASSERT_FALSE(pFileBuffer->HasFileFlags(FileFlags::Dirty));
+    ASSERT_EQ(spThreadedEditor->GetCommandText().find("Wrote"), 0);
+
+    spThreadedEditor.reset();
+    fs::remove(path);
+}
+
+// Run with --gtest_also_run_disabled_tests to time a search over a large buffer
+TEST_F(BufferTest, DISABLED_FindBenchmark)
+{
+    const size_t Size = 1024 * 1024 * 1024;
+    std::string text;
+    text.reserve(Size + 64);
+    while (text.size() < Size)
+    {
+        text += "The quick brown fox jumps over the lazy dog\n";
+    }
+    text += "needle";
+    pBuffer->SetText(text);
+    text.clear();
+    text.shrink_to_fit();
+
+    // Put the gap in the middle of the buffer
+    ChangeRecord record;
+    pBuffer->Insert(pBuffer->Begin() + long(Size / 2), "x", record);
+
+    std::string search("needle");
+    timer searchTimer;
+    timer_start(searchTimer);
+    auto loc = pBuffer->Find(pBuffer->Begin(), (const uint8_t*)search.c_str(), nullptr);
+    auto elapsed = timer_get_elapsed_seconds(searchTimer);
+    ASSERT_TRUE(loc.Valid());
+
+    std::cout << "Find: " << (pBuffer->GetWorkingBuffer().size() / (1024.0 * 1024.0)) / elapsed << " MB/s" << std::endl;
+}
+
 // TODO
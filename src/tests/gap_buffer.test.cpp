@@ -130,3 +130,34 @@ TEST(GapBuffer, Manipulations)
     out = buffer.string(true);
     ASSERT_TRUE(out == "coHelloA really long string|4|01");
 }
+
+TEST(GapBuffer, Find)
+{
+    GapBuffer<char> buffer(0, 4);
+
+    std::string foo("Hello World");
+    buffer.insert(buffer.begin(), foo.begin(), foo.end());
+
+    std::string search("World");
+    ASSERT_EQ(buffer.find(0, buffer.size(), &search[0], &search[0] + search.size()), 6);
+
+    // Match must fit inside the range
+    ASSERT_EQ(buffer.find(0, 10, &search[0], &search[0] + search.size()), 10);
+    ASSERT_EQ(buffer.find(7, buffer.size(), &search[0], &search[0] + search.size()), buffer.size());
+
+    // Move the gap into the middle of the match
+    std::string r("r");
+    buffer.erase(buffer.begin() + 8, buffer.begin() + 9);
+    buffer.insert(buffer.begin() + 8, r.begin(), r.end());
+    std::string out = buffer.string(true);
+    ASSERT_EQ(out, "Hello Wor|4|ld");
+    ASSERT_EQ(buffer.find(0, buffer.size(), &search[0], &search[0] + search.size()), 6);
+
+    // Start on the far side of the gap
+    search = "ld";
+    ASSERT_EQ(buffer.find(9, buffer.size(), &search[0], &search[0] + search.size()), 9);
+    search = "rl";
+    ASSERT_EQ(buffer.find(0, buffer.size(), &search[0], &search[0] + search.size()), 8);
+    search = "Hello";
+    ASSERT_EQ(buffer.find(1, buffer.size(), &search[0], &search[0] + search.size()), buffer.size());
+}
@@ -0,0 +1,342 @@
+#include "config_app.h"
+
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/filesystem.h"
+#include "zep/indexer.h"
+#include "zep/mode_vim.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace Zep;
+class IndexerTest : public testing::Test
+{
+public:
+    IndexerTest()
+    {
+        // Opening a file in a project changes the working directory
+        workingDirectory = fs::current_path();
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+
+        root = fs::temp_directory_path() / "zep_indexer_test";
+        fs::remove_all(root);
+        fs::create_directories(root / "sub");
+        root = spEditor->GetFileSystem().Canonical(root);
+        WriteFile("a.cpp", "int a;");
+        WriteFile("sub/b.h", "int b;");
+        WriteFile("ignored.xyz", "");
+    }
+
+    ~IndexerTest()
+    {
+        spEditor.reset();
+        fs::current_path(workingDirectory);
+        fs::remove_all(root);
+    }
+
+    void WriteFile(const fs::path& path, const std::string& text)
+    {
+        std::ofstream file(root / path, std::ios::binary);
+        file << text;
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    fs::path root;
+    fs::path workingDirectory;
+};
+
+TEST_F(IndexerTest, SaveLoad)
+{
+    ProjectIndex index;
+    index.root = root;
+    auto spIndex = Indexer::UpdateIndex(*spEditor, index);
+    ASSERT_EQ(spIndex->files.size(), 2);
+    ASSERT_EQ(spIndex->files[0].path, fs::path("a.cpp"));
+    ASSERT_FALSE(spIndex->files[0].parsed);
+
+    spIndex->files[0].parsed = true;
+    spIndex->files[0].symbols.push_back(std::make_pair("a", SymbolDetails{ 1, 4 }));
+
+    auto indexPath = root / "indexdb";
+    ASSERT_TRUE(Indexer::SaveIndex(spEditor->GetFileSystem(), indexPath, *spIndex));
+
+    ProjectIndex loaded;
+    ASSERT_TRUE(Indexer::LoadIndex(spEditor->GetFileSystem(), indexPath, loaded));
+    ASSERT_EQ(loaded.root, root);
+    ASSERT_EQ(loaded.directories.size(), spIndex->directories.size());
+    ASSERT_EQ(loaded.files.size(), 2);
+    ASSERT_TRUE(loaded.files[0].parsed);
+    ASSERT_EQ(loaded.files[0].symbols.size(), 1);
+    ASSERT_EQ(loaded.files[0].symbols[0].first, "a");
+    ASSERT_EQ(loaded.files[0].symbols[0].second.column, 4);
+
+    // Not parsed, so it will be again next time
+    ASSERT_FALSE(loaded.files[1].parsed);
+
+    // A bad file is ignored
+    WriteFile("indexdb", "ZIDX");
+    ASSERT_FALSE(Indexer::LoadIndex(spEditor->GetFileSystem(), indexPath, loaded));
+}
+
+TEST_F(IndexerTest, UpdateChanged)
+{
+    ProjectIndex index;
+    index.root = root;
+    auto spIndex = Indexer::UpdateIndex(*spEditor, index);
+    for (auto& file : spIndex->files)
+    {
+        file.parsed = true;
+    }
+
+    // Nothing changed
+    auto spUpdated = Indexer::UpdateIndex(*spEditor, *spIndex);
+    ASSERT_EQ(spUpdated->files.size(), 2);
+    ASSERT_TRUE(spUpdated->files[0].parsed);
+    ASSERT_TRUE(spUpdated->files[1].parsed);
+
+    // A changed file needs parsing, a new file is found, and a removed one is gone
+    WriteFile("a.cpp", "int a = 1;");
+    WriteFile("sub/c.cpp", "int c;");
+    fs::remove(root / "sub" / "b.h");
+    spUpdated = Indexer::UpdateIndex(*spEditor, *spIndex);
+    ASSERT_EQ(spUpdated->files.size(), 2);
+    ASSERT_EQ(spUpdated->files[0].path, fs::path("a.cpp"));
+    ASSERT_FALSE(spUpdated->files[0].parsed);
+    ASSERT_EQ(spUpdated->files[1].path, fs::path("sub/c.cpp"));
+    ASSERT_FALSE(spUpdated->files[1].parsed);
+}
+
+TEST_F(IndexerTest, ScanSymbols)
+{
+    auto text = R"(#define MAX_SIZE 10
+#define \
+    CONTINUED 1
+// void Commented() {}
+namespace Test
+{
+class Base;
+class Widget : public Base
+{
+public:
+    Widget(int size) : m_size(size) {}
+    ~Widget() {}
+    int Size() const { if (m_size) { return m_size; } return 0; }
+    void Declared();
+private:
+    struct Inner { int x; };
+    int m_size;
+};
+
+const char* str = "int NotAFunction() {";
+void Widget::Declared()
+{
+    auto lambda = []() { return 1; };
+}
+
+static int* Free(int a, int b)
+{
+    if (a) { Call(b); }
+}
+TEST_F(Fixture, Name)
+{
+}
+enum class Color : int { Red };
+} // namespace Test
+)";
+
+    FileSymbols symbols;
+    Indexer::ScanSymbols(text, symbols);
+
+    std::vector<std::string> names;
+    for (auto& symbol : symbols)
+    {
+        names.push_back(symbol.first);
+    }
+
+    std::vector<std::string> expected = { "MAX_SIZE", "Widget", "Widget::Widget", "Widget::~Widget", "Widget::Size", "Widget::Inner", "Widget::Declared", "Free", "Color" };
+    ASSERT_EQ(names, expected);
+
+    // 0 based, at the start of the name
+    ASSERT_EQ(symbols[0].second.line, 0);
+    ASSERT_EQ(symbols[0].second.column, 8);
+    ASSERT_EQ(symbols[1].second.line, 7);
+    ASSERT_EQ(symbols[1].second.column, 6);
+    ASSERT_EQ(symbols[6].second.line, 20);
+    ASSERT_EQ(symbols[6].second.column, 13);
+}
+
+TEST_F(IndexerTest, FindSymbol)
+{
+    WriteFile("a.cpp", "class Foo\n{\n    void Bar() {}\n};\n");
+    WriteFile("sub/b.h", "void Bar()\n{\n}\n");
+
+    Indexer indexer(*spEditor);
+    ASSERT_TRUE(indexer.StartIndexing(root));
+
+    // The index, then the symbols, are found on the thread pool
+    spEditor->RefreshRequired();
+    spEditor->RefreshRequired();
+
+    std::vector<SymbolLocation> locations;
+    ASSERT_TRUE(indexer.FindSymbol("Bar", locations));
+    ASSERT_EQ(locations.size(), 2);
+    ASSERT_EQ(locations[0].name, "Foo::Bar");
+    ASSERT_EQ(locations[0].path, fs::path("a.cpp"));
+    ASSERT_EQ(locations[0].details.line, 2);
+    ASSERT_EQ(locations[1].path, fs::path("sub/b.h"));
+
+    locations.clear();
+    ASSERT_TRUE(indexer.FindSymbol("Foo::Bar", locations));
+    ASSERT_EQ(locations.size(), 1);
+    ASSERT_FALSE(indexer.FindSymbol("Baz", locations));
+
+    // The index is saved once the symbols are found
+    ASSERT_TRUE(fs::exists(root / ".zep" / "indexdb"));
+}
+
+TEST_F(IndexerTest, FileSearch)
+{
+    // More than 64 paths, so the candidates span several words of the character bits
+    for (int file = 0; file < 100; file++)
+    {
+        WriteFile("sub/file_" + std::to_string(file) + ".cpp", "");
+    }
+    WriteFile("sub/zebra_tree.cpp", "");
+    WriteFile("sub/bz_t.cpp", "");
+
+    spEditor->InitWithFile((root / "a.cpp").string());
+    auto pSearchWindow = spEditor->AddSearch();
+    spEditor->RefreshRequired();
+
+    // Every path with the characters is a candidate; only those with them in order are kept
+    for (auto ch : std::string("zbt"))
+    {
+        pSearchWindow->GetBuffer().GetMode()->AddKeyPress(ch);
+        spEditor->RefreshRequired();
+    }
+    ASSERT_EQ(pSearchWindow->GetBuffer().GetWorkingBuffer().string(), (fs::path("sub") / "zebra_tree.cpp").string() + std::string(1, '\0'));
+
+    // Going back widens it again
+    pSearchWindow->GetBuffer().GetMode()->AddKeyPress(ExtKeys::BACKSPACE);
+    pSearchWindow->GetBuffer().GetMode()->AddKeyPress(ExtKeys::BACKSPACE);
+    spEditor->RefreshRequired();
+    ASSERT_NE(pSearchWindow->GetBuffer().GetWorkingBuffer().string().find("bz_t.cpp"), std::string::npos);
+}
+
+TEST_F(IndexerTest, EditorIndexesProject)
+{
+    WriteFile("a.cpp", "class Foo\n{\n};\n");
+
+    // Not a project yet
+    spEditor->InitWithFileOrDir((root / "a.cpp").string());
+    ASSERT_EQ(spEditor->GetIndexer(), nullptr);
+
+    fs::create_directories(root / ".git");
+    spEditor->InitWithFileOrDir((root / "a.cpp").string());
+    auto pIndexer = spEditor->GetIndexer();
+    ASSERT_NE(pIndexer, nullptr);
+    ASSERT_EQ(pIndexer->GetSearchRoot(), root);
+    spEditor->RefreshRequired();
+    spEditor->RefreshRequired();
+
+    std::vector<SymbolLocation> locations;
+    ASSERT_TRUE(pIndexer->FindSymbol("Foo", locations));
+    ASSERT_TRUE(fs::exists(root / ".zep" / "indexdb"));
+
+    // The same project keeps its index
+    spEditor->InitWithFileOrDir((root / "sub" / "b.h").string());
+    ASSERT_EQ(spEditor->GetIndexer(), pIndexer);
+}
+
+TEST_F(IndexerTest, TagCommand)
+{
+    WriteFile("sub/b.h", "namespace N\n{\nclass Foo\n{\n    void Bar() {}\n};\n}\n");
+    fs::create_directories(root / ".git");
+    spEditor->InitWithFileOrDir((root / "a.cpp").string());
+    spEditor->RefreshRequired();
+    spEditor->RefreshRequired();
+
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    auto spMode = std::make_shared<ZepMode_Vim>(*spEditor);
+    spMode->Init();
+    spMode->Begin(pWindow);
+
+    // Goes to the file, at the name
+    spMode->AddCommandText(":tag Foo::Bar");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->GetBuffer().GetFilePath(), root / "sub" / "b.h");
+    ASSERT_EQ(pWindow->GetBufferCursor().Index(), 35);
+    ASSERT_EQ(spEditor->GetCommandText(), "Foo::Bar (1 of 1)");
+
+    spMode->AddCommandText(":tag Missing");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetCommandText(), "Symbol not found: Missing");
+    ASSERT_EQ(pWindow->GetBuffer().GetFilePath(), root / "sub" / "b.h");
+}
+
+#ifdef __linux__
+TEST_F(IndexerTest, WatchChanges)
+{
+    Indexer indexer(*spEditor);
+    ASSERT_TRUE(indexer.StartIndexing(root));
+    spEditor->RefreshRequired();
+    spEditor->RefreshRequired();
+
+    std::vector<SymbolLocation> locations;
+    ASSERT_FALSE(indexer.FindSymbol("Added", locations));
+
+    // A new file is parsed
+    WriteFile("sub/c.cpp", "void Added()\n{\n}\n");
+    spEditor->RefreshRequired();
+    ASSERT_TRUE(indexer.FindSymbol("Added", locations));
+    ASSERT_EQ(locations[0].path, fs::path("sub/c.cpp"));
+
+    // A changed one is parsed again, and its old symbols go
+    WriteFile("sub/c.cpp", "void Changed()\n{\n}\n");
+    spEditor->RefreshRequired();
+    ASSERT_FALSE(indexer.FindSymbol("Added", locations));
+    ASSERT_TRUE(indexer.FindSymbol("Changed", locations));
+
+    // Files in a new folder are found
+    fs::create_directories(root / "new");
+    WriteFile("new/d.h", "struct NewFolder\n{\n};\n");
+    spEditor->RefreshRequired();
+    ASSERT_TRUE(indexer.FindSymbol("NewFolder", locations));
+
+    // Deleting removes the symbols, and the files from the index
+    fs::remove(root / "sub" / "c.cpp");
+    fs::remove_all(root / "new");
+    spEditor->RefreshRequired();
+    ASSERT_FALSE(indexer.FindSymbol("Changed", locations));
+    ASSERT_FALSE(indexer.FindSymbol("NewFolder", locations));
+
+    auto spIndex = indexer.GetIndex();
+    ASSERT_EQ(spIndex->files.size(), 2);
+    ASSERT_EQ(spIndex->files[0].path, fs::path("a.cpp"));
+    ASSERT_EQ(spIndex->files[1].path, fs::path("sub/b.h"));
+}
+
+TEST_F(IndexerTest, EditorWatchChanges)
+{
+    fs::create_directories(root / ".git");
+    spEditor->InitWithFileOrDir((root / "a.cpp").string());
+    spEditor->RefreshRequired();
+    spEditor->RefreshRequired();
+
+    // The editor's own index follows the files as they change
+    std::vector<SymbolLocation> locations;
+    auto pIndexer = spEditor->GetIndexer();
+    ASSERT_FALSE(pIndexer->FindSymbol("Added", locations));
+    WriteFile("sub/c.cpp", "void Added()\n{\n}\n");
+    spEditor->RefreshRequired();
+    ASSERT_TRUE(pIndexer->FindSymbol("Added", locations));
+
+    fs::remove(root / "sub" / "c.cpp");
+    spEditor->RefreshRequired();
+    ASSERT_FALSE(pIndexer->FindSymbol("Added", locations));
+}
+#endif
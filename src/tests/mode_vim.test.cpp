@@ -1,15 +1,21 @@
 #include "config_app.h"
 
 #include "zep/buffer.h"
+#include "zep/buffer_io.h"
+#include "zep/buffer_search.h"
 #include "zep/display.h"
 #include "zep/editor.h"
+#include "zep/filesystem.h"
+#include "zep/mcommon/animation/timer.h"
 #include "zep/mcommon/logger.h"
 #include "zep/mode_vim.h"
 #include "zep/tab_window.h"
 #include "zep/window.h"
 
+#include <fstream>
 #include <gtest/gtest.h>
 #include <regex>
+#include <thread>
 
 // TESTS
 // TODO:
@@ -142,6 +148,67 @@ TEST_F(VimTest, UndoRedo)
     ASSERT_STREQ(pBuffer->GetWorkingBuffer().string().c_str(), "Yo, Hello");
 }
 
+TEST_F(VimTest, KeyMapAutomaton)
+{
+    // Counts before the register and inside the command, found a key at a time
+    KeyMapResult result;
+    spMode->FindKeyMapping("2\"a", EditorMode::Normal, result);
+    ASSERT_TRUE(result.needMoreChars);
+
+    result = KeyMapResult();
+    spMode->FindKeyMapping("2\"ad3", EditorMode::Normal, result);
+    ASSERT_TRUE(result.needMoreChars);
+
+    result = KeyMapResult();
+    spMode->FindKeyMapping("2\"ad3d", EditorMode::Normal, result);
+    ASSERT_EQ(result.foundMapping, id_DeleteLine);
+    ASSERT_EQ(result.TotalCount(), 5);
+    ASSERT_EQ(result.RegisterName(), 'a');
+
+    // A key command beats a wildcard one
+    result = KeyMapResult();
+    spMode->FindKeyMapping("ciw", EditorMode::Normal, result);
+    ASSERT_EQ(result.foundMapping, id_ChangeInnerWord);
+
+    result = KeyMapResult();
+    spMode->FindKeyMapping("fx", EditorMode::Normal, result);
+    ASSERT_EQ(result.foundMapping, id_Find);
+    ASSERT_EQ(result.captureChars.size(), 1);
+    ASSERT_EQ(result.captureChars[0], 'x');
+
+    result = KeyMapResult();
+    spMode->FindKeyMapping("<F12>", EditorMode::Normal, result);
+    ASSERT_FALSE(result.needMoreChars);
+    ASSERT_EQ(result.foundMapping.id, 0);
+    ASSERT_STREQ(result.commandWithoutGroups.c_str(), "<F12>");
+}
+
+TEST_F(VimTest, TraceCommand)
+{
+    // Zones are only kept once asked for
+    spMode->AddCommandText(":ZTrace");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_TRUE(profile_enabled());
+
+    // Edits and layout are zones in the trace
+    pBuffer->SetText("Hello");
+    spMode->AddCommandText("xiabcjk");
+    spEditor->Display();
+
+    // The path can have spaces in it
+    auto path = fs::temp_directory_path() / "zep trace test.json";
+    spMode->AddCommandText(":ZTrace " + path.string());
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    profile_enable(false);
+
+    auto trace = spEditor->GetFileSystem().Read(path);
+    fs::remove(path);
+    ASSERT_EQ(trace.find("{\"traceEvents\":["), 0);
+    ASSERT_NE(trace.find("\"name\":\"BufferInsert\""), std::string::npos);
+    ASSERT_NE(trace.find("\"name\":\"UpdateLayout\""), std::string::npos);
+    ASSERT_NE(trace.find("\"args\":{\"name\":\"Main\"}"), std::string::npos);
+}
+
 TEST_F(VimTest, DELETE)
 {
     pBuffer->SetText("Hello");
@@ -367,10 +434,23 @@ COMMAND_TEST(delete_x, "one three", "xxxx", "three")
 COMMAND_TEST(delete_dd, "one three", "dd", "")
 COMMAND_TEST(delete_D, "one three", "lD", "o")
 COMMAND_TEST(undo_redo, "one two three", "vllydur", "one two three")
+COMMAND_TEST(undo_earlier_branch, "abc", "xu$xg-", "bc")
+COMMAND_TEST(undo_later_branch, "abc", "xu$xg-g-g+g+", "ab")
+
+COMMAND_TEST(macro_play, "one two three four", "qadwq2@a", "four")
+COMMAND_TEST(macro_play_last, "one two three four", "qadwq@a@@", "four")
+COMMAND_TEST(macro_play_insert, "a\nb\nc", "qaIx jkjq2@a", "x a\nx b\nx c")
+COMMAND_TEST(macro_play_is_one_undo, "one two three four", "qadwq2@au", "two three four")
+COMMAND_TEST(macro_play_append, "one two three four five six", "qadwqqAdwq@a", "five six")
+COMMAND_TEST(macro_play_less_than, "a\nb", "qaI<jkA>jkjq@a", "<a>\n<b>")
 
 COMMAND_TEST(delete_to_eol, "hello\nworld", "lll10x", "hel\nworld");
 COMMAND_TEST(delete_x_paste, "hello", "lxp", "hlelo");
 COMMAND_TEST(delete_3x, "hello", "3x", "lo");
+
+// The context for each key is used again, so nothing from the last command may be left in it
+COMMAND_TEST(delete_count_then_x, "abcdef", "2xx", "def");
+COMMAND_TEST(copy_register_then_yy, "one\ntwo\n", "\"ayyjyy\"ap", "one\ntwo\none\n");
 COMMAND_TEST(delete_3x_paste, "hello", "l3xp", "hoell");
 
 COMMAND_TEST(delete_d_visual, "one three", "lvld", "o three")
@@ -390,6 +470,200 @@ COMMAND_TEST_RET(registers, "one\ntwo", "2Y:reg", "one\ntwo")
 COMMAND_TEST_RET(bufferset, "one", ":buf 1", "one")
 COMMAND_TEST_RET(buffers, "one", ":ls", "one")
 COMMAND_TEST_RET(invalid_command, "one", ":invalid", "one")
+COMMAND_TEST_RET(substitute_line, "one one\none", ":s/one/two", "two one\none")
+COMMAND_TEST_RET(substitute_line_global, "one one\none", ":s/one/two/g", "two two\none")
+COMMAND_TEST_RET(substitute_all, "one one\none", ":%s/one/two", "two one\ntwo")
+COMMAND_TEST_RET(substitute_range, "a\na\na\na", ":2,3s/a/b", "a\nb\nb\na")
+COMMAND_TEST_RET(substitute_regex, "one two three", ":s/t\\w\\+/<&>/g", "one <two> <three>")
+COMMAND_TEST_RET(substitute_delimiter, "a/b", ":s#/#\\r#", "a\nb")
+COMMAND_TEST_RET(substitute_none, "one", ":s/xyz/abc", "one")
+COMMAND_TEST_RET(substitute_line_start, "a\nb", ":%s/^/# /", "# a\n# b")
+COMMAND_TEST_RET(substitute_line_end, "a\nb\n", ":%s/$/;/", "a;\nb;\n")
+COMMAND_TEST_RET(substitute_empty_star, "abc", ":s/x*/-/g", "-a-b-c-")
+COMMAND_TEST_RET(substitute_empty_after_match, "abc", ":s/b*/-/g", "-a-c-")
+COMMAND_TEST_RET(substitute_groups, "one two", ":s/\\(\\w\\+\\) \\(\\w\\+\\)/\\2 \\1 \\0", "two one one two")
+COMMAND_TEST_RET(substitute_ignore_case, "One one", ":s/one/two/gi", "two two")
+
+TEST_F(VimTest, substitute_flags)
+{
+    // n counts without changing anything
+    pBuffer->SetText("a a\na\nb");
+    spMode->AddCommandText(":%s/a/x/gn");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(pBuffer->GetWorkingBuffer().string().c_str(), "a a\na\nb");
+    ASSERT_EQ(spEditor->GetCommandText(), "3 matches on 2 lines");
+
+    // Flags and replacements which aren't done are refused, instead of doing something else
+    spMode->AddCommandText(":%s/a/x/c");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(pBuffer->GetWorkingBuffer().string().c_str(), "a a\na\nb");
+    ASSERT_EQ(spEditor->GetCommandText(), "Unsupported substitute flag: c");
+
+    spMode->AddCommandText(":%s/a/\\U&/");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(pBuffer->GetWorkingBuffer().string().c_str(), "a a\na\nb");
+    ASSERT_EQ(spEditor->GetCommandText(), "Unsupported in the replacement: \\U");
+
+    // e keeps quiet when there is nothing to change
+    spMode->AddCommandText(":%s/z/x/e");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetCommandText().find("Pattern not found"), std::string::npos);
+}
+
+TEST_F(VimTest, grep)
+{
+    // A project of its own, so that the results don't depend on where the tests are run from
+    auto root = fs::temp_directory_path() / "zep_grep_test";
+    fs::remove_all(root);
+    fs::create_directories(root / ".git");
+    fs::create_directories(root / "sub");
+    std::ofstream(root / "main.cpp", std::ios::binary) << "int main()\n{\n    Target();\n}\n";
+    std::ofstream(root / "sub" / "lib.cpp", std::ios::binary) << "// Lib\nvoid Target()\n{\n}\n";
+
+    // Binary files aren't searched
+    std::ofstream(root / "packed.cpp", std::ios::binary) << std::string("void Target()\0", 14);
+
+    pWindow->SetBuffer(spEditor->GetFileBuffer(root / "main.cpp"));
+    spMode->AddCommandText(":ZGrep void Target");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+
+    // The results are added on the tick
+    auto pGrepWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    ASSERT_NE(pGrepWindow, pWindow);
+    spEditor->RefreshRequired();
+    auto results = pGrepWindow->GetBuffer().GetWorkingBuffer().string();
+    ASSERT_NE(results.find("lib.cpp:"), std::string::npos);
+    ASSERT_EQ(results.find("main.cpp:"), std::string::npos);
+    ASSERT_EQ(results.find("packed.cpp:"), std::string::npos);
+
+    // Open the first one at the line of the match
+    pGrepWindow->GetBuffer().GetMode()->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetActiveTabWindow()->GetActiveWindow(), pWindow);
+    auto& openBuffer = pWindow->GetBuffer();
+    auto cursor = pWindow->GetBufferCursor();
+    ASSERT_EQ(openBuffer.GetBufferText(cursor, cursor.Peek(8)), "void Tar");
+    ASSERT_EQ(openBuffer.GetBufferLine(cursor), 1);
+
+    fs::remove_all(root);
+}
+
+namespace
+{
+// Holds up reading the files grep looks in, until they are let go
+class HeldFileSystem : public ZepFileSystemCPP
+{
+public:
+    HeldFileSystem(const fs::path& configPath, std::shared_future<void> release)
+        : ZepFileSystemCPP(configPath)
+        , m_release(release)
+    {
+    }
+
+    virtual std::string Read(const fs::path& filePath) override
+    {
+        if (filePath.filename().string().find("held") == 0)
+        {
+            held++;
+            m_release.wait();
+        }
+        return ZepFileSystemCPP::Read(filePath);
+    }
+
+    std::atomic<int> held = { 0 };
+
+private:
+    std::shared_future<void> m_release;
+};
+} // namespace
+
+TEST_F(VimTest, grep_leaves_a_worker)
+{
+    auto root = fs::temp_directory_path() / "zep_grep_busy_test";
+    fs::remove_all(root);
+    fs::create_directories(root / ".git");
+    for (int file = 0; file < 16; file++)
+    {
+        std::ofstream(root / ("held" + std::to_string(file) + ".cpp"), std::ios::binary) << "void Target()\n";
+    }
+
+    std::string text;
+    for (int line = 0; line < 200000; line++)
+    {
+        text += "line " + std::to_string(line) + "\n";
+    }
+    std::ofstream(root / "main.txt", std::ios::binary) << text;
+
+    // The files are let go at the end, or after a while if typing got stuck behind the grep
+    std::promise<void> release;
+    std::atomic<bool> letGo = { false };
+    auto fnLetGo = [&]() {
+        if (!letGo.exchange(true))
+        {
+            release.set_value();
+        }
+    };
+    auto pFileSystem = new HeldFileSystem(ZEP_ROOT, release.get_future().share());
+    auto spThreadedEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, 0, pFileSystem);
+
+    std::promise<void> finished;
+    std::thread watchdog([&fnLetGo, done = finished.get_future()]() {
+        if (done.wait_for(std::chrono::seconds(10)) == std::future_status::timeout)
+        {
+            fnLetGo();
+        }
+    });
+    std::shared_ptr<void> cleanup(nullptr, [&](void*) {
+        finished.set_value();
+        watchdog.join();
+        fnLetGo();
+        spThreadedEditor.reset();
+        fs::remove_all(root);
+    });
+
+    // With no workers the grep would happen here, and never be let go
+    if (spThreadedEditor->GetThreadPool().thread_count() < 2)
+    {
+        return;
+    }
+
+    auto pFileBuffer = spThreadedEditor->InitWithFile((root / "main.txt").string());
+    pFileBuffer->GetIO().Wait();
+    spThreadedEditor->AddGrep("Target");
+
+    // The grep starts on the tick after the files are found
+    auto start = timer_get_time_now();
+    while (pFileSystem->held == 0 && timer_to_seconds(timer_get_time_now() - start) < 10.0)
+    {
+        spThreadedEditor->RefreshRequired();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_NE(pFileSystem->held, 0);
+
+    // Typing stops the search's thread before the text changes; the grep holds the workers it has, but not all of them
+    std::string error;
+    ASSERT_TRUE(pFileBuffer->GetSearch().Start("line 1\\d*9", ByteRange(0, 0), error));
+    ChangeRecord record;
+    pFileBuffer->Insert(pFileBuffer->Begin(), "typed\n", record);
+    ASSERT_FALSE(letGo);
+}
+
+TEST_F(VimTest, substitute_undo)
+{
+    std::string text;
+    for (int line = 0; line < 100000; line++)
+    {
+        text += "one two one\n";
+    }
+    pBuffer->SetText(text);
+    spMode->AddCommandText(":%s/one/three/g");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pBuffer->GetWorkingBuffer().string().find("one"), std::string::npos);
+    ASSERT_EQ(pBuffer->GetLineCount(), 100001);
+
+    // All of the changes are a single undo step
+    spMode->AddCommandText("u");
+    ASSERT_STREQ(pBuffer->GetWorkingBuffer().string().c_str(), text.c_str());
+}
 
 // Visual
 COMMAND_TEST(visual_switch_v, "one", "lvlv", "one");
@@ -430,6 +704,10 @@ CURSOR_TEST(motion_jdown_limit, "one\ntwo", "jjjjjjjjj", 0, 1);
 CURSOR_TEST(motion_jklh_find_center, "one\ntwo\nthree", "jjlk", 1, 1);
 CURSOR_TEST(motion_goto_endline, "one two", "$", 6, 0);
 CURSOR_TEST(motion_find_jumpto, "one two", "/two\n", 4, 0);
+CURSOR_TEST(motion_find_regex, "one two\nthree", "/^t.*e$\n", 0, 1);
+CURSOR_TEST(motion_find_regex_backward, "one two one", "$?o\\w\\+\n", 8, 0);
+CURSOR_TEST(motion_find_regex_next, "one two\nthree two", "/t\\(wo\\|hree\\)\nn", 0, 1);
+CURSOR_TEST(motion_find_none, "one two", "l/xyz\n", 1, 0);
 CURSOR_TEST(motion_G_goto_enddoc, "one\ntwo", "G", 0, 1);
 CURSOR_TEST(motion_3G, "one\ntwo\nthree\nfour\n", "3G", 0, 2); // Note: Goto line3, offset 2!
 CURSOR_TEST(motion_0G, "one\ntwo\nthree\nfour\n", "0G", 0, 4); // Note: 0 means go to last line
@@ -0,0 +1,108 @@
+#include "config_app.h"
+
+#include "zep/regex.h"
+#include <gtest/gtest.h>
+
+using namespace Zep;
+
+namespace
+{
+// Returns "begin,end" of the first match, or "none"
+std::string RegexFind(const std::string& pattern, const std::string& text)
+{
+    ZepRegex regex;
+    std::string error;
+    if (!regex.Compile(pattern, error))
+    {
+        return "error";
+    }
+
+    auto pBegin = (const uint8_t*)text.c_str();
+    auto pEnd = pBegin + text.size();
+    const uint8_t* pMatchBegin;
+    const uint8_t* pMatchEnd;
+    if (!regex.Find(pBegin, pEnd, pBegin, pMatchBegin, pMatchEnd))
+    {
+        return "none";
+    }
+    return std::to_string(pMatchBegin - pBegin) + "," + std::to_string(pMatchEnd - pBegin);
+}
+} // namespace
+
+#define REGEX_TEST(name, pattern, text, result) \
+    TEST(Regex, name)                           \
+    {                                           \
+        ASSERT_EQ(RegexFind(pattern, text), result); \
+    }
+
+REGEX_TEST(literal, "two", "one two three", "4,7");
+REGEX_TEST(literal_none, "four", "one two three", "none");
+REGEX_TEST(literal_specials, "a+b(c)|d?", "x a+b(c)|d?", "2,11");
+REGEX_TEST(dot, "t.o", "one two", "4,7");
+REGEX_TEST(star_greedy, "ab*", "xabbbc", "1,5");
+REGEX_TEST(plus, "ab\\+", "a ab", "2,4");
+REGEX_TEST(quest, "colou\\?r", "color", "0,5");
+REGEX_TEST(alternate, "cat\\|dog", "hotdog cat", "3,6");
+REGEX_TEST(group, "\\(ab\\)\\+", "xababab", "1,7");
+REGEX_TEST(bracket, "[0-9]\\+", "abc 123 def", "4,7");
+REGEX_TEST(bracket_negate, "[^a-z ]", "abc dEf", "5,6");
+REGEX_TEST(bracket_unclosed, "[ab", "x[ab", "1,4");
+REGEX_TEST(line_begin, "^two", "one two\ntwo", "8,11");
+REGEX_TEST(line_end, "one$", "one two\nthree one", "14,17");
+REGEX_TEST(word, "\\<on\\>", "one on", "4,6");
+REGEX_TEST(escape_class, "\\d\\+", "abc 42", "4,6");
+REGEX_TEST(ignore_case, "\\cHELLO", "say hello", "4,9");
+REGEX_TEST(dot_not_newline, "e.t", "one\ntwo", "none");
+REGEX_TEST(dot_utf8, "a.b", "a\xc2\xa3" "b", "0,4");
+REGEX_TEST(leftmost, "b\\|abc", "abc", "0,3");
+REGEX_TEST(unmatched_group, "\\(ab", "ab", "error");
+REGEX_TEST(unmatched_close, "ab\\)", "ab", "error");
+
+// This would take forever with a backtracking matcher
+TEST(Regex, Linear)
+{
+    std::string text(10000, 'a');
+    ASSERT_EQ(RegexFind("\\(a*\\)*b", text), "none");
+}
+
+TEST(Regex, FindAll)
+{
+    ZepRegex regex;
+    std::string error;
+    ASSERT_TRUE(regex.Compile("o*", error));
+
+    std::string text("foo bar oo");
+    auto pBegin = (const uint8_t*)text.c_str();
+    std::vector<std::pair<long, long>> matches;
+    regex.FindAll(pBegin, pBegin + text.size(), [&](const uint8_t* pMatchBegin, const uint8_t* pMatchEnd) {
+        matches.push_back(std::make_pair(long(pMatchBegin - pBegin), long(pMatchEnd - pBegin)));
+        return true;
+    });
+
+    // Empty matches are found between the characters, but not straight after a match
+    std::vector<std::pair<long, long>> expected{ { 0, 0 }, { 1, 3 }, { 4, 4 }, { 5, 5 }, { 6, 6 }, { 7, 7 }, { 8, 10 } };
+    ASSERT_EQ(matches, expected);
+}
+
+TEST(Regex, Groups)
+{
+    ZepRegex regex;
+    std::string error;
+    ASSERT_TRUE(regex.Compile("\\(a\\+\\)\\(x\\)\\?\\(b*\\)", error));
+    ASSERT_EQ(regex.GetGroupCount(), 3);
+
+    std::string text("zaab");
+    auto pBegin = (const uint8_t*)text.c_str();
+    auto pEnd = pBegin + text.size();
+    const uint8_t* pMatchBegin;
+    const uint8_t* pMatchEnd;
+    ASSERT_TRUE(regex.Find(pBegin, pEnd, pBegin, pMatchBegin, pMatchEnd));
+
+    ZepRegex::RegexGroups groups;
+    regex.GetGroups(pBegin, pEnd, pMatchBegin, pMatchEnd, groups);
+    ASSERT_EQ(groups.size(), 4);
+    ASSERT_EQ(std::string(groups[0].first, groups[0].second), "aab");
+    ASSERT_EQ(std::string(groups[1].first, groups[1].second), "aa");
+    ASSERT_EQ(groups[2].first, groups[2].second);
+    ASSERT_EQ(std::string(groups[3].first, groups[3].second), "b");
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "zep/mcommon/threadpool.h"
+
+TEST(ThreadPool, RunsEverything)
+{
+    ThreadPool pool(4);
+    std::atomic<int> total = { 0 };
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 1000; i++)
+    {
+        results.push_back(pool.enqueue([&total](int value) {
+            total += value;
+            return value * 2;
+        }, i));
+    }
+
+    int doubled = 0;
+    for (auto& result : results)
+    {
+        doubled += result.get();
+    }
+    ASSERT_EQ(total, 499500);
+    ASSERT_EQ(doubled, 999000);
+}
+
+TEST(ThreadPool, TasksAddTasks)
+{
+    // Workers put their tasks on their own queues; the others take them
+    ThreadPool pool(4);
+    std::atomic<int> count = { 0 };
+    std::vector<std::future<std::future<void>>> outer;
+    for (int i = 0; i < 100; i++)
+    {
+        outer.push_back(pool.enqueue([&]() {
+            count++;
+            return pool.enqueue([&]() { count++; });
+        }));
+    }
+
+    for (auto& result : outer)
+    {
+        result.get().wait();
+    }
+    ASSERT_EQ(count, 200);
+}
+
+TEST(ThreadPool, CancelledTasksAreSkipped)
+{
+    ThreadPool pool(2);
+
+    // Hold the workers, so the rest wait in the queue
+    std::promise<void> release;
+    auto held = release.get_future().share();
+    std::atomic<int> holding = { 0 };
+    auto first = pool.enqueue([held, &holding]() { holding++; held.wait(); });
+    auto second = pool.enqueue([held, &holding]() { holding++; held.wait(); });
+    while (holding != 2)
+    {
+        std::this_thread::yield();
+    }
+
+    CancelToken token;
+    std::atomic<int> ran = { 0 };
+    auto skipped = pool.enqueue_with(TaskPriority::Interactive, token, [&]() {
+        ran++;
+        return 42;
+    });
+    token.cancel();
+
+    release.set_value();
+    ASSERT_EQ(skipped.get(), 0);
+    ASSERT_EQ(ran, 0);
+    first.wait();
+    second.wait();
+}
+
+TEST(ThreadPool, BackgroundLeavesAWorker)
+{
+    ThreadPool pool(2);
+
+    // Background tasks can only have one of the two workers, so an interactive one still runs while it is held
+    std::promise<void> release;
+    auto held = release.get_future().share();
+    std::vector<std::future<void>> background;
+    for (int i = 0; i < 3; i++)
+    {
+        background.push_back(pool.enqueue_with(TaskPriority::Background, CancelToken(), [held]() { held.wait(); }));
+    }
+
+    auto interactive = pool.enqueue([]() { return 1; });
+    ASSERT_EQ(interactive.get(), 1);
+
+    release.set_value();
+    for (auto& result : background)
+    {
+        result.wait();
+    }
+}
+
+TEST(ThreadPool, InteractiveGetsInFirst)
+{
+    ThreadPool pool(4);
+
+    // Far more background work than workers; an interactive task doesn't wait for it, or even for one of them to end
+    const auto taskTime = std::chrono::milliseconds(50);
+    std::vector<std::future<void>> background;
+    for (int i = 0; i < 30; i++)
+    {
+        background.push_back(pool.enqueue_with(TaskPriority::Background, CancelToken(), [taskTime]() { std::this_thread::sleep_for(taskTime); }));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto interactive = pool.enqueue([start]() { return std::chrono::steady_clock::now() - start; });
+    ASSERT_LT(interactive.get(), taskTime);
+
+    // And the rest still runs
+    for (auto& result : background)
+    {
+        result.wait();
+    }
+}
+
+TEST(ThreadPool, NoThreadsRunsNow)
+{
+    ThreadPool pool(1);
+    int value = 0;
+    auto result = pool.enqueue([&value]() { value = 1; });
+    ASSERT_EQ(value, 1);
+    result.wait();
+}
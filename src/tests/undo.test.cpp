@@ -0,0 +1,396 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/commands.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/undo.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+
+using namespace Zep;
+class UndoTest : public testing::Test
+{
+public:
+    UndoTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+        pBuffer = spEditor->InitWithText("undo", "Hello World\n");
+    }
+
+    // Make the change, and record it as the editor does
+    void AddCommand(std::shared_ptr<ZepCommand> spCommand)
+    {
+        spCommand->Redo();
+        pBuffer->GetUndo().AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+    }
+
+    std::string GetText() const
+    {
+        return pBuffer->GetBufferText(pBuffer->Begin(), pBuffer->End());
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    ZepBuffer* pBuffer;
+};
+
+TEST_F(UndoTest, GroupsUndoAndRedo)
+{
+    auto& undo = pBuffer->GetUndo();
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin(), "A"));
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin() + 1, "B"));
+
+    // Longer than fits in a record
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_ReplaceRange>(*pBuffer, ReplaceRangeMode::Replace, pBuffer->Begin() + 2, pBuffer->Begin() + 7, "Goodbye, cruel"));
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_DeleteRange>(*pBuffer, pBuffer->Begin(), pBuffer->Begin() + 2));
+    ASSERT_EQ(GetText(), "Goodbye, cruel World\n");
+
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "ABGoodbye, cruel World\n");
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "ABHello World\n");
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "Hello World\n");
+    ASSERT_FALSE(undo.Undo(cursor));
+
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_EQ(GetText(), "ABGoodbye, cruel World\n");
+
+    // A new change loses the redo
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->End(), "!"));
+    ASSERT_FALSE(undo.CanRedo());
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "ABHello World\n");
+}
+
+TEST_F(UndoTest, KeepsBranches)
+{
+    auto& undo = pBuffer->GetUndo();
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin(), "One "));
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin(), "Two "));
+
+    // A change after undo starts a second branch
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_ReplaceRange>(*pBuffer, ReplaceRangeMode::Replace, pBuffer->Begin(), pBuffer->Begin() + 3, "Three"));
+    ASSERT_EQ(GetText(), "Three Hello World\n");
+    ASSERT_FALSE(undo.CanRedo());
+
+    // In the order they were made: "Two" is on the other branch
+    ASSERT_TRUE(undo.MoveByChanges(-1, cursor));
+    ASSERT_EQ(GetText(), "Two One Hello World\n");
+    ASSERT_TRUE(undo.MoveByChanges(-1, cursor));
+    ASSERT_EQ(GetText(), "One Hello World\n");
+    ASSERT_TRUE(undo.MoveByChanges(2, cursor));
+    ASSERT_EQ(GetText(), "Three Hello World\n");
+
+    // Redo follows the branch last used
+    ASSERT_TRUE(undo.MoveByChanges(-1, cursor));
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_EQ(GetText(), "Two One Hello World\n");
+
+    // Everything was done in the last hour
+    ASSERT_TRUE(undo.MoveByTime(-3600, cursor));
+    ASSERT_EQ(GetText(), "Hello World\n");
+    ASSERT_FALSE(undo.MoveByChanges(-1, cursor));
+    ASSERT_TRUE(undo.MoveByTime(3600, cursor));
+    ASSERT_EQ(GetText(), "Three Hello World\n");
+}
+
+TEST_F(UndoTest, FillIsUndone)
+{
+    auto& undo = pBuffer->GetUndo();
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_ReplaceRange>(*pBuffer, ReplaceRangeMode::Fill, pBuffer->Begin(), pBuffer->Begin() + 5, "x"));
+    ASSERT_EQ(GetText(), "xxxxx World\n");
+
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "Hello World\n");
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_EQ(GetText(), "xxxxx World\n");
+}
+
+namespace
+{
+// Counts the changes made to the text
+class ChangeCounter : public ZepComponent
+{
+public:
+    ChangeCounter(ZepEditor& editor)
+        : ZepComponent(editor)
+    {
+    }
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override
+    {
+        if (message->messageId == Msg::Buffer && std::static_pointer_cast<BufferMessage>(message)->type == BufferMessageType::PreBufferChange)
+        {
+            changes++;
+        }
+    }
+
+    int changes = 0;
+};
+} // namespace
+
+TEST_F(UndoTest, TypingIsOneChange)
+{
+    auto& undo = pBuffer->GetUndo();
+    undo.BeginGroup();
+    auto text = std::string("Typing a long run of text ");
+    for (size_t index = 0; index < text.size(); index++)
+    {
+        AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin() + long(index), text.substr(index, 1)));
+    }
+
+    // Backspace over some of it
+    for (long index = long(text.size()); index > 23; index--)
+    {
+        AddCommand(std::make_shared<ZepCommand_DeleteRange>(*pBuffer, pBuffer->Begin() + index - 1, pBuffer->Begin() + index));
+    }
+    ASSERT_EQ(GetText(), "Typing a long run of teHello World\n");
+
+    // Delete forwards
+    undo.BeginGroup();
+    for (int count = 0; count < 5; count++)
+    {
+        AddCommand(std::make_shared<ZepCommand_DeleteRange>(*pBuffer, pBuffer->Begin() + 23, pBuffer->Begin() + 24));
+    }
+    ASSERT_EQ(GetText(), "Typing a long run of te World\n");
+
+    ChangeCounter counter(*spEditor);
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "Typing a long run of teHello World\n");
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "Hello World\n");
+    ASSERT_EQ(counter.changes, 2);
+
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_EQ(GetText(), "Typing a long run of teHello World\n");
+}
+
+TEST_F(UndoTest, LargeGroup)
+{
+    auto& undo = pBuffer->GetUndo();
+    undo.BeginGroup();
+    for (int count = 0; count < 10000; count++)
+    {
+        AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin(), "a"));
+    }
+
+    // Typed characters fit in the records
+    ASSERT_LT(undo.GetMemoryUsed(), size_t(10000 * 128));
+
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_EQ(GetText(), "Hello World\n");
+    ASSERT_FALSE(undo.CanUndo());
+}
+
+TEST_F(UndoTest, SpillsOverBudget)
+{
+    spEditor->GetConfig().undoBufferMemory = 1024 * 1024;
+
+    // Pastes of 100K each, much more than the budget
+    auto& undo = pBuffer->GetUndo();
+    size_t pasted = 0;
+    for (int paste = 0; paste < 40; paste++)
+    {
+        std::string text;
+        for (int line = 0; text.size() < 100 * 1024; line++)
+        {
+            text += "Paste " + std::to_string(paste) + ", line " + std::to_string(line) + "\n";
+        }
+        undo.BeginGroup();
+        AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->End(), text));
+        pasted += text.size();
+    }
+    auto finalText = GetText();
+
+    ASSERT_LT(undo.GetMemoryUsed(), size_t(1024 * 1024));
+    ASSERT_GT(undo.GetSpilledSize(), uint64_t(0));
+    ASSERT_LT(undo.GetSpilledSize(), uint64_t(pasted / 2));
+
+    // It all comes back
+    GlyphIterator cursor;
+    while (undo.Undo(cursor))
+    {
+    }
+    ASSERT_EQ(GetText(), "Hello World\n");
+
+    while (undo.Redo(cursor))
+    {
+    }
+    ASSERT_TRUE(GetText() == finalText);
+    ASSERT_LT(undo.GetMemoryUsed(), size_t(1024 * 1024));
+
+    // A change after undoing into spilled history
+    for (int step = 0; step < 30; step++)
+    {
+        undo.Undo(cursor);
+    }
+    undo.BeginGroup();
+    AddCommand(std::make_shared<ZepCommand_Insert>(*pBuffer, pBuffer->Begin(), "New"));
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_TRUE(undo.Undo(cursor));
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_TRUE(undo.Redo(cursor));
+    ASSERT_EQ(GetText().substr(0, 10), "NewHello W");
+}
+
+TEST_F(UndoTest, SavedWithFile)
+{
+    // History is kept in the project's .zep folder
+    auto root = fs::temp_directory_path() / "zep_undo_project";
+    fs::remove_all(root);
+    fs::create_directories(root / ".git");
+    auto path = root / "file.txt";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "Hello World\n";
+    }
+
+    // A big change, and typing
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+    auto& undo = pFileBuffer->GetUndo();
+    auto lines = std::string();
+    for (int line = 0; line < 1000; line++)
+    {
+        lines += "Line " + std::to_string(line) + "\n";
+    }
+    undo.BeginGroup();
+    auto spCommand = std::make_shared<ZepCommand_Insert>(*pFileBuffer, pFileBuffer->Begin(), lines);
+    spCommand->Redo();
+    undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+    undo.BeginGroup();
+    spCommand = std::make_shared<ZepCommand_Insert>(*pFileBuffer, pFileBuffer->End(), "Typed");
+    spCommand->Redo();
+    undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+
+    int64_t size = 0;
+    ASSERT_TRUE(pFileBuffer->Save(size));
+    auto savedText = pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End());
+
+    // Next session; undo goes back past the load
+    auto spNextEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pNextBuffer = spNextEditor->InitWithFile(path.string());
+    ASSERT_TRUE(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()) == savedText);
+    auto& nextUndo = pNextBuffer->GetUndo();
+    nextUndo.BeginGroup();
+    spCommand = std::make_shared<ZepCommand_Insert>(*pNextBuffer, pNextBuffer->Begin(), "New");
+    spCommand->Redo();
+    nextUndo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+
+    GlyphIterator cursor;
+    ASSERT_TRUE(nextUndo.Undo(cursor));
+    ASSERT_TRUE(nextUndo.Undo(cursor));
+    ASSERT_TRUE(nextUndo.Undo(cursor));
+    ASSERT_EQ(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()), "Hello World\n");
+    ASSERT_FALSE(nextUndo.Undo(cursor));
+    ASSERT_TRUE(nextUndo.Redo(cursor));
+    ASSERT_TRUE(nextUndo.Redo(cursor));
+    ASSERT_TRUE(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()) == savedText);
+    spNextEditor.reset();
+
+    // Changed by something else; the history doesn't fit
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "Changed\n";
+    }
+    spNextEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    pNextBuffer = spNextEditor->InitWithFile(path.string());
+    ASSERT_FALSE(pNextBuffer->GetUndo().Undo(cursor));
+
+    spNextEditor.reset();
+    spEditor.reset();
+    fs::remove_all(root);
+}
+
+TEST_F(UndoTest, SavesAddToHistory)
+{
+    auto root = fs::temp_directory_path() / "zep_undo_append";
+    fs::remove_all(root);
+    fs::create_directories(root / ".git");
+    auto path = root / "file.txt";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "Hello World\n";
+    }
+
+    auto pFileBuffer = spEditor->InitWithFile(path.string());
+    auto& undo = pFileBuffer->GetUndo();
+    auto insert = [&](const GlyphIterator& location, const std::string& text) {
+        undo.BeginGroup();
+        auto spCommand = std::make_shared<ZepCommand_Insert>(*pFileBuffer, location, text);
+        spCommand->Redo();
+        undo.AddChange(spCommand->GetChangeRecord(), spCommand->GetCursorBefore(), spCommand->GetCursorAfter());
+    };
+    auto readHistory = [&]() {
+        std::string history;
+        for (auto& entry : fs::directory_iterator(root / ".zep" / "undo"))
+        {
+            std::ifstream file(entry.path(), std::ios::binary);
+            history.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        return history;
+    };
+
+    std::string lines;
+    for (int line = 0; line < 1000; line++)
+    {
+        lines += "Line " + std::to_string(line) + "\n";
+    }
+    insert(pFileBuffer->Begin(), lines);
+    int64_t size = 0;
+    ASSERT_TRUE(pFileBuffer->Save(size));
+    auto firstSave = readHistory();
+
+    // Each save only adds to the end of the file
+    insert(pFileBuffer->End(), "Typed at the end");
+    ASSERT_TRUE(pFileBuffer->Save(size));
+    auto secondSave = readHistory();
+    ASSERT_GT(secondSave.size(), firstSave.size());
+    ASSERT_TRUE(secondSave.compare(0, firstSave.size(), firstSave) == 0);
+
+    // Another branch; redo follows it when the history is read back
+    GlyphIterator cursor;
+    ASSERT_TRUE(undo.Undo(cursor));
+    insert(pFileBuffer->Begin(), "Branch");
+    ASSERT_TRUE(pFileBuffer->Save(size));
+    ASSERT_TRUE(readHistory().compare(0, secondSave.size(), secondSave) == 0);
+    auto savedText = pFileBuffer->GetBufferText(pFileBuffer->Begin(), pFileBuffer->End());
+
+    auto spNextEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pNextBuffer = spNextEditor->InitWithFile(path.string());
+    auto& nextUndo = pNextBuffer->GetUndo();
+    ASSERT_TRUE(nextUndo.Undo(cursor));
+    ASSERT_TRUE(nextUndo.Undo(cursor));
+    ASSERT_EQ(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()), "Hello World\n");
+    ASSERT_FALSE(nextUndo.Undo(cursor));
+    ASSERT_TRUE(nextUndo.Redo(cursor));
+    ASSERT_TRUE(nextUndo.Redo(cursor));
+    ASSERT_TRUE(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()) == savedText);
+
+    // The first branch is still there
+    ASSERT_TRUE(nextUndo.MoveByChanges(-1, cursor));
+    ASSERT_TRUE(pNextBuffer->GetBufferText(pNextBuffer->Begin(), pNextBuffer->End()) == lines + "Hello World\nTyped at the end");
+
+    spNextEditor.reset();
+    spEditor.reset();
+    fs::remove_all(root);
+}
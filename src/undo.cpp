@@ -0,0 +1,1308 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+#include "zep/buffer.h"
+#include "zep/editor.h"
+#include "zep/undo.h"
+
+#include "zep/mcommon/file/compress.h"
+#include "zep/mcommon/logger.h"
+#include "zep/mcommon/string/stringutils.h"
+
+namespace Zep
+{
+
+namespace
+{
+// Text that doesn't fit in a record goes in blocks of this size, or one of its own if it is bigger
+const size_t UndoArenaBlockSize = 256 * 1024;
+
+const uint32_t UndoHistoryMagic = 0x444e555a; // 'ZUND'
+const uint32_t UndoHistoryVersion = 3;
+
+// The layout of a file in .zep/undo: the file's path, then a segment for each save with what it added to the history.
+// The records are all 8 byte aligned, and the compressed text comes last in each segment
+struct UndoHistoryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pathLength;
+    uint32_t unused;
+};
+
+struct UndoHistorySegment
+{
+    // Of the rest of the segment; a save that didn't get to the end is left off, with anything after it
+    uint64_t size;
+    uint64_t checksum;
+
+    // The text the file was saved with; the state that has it, and where redo goes from the root
+    uint64_t textHash;
+    uint32_t current;
+    uint32_t rootLastChild;
+
+    // Groups and records added since the last save, the earlier groups whose redo branch has changed, and the text
+    // added to the blocks
+    uint32_t groupCount;
+    uint32_t recordCount;
+    uint32_t linkCount;
+    uint32_t pieceCount;
+};
+
+struct UndoHistoryGroup
+{
+    uint32_t firstRecord;
+    uint32_t parent;
+    uint32_t lastChild;
+    uint32_t unused;
+    int64_t time;
+};
+
+struct UndoHistoryText
+{
+    uint64_t size;
+    uint8_t data[8];
+};
+
+struct UndoHistoryRecord
+{
+    int64_t location;
+    int64_t cursorBefore;
+    int64_t cursorAfter;
+    UndoHistoryText deleted;
+    UndoHistoryText inserted;
+};
+
+struct UndoHistoryLink
+{
+    uint32_t group;
+    uint32_t lastChild;
+};
+
+struct UndoHistoryPiece
+{
+    uint32_t block;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t packedSize;
+};
+
+size_t UndoHistoryPadding(size_t size)
+{
+    return (8 - (size & 7)) & 7;
+}
+
+bool SeekSpillFile(FILE* pFile, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(pFile, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(pFile, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+} // namespace
+
+// Text added to a block since the last save; blocks that have been spilled are already compressed, and go again whole
+struct ZepUndoJournal::HistorySegment
+{
+    struct Text
+    {
+        uint32_t block = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        bool packed = false;
+        std::vector<uint8_t> data;
+    };
+
+    fs::path historyPath;
+    std::string filePath;
+
+    // Starts the file again, rather than adding to it
+    bool rewrite = false;
+
+    UndoHistorySegment segment;
+    std::string tables;
+    std::vector<Text> text;
+};
+
+struct ZepUndoJournal::HistoryWriter
+{
+    std::mutex mutex;
+    std::deque<HistorySegment> segments;
+
+    // Held while writing, so that the segments go in the order they were made
+    std::mutex writeMutex;
+
+    // A segment didn't get written; the ones after it can't be added, so the next save writes it all again
+    std::atomic<bool> failed = { false };
+};
+
+ZepUndoJournal::ZepUndoJournal(ZepBuffer& buffer)
+    : m_buffer(buffer)
+{
+}
+
+ZepUndoJournal::~ZepUndoJournal()
+{
+    if (m_historyWritten.valid())
+    {
+        m_historyWritten.wait();
+    }
+    CloseSpillFile();
+}
+
+void ZepUndoJournal::BeginGroup()
+{
+    m_groupOpen = false;
+}
+
+void ZepUndoJournal::AddChange(const ChangeRecord& change, const GlyphIterator& cursorBefore, const GlyphIterator& cursorAfter)
+{
+    if (change.strDeleted.empty() && change.strInserted.empty())
+    {
+        return;
+    }
+
+    // A new branch from where we are; redo now follows it
+    if (!m_groupOpen)
+    {
+        UndoGroup group;
+        group.firstRecord = uint32_t(m_records.size());
+        group.parent = m_current;
+        group.time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        m_current = uint32_t(m_groups.size());
+        LastChild(group.parent) = m_current;
+        m_groups.push_back(group);
+        m_groupOpen = true;
+    }
+
+    if (!MergeChange(change, cursorAfter))
+    {
+        UndoRecord record;
+        record.location = change.itrStart.Index();
+        record.cursorBefore = cursorBefore.Valid() ? cursorBefore.Index() : -1;
+        record.cursorAfter = cursorAfter.Valid() ? cursorAfter.Index() : -1;
+        record.deleted = StoreText(change.strDeleted);
+        record.inserted = StoreText(change.strInserted);
+        m_records.push_back(record);
+    }
+    CheckBudget();
+}
+
+// Typing, backspace and delete in one place make one record, not one per character; so undoing a burst of typing is
+// one change to the buffer
+bool ZepUndoJournal::MergeChange(const ChangeRecord& change, const GlyphIterator& cursorAfter)
+{
+    if (m_groups.empty() || m_records.size() <= m_groups.back().firstRecord)
+    {
+        return false;
+    }
+
+    auto& last = m_records.back();
+    auto location = change.itrStart.Index();
+    auto lastEnd = last.location + ByteIndex(last.inserted.size);
+    if (change.strDeleted.empty() && last.deleted.size == 0 && location == lastEnd)
+    {
+        // Typed after the last insert
+        AppendText(last.inserted, change.strInserted);
+    }
+    else if (change.strInserted.empty() && last.deleted.size == 0 && location + ByteIndex(change.strDeleted.size()) == lastEnd && change.strDeleted.size() <= last.inserted.size)
+    {
+        // Backspace over what was just typed
+        auto inserted = GetText(last.inserted);
+        last.inserted = UpdateText(last.inserted, inserted.substr(0, inserted.size() - change.strDeleted.size()));
+        if (last.inserted.size == 0)
+        {
+            m_records.pop_back();
+            return true;
+        }
+    }
+    else if (change.strInserted.empty() && last.inserted.size == 0 && location + ByteIndex(change.strDeleted.size()) == last.location)
+    {
+        // Backspace before the last delete
+        last.deleted = UpdateText(last.deleted, change.strDeleted + GetText(last.deleted));
+        last.location = location;
+    }
+    else if (change.strInserted.empty() && last.inserted.size == 0 && location == last.location)
+    {
+        // Delete after it
+        AppendText(last.deleted, change.strDeleted);
+    }
+    else
+    {
+        return false;
+    }
+
+    last.cursorAfter = cursorAfter.Valid() ? cursorAfter.Index() : -1;
+    return true;
+}
+
+bool ZepUndoJournal::Undo(GlyphIterator& cursor)
+{
+    // Before the history in memory is the history saved with the file
+    if (m_current == RootGroup)
+    {
+        LoadSavedHistory();
+        if (m_current == RootGroup)
+        {
+            return false;
+        }
+    }
+    return GoTo(m_groups[m_current].parent, cursor);
+}
+
+bool ZepUndoJournal::Redo(GlyphIterator& cursor)
+{
+    auto next = LastChild(m_current);
+    if (next == RootGroup)
+    {
+        return false;
+    }
+    return GoTo(next, cursor);
+}
+
+// The groups are in the order they were made, so this is just a step through them; the root is before the first
+bool ZepUndoJournal::MoveByChanges(long changes, GlyphIterator& cursor)
+{
+    if (changes < 0)
+    {
+        LoadSavedHistory();
+    }
+
+    auto current = m_current == RootGroup ? -1l : long(m_current);
+    auto target = std::max(-1l, std::min(current + changes, long(m_groups.size()) - 1));
+    if (target == current)
+    {
+        return false;
+    }
+    return GoTo(target == -1 ? RootGroup : uint32_t(target), cursor);
+}
+
+// The last state made at or before the time, counting from the time the current one was made
+bool ZepUndoJournal::MoveByTime(int64_t seconds, GlyphIterator& cursor)
+{
+    if (seconds < 0)
+    {
+        LoadSavedHistory();
+    }
+
+    if (m_groups.empty())
+    {
+        return false;
+    }
+
+    auto time = (m_current == RootGroup ? m_groups[0].time : m_groups[m_current].time) + seconds;
+    auto itr = std::upper_bound(m_groups.begin(), m_groups.end(), time, [](int64_t time, const UndoGroup& group) {
+        return time < group.time;
+    });
+
+    auto target = itr == m_groups.begin() ? RootGroup : uint32_t(itr - m_groups.begin() - 1);
+    if (target == m_current)
+    {
+        return false;
+    }
+    return GoTo(target, cursor);
+}
+
+// Undo up to where the branches meet, then redo down to the target
+bool ZepUndoJournal::GoTo(uint32_t target, GlyphIterator& cursor)
+{
+    std::vector<bool> aboveCurrent(m_groups.size(), false);
+    for (auto group = m_current; group != RootGroup; group = m_groups[group].parent)
+    {
+        aboveCurrent[group] = true;
+    }
+
+    std::vector<uint32_t> down;
+    auto common = target;
+    while (common != RootGroup && !aboveCurrent[common])
+    {
+        down.push_back(common);
+        common = m_groups[common].parent;
+    }
+
+    // Read back all of the text first, so that it is all done or none of it
+    for (auto group = m_current; group != common; group = m_groups[group].parent)
+    {
+        if (!LoadGroup(group))
+        {
+            return false;
+        }
+    }
+
+    for (auto group : down)
+    {
+        if (!LoadGroup(group))
+        {
+            return false;
+        }
+    }
+
+    // Anything typed after this is a new step
+    m_groupOpen = false;
+    while (m_current != common)
+    {
+        ApplyGroup(m_current, true, cursor);
+
+        // Redo comes back down this branch
+        auto parent = m_groups[m_current].parent;
+        LastChild(parent) = m_current;
+        m_current = parent;
+    }
+
+    for (auto itr = down.rbegin(); itr != down.rend(); itr++)
+    {
+        ApplyGroup(*itr, false, cursor);
+        LastChild(m_groups[*itr].parent) = *itr;
+        m_current = *itr;
+    }
+
+    CheckBudget();
+    return true;
+}
+
+void ZepUndoJournal::ApplyGroup(uint32_t group, bool undo, GlyphIterator& cursor)
+{
+    auto first = m_groups[group].firstRecord;
+    auto end = GroupEnd(group);
+    for (uint32_t step = 0; step < end - first; step++)
+    {
+        auto record = m_records[undo ? end - 1 - step : first + step];
+        Apply(record, undo);
+
+        auto location = undo ? record.cursorBefore : record.cursorAfter;
+        if (location != -1)
+        {
+            cursor = GlyphIterator(&m_buffer, location);
+        }
+    }
+}
+
+uint32_t& ZepUndoJournal::LastChild(uint32_t group)
+{
+    return group == RootGroup ? m_rootLastChild : m_groups[group].lastChild;
+}
+
+bool ZepUndoJournal::CanUndo() const
+{
+    return m_current != RootGroup;
+}
+
+bool ZepUndoJournal::CanRedo() const
+{
+    return (m_current == RootGroup ? m_rootLastChild : m_groups[m_current].lastChild) != RootGroup;
+}
+
+void ZepUndoJournal::Clear()
+{
+    m_records.clear();
+    m_groups.clear();
+    m_arena.clear();
+    m_current = RootGroup;
+    m_rootLastChild = RootGroup;
+    m_groupOpen = false;
+    m_savedHistoryFile.clear();
+    m_historyInFile = false;
+    m_savedLastChild.clear();
+    CloseSpillFile();
+}
+
+void ZepUndoJournal::RemovedFromStart(ByteIndex size)
+{
+    for (auto& record : m_records)
+    {
+        if (record.location < size)
+        {
+            Clear();
+            return;
+        }
+    }
+
+    for (auto& record : m_records)
+    {
+        record.location -= size;
+        for (auto pCursor : { &record.cursorBefore, &record.cursorAfter })
+        {
+            if (*pCursor != -1)
+            {
+                *pCursor = std::max(ByteIndex(0), *pCursor - size);
+            }
+        }
+    }
+
+    // The history saved with the file is of the text as it was
+    m_savedHistoryFile.clear();
+    m_historyInFile = false;
+}
+
+size_t ZepUndoJournal::GetMemoryUsed() const
+{
+    auto used = m_records.capacity() * sizeof(UndoRecord) + m_groups.capacity() * sizeof(UndoGroup);
+    for (auto& block : m_arena)
+    {
+        used += block.text.capacity();
+    }
+    return used;
+}
+
+uint64_t ZepUndoJournal::GetSpilledSize() const
+{
+    return m_spillSize;
+}
+
+// Spill the blocks furthest from the current point in the history first, since undo/redo gets to them last.
+// The last block is still being added to, so it stays
+void ZepUndoJournal::Spill(size_t memoryUsed)
+{
+    auto used = GetMemoryUsed();
+    if (used <= memoryUsed || m_arena.size() < 2)
+    {
+        return;
+    }
+
+    // The block with the current group's text, if it has any
+    auto current = long(m_arena.size() - 1);
+    if (m_current != RootGroup)
+    {
+        for (auto index = m_groups[m_current].firstRecord; index < GroupEnd(m_current); index++)
+        {
+            auto& record = m_records[index];
+            if (record.inserted.size > InlineTextSize || record.deleted.size > InlineTextSize)
+            {
+                current = long(record.inserted.size > InlineTextSize ? record.inserted.data.arena[0] : record.deleted.data.arena[0]);
+                break;
+            }
+        }
+    }
+
+    size_t low = 0;
+    size_t high = m_arena.size() - 1;
+    while (used > memoryUsed && low < high)
+    {
+        size_t index = 0;
+        if (std::abs(current - long(low)) >= std::abs(current - long(high - 1)))
+        {
+            index = low++;
+        }
+        else
+        {
+            index = --high;
+        }
+
+        auto& block = m_arena[index];
+        if (block.spilled)
+        {
+            continue;
+        }
+
+        auto capacity = block.text.capacity();
+        if (!SpillBlock(block))
+        {
+            return;
+        }
+        used -= capacity;
+    }
+}
+
+ZepUndoJournal::UndoText ZepUndoJournal::StoreText(const std::string& text)
+{
+    UndoText stored;
+    stored.size = text.size();
+    if (text.size() <= InlineTextSize)
+    {
+        memcpy(stored.data.bytes, text.data(), text.size());
+        return stored;
+    }
+
+    if (m_arena.empty() || m_arena.back().text.capacity() - m_arena.back().text.size() < text.size())
+    {
+        m_arena.emplace_back();
+        m_arena.back().text.reserve(std::max(UndoArenaBlockSize, text.size()));
+        m_arenaGrew = true;
+    }
+
+    auto& block = m_arena.back().text;
+    stored.data.arena[0] = uint32_t(m_arena.size() - 1);
+    stored.data.arena[1] = uint32_t(block.size());
+    block.insert(block.end(), text.begin(), text.end());
+    return stored;
+}
+
+// Replace stored text; if it was the last thing in the arena, its space is used again
+ZepUndoJournal::UndoText ZepUndoJournal::UpdateText(const UndoText& oldText, const std::string& text)
+{
+    if (oldText.size > InlineTextSize && oldText.data.arena[0] + 1 == m_arena.size())
+    {
+        auto& block = m_arena.back().text;
+        if (oldText.data.arena[1] + oldText.size == block.size())
+        {
+            block.resize(oldText.data.arena[1]);
+        }
+    }
+    return StoreText(text);
+}
+
+// Add to the end of stored text, in place if there is room
+void ZepUndoJournal::AppendText(UndoText& stored, const std::string& text)
+{
+    auto size = stored.size + text.size();
+    if (size <= InlineTextSize)
+    {
+        memcpy(stored.data.bytes + stored.size, text.data(), text.size());
+        stored.size = size;
+        return;
+    }
+
+    if (stored.size > InlineTextSize && stored.data.arena[0] + 1 == m_arena.size())
+    {
+        auto& block = m_arena.back().text;
+        if (stored.data.arena[1] + stored.size == block.size() && block.capacity() - block.size() >= text.size())
+        {
+            block.insert(block.end(), text.begin(), text.end());
+            stored.size = size;
+            return;
+        }
+    }
+    stored = UpdateText(stored, GetText(stored) + text);
+}
+
+std::string ZepUndoJournal::GetText(const UndoText& text)
+{
+    if (text.size <= InlineTextSize)
+    {
+        return std::string((const char*)text.data.bytes, size_t(text.size));
+    }
+
+    auto& block = m_arena[text.data.arena[0]];
+    if (!LoadBlock(block))
+    {
+        return std::string();
+    }
+    return std::string((const char*)block.text.data() + text.data.arena[1], size_t(text.size));
+}
+
+uint32_t ZepUndoJournal::GroupEnd(size_t group) const
+{
+    return group + 1 < m_groups.size() ? m_groups[group + 1].firstRecord : uint32_t(m_records.size());
+}
+
+// Read back the text a group needs before changing anything, so that it is all done or not at all
+bool ZepUndoJournal::LoadGroup(size_t group)
+{
+    auto end = GroupEnd(group);
+    for (auto index = m_groups[group].firstRecord; index < end; index++)
+    {
+        for (auto pText : { &m_records[index].deleted, &m_records[index].inserted })
+        {
+            if (pText->size > InlineTextSize && !LoadBlock(m_arena[pText->data.arena[0]]))
+            {
+                m_buffer.GetEditor().SetCommandText("Failed to read back the undo history");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool ZepUndoJournal::LoadBlock(ArenaBlock& block)
+{
+    if (!block.spilled)
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> packed;
+    if (!ReadSpillCopy(block, packed) || !lz_decompress(packed.data(), packed.size(), block.size, block.text))
+    {
+        ZLOG(ERROR, "Failed to read spilled undo history");
+        return false;
+    }
+
+    block.spilled = false;
+    m_arenaGrew = true;
+    return true;
+}
+
+// Compress the block into the spill file, unless it is already there
+bool ZepUndoJournal::WriteSpillCopy(ArenaBlock& block)
+{
+    if (block.spillSize != 0)
+    {
+        return true;
+    }
+
+    if (!OpenSpillFile())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> packed;
+    lz_compress(block.text.data(), block.text.size(), packed);
+    return AddSpillCopy(block, packed.data(), packed.size());
+}
+
+bool ZepUndoJournal::AddSpillCopy(ArenaBlock& block, const uint8_t* pPacked, size_t size)
+{
+    if (!SeekSpillFile(m_pSpillFile, m_spillSize) || fwrite(pPacked, 1, size, m_pSpillFile) != size)
+    {
+        ZLOG(ERROR, "Failed to write undo history");
+        return false;
+    }
+    block.spillOffset = m_spillSize;
+    block.spillSize = uint32_t(size);
+    m_spillSize += size;
+    return true;
+}
+
+bool ZepUndoJournal::ReadSpillCopy(const ArenaBlock& block, std::vector<uint8_t>& packed)
+{
+    packed.resize(block.spillSize);
+    return m_pSpillFile && SeekSpillFile(m_pSpillFile, block.spillOffset) && fread(packed.data(), 1, packed.size(), m_pSpillFile) == packed.size();
+}
+
+// Free the block's memory; it is read back from the spill file when it is needed
+bool ZepUndoJournal::SpillBlock(ArenaBlock& block)
+{
+    if (!WriteSpillCopy(block))
+    {
+        return false;
+    }
+
+    block.size = uint32_t(block.text.size());
+    std::vector<uint8_t>().swap(block.text);
+    block.spilled = true;
+    return true;
+}
+
+bool ZepUndoJournal::OpenSpillFile()
+{
+    if (!m_pSpillFile)
+    {
+        m_pSpillFile = tmpfile();
+        if (!m_pSpillFile)
+        {
+            ZLOG(ERROR, "Failed to create a file for the undo history");
+            return false;
+        }
+    }
+    return true;
+}
+
+void ZepUndoJournal::CloseSpillFile()
+{
+    if (m_pSpillFile)
+    {
+        fclose(m_pSpillFile);
+        m_pSpillFile = nullptr;
+    }
+    m_spillSize = 0;
+}
+
+void ZepUndoJournal::SetSavedHistory(const fs::path& filePath, uint64_t textHash)
+{
+    m_savedHistoryFile = filePath;
+    m_savedHistoryHash = textHash;
+}
+
+// .zep/undo in the file's project, named by the hash of its path
+fs::path ZepUndoJournal::GetHistoryPath(const fs::path& filePath) const
+{
+    if (filePath.empty())
+    {
+        return fs::path();
+    }
+
+    bool foundGit = false;
+    auto root = m_buffer.GetEditor().GetFileSystem().GetSearchRoot(filePath, foundGit);
+    if (!foundGit)
+    {
+        return fs::path();
+    }
+
+    auto pathText = filePath.string();
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.undo", (unsigned long long)fnv_hash_64(pathText.data(), pathText.size()));
+    return root / ".zep" / "undo" / name;
+}
+
+// Add what is new since the last save to the end of the history file: the groups and records made since, the earlier
+// groups whose redo branch has changed, and the text.  The history saved with the file is read first, so that the new
+// part follows on from it; if it didn't fit the text, the file is started again.  The file is written on the thread pool
+bool ZepUndoJournal::SaveHistory(const fs::path& filePath, uint64_t textHash)
+{
+    auto historyPath = GetHistoryPath(filePath);
+    if (historyPath.empty())
+    {
+        return false;
+    }
+
+    // What was saved last time comes first
+    LoadSavedHistory();
+
+    if (!m_spHistoryWriter)
+    {
+        m_spHistoryWriter = std::make_shared<HistoryWriter>();
+    }
+
+    if (m_spHistoryWriter->failed.exchange(false) || historyPath != m_historyPath)
+    {
+        m_historyInFile = false;
+    }
+
+    if (!m_historyInFile)
+    {
+        m_savedGroups = 0;
+        m_savedRecords = 0;
+        m_savedBlocks = 0;
+        m_savedBlockSize = 0;
+        m_savedLastChild.clear();
+    }
+
+    HistorySegment segment;
+    segment.historyPath = historyPath;
+    segment.filePath = filePath.string();
+    segment.rewrite = !m_historyInFile;
+
+    // The text first, since a spilled block might not read back
+    for (auto index = std::max(m_savedBlocks, 1u) - 1; index < m_arena.size(); index++)
+    {
+        auto& block = m_arena[index];
+        auto size = block.spilled ? block.size : uint32_t(block.text.size());
+        auto from = index + 1 == m_savedBlocks ? m_savedBlockSize : 0;
+        if (size <= from)
+        {
+            continue;
+        }
+
+        HistorySegment::Text text;
+        text.block = index;
+        if (block.spilled)
+        {
+            text.size = size;
+            text.packed = true;
+            if (!ReadSpillCopy(block, text.data))
+            {
+                ZLOG(ERROR, "Failed to read spilled undo history");
+                return false;
+            }
+        }
+        else
+        {
+            text.offset = from;
+            text.size = size - from;
+            text.data.assign(block.text.begin() + from, block.text.begin() + size);
+        }
+        segment.text.push_back(std::move(text));
+    }
+
+    auto& tables = segment.tables;
+    for (auto index = m_savedGroups; index < m_groups.size(); index++)
+    {
+        UndoHistoryGroup group;
+        group.firstRecord = m_groups[index].firstRecord;
+        group.parent = m_groups[index].parent;
+        group.lastChild = m_groups[index].lastChild;
+        group.unused = 0;
+        group.time = m_groups[index].time;
+        tables.append((const char*)&group, sizeof(group));
+    }
+
+    for (auto index = m_savedRecords; index < m_records.size(); index++)
+    {
+        auto& record = m_records[index];
+        UndoHistoryRecord historyRecord;
+        historyRecord.location = record.location;
+        historyRecord.cursorBefore = record.cursorBefore;
+        historyRecord.cursorAfter = record.cursorAfter;
+        historyRecord.deleted.size = record.deleted.size;
+        memcpy(historyRecord.deleted.data, record.deleted.data.bytes, sizeof(historyRecord.deleted.data));
+        historyRecord.inserted.size = record.inserted.size;
+        memcpy(historyRecord.inserted.data, record.inserted.data.bytes, sizeof(historyRecord.inserted.data));
+        tables.append((const char*)&historyRecord, sizeof(historyRecord));
+    }
+
+    uint32_t linkCount = 0;
+    for (uint32_t index = 0; index < m_savedLastChild.size(); index++)
+    {
+        if (m_savedLastChild[index] != m_groups[index].lastChild)
+        {
+            UndoHistoryLink link{ index, m_groups[index].lastChild };
+            tables.append((const char*)&link, sizeof(link));
+            linkCount++;
+        }
+    }
+
+    auto& header = segment.segment;
+    header.textHash = textHash;
+    header.current = m_current;
+    header.rootLastChild = m_rootLastChild;
+    header.groupCount = uint32_t(m_groups.size()) - m_savedGroups;
+    header.recordCount = uint32_t(m_records.size()) - m_savedRecords;
+    header.linkCount = linkCount;
+    header.pieceCount = uint32_t(segment.text.size());
+
+    // The file has all of it now, and nothing in it changes; typing after this is a new group
+    m_historyPath = historyPath;
+    m_historyInFile = true;
+    m_savedGroups = uint32_t(m_groups.size());
+    m_savedRecords = uint32_t(m_records.size());
+    m_savedBlocks = uint32_t(m_arena.size());
+    m_savedBlockSize = m_arena.empty() ? 0 : (m_arena.back().spilled ? m_arena.back().size : uint32_t(m_arena.back().text.size()));
+    m_savedLastChild.resize(m_groups.size());
+    for (size_t index = 0; index < m_groups.size(); index++)
+    {
+        m_savedLastChild[index] = m_groups[index].lastChild;
+    }
+    m_groupOpen = false;
+
+    auto spWriter = m_spHistoryWriter;
+    {
+        std::lock_guard<std::mutex> lock(spWriter->mutex);
+        spWriter->segments.push_back(std::move(segment));
+    }
+
+    auto& fileSystem = m_buffer.GetEditor().GetFileSystem();
+    m_historyWritten = m_buffer.GetEditor().GetThreadPool().enqueue([spWriter, &fileSystem]() {
+        WriteHistory(fileSystem, *spWriter);
+    });
+    return true;
+}
+
+// Write the segments that are waiting, in order; whichever task gets here first writes all of them
+void ZepUndoJournal::WriteHistory(IZepFileSystem& fileSystem, HistoryWriter& writer)
+{
+    std::lock_guard<std::mutex> writeLock(writer.writeMutex);
+    for (;;)
+    {
+        HistorySegment segment;
+        {
+            std::lock_guard<std::mutex> lock(writer.mutex);
+            if (writer.segments.empty())
+            {
+                return;
+            }
+            segment = std::move(writer.segments.front());
+            writer.segments.pop_front();
+        }
+
+        // The next save writes it all again
+        if (writer.failed)
+        {
+            continue;
+        }
+
+        std::string body = segment.tables;
+        std::string packedText;
+        std::vector<uint8_t> packed;
+        for (auto& text : segment.text)
+        {
+            if (!text.packed)
+            {
+                lz_compress(text.data.data(), text.data.size(), packed);
+                text.data.swap(packed);
+            }
+
+            UndoHistoryPiece piece{ text.block, text.offset, text.size, uint32_t(text.data.size()) };
+            body.append((const char*)&piece, sizeof(piece));
+            packedText.append((const char*)text.data.data(), text.data.size());
+        }
+        body.append(packedText);
+        body.append(UndoHistoryPadding(body.size()), '\0');
+
+        segment.segment.size = body.size();
+        segment.segment.checksum = fnv_hash_64(body.data(), body.size());
+
+        std::string data;
+        if (segment.rewrite)
+        {
+            UndoHistoryHeader header;
+            header.magic = UndoHistoryMagic;
+            header.version = UndoHistoryVersion;
+            header.pathLength = uint32_t(segment.filePath.size());
+            header.unused = 0;
+            data.append((const char*)&header, sizeof(header));
+            data.append(segment.filePath);
+            data.append(UndoHistoryPadding(segment.filePath.size()), '\0');
+        }
+        data.append((const char*)&segment.segment, sizeof(segment.segment));
+        data.append(body);
+
+        bool ok = false;
+        if (!segment.rewrite)
+        {
+            ok = fileSystem.Append(segment.historyPath, data.data(), data.size());
+        }
+        else if (!fileSystem.IsDirectory(segment.historyPath.parent_path()) && !fileSystem.MakeDirectories(segment.historyPath.parent_path()))
+        {
+            ZLOG(ERROR, "Can't make the undo history folder: " << segment.historyPath.parent_path().string());
+        }
+        else
+        {
+            ok = fileSystem.Write(segment.historyPath, data.data(), data.size());
+        }
+
+        if (!ok)
+        {
+            ZLOG(ERROR, "Failed to write the undo history: " << segment.historyPath.string());
+            writer.failed = true;
+        }
+    }
+}
+
+// Read the history saved with the file, and put it before the history in memory.  The text stays compressed; it is
+// copied to the spill file, and read back from there like any other spilled block.  Saves after this add to the file
+void ZepUndoJournal::LoadSavedHistory()
+{
+    if (m_savedHistoryFile.empty())
+    {
+        return;
+    }
+
+    auto filePath = m_savedHistoryFile;
+    m_savedHistoryFile.clear();
+
+    auto historyPath = GetHistoryPath(filePath);
+    auto& fileSystem = m_buffer.GetEditor().GetFileSystem();
+    if (historyPath.empty() || !fileSystem.Exists(historyPath))
+    {
+        return;
+    }
+
+    auto data = fileSystem.Read(historyPath);
+    UndoHistoryHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    auto segmentStart = sizeof(header) + header.pathLength + UndoHistoryPadding(header.pathLength);
+    if (header.magic != UndoHistoryMagic || header.version != UndoHistoryVersion || segmentStart > data.size() || data.compare(sizeof(header), header.pathLength, filePath.string()) != 0)
+    {
+        return;
+    }
+
+    // Each segment adds to the one before; the text of a block can be spread over several of them
+    struct PackedPiece
+    {
+        UndoHistoryPiece piece;
+        const uint8_t* pPacked;
+    };
+
+    std::vector<UndoGroup> groups;
+    std::vector<UndoRecord> records;
+    std::vector<std::vector<PackedPiece>> blockPieces;
+    UndoHistorySegment last = {};
+    bool found = false;
+    bool valid = true;
+    while (valid && segmentStart + sizeof(UndoHistorySegment) <= data.size())
+    {
+        UndoHistorySegment segment;
+        memcpy(&segment, data.data() + segmentStart, sizeof(segment));
+        auto bodyStart = segmentStart + sizeof(segment);
+        auto tableSize = uint64_t(segment.groupCount) * sizeof(UndoHistoryGroup) + uint64_t(segment.recordCount) * sizeof(UndoHistoryRecord)
+            + uint64_t(segment.linkCount) * sizeof(UndoHistoryLink) + uint64_t(segment.pieceCount) * sizeof(UndoHistoryPiece);
+        if (segment.size > data.size() - bodyStart || tableSize > segment.size || fnv_hash_64(data.data() + bodyStart, size_t(segment.size)) != segment.checksum)
+        {
+            break;
+        }
+
+        auto pRead = data.data() + bodyStart;
+        for (uint32_t index = 0; index < segment.groupCount; index++, pRead += sizeof(UndoHistoryGroup))
+        {
+            UndoHistoryGroup historyGroup;
+            memcpy(&historyGroup, pRead, sizeof(historyGroup));
+
+            UndoGroup group;
+            group.firstRecord = historyGroup.firstRecord;
+            group.parent = historyGroup.parent;
+            group.lastChild = historyGroup.lastChild;
+            group.time = historyGroup.time;
+            groups.push_back(group);
+        }
+
+        for (uint32_t index = 0; index < segment.recordCount; index++, pRead += sizeof(UndoHistoryRecord))
+        {
+            UndoHistoryRecord historyRecord;
+            memcpy(&historyRecord, pRead, sizeof(historyRecord));
+
+            UndoRecord record;
+            record.location = ByteIndex(historyRecord.location);
+            record.cursorBefore = ByteIndex(historyRecord.cursorBefore);
+            record.cursorAfter = ByteIndex(historyRecord.cursorAfter);
+            record.deleted.size = historyRecord.deleted.size;
+            memcpy(record.deleted.data.bytes, historyRecord.deleted.data, sizeof(historyRecord.deleted.data));
+            record.inserted.size = historyRecord.inserted.size;
+            memcpy(record.inserted.data.bytes, historyRecord.inserted.data, sizeof(historyRecord.inserted.data));
+            records.push_back(record);
+        }
+
+        for (uint32_t index = 0; index < segment.linkCount; index++, pRead += sizeof(UndoHistoryLink))
+        {
+            UndoHistoryLink link;
+            memcpy(&link, pRead, sizeof(link));
+            if (link.group >= groups.size())
+            {
+                valid = false;
+                break;
+            }
+            groups[link.group].lastChild = link.lastChild;
+        }
+
+        // Blocks are made in order, so a piece is of a block there already or the next one
+        auto pPacked = (const uint8_t*)data.data() + bodyStart + tableSize;
+        auto packedSize = segment.size - tableSize;
+        for (uint32_t index = 0; valid && index < segment.pieceCount; index++, pRead += sizeof(UndoHistoryPiece))
+        {
+            UndoHistoryPiece piece;
+            memcpy(&piece, pRead, sizeof(piece));
+            if (piece.block > blockPieces.size() || piece.packedSize > packedSize || uint64_t(piece.offset) + piece.size > UINT32_MAX)
+            {
+                valid = false;
+                break;
+            }
+
+            if (piece.block == blockPieces.size())
+            {
+                blockPieces.emplace_back();
+            }
+            blockPieces[piece.block].push_back(PackedPiece{ piece, pPacked });
+            pPacked += piece.packedSize;
+            packedSize -= piece.packedSize;
+        }
+
+        last = segment;
+        found = valid;
+        segmentStart = bodyStart + segment.size;
+    }
+
+    // Saved with different text; a change made by something else, or another file at the same path
+    if (!found || last.textHash != m_savedHistoryHash)
+    {
+        if (!valid)
+        {
+            ZLOG(INFO, "Undo history is damaged, ignoring: " << historyPath.string());
+        }
+        return;
+    }
+
+    std::vector<uint32_t> blockSizes(blockPieces.size(), 0);
+    for (size_t index = 0; index < blockPieces.size(); index++)
+    {
+        for (auto& packedPiece : blockPieces[index])
+        {
+            blockSizes[index] = std::max(blockSizes[index], packedPiece.piece.offset + packedPiece.piece.size);
+        }
+    }
+
+    for (auto& record : records)
+    {
+        for (auto pText : { &record.deleted, &record.inserted })
+        {
+            if (pText->size > InlineTextSize && (pText->data.arena[0] >= blockSizes.size() || pText->data.arena[1] + pText->size > blockSizes[pText->data.arena[0]]))
+            {
+                valid = false;
+            }
+        }
+    }
+
+    for (uint32_t index = 0; index < groups.size(); index++)
+    {
+        auto& group = groups[index];
+
+        // Parents are always made first, so there can't be a loop
+        if (group.firstRecord > records.size() || (index > 0 && group.firstRecord < groups[index - 1].firstRecord)
+            || (group.parent != RootGroup && group.parent >= index) || (group.lastChild != RootGroup && group.lastChild >= groups.size()))
+        {
+            valid = false;
+        }
+    }
+
+    if ((last.current != RootGroup && last.current >= groups.size()) || (last.rootLastChild != RootGroup && last.rootLastChild >= groups.size()))
+    {
+        valid = false;
+    }
+
+    if (!valid || !OpenSpillFile())
+    {
+        ZLOG(INFO, "Undo history is damaged, ignoring: " << historyPath.string());
+        return;
+    }
+
+    // A block written in one piece is copied to the spill file as it is; one added to over several saves is put back
+    // together first
+    std::vector<ArenaBlock> arena(blockPieces.size());
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> unpacked;
+    std::vector<uint8_t> packed;
+    for (size_t index = 0; index < arena.size(); index++)
+    {
+        auto& block = arena[index];
+        auto& pieces = blockPieces[index];
+        if (pieces.size() == 1 && pieces[0].piece.offset == 0)
+        {
+            if (!AddSpillCopy(block, pieces[0].pPacked, pieces[0].piece.packedSize))
+            {
+                return;
+            }
+        }
+        else
+        {
+            text.assign(blockSizes[index], 0);
+            for (auto& packedPiece : pieces)
+            {
+                if (!lz_decompress(packedPiece.pPacked, packedPiece.piece.packedSize, packedPiece.piece.size, unpacked))
+                {
+                    ZLOG(INFO, "Undo history is damaged, ignoring: " << historyPath.string());
+                    return;
+                }
+                memcpy(text.data() + packedPiece.piece.offset, unpacked.data(), unpacked.size());
+            }
+
+            lz_compress(text.data(), text.size(), packed);
+            if (!AddSpillCopy(block, packed.data(), packed.size()))
+            {
+                return;
+            }
+        }
+        block.size = blockSizes[index];
+        block.spilled = true;
+    }
+
+    // The file has all of this; the next save adds what comes after it
+    m_historyPath = historyPath;
+    m_historyInFile = true;
+    m_savedGroups = uint32_t(groups.size());
+    m_savedRecords = uint32_t(records.size());
+    m_savedBlocks = uint32_t(arena.size());
+    m_savedBlockSize = arena.empty() ? 0 : arena.back().size;
+    m_savedLastChild.resize(groups.size());
+    for (size_t index = 0; index < groups.size(); index++)
+    {
+        m_savedLastChild[index] = groups[index].lastChild;
+    }
+
+    // The history in memory now comes after it; it grew from the state the file was saved at
+    auto loadedGroups = uint32_t(groups.size());
+    auto loadedRecords = uint32_t(records.size());
+    auto loadedBlocks = uint32_t(arena.size());
+    auto shift = [&](uint32_t group) {
+        return group == RootGroup ? RootGroup : group + loadedGroups;
+    };
+
+    for (auto& group : m_groups)
+    {
+        group.firstRecord += loadedRecords;
+        group.parent = group.parent == RootGroup ? last.current : group.parent + loadedGroups;
+        group.lastChild = shift(group.lastChild);
+    }
+
+    for (auto& record : m_records)
+    {
+        for (auto pText : { &record.deleted, &record.inserted })
+        {
+            if (pText->size > InlineTextSize)
+            {
+                pText->data.arena[0] += loadedBlocks;
+            }
+        }
+    }
+
+    auto& savedLastChild = last.current == RootGroup ? last.rootLastChild : groups[last.current].lastChild;
+    if (m_rootLastChild != RootGroup)
+    {
+        savedLastChild = shift(m_rootLastChild);
+    }
+    m_rootLastChild = last.rootLastChild;
+    m_current = m_current == RootGroup ? last.current : shift(m_current);
+
+    groups.insert(groups.end(), m_groups.begin(), m_groups.end());
+    m_groups.swap(groups);
+    records.insert(records.end(), m_records.begin(), m_records.end());
+    m_records.swap(records);
+    for (auto& block : m_arena)
+    {
+        arena.push_back(std::move(block));
+    }
+    m_arena.swap(arena);
+}
+
+// Called when the arena has grown; first this buffer's budget, then that of all of them together
+void ZepUndoJournal::CheckBudget()
+{
+    if (!m_arenaGrew)
+    {
+        return;
+    }
+    m_arenaGrew = false;
+
+    // Go a quarter under, so that it doesn't happen again for a while
+    auto& editor = m_buffer.GetEditor();
+    auto bufferMemory = size_t(editor.GetConfig().undoBufferMemory);
+    if (GetMemoryUsed() > bufferMemory)
+    {
+        Spill(bufferMemory / 4 * 3);
+    }
+
+    std::vector<std::pair<size_t, ZepUndoJournal*>> journals;
+    size_t total = 0;
+    for (auto& spBuffer : editor.GetBuffers())
+    {
+        auto& undo = spBuffer->GetUndo();
+        journals.emplace_back(undo.GetMemoryUsed(), &undo);
+        total += journals.back().first;
+    }
+
+    auto totalMemory = size_t(editor.GetConfig().undoTotalMemory);
+    if (total <= totalMemory)
+    {
+        return;
+    }
+
+    // The biggest histories give up the most
+    std::sort(journals.begin(), journals.end(), [](auto& lhs, auto& rhs) {
+        return lhs.first > rhs.first;
+    });
+
+    auto target = totalMemory / 4 * 3;
+    for (auto& journal : journals)
+    {
+        if (total <= target)
+        {
+            break;
+        }
+
+        auto excess = total - target;
+        journal.second->Spill(journal.first > excess ? journal.first - excess : 0);
+        total = total - journal.first + journal.second->GetMemoryUsed();
+    }
+}
+
+// Put back the text that was there before the change, or make the change again
+void ZepUndoJournal::Apply(const UndoRecord& record, bool undo)
+{
+    auto& remove = undo ? record.inserted : record.deleted;
+    auto& add = undo ? record.deleted : record.inserted;
+
+    GlyphIterator start(&m_buffer, record.location);
+    GlyphIterator end(&m_buffer, record.location + ByteIndex(remove.size));
+    ChangeRecord tempRecord;
+    if (remove.size == 0)
+    {
+        m_buffer.Insert(start, GetText(add), tempRecord);
+    }
+    else if (add.size == 0)
+    {
+        m_buffer.Delete(start, end, tempRecord);
+    }
+    else
+    {
+        m_buffer.Replace(start, end, GetText(add), ReplaceRangeMode::Replace, tempRecord);
+    }
+}
+
+} // namespace Zep
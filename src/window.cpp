@@ -3,6 +3,7 @@
 #include <sstream>
 
 #include "zep/buffer.h"
+#include "zep/buffer_search.h"
 #include "zep/display.h"
 #include "zep/mode.h"
 #include "zep/scroller.h"
@@ -156,6 +157,12 @@ void ZepWindow::UpdateAirline()
             m_airline.leftBoxes.push_back(AirBox{ "VISUAL", FilterActiveColor(m_pBuffer->GetTheme().GetColor(ThemeColor::VisualSelectBackground)) });
             break;
         };
+
+        auto macroRegister = GetBuffer().GetMode()->GetMacroRegister();
+        if (macroRegister != 0)
+        {
+            m_airline.leftBoxes.push_back(AirBox{ std::string("recording @") + macroRegister, m_pBuffer->GetTheme().GetColor(ThemeColor::Warning) });
+        }
     }
 
     auto& font = GetEditor().GetDisplay().GetFont(ZepTextType::Text);
@@ -165,6 +172,13 @@ void ZepWindow::UpdateAirline()
     m_airline.leftBoxes.push_back(AirBox{ m_pBuffer->GetDisplayName(), FilterActiveColor(m_pBuffer->GetTheme().GetColor(ThemeColor::AirlineBackground)) });
     m_airline.leftBoxes.push_back(AirBox{ std::to_string(cursor.x) + ":" + std::to_string(cursor.y), m_pBuffer->GetTheme().GetColor(ThemeColor::TabActive) });
 
+    // Loading or saving on the thread pool
+    auto progress = m_pBuffer->GetProgressText();
+    if (!progress.empty())
+    {
+        m_airline.leftBoxes.push_back(AirBox{ progress, m_pBuffer->GetTheme().GetColor(ThemeColor::Warning) });
+    }
+
 #ifdef _SHOW_SCALE
     m_airline.leftBoxes.push_back(AirBox{ "(" + std::to_string(GetEditor().GetDisplay().GetPixelScale().x) + "," + std::to_string(GetEditor().GetDisplay().GetPixelScale().y) + ")", m_pBuffer->GetTheme().GetColor(ThemeColor::Error) });
 #endif
@@ -1015,6 +1029,18 @@ void ZepWindow::DisplayLineBackground(SpanInfo& lineInfo, ZepSyntax* pSyntax)
             return true;
         });
 
+        // Search matches; these are not markers, since there can be any number of them.
+        // An empty match (/^ or /$) is shown on the character it is in front of
+        auto itrMatch = std::upper_bound(m_searchMatches.begin(), m_searchMatches.end(), cp.iterator.Index(), [](ByteIndex location, const ByteRange& match) {
+            return location < std::max(match.second, match.first + 1);
+        });
+        if (itrMatch != m_searchMatches.end() && itrMatch->first <= cp.iterator.Index())
+        {
+            auto& currentMatch = m_pBuffer->GetSearch().GetCurrentMatch();
+            auto matchColor = (itrMatch->first == currentMatch.first && itrMatch->second == currentMatch.second) ? ThemeColor::Info : ThemeColor::VisualSelectBackground;
+            display.DrawRectFilled(charRect, m_pBuffer->GetTheme().GetColor(matchColor));
+        }
+
         screenPosX += cp.size.x + m_xPad;
     }
 }
@@ -1367,6 +1393,19 @@ long ZepWindow::GetNumDisplayedLines()
     return std::min((long)m_windowLines.size(), GetMaxDisplayLines());
 }
 
+// The buffer range covered by the lines on screen
+ByteRange ZepWindow::GetVisibleByteRange()
+{
+    UpdateLayout();
+    auto firstLine = std::max(0l, long(m_visibleLineIndices.x));
+    auto lastLine = std::min(long(m_windowLines.size()), long(m_visibleLineIndices.y)) - 1;
+    if (lastLine < firstLine)
+    {
+        return ByteRange(0, 0);
+    }
+    return ByteRange(m_windowLines[firstLine]->lineByteRange.first, m_windowLines[lastLine]->lineByteRange.second);
+}
+
 void ZepWindow::SetBufferCursor(GlyphIterator location)
 {
     // Don't move cursor if not necessary
@@ -1375,13 +1414,29 @@ void ZepWindow::SetBufferCursor(GlyphIterator location)
     if (location != m_bufferCursor)
     {
         m_bufferCursor = location.Clamped();
-        m_lastCursorColumn = BufferToDisplay(m_bufferCursor).x;
+
+        // Working out the column lays out the window
+        m_cursorColumnStale = GetEditor().CursorColumnsHeld();
+        if (!m_cursorColumnStale)
+        {
+            m_lastCursorColumn = BufferToDisplay(m_bufferCursor).x;
+        }
         m_cursorMoved = true;
         DisableToolTipTillMove();
     }
     assert(!m_pBuffer || m_bufferCursor.Valid());
 }
 
+long ZepWindow::GetLastCursorColumn()
+{
+    if (m_cursorColumnStale)
+    {
+        m_lastCursorColumn = BufferToDisplay(m_bufferCursor).x;
+        m_cursorColumnStale = false;
+    }
+    return m_lastCursorColumn;
+}
+
 void ZepWindow::DisableToolTipTillMove()
 {
     m_tipDisabledTillMove = true;
@@ -1397,6 +1452,7 @@ void ZepWindow::SetBuffer(ZepBuffer* pBuffer)
     m_textOffsetPx = 0;
     m_bufferCursor = pBuffer->GetLastEditLocation().Clamped();
     m_lastCursorColumn = 0;
+    m_cursorColumnStale = false;
     m_cursorMoved = false;
     if (pBuffer->GetMode())
     {
@@ -1451,6 +1507,8 @@ void ZepWindow::UpdateLayout(bool force)
 {
     if (m_layoutDirty || force)
     {
+        PROFILE_ZONE(UpdateLayout);
+
         // Border, and move the text across a bit
         if (ZTestFlags(GetWindowFlags(), WindowFlags::ShowLineNumbers) && GetEditor().GetConfig().showLineNumbers)
         {
@@ -1751,6 +1809,13 @@ void ZepWindow::Display()
 
     DisplayLineNumbers();
 
+    // Only the matches on screen are needed to draw them
+    m_searchMatches.clear();
+    if (m_pBuffer->GetSearch().IsVisible())
+    {
+        m_pBuffer->GetSearch().GetMatches(GetVisibleByteRange(), m_searchMatches);
+    }
+
     {
         // Reset the last line pixel size
         lastLinePx = NVec2f(0.0f);
@@ -1945,8 +2010,8 @@ void ZepWindow::MoveCursorY(int yDistance, LineLocation clampLocation)
     auto& line = *m_windowLines[target.y];
 
     // Snap to the new vertical column if necessary (see comment below)
-    if (target.x < m_lastCursorColumn)
-        target.x = m_lastCursorColumn;
+    if (target.x < GetLastCursorColumn())
+        target.x = GetLastCursorColumn();
 
     // TODO; this was an assert
     if (line.lineCodePoints.empty())